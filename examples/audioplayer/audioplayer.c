@@ -200,7 +200,7 @@ enum Page page_song(void) {
 		song_ramsz = sizeof(xm64player_t) + xm.ctx->ctx_size;
 		#if XM_STREAM_PATTERNS
 		song_ramsz -= xm.ctx->ctx_size_all_patterns;
-		song_ramsz += xm.ctx->ctx_size_stream_pattern_buf;
+		song_ramsz += 2 * xm.ctx->ctx_size_stream_pattern_buf;
 		#endif
 		#if XM_STREAM_WAVEFORMS
 		song_ramsz -= xm.ctx->ctx_size_all_samples;
@@ -310,8 +310,7 @@ enum Page page_song(void) {
 		int audiosz = audio_get_buffer_length();
 		while (TICKS_DISTANCE(start_play_loop, TICKS_READ()) < TICKS_PER_SECOND)
 		{
-			extern int64_t __mixer_profile_rsp, __wav64_profile_dma;
-			__mixer_profile_rsp = __wav64_profile_dma = 0;
+			mixer_reset_stats();
 
 			uint32_t t0 = TICKS_READ();
 
@@ -326,9 +325,11 @@ enum Page page_song(void) {
 			uint32_t t2 = TICKS_READ();
 
 			if (!first_loop) {
-				tot_dma += __wav64_profile_dma;	
-				tot_rsp += __mixer_profile_rsp;
-				tot_cpu += (t2-t1) - __mixer_profile_rsp - __wav64_profile_dma;
+				mixer_stats_t stats;
+				mixer_get_stats(&stats);
+				tot_dma += stats.dma_ticks;
+				tot_rsp += stats.rsp_ticks;
+				tot_cpu += (t2-t1) - stats.rsp_ticks - stats.dma_ticks;
 				tot_time += t2-t0;
 			}
 			first_loop = false;
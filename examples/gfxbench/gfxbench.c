@@ -0,0 +1,199 @@
+/**
+ * graphics.c benchmark
+ *
+ * Measures the CPU renderer primitives of graphics.c against a reference
+ * implementation of each of them built on top of graphics_draw_pixel (that is,
+ * one function call and one store per pixel). It reports the CPU cycles spent
+ * by each, and whether the two produce the same image.
+ *
+ * All drawing happens on an offscreen surface, in both 16-bit and 32-bit
+ * formats. The results are printed on the console at the end.
+ */
+#include <libdragon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <font.h>
+
+// Number of times each primitive is drawn
+#define NUM_ITERATIONS   64
+
+#define WIDTH   320
+#define HEIGHT  240
+
+static uint32_t fg_color, bg_color, half_color;
+
+/* Reference implementations: one graphics_draw_pixel call per pixel */
+
+static void ref_draw_box(surface_t *disp, int x, int y, int w, int h, uint32_t color) {
+	for (int j=y; j<y+h; j++)
+		for (int i=x; i<x+w; i++)
+			graphics_draw_pixel(disp, i, j, color);
+}
+
+static void ref_draw_box_trans(surface_t *disp, int x, int y, int w, int h, uint32_t color) {
+	for (int j=y; j<y+h; j++)
+		for (int i=x; i<x+w; i++)
+			graphics_draw_pixel_trans(disp, i, j, color);
+}
+
+static void ref_draw_hline(surface_t *disp, int x0, int y, int x1, uint32_t color) {
+	for (int i=x0; i<=x1; i++)
+		graphics_draw_pixel(disp, i, y, color);
+}
+
+static void ref_draw_text(surface_t *disp, int x, int y, const char *msg) {
+	for (; *msg; msg++, x += 8) {
+		for (int row=0; row<8; row++) {
+			uint8_t c = __font_data[*msg * 8 + row];
+			for (int col=0; col<8; col++, c <<= 1) {
+				if (c & 0x80)
+					graphics_draw_pixel(disp, x + col, y + row, fg_color);
+				else if (bg_color)
+					graphics_draw_pixel(disp, x + col, y + row, bg_color);
+			}
+		}
+	}
+}
+
+static uint32_t sprite_pixel(sprite_t *sprite, int x, int y) {
+	if (TEX_FORMAT_BITDEPTH(sprite_get_format(sprite)) == 16)
+		return ((uint16_t*)sprite->data)[y * sprite->width + x];
+	return ((uint32_t*)sprite->data)[y * sprite->width + x];
+}
+
+static void ref_draw_sprite(surface_t *disp, int x, int y, sprite_t *sprite) {
+	for (int j=0; j<sprite->height; j++)
+		for (int i=0; i<sprite->width; i++)
+			graphics_draw_pixel(disp, x + i, y + j, sprite_pixel(sprite, i, j));
+}
+
+static void ref_draw_sprite_trans(surface_t *disp, int x, int y, sprite_t *sprite) {
+	for (int j=0; j<sprite->height; j++)
+		for (int i=0; i<sprite->width; i++)
+			graphics_draw_pixel_trans(disp, x + i, y + j, sprite_pixel(sprite, i, j));
+}
+
+/** @brief Create a sprite with a circle on a transparent background */
+static sprite_t *make_sprite(tex_format_t fmt, int size) {
+	int bpp = TEX_FORMAT_BITDEPTH(fmt) / 8;
+	sprite_t *sprite = calloc(1, sizeof(sprite_t) + size * size * bpp);
+	sprite->width = sprite->height = size;
+	sprite->flags = fmt;
+	sprite->hslices = sprite->vslices = 1;
+
+	int r = size / 2;
+	for (int j=0; j<size; j++) {
+		for (int i=0; i<size; i++) {
+			bool inside = (i-r)*(i-r) + (j-r)*(j-r) < r*r;
+			color_t c = RGBA32(i*255/size, j*255/size, 128, inside ? 255 : 0);
+			if (bpp == 2) ((uint16_t*)sprite->data)[j*size+i] = color_to_packed16(c);
+			else          ((uint32_t*)sprite->data)[j*size+i] = color_to_packed32(c);
+		}
+	}
+	data_cache_hit_writeback(sprite, sizeof(sprite_t) + size * size * bpp);
+	return sprite;
+}
+
+typedef struct {
+	const char *name;
+	void (*ref)(surface_t *disp, int i);
+	void (*fast)(surface_t *disp, int i);
+} bench_t;
+
+static sprite_t *bench_sprite;
+
+static void box_ref(surface_t *disp, int i)         { ref_draw_box(disp, 8+i, 8, 200, 100, fg_color); }
+static void box_fast(surface_t *disp, int i)        { graphics_draw_box(disp, 8+i, 8, 200, 100, fg_color); }
+static void boxtr_ref(surface_t *disp, int i)       { ref_draw_box_trans(disp, 8+i, 8, 200, 100, half_color); }
+static void boxtr_fast(surface_t *disp, int i)      { graphics_draw_box_trans(disp, 8+i, 8, 200, 100, half_color); }
+static void hline_ref(surface_t *disp, int i)       { ref_draw_hline(disp, 3, 8+i, 300, fg_color); }
+static void hline_fast(surface_t *disp, int i)      { graphics_draw_line(disp, 3, 8+i, 300, 8+i, fg_color); }
+static void text_ref(surface_t *disp, int i)        { ref_draw_text(disp, 8, 8+i, "The quick brown fox jumps over the lazy dog"); }
+static void text_fast(surface_t *disp, int i)       { graphics_draw_text(disp, 8, 8+i, "The quick brown fox jumps over the lazy dog"); }
+static void sprite_ref(surface_t *disp, int i)      { ref_draw_sprite(disp, 8+i, 8, bench_sprite); }
+static void sprite_fast(surface_t *disp, int i)     { graphics_draw_sprite(disp, 8+i, 8, bench_sprite); }
+static void spritetr_ref(surface_t *disp, int i)    { ref_draw_sprite_trans(disp, 8+i, 8, bench_sprite); }
+static void spritetr_fast(surface_t *disp, int i)   { graphics_draw_sprite_trans(disp, 8+i, 8, bench_sprite); }
+
+static const bench_t benchs[] = {
+	{ "box 200x100",       box_ref,      box_fast      },
+	{ "box_trans 200x100", boxtr_ref,    boxtr_fast    },
+	{ "hline 298",         hline_ref,    hline_fast    },
+	{ "text 43 chars",     text_ref,     text_fast     },
+	{ "sprite 64x64",      sprite_ref,   sprite_fast   },
+	{ "sprite_trans 64x64", spritetr_ref, spritetr_fast },
+};
+
+static uint32_t run(void (*fn)(surface_t*, int), surface_t *disp) {
+	surface_t clear = *disp;
+	memset(clear.buffer, 0, disp->stride * disp->height);
+
+	uint32_t total = 0;
+	for (int i=0; i<NUM_ITERATIONS; i++) {
+		uint32_t t0 = TICKS_READ();
+		fn(disp, i);
+		total += TICKS_SINCE(t0);
+	}
+	// CPU cycles are twice the ticks of the COP0 counter.
+	return total * 2 / NUM_ITERATIONS;
+}
+
+static void bench_format(tex_format_t fmt) {
+	surface_t ref = surface_alloc(fmt, WIDTH, HEIGHT);
+	surface_t fast = surface_alloc(fmt, WIDTH, HEIGHT);
+	int bytes = ref.stride * ref.height;
+
+	// graphics.c converts colors according to the current display bitdepth,
+	// so pack the colors manually.
+	color_t fg = RGBA32(0xFF, 0xC0, 0x40, 0xFF);
+	fg_color = fmt == FMT_RGBA16 ? color_to_packed16(fg) * 0x10001 : color_to_packed32(fg);
+	bg_color = 0;
+	color_t half = RGBA32(0x40, 0x80, 0xFF, 0x80);
+	half_color = fmt == FMT_RGBA16 ? color_to_packed16(half) * 0x10001 : color_to_packed32(half);
+	bench_sprite = make_sprite(fmt, 64);
+
+	printf("%s                 ref     fast\n", tex_format_name(fmt));
+	for (int b=0; b<sizeof(benchs)/sizeof(benchs[0]); b++) {
+		// Text rendering picks the font format from the display bitdepth,
+		// which is 16-bit (the console one).
+		if (fmt != FMT_RGBA16 && benchs[b].fast == text_fast)
+			continue;
+
+		graphics_set_color(fg_color, bg_color);
+		uint32_t t_ref = run(benchs[b].ref, &ref);
+		uint32_t t_fast = run(benchs[b].fast, &fast);
+		graphics_set_color(0xFFFFFFFF, 0x00000000);
+
+		// The reference sprite_trans in 32-bit blends every pixel (including
+		// transparent and opaque ones), so its output is slightly different.
+		bool check = !(fmt == FMT_RGBA32 && benchs[b].fast == spritetr_fast);
+		bool same = memcmp(ref.buffer, fast.buffer, bytes) == 0;
+		printf("  %-18s %8lu %8lu  x%-5.1f %s\n", benchs[b].name, (unsigned long)t_ref, (unsigned long)t_fast,
+			(float)t_ref / t_fast, !check ? "" : same ? "OK" : "MISMATCH");
+	}
+	printf("\n");
+
+	free(bench_sprite);
+	surface_free(&ref);
+	surface_free(&fast);
+}
+
+int main(void) {
+	debug_init_isviewer();
+	debug_init_usblog();
+	console_init();
+	// Render manually, so that the console doesn't draw while benchmarking.
+	console_set_render_mode(RENDER_MANUAL);
+
+	printf("graphics.c benchmark (cycles per call, avg of %d)\n\n", NUM_ITERATIONS);
+	console_render();
+
+	bench_format(FMT_RGBA16);
+	console_render();
+	bench_format(FMT_RGBA32);
+
+	printf("Done.\n");
+	console_render();
+	while(1) {}
+}
@@ -0,0 +1,123 @@
+/**
+ * timer.c benchmark
+ *
+ * Measures the cost of the timer subsystem as the number of pending timers
+ * grows:
+ *
+ *  - The interrupt cost: a busy loop counts iterations for a fixed window,
+ *    first with no timers, then with N continuous timers running. The
+ *    iterations lost are converted into CPU time, and divided by the number
+ *    of callbacks that fired, giving the cost of a single firing (interrupt
+ *    entry, queue update and callback dispatch).
+ *  - The queue cost: the time taken by a stop_timer + start_timer pair on
+ *    one timer, while N other timers are pending.
+ *
+ * Periods are staggered so that timers rarely expire together, which is the
+ * worst case for the interrupt handler. The results are printed on the
+ * console at the end of each test.
+ */
+#include <libdragon.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Duration of each busy-loop measurement
+#define WINDOW_TICKS        (TICKS_PER_SECOND / 4)
+
+// Base period of the continuous timers, and stagger between them
+#define PERIOD_US           10000
+#define PERIOD_STEP_US      13
+
+// Number of stop/start pairs measured for the queue cost
+#define NUM_RESTARTS        1000
+
+static const int timer_counts[] = { 1, 10, 100, 250, 500 };
+
+static volatile uint32_t num_fired;
+
+static void timer_cb(int ovfl) {
+	num_fired++;
+}
+
+static void idle_cb(int ovfl) {
+}
+
+/** @brief Count the iterations of an empty loop in a fixed window */
+static uint32_t busy_loop(void) {
+	volatile uint32_t iters = 0;
+	uint32_t t0 = TICKS_READ();
+	while (TICKS_DISTANCE(t0, TICKS_READ()) < WINDOW_TICKS)
+		iters++;
+	return iters;
+}
+
+static void bench_interrupt(int count, uint32_t baseline) {
+	timer_link_t **timers = malloc(count * sizeof(timer_link_t*));
+	for (int i=0; i<count; i++)
+		timers[i] = new_timer(TIMER_TICKS(PERIOD_US + i * PERIOD_STEP_US), TF_CONTINUOUS, timer_cb);
+
+	num_fired = 0;
+	uint32_t iters = busy_loop();
+	uint32_t fired = num_fired;
+
+	for (int i=0; i<count; i++)
+		delete_timer(timers[i]);
+	free(timers);
+
+	int64_t lost = (int64_t)WINDOW_TICKS * (baseline - iters) / baseline;
+	if (lost < 0) lost = 0;
+	printf("%4d timers: %5lu fired, %5.2f%% CPU, %6lld cycles/fire\n",
+		count, fired, 100.0f * lost / WINDOW_TICKS,
+		fired ? lost * 2 / fired : 0);
+}
+
+static void bench_restart(int count) {
+	timer_link_t **timers = malloc(count * sizeof(timer_link_t*));
+	// Long periods: nothing fires during the measurement
+	for (int i=0; i<count; i++)
+		timers[i] = new_timer(TIMER_TICKS(1000000 + i * PERIOD_STEP_US), TF_ONE_SHOT, idle_cb);
+	timer_link_t *t = new_timer(TIMER_TICKS(500000), TF_ONE_SHOT, idle_cb);
+
+	uint32_t t0 = TICKS_READ();
+	for (int i=0; i<NUM_RESTARTS; i++) {
+		stop_timer(t);
+		start_timer(t, TIMER_TICKS(500000 + i * PERIOD_STEP_US), TF_ONE_SHOT, idle_cb);
+	}
+	uint32_t elapsed = TICKS_DISTANCE(t0, TICKS_READ());
+
+	delete_timer(t);
+	for (int i=0; i<count; i++)
+		delete_timer(timers[i]);
+	free(timers);
+
+	printf("%4d timers: %6lu cycles per stop+start\n", count, elapsed * 2 / NUM_RESTARTS);
+}
+
+int main(void) {
+	debug_init_isviewer();
+	debug_init_usblog();
+	console_init();
+	// Render manually, so that the console doesn't draw while benchmarking.
+	console_set_render_mode(RENDER_MANUAL);
+	timer_init();
+
+	uint32_t baseline = busy_loop();
+	printf("timer.c benchmark\n\n");
+	printf("Interrupt cost (%d ms window):\n", (int)TICKS_TO_MS(WINDOW_TICKS));
+	console_render();
+
+	for (int i=0; i<sizeof(timer_counts)/sizeof(timer_counts[0]); i++) {
+		bench_interrupt(timer_counts[i], baseline);
+		console_render();
+	}
+
+	printf("\nQueue cost (avg of %d):\n", NUM_RESTARTS);
+	console_render();
+	for (int i=0; i<sizeof(timer_counts)/sizeof(timer_counts[0]); i++) {
+		bench_restart(timer_counts[i]);
+		console_render();
+	}
+
+	printf("\nDone.\n");
+	console_render();
+	while(1) {}
+}
@@ -0,0 +1,150 @@
+/**
+ * XM tick benchmark
+ *
+ * Runs the float and the fixed-point builds of the libxm tick engine in
+ * lockstep on every XM64 module in the filesystem, and reports the CPU
+ * cycles spent per tick by each, plus the maximum difference in the values
+ * that are sent to the mixer (frequency in cents, and channel volume).
+ *
+ * It also reports the worst-case tick when patterns are loaded synchronously
+ * at every pattern boundary, versus prefetched via asynchronous DMA.
+ */
+#include <libdragon.h>
+#include <stdio.h>
+#include <math.h>
+
+// We need to poke at internal details of the module which are not
+// exposed via public API, so include the internal header file.
+#include "../../src/audio/libxm/xm_internal.h"
+
+// Number of ticks to run per module (at 125 BPM, that's 50 ticks per second).
+#define NUM_TICKS    3000
+
+void xm_tick_float(xm_context_t *ctx);
+void xm_tick_fixed(xm_context_t *ctx);
+
+typedef struct {
+	uint64_t total;
+	uint32_t max;
+} bench_t;
+
+static void bench_tick(bench_t *b, void (*tick)(xm_context_t*), xm_context_t *ctx) {
+	uint32_t t0 = TICKS_READ();
+	tick(ctx);
+	uint32_t dt = TICKS_SINCE(t0);
+	b->total += dt;
+	if (dt > b->max) b->max = dt;
+}
+
+static xm_context_t* load(const char *fn, FILE **fh) {
+	xm_context_t *ctx;
+	*fh = fopen(fn, "rb");
+	assertf(*fh, "cannot open %s", fn);
+	int err = xm_context_load(&ctx, *fh, 44100);
+	assertf(err == 0, "error loading %s (%d)", fn, err);
+	return ctx;
+}
+
+static void run(const char *fn) {
+	FILE *fh_flt, *fh_fix;
+	xm_context_t *ctx_flt = load(fn, &fh_flt);
+	xm_context_t *ctx_fix = load(fn, &fh_fix);
+	bench_t b_flt = {0}, b_fix = {0};
+	float max_cents = 0, max_vol = 0;
+
+	for (int t=0; t<NUM_TICKS; t++) {
+		// Alternate the order to avoid favoring one of the two with
+		// a warm instruction cache.
+		if (t & 1) {
+			bench_tick(&b_flt, xm_tick_float, ctx_flt);
+			bench_tick(&b_fix, xm_tick_fixed, ctx_fix);
+		} else {
+			bench_tick(&b_fix, xm_tick_fixed, ctx_fix);
+			bench_tick(&b_flt, xm_tick_float, ctx_flt);
+		}
+
+		for (int i=0; i<ctx_flt->module.num_channels; i++) {
+			xm_channel_context_t *a = &ctx_flt->channels[i];
+			xm_channel_context_t *b = &ctx_fix->channels[i];
+			if (a->frequency > 0 && b->frequency > 0) {
+				float cents = fabsf(1200.f * log2f(b->frequency / a->frequency));
+				if (cents > max_cents) max_cents = cents;
+			}
+			for (int j=0; j<2; j++) {
+				float dv = fabsf(b->actual_volume[j] - a->actual_volume[j]);
+				if (dv > max_vol) max_vol = dv;
+			}
+		}
+	}
+
+	printf("%-24.24s %2d ch\n", fn+5, ctx_flt->module.num_channels);
+	// CPU cycles are twice the ticks of the COP0 counter.
+	printf("  float: avg %5llu max %6llu cycles\n",
+		b_flt.total * 2 / NUM_TICKS, (uint64_t)b_flt.max * 2);
+	printf("  fixed: avg %5llu max %6llu cycles\n",
+		b_fix.total * 2 / NUM_TICKS, (uint64_t)b_fix.max * 2);
+	printf("  diff:  %.4f cents, %.6f vol\n", max_cents, max_vol);
+
+	xm_free_context(ctx_flt);
+	xm_free_context(ctx_fix);
+	fclose(fh_flt);
+	fclose(fh_fix);
+}
+
+static void run_stream(const char *fn) {
+	// Compare the worst-case tick with synchronous pattern loading (stdio)
+	// and with patterns prefetched via asynchronous DMA.
+	bench_t b_sync = {0}, b_prefetch = {0};
+	FILE *fh_sync, *fh_prefetch;
+	xm_context_t *ctx_sync = load(fn, &fh_sync);
+	xm_context_t *ctx_prefetch = load(fn, &fh_prefetch);
+	ctx_prefetch->stream_rom_addr = dfs_rom_addr(fn+5);
+
+	for (int t=0; t<NUM_TICKS; t++) {
+		bench_tick(&b_sync, xm_tick_fixed, ctx_sync);
+		bench_tick(&b_prefetch, xm_tick_fixed, ctx_prefetch);
+	}
+
+	printf("  patterns: sync max %6llu, prefetch max %6llu cycles\n",
+		(uint64_t)b_sync.max * 2, (uint64_t)b_prefetch.max * 2);
+
+	xm_free_context(ctx_sync);
+	xm_free_context(ctx_prefetch);
+	fclose(fh_sync);
+	fclose(fh_prefetch);
+}
+
+static bool strendswith(const char *str, const char *suffix) {
+	char *p = strstr(str, suffix);
+	return p && p[strlen(suffix)] == '\0';
+}
+
+int main(void) {
+	debug_init_isviewer();
+	debug_init_usblog();
+	console_init();
+	console_set_render_mode(RENDER_AUTOMATIC);
+	dfs_init(DFS_DEFAULT_LOCATION);
+
+	printf("XM tick benchmark (%d ticks)\n\n", NUM_TICKS);
+
+	// Collect the file list first, as running a benchmark opens files.
+	static char* files[256];
+	int num_files = 0;
+	char sbuf[1024];
+	strcpy(sbuf, "rom:/");
+	if (dfs_dir_findfirst(".", sbuf+5) == FLAGS_FILE) {
+		do {
+			if (strendswith(sbuf, ".xm64") || strendswith(sbuf, ".XM64"))
+				files[num_files++] = strdup(sbuf);
+		} while (num_files < 256 && dfs_dir_findnext(sbuf+5) == FLAGS_FILE);
+	}
+
+	for (int i=0; i<num_files; i++) {
+		run(files[i]);
+		run_stream(files[i]);
+	}
+
+	printf("\nDone.\n");
+	while(1) {}
+}
@@ -0,0 +1,144 @@
+/**
+ * YM generator benchmark
+ *
+ * Runs the float and the fixed-point builds of the AY8910 generator in
+ * lockstep on every YM64 module in the filesystem, feeding both the same
+ * register writes. It reports the CPU cycles spent per audioframe by each,
+ * and the maximum difference between the generated samples.
+ */
+#include <libdragon.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// We need to read the register dump directly, bypassing the player, so
+// include the internal header of the decompressor.
+#include "../../src/compress/lzh5_internal.h"
+
+// Number of audioframes to run per module (at 50 Hz, that's 60 seconds).
+#define NUM_FRAMES   3000
+
+void ay8910_reset_float(AY8910 *ay);
+void ay8910_write_addr_float(AY8910 *ay, uint8_t addr);
+void ay8910_write_data_float(AY8910 *ay, uint8_t val);
+int ay8910_gen_float(AY8910 *ay, int16_t *out, int nsamples);
+
+void ay8910_reset_fixed(AY8910 *ay);
+void ay8910_write_addr_fixed(AY8910 *ay, uint8_t addr);
+void ay8910_write_data_fixed(AY8910 *ay, uint8_t val);
+int ay8910_gen_fixed(AY8910 *ay, int16_t *out, int nsamples);
+
+typedef struct {
+	uint64_t total;
+	uint32_t max;
+} bench_t;
+
+static void bench_gen(bench_t *b, int (*gen)(AY8910*, int16_t*, int), AY8910 *ay, int16_t *out, int nsamples) {
+	uint32_t t0 = TICKS_READ();
+	gen(ay, out, nsamples);
+	uint32_t dt = TICKS_SINCE(t0);
+	b->total += dt;
+	if (dt > b->max) b->max = dt;
+}
+
+static int ymread(ym64player_t *player, void *buf, int sz) {
+	if (player->decoder)
+		return decompress_lzh5_read(player->decoder, buf, sz);
+	return fread(buf, 1, sz, player->f);
+}
+
+static void run(const char *fn) {
+	// Open the module with the player, just to parse the header. We then
+	// read the register dump ourselves.
+	ym64player_t player;
+	ym64player_open(&player, fn, NULL);
+
+	AY8910 ay_flt, ay_fix;
+	ay8910_reset_float(&ay_flt);
+	ay8910_reset_fixed(&ay_fix);
+
+	int nframes = player.nframes < NUM_FRAMES ? (int)player.nframes : NUM_FRAMES;
+	int samples_per_frame = (int)(player.wave.frequency / player.playfreq);
+	int num_channels = AY8910_OUTPUT_STEREO ? 2 : 1;
+	int16_t *out_flt = malloc(samples_per_frame * num_channels * sizeof(int16_t));
+	int16_t *out_fix = malloc(samples_per_frame * num_channels * sizeof(int16_t));
+
+	bench_t b_flt = {0}, b_fix = {0};
+	int max_diff = 0;
+	uint8_t cur[16] = {0};
+
+	for (int f=0; f<nframes; f++) {
+		// Apply the register writes exactly like ym64player does.
+		uint8_t regs[16];
+		ymread(&player, regs, 16);
+		for (int i=0; i<14; i++) {
+			if (cur[i] != regs[i]) {
+				cur[i] = regs[i];
+				if (i == 13 && regs[i] == 0xFF) continue;
+				ay8910_write_addr_float(&ay_flt, i);
+				ay8910_write_data_float(&ay_flt, regs[i]);
+				ay8910_write_addr_fixed(&ay_fix, i);
+				ay8910_write_data_fixed(&ay_fix, regs[i]);
+			}
+		}
+
+		// Alternate the order to avoid favoring one of the two with
+		// a warm instruction cache.
+		if (f & 1) {
+			bench_gen(&b_flt, ay8910_gen_float, &ay_flt, out_flt, samples_per_frame);
+			bench_gen(&b_fix, ay8910_gen_fixed, &ay_fix, out_fix, samples_per_frame);
+		} else {
+			bench_gen(&b_fix, ay8910_gen_fixed, &ay_fix, out_fix, samples_per_frame);
+			bench_gen(&b_flt, ay8910_gen_float, &ay_flt, out_flt, samples_per_frame);
+		}
+
+		for (int i=0; i<samples_per_frame * num_channels; i++) {
+			int diff = abs(out_flt[i] - out_fix[i]);
+			if (diff > max_diff) max_diff = diff;
+		}
+	}
+
+	printf("%-24.24s %d frames, %d samples/frame\n", fn+5, nframes, samples_per_frame);
+	// CPU cycles are twice the ticks of the COP0 counter.
+	printf("  float: avg %6llu max %6llu cycles\n",
+		b_flt.total * 2 / nframes, (uint64_t)b_flt.max * 2);
+	printf("  fixed: avg %6llu max %6llu cycles\n",
+		b_fix.total * 2 / nframes, (uint64_t)b_fix.max * 2);
+	printf("  diff:  %d LSB %s\n", max_diff, max_diff <= 2 ? "(OK)" : "(MISMATCH)");
+
+	free(out_flt);
+	free(out_fix);
+	ym64player_close(&player);
+}
+
+static bool strendswith(const char *str, const char *suffix) {
+	char *p = strstr(str, suffix);
+	return p && p[strlen(suffix)] == '\0';
+}
+
+int main(void) {
+	debug_init_isviewer();
+	debug_init_usblog();
+	console_init();
+	console_set_render_mode(RENDER_AUTOMATIC);
+	dfs_init(DFS_DEFAULT_LOCATION);
+
+	printf("YM generator benchmark (%d frames)\n\n", NUM_FRAMES);
+
+	// Collect the file list first, as running a benchmark opens files.
+	static char* files[256];
+	int num_files = 0;
+	char sbuf[1024];
+	strcpy(sbuf, "rom:/");
+	if (dfs_dir_findfirst(".", sbuf+5) == FLAGS_FILE) {
+		do {
+			if (strendswith(sbuf, ".ym64") || strendswith(sbuf, ".YM64"))
+				files[num_files++] = strdup(sbuf);
+		} while (num_files < 256 && dfs_dir_findnext(sbuf+5) == FLAGS_FILE);
+	}
+
+	for (int i=0; i<num_files; i++)
+		run(files[i]);
+
+	printf("\nDone.\n");
+	while(1) {}
+}
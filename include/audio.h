@@ -8,6 +8,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * @defgroup audio Audio Subsystem
@@ -143,6 +144,18 @@ int audio_get_frequency();
  */
 int audio_get_buffer_length();
 
+/**
+ * @brief Return the number of audio buffer underruns
+ *
+ * An underrun happens when the AI has finished playing all the queued buffers,
+ * and no new buffer was written in time, which results in an audible gap.
+ * This is a good indication that audio is not being produced fast enough
+ * (eg: #mixer_poll is not called often enough).
+ *
+ * @return Number of underruns since #audio_init
+ */
+uint32_t audio_get_underruns(void);
+
 
 /**
  * @brief Start writing to the first free internal buffer.
@@ -51,6 +51,22 @@ extern "C" {
  */
 #define AY8910_CENTER_SILENCE     1
 
+/** @brief Use fixed-point arithmetic for sample generation.
+ *
+ * If 1, the generator mixes channels and accumulates the decimated samples
+ * using integer arithmetic, which is faster on the N64 CPU than going through
+ * the FPU for every run of samples. The output differs from the floating
+ * point version by 1 LSB at most, or 2 LSB when emulating very high-frequency
+ * noise (which uses a random amplitude modulation of lower resolution).
+ */
+#ifndef AY8910_FIXED_POINT
+#ifdef N64
+#define AY8910_FIXED_POINT        1
+#else
+#define AY8910_FIXED_POINT        0
+#endif
+#endif
+
 /** @brief A AY-3-8910 channel */
 typedef struct {
 	uint16_t tone_period;      ///< Period (in ticks) of the current tone
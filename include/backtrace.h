@@ -186,6 +186,41 @@ char** backtrace_symbols(void **buffer, int size);
 bool backtrace_symbols_cb(void **buffer, int size, uint32_t flags,
     void (*cb)(void *, backtrace_frame_t*), void *cb_arg);
 
+/**
+ * @brief Load the symbol table into RAM to speed up symbolization
+ * 
+ * By default, symbolization queries the symbol table directly from ROM, so
+ * that it works without allocating memory (eg: in a crash handler). This is
+ * fine for a few backtraces, but each lookup requires several PI accesses, so
+ * it is too slow to symbolize thousands of addresses, as a profiler or an
+ * allocation tracker does.
+ * 
+ * This function copies the symbol table into RAM, within the specified memory
+ * budget. The address table (used for every lookup) is loaded first, then the
+ * symbol entries and the strings, as long as they fit. The remaining budget is
+ * used as a cache of the most recently accessed blocks of the tables that did
+ * not fit. With a budget large enough for the whole table, symbolization
+ * does not access the ROM anymore.
+ * 
+ * This also speeds up #backtrace when walking through exception frames (for
+ * instance, in the sampling profiler), as it needs to look up the symbol table
+ * to find the start of the interrupted function.
+ * 
+ * @param max_bytes     Maximum amount of memory to allocate, in bytes
+ * @return              Amount of memory allocated, in bytes (0 if no symbol
+ *                      table was found, or the budget is too small)
+ * 
+ * @see #backtrace_symbols_cache_close
+ */
+int backtrace_symbols_cache_init(int max_bytes);
+
+/**
+ * @brief Free the RAM copy of the symbol table
+ * 
+ * Symbolization goes back to querying the symbol table directly from ROM.
+ */
+void backtrace_symbols_cache_close(void);
+
 #ifdef __cplusplus
 }
 #endif
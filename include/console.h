@@ -158,6 +158,12 @@ void console_clear();
  *
  * The color that is used to draw the text can be set using #graphics_set_color.
  *
+ * The console remembers what it drew in each framebuffer, and only redraws the
+ * characters that changed since then.  This assumes that the application does
+ * not draw to the display framebuffers, nor closes and reinitializes the
+ * display, while the console is initialized.  Everything is redrawn after
+ * #console_clear, or when the colors are changed.
+ *
  * Do not call while interrupts are disabled, or it will lock the system.
  */
 void console_render();
@@ -7,6 +7,7 @@
 #define __LIBDRAGON_CONTROLLER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * @addtogroup controller
@@ -193,6 +194,37 @@ typedef struct controller_origin_data
     struct SI_origdat_gc gc[4];
 } SI_controllers_origin_t;
 
+/** @brief Maximum number of reads per frame of the polling engine (see #controller_poll_init) */
+#define CONTROLLER_POLL_MAX_PER_FRAME   8
+/** @brief Number of samples kept in the history of the polling engine */
+#define CONTROLLER_POLL_HISTORY         16
+
+/** @brief A timestamped controller read, performed by the polling engine */
+typedef struct controller_sample
+{
+    /** @brief Status of the N64 controllers */
+    struct controller_data data;
+    /** @brief Time at which the read completed (see #TICKS_READ) */
+    uint32_t ticks;
+    /** @brief Time between the issue of the read and its completion, in ticks */
+    uint32_t latency;
+} controller_sample_t;
+
+/** @brief Statistics of the polling engine */
+typedef struct controller_poll_stats
+{
+    /** @brief Number of completed reads */
+    uint32_t num_polls;
+    /** @brief Number of reads skipped because the previous one was still pending, or could not be issued in time */
+    uint32_t num_skipped;
+    /** @brief Average time between the issue of a read and its completion, in ticks */
+    uint32_t avg_latency_ticks;
+    /** @brief Time spent by the SI processing joybus messages (of any kind), in ticks */
+    uint64_t si_busy_ticks;
+    /** @brief Time elapsed, in ticks: si_busy_ticks / elapsed_ticks is the SI bus occupancy */
+    uint64_t elapsed_ticks;
+} controller_poll_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -204,6 +236,10 @@ void controller_read_gc_origin( struct controller_origin_data * data);
 int get_controllers_present( void );
 int get_accessories_present( struct controller_data * data );
 void controller_scan( void );
+void controller_poll_init( int polls_per_frame, int deadline_us );
+void controller_poll_close( void );
+int controller_poll_get_samples( controller_sample_t *samples, int max );
+controller_poll_stats_t controller_poll_get_stats( bool reset );
 struct controller_data get_keys_down( void );
 struct controller_data get_keys_up( void );
 struct controller_data get_keys_held( void );
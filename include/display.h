@@ -269,6 +269,79 @@ uint32_t display_get_num_buffers(void);
  */
 float display_get_fps(void);
 
+/** @brief Percentiles of a frame timing metric, in microseconds */
+typedef struct {
+    uint32_t p50;       ///< Median
+    uint32_t p90;       ///< 90th percentile
+    uint32_t p99;       ///< 99th percentile
+    uint32_t max;       ///< Maximum
+} display_timing_percentiles_t;
+
+/** @brief Timing of a single frame, in CPU ticks */
+typedef struct {
+    uint32_t wait;      ///< Time spent in #display_get waiting for a free buffer
+    uint32_t render;    ///< Time between the buffer being acquired and #display_show
+    uint32_t latency;   ///< Time between #display_show and the start of scanout (vblank)
+    uint32_t interval;  ///< Time between the start of scanout of the previous frame and this one
+} display_frame_timing_t;
+
+/** @brief Frame timing statistics (see #display_get_timing) */
+typedef struct {
+    int num_frames;                         ///< Number of frames in the statistics window
+    uint32_t frames_shown;                  ///< Total number of frames shown since #display_init
+    uint32_t missed_vblanks;                ///< Total number of vblanks with a frame being drawn, but none ready to be shown
+    display_timing_percentiles_t wait;      ///< Time spent waiting for a free buffer
+    display_timing_percentiles_t render;    ///< Time spent drawing a frame (from #display_get to #display_show)
+    display_timing_percentiles_t latency;   ///< Time from #display_show to scanout
+    display_timing_percentiles_t interval;  ///< Time between two frames being scanned out
+} display_timing_stats_t;
+
+/**
+ * @brief Get frame timing statistics
+ *
+ * The display module records the timing of the last frames shown on the
+ * screen (up to 64): how long #display_get waited for a free buffer, how long
+ * the frame took to draw, how long it was queued before being scanned out,
+ * and the interval between frames. This function computes percentiles of
+ * these metrics over the recorded frames.
+ *
+ * Frames whose buffer was obtained with #display_try_get have no waiting
+ * time.
+ *
+ * @param[out] stats    Statistics
+ */
+void display_get_timing(display_timing_stats_t *stats);
+
+/**
+ * @brief Get the timing of the last frames shown
+ *
+ * @param[out] frames       Array that will be filled with the timing of the
+ *                          last frames, from the oldest to the most recent
+ * @param[in]  max_frames   Size of the array
+ * @return                  Number of frames written to the array
+ */
+int display_get_frame_timings(display_frame_timing_t *frames, int max_frames);
+
+/**
+ * @brief Enable or disable frame pacing
+ *
+ * When the game is able to draw frames faster than they are shown (for
+ * instance, with triple buffering), completed frames wait in a queue, which
+ * increases the latency between reading the input and showing its result.
+ *
+ * With frame pacing enabled, #display_get waits until no completed frame is
+ * waiting to be shown, and then delays the start of the next frame so that
+ * it completes just before the vblank it would have been shown at anyway,
+ * using the recent rendering times (90th percentile) as prediction. This
+ * trades CPU idle time at the beginning of the frame for a lower input
+ * latency, without reducing the frame rate as long as the prediction holds.
+ *
+ * Frame pacing is disabled by default.
+ *
+ * @param[in] enable    True to enable frame pacing
+ */
+void display_set_pacing(bool enable);
+
 
 /** @cond */
 __attribute__((deprecated("use display_get or display_try_get instead")))
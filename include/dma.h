@@ -221,6 +221,180 @@ void io_write(uint32_t pi_address, uint32_t data);
  */
 bool io_accessible(uint32_t pi_address);
 
+/**
+ * @brief Priority classes of the DMA queue
+ *
+ * Requests are served in priority order. A long transfer is split into chunks
+ * (see #dma_queue_set_chunk_size), so a request with a higher priority can
+ * be served between two chunks of a lower priority one.
+ */
+typedef enum {
+    DMA_PRIO_AUDIO = 0,     ///< Audio refills: must never starve
+    DMA_PRIO_HIGH,          ///< Latency-sensitive transfers
+    DMA_PRIO_NORMAL,        ///< Default priority (used by DragonFS)
+    DMA_PRIO_BULK,          ///< Background streaming of large assets
+    DMA_PRIO_NUM,           ///< Number of priority classes
+} dma_prio_t;
+
+///@cond
+typedef struct dma_request_s dma_request_t;
+///@endcond
+
+/**
+ * @brief Callback invoked when a queued DMA request is completed
+ *
+ * The callback runs while the queue is being serviced, often under interrupt.
+ * It can queue new requests, but it must not wait on the queue (via
+ * #dma_queue_wait or #dma_read_prio), as that would never return.
+ */
+typedef void (*dma_callback_t)(dma_request_t *req, void *arg);
+
+/**
+ * @brief A request of the DMA queue
+ *
+ * The structure is allocated by the caller, and must stay valid until the
+ * request is completed. Its fields are private.
+ */
+typedef struct dma_request_s {
+    ///@cond
+    uint8_t *ram;                   // Next RAM address to transfer (uncached)
+    uint32_t pi_address;            // Next PI address to transfer
+    uint32_t remaining;             // Bytes left to transfer
+    uint32_t len;                   // Total length of the request
+    uint32_t queued_time;           // Time at which the request was queued
+    dma_prio_t prio;                // Priority class
+    bool write;                     // True for RAM->PI transfers
+    bool started;                   // True once the first chunk was started
+    volatile bool done;             // True once the request is completed
+    dma_callback_t callback;        // Completion callback
+    void *arg;                      // Argument of the completion callback
+    struct dma_request_s *next;     // Next request in the same priority class
+    ///@endcond
+} dma_request_t;
+
+/** @brief Statistics of a priority class of the DMA queue */
+typedef struct {
+    uint32_t num_requests;          ///< Number of requests completed
+    uint64_t bytes;                 ///< Number of bytes transferred
+    uint64_t busy_ticks;            ///< Time spent by the PI on transfers of this class (in ticks)
+    uint64_t latency_ticks;         ///< Sum of the latencies (from queuing to completion) of the requests (in ticks)
+    uint32_t max_latency_ticks;     ///< Maximum latency of a request (in ticks)
+} dma_queue_stats_t;
+
+/**
+ * @brief Initialize the DMA queue
+ *
+ * The DMA queue schedules PI DMA transfers, driven by the PI interrupt.
+ * Transfers are split into chunks, and at the end of each chunk the next one
+ * is picked from the non-empty priority class with the highest priority.
+ *
+ * Direct calls to the other DMA functions keep working while the queue is
+ * active: they wait for the current chunk to finish, and the queue resumes
+ * after them.
+ */
+void dma_queue_init(void);
+
+/**
+ * @brief Shut down the DMA queue, after waiting for all the pending requests
+ */
+void dma_queue_close(void);
+
+/**
+ * @brief Set the maximum size of a chunk of a queued transfer
+ *
+ * Smaller chunks reduce the time a high priority request waits for the
+ * current chunk to complete, at the cost of more interrupts. The PI
+ * transfers about 5 MiB/s from ROM, so the default of 8 KiB corresponds to
+ * about 1.6 ms.
+ *
+ * @param[in] size      Chunk size in bytes (rounded down to a multiple of 8)
+ */
+void dma_queue_set_chunk_size(uint32_t size);
+
+/**
+ * @brief Queue a read from a peripheral
+ *
+ * The alignment constraints are the same as #dma_read_async: the RAM and PI
+ * addresses must have the same 1-bit misalignment. Misaligned bytes at the
+ * beginning of the transfer and an odd trailing byte are transferred by the
+ * CPU when the request is started.
+ *
+ * Like for the other DMA functions, the caller is responsible for cache
+ * coherency of the RAM buffer.
+ *
+ * @param[out] req          Request structure to use (owned by the caller)
+ * @param[out] ram_address  Pointer to a buffer in RDRAM to place read data
+ * @param[in]  pi_address   Memory address of the peripheral to read from
+ * @param[in]  len          Length in bytes to read
+ * @param[in]  prio         Priority class of the request
+ * @param[in]  callback     Function to call when the request is completed
+ *                          (can be NULL). It can be called from the PI
+ *                          interrupt handler.
+ * @param[in]  arg          Argument of the callback
+ */
+void dma_queue_read(dma_request_t *req, void *ram_address, unsigned long pi_address,
+    unsigned long len, dma_prio_t prio, dma_callback_t callback, void *arg);
+
+/**
+ * @brief Queue a write to a peripheral
+ *
+ * The alignment constraints are the same as #dma_write_raw_async.
+ *
+ * @param[out] req          Request structure to use (owned by the caller)
+ * @param[in]  ram_address  Pointer to a buffer to read data from (must be 8-byte aligned)
+ * @param[in]  pi_address   Memory address of the peripheral to write to (must be 2-byte aligned)
+ * @param[in]  len          Length in bytes to write (must be multiple of 2)
+ * @param[in]  prio         Priority class of the request
+ * @param[in]  callback     Function to call when the request is completed (can be NULL)
+ * @param[in]  arg          Argument of the callback
+ */
+void dma_queue_write(dma_request_t *req, const void *ram_address, unsigned long pi_address,
+    unsigned long len, dma_prio_t prio, dma_callback_t callback, void *arg);
+
+/**
+ * @brief Check whether a queued request is completed
+ *
+ * @param[in] req           Request to check
+ * @return                  True if the request is completed
+ */
+bool dma_queue_done(dma_request_t *req);
+
+/**
+ * @brief Wait for a queued request to be completed
+ *
+ * This function also works with interrupts disabled, as it drives the queue
+ * itself while waiting. It must not be called from a completion callback.
+ *
+ * @param[in] req           Request to wait for
+ */
+void dma_queue_wait(dma_request_t *req);
+
+/**
+ * @brief Read data from ROM with the specified priority, waiting for completion
+ *
+ * If the DMA queue is initialized, the read goes through the queue, so that
+ * it is served before the lower priority transfers. Otherwise, it is
+ * equivalent to #dma_read. It must not be called from a completion callback.
+ *
+ * @param[out] ram_address  Pointer to a buffer in RDRAM to place read data
+ * @param[in]  pi_address   ROM address to read from (mangled like #dma_read)
+ * @param[in]  len          Length in bytes to read
+ * @param[in]  prio         Priority class of the request
+ */
+void dma_read_prio(void *ram_address, unsigned long pi_address, unsigned long len, dma_prio_t prio);
+
+/**
+ * @brief Get the statistics of a priority class of the DMA queue
+ *
+ * The bandwidth of the class can be computed as
+ * `bytes * TICKS_PER_SECOND / busy_ticks`, and its average latency as
+ * `latency_ticks / num_requests`.
+ *
+ * @param[in]  prio         Priority class
+ * @param[out] stats        Statistics
+ */
+void dma_queue_get_stats(dma_prio_t prio, dma_queue_stats_t *stats);
+
 __attribute__((deprecated("use dma_wait instead"))) 
 volatile int dma_busy(void);
 
@@ -73,6 +73,24 @@ typedef struct eepfs_entry_t
     size_t size;
 } eepfs_entry_t;
 
+/**
+ * @brief EEPROM filesystem flush statistics
+ * @see #eepfs_get_flush_stats
+ */
+typedef struct eepfs_flush_stats_t
+{
+    /** @brief Bytes written to EEPROM by the last completed flush */
+    size_t last_flush_bytes;
+    /** @brief Bytes written to EEPROM by all flushes */
+    size_t total_bytes;
+    /** @brief Number of completed flushes */
+    size_t num_flushes;
+    /** @brief Bytes in blocks modified in RAM and not written to EEPROM yet */
+    size_t pending_bytes;
+    /** @brief Whether a background flush is in progress */
+    bool flushing;
+} eepfs_flush_stats_t;
+
 /**
  * @brief Initializes the EEPROM filesystem.
  * 
@@ -112,6 +130,8 @@ int eepfs_init(const eepfs_entry_t * entries, size_t count);
  * 
  * You probably won't ever need to call this.
  * 
+ * If write-back mode is enabled, pending changes are flushed first.
+ * 
  * @return EEPFS_ESUCCESS on success or a negative error otherwise
  */
 int eepfs_close(void);
@@ -167,6 +187,74 @@ int eepfs_write(const char * path, const void * src, size_t size);
 int eepfs_erase(const char * path);
 
 
+/**
+ * @brief Enables or disables write-back mode.
+ * 
+ * By default, #eepfs_write and #eepfs_erase write whole files through to
+ * EEPROM, blocking for approximately 15 milliseconds per block.
+ * 
+ * In write-back mode, the blocks used by the filesystem are kept in RAM
+ * (twice: the current contents and the last contents persisted to EEPROM,
+ * up to 4 kilobytes in total). Reads, writes and erases only access RAM,
+ * and changes are written to EEPROM by #eepfs_flush or #eepfs_flush_async.
+ * A flush only writes the 8-byte blocks whose contents actually changed
+ * since they were last persisted, which also limits EEPROM wear.
+ * 
+ * Enabling write-back mode reads the filesystem blocks from EEPROM, and
+ * initializes the timer subsystem (see #timer_init). Disabling it flushes
+ * pending changes first.
+ * 
+ * @param[in] enabled
+ *            Whether write-back mode should be enabled
+ * 
+ * @retval EEPFS_ESUCCESS if successful
+ * @retval EEPFS_EBADFS if the filesystem is not initialized
+ * @retval EEPFS_ENOMEM if the RAM images couldn't be allocated
+ */
+int eepfs_set_writeback(bool enabled);
+
+/**
+ * @brief Writes pending changes to EEPROM.
+ * 
+ * Writes all blocks modified in write-back mode, blocking for approximately
+ * 15 milliseconds per block. If a background flush is in progress, it is
+ * completed synchronously.
+ * 
+ * Does nothing if write-back mode is not enabled.
+ * 
+ * @return The number of bytes written to EEPROM
+ */
+int eepfs_flush(void);
+
+/**
+ * @brief Starts writing pending changes to EEPROM in background.
+ * 
+ * Modified blocks are written one at a time, spaced by the time the EEPROM
+ * takes to complete each write, without blocking the caller. Reads and writes
+ * of files can continue meanwhile: blocks modified while flushing are
+ * written again by the next flush.
+ * 
+ * If a background flush is already in progress, it is extended to include
+ * all the changes made so far. Use #eepfs_get_flush_stats to check when
+ * the flush is complete.
+ * 
+ * Does nothing if write-back mode is not enabled.
+ * 
+ * @return The number of bytes that are going to be written to EEPROM
+ */
+int eepfs_flush_async(void);
+
+/**
+ * @brief Returns the write-back mode flush statistics.
+ * 
+ * The number of bytes written per flush can be used to tune how often
+ * the game saves.
+ * 
+ * @return The statistics since write-back mode was enabled (all zeroes if
+ *         write-back mode is disabled)
+ */
+eepfs_flush_stats_t eepfs_get_flush_stats(void);
+
 /**
  * @brief Validates the first block of EEPROM.
  * 
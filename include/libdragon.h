@@ -44,6 +44,8 @@
 #include "rdp.h"
 #include "rsp.h"
 #include "timer.h"
+#include "profile.h"
+#include "trace.h"
 #include "exception.h"
 #include "dir.h"
 #include "mixer.h"
@@ -59,6 +61,7 @@
 #include "rdpq_mode.h"
 #include "rdpq_tex.h"
 #include "rdpq_sprite.h"
+#include "rdpq_font.h"
 #include "rdpq_debug.h"
 #include "rdpq_macros.h"
 #include "surface.h"
@@ -26,6 +26,15 @@
  * first using #delete_mempak_entry.  Code should be careful to check how many blocks
  * are free before writing using #get_mempak_free_space.
  *
+ * Every operation on the filesystem reads the ID, TOC and note index sectors,
+ * and a Controller Pak transfers only 32 bytes at a time.  To speed up
+ * repeated operations, the metadata sectors of a Controller Pak can be kept
+ * in RAM with #mempak_cache_init; after that, only the 32-byte chunks of the
+ * metadata that are actually modified are written back.  Transfers of whole
+ * sectors and notes are always queued to the joybus at once, so that the
+ * SI never waits for the CPU in between.  Saving a large note can also be
+ * done in background with #write_mempak_entry_data_async.
+ *
  * @{
  */
 
@@ -67,6 +76,22 @@ typedef struct entry_structure
     char name[19];
 } entry_structure_t;
 
+/**
+ * @brief Completion callback of #write_mempak_entry_data_async
+ *
+ * The callback is called under interrupt, and must not call other
+ * Controller Pak functions.
+ *
+ * @param[in] controller
+ *            The controller (0-3) the note was written to
+ * @param[in] result
+ *            0 if the note was written successfully, -2 if the Controller Pak
+ *            was bad or not present, or -3 if there was an error writing the data
+ * @param[in] ctx
+ *            The context passed to #write_mempak_entry_data_async
+ */
+typedef void (*mempak_write_callback_t)( int controller, int result, void *ctx );
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -218,6 +243,39 @@ int read_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *d
  */
 int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *data );
 
+/**
+ * @brief Write associated data to a Controller Pak entry in background
+ *
+ * Same as #write_mempak_entry_data, but only the allocation of the entry is
+ * done before returning: the data, the TOC and the note index are then written
+ * in background, and the callback is invoked when done.  The entry structure
+ * is updated before returning.  The data buffer must not be modified or freed
+ * until the callback is called.
+ *
+ * The Controller Pak must be cached with #mempak_cache_init.  Any other
+ * Controller Pak function called on the same controller waits for the write
+ * to complete.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to write the entry and data to
+ * @param[in] entry
+ *            The entry structure containing a region, name and block count
+ * @param[in] data
+ *            The associated data to write to to the created entry
+ * @param[in] callback
+ *            Function called under interrupt when the write is complete, or NULL
+ * @param[in] ctx
+ *            Opaque pointer passed to the callback
+ *
+ * @retval 0 if the write was started successfully
+ * @retval -1 if the parameters were invalid or the note has no length
+ * @retval -2 if the Controller Pak wasn't present or was bad
+ * @retval -4 if there wasn't enough space to store the note
+ * @retval -5 if there is no room in the TOC to add a new entry
+ */
+int write_mempak_entry_data_async( int controller, entry_structure_t *entry, uint8_t *data,
+                                   mempak_write_callback_t callback, void *ctx );
+
 /**
  * @brief Delete a Controller Pak entry and associated data
  *
@@ -235,6 +293,38 @@ int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *
  */
 int delete_mempak_entry( int controller, entry_structure_t *entry );
 
+/**
+ * @brief Cache the filesystem metadata of a Controller Pak
+ *
+ * Read the ID, TOC and note index sectors of a Controller Pak into RAM (1280
+ * bytes), so that the filesystem functions don't need to read them again.
+ * Modifications are written through to the Controller Pak by each function,
+ * limited to the 32-byte chunks that actually changed.  If a transfer fails,
+ * the metadata is read again by the next call.
+ *
+ * The cache must be closed with #mempak_cache_close if the Controller Pak is
+ * removed or replaced.
+ *
+ * @param[in] controller
+ *            The controller (0-3) with the Controller Pak to cache
+ *
+ * @retval 0 if the metadata was cached successfully (or was already cached)
+ * @retval -1 if the controller was out of range or memory couldn't be allocated
+ * @retval -2 if the Controller Pak was not present or couldn't be read
+ */
+int mempak_cache_init( int controller );
+
+/**
+ * @brief Stop caching the filesystem metadata of a Controller Pak
+ *
+ * Wait for any pending write started by #write_mempak_entry_data_async,
+ * and free the cache.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to stop caching
+ */
+void mempak_cache_close( int controller );
+
 #ifdef __cplusplus
 }
 #endif
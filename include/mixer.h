@@ -354,6 +354,67 @@ void mixer_add_event(int64_t delay, MixerEvent cb, void *ctx);
  */
 void mixer_remove_event(MixerEvent cb, void *ctx);
 
+/**
+ * @brief Statistics of a single mixer channel.
+ *
+ * See #mixer_stats_t for more information.
+ */
+typedef struct {
+	uint32_t samples;         ///< Number of samples refilled into the channel sample buffer
+	uint32_t reads;           ///< Number of calls to the waveform read callback
+	uint32_t dma_bytes;       ///< Bytes fetched from ROM via PI DMA
+	uint64_t read_ticks;      ///< Ticks spent in the waveform read callback (total)
+	uint64_t dma_ticks;       ///< Ticks spent waiting for PI DMA within the read callback
+	uint64_t decode_ticks;    ///< Ticks spent in the read callback not waiting for DMA (decoding, generation)
+} mixer_ch_stats_t;
+
+/**
+ * @brief Statistics about the mixer and the audio pipeline.
+ *
+ * The mixer keeps track of where the time is spent while running #mixer_poll.
+ * All counters are accumulated since the mixer was initialized or since the
+ * last call to #mixer_reset_stats. All times are expressed in CPU ticks
+ * (see #TICKS_READ).
+ *
+ * To obtain statistics per frame, call #mixer_reset_stats after reading
+ * them every frame. Otherwise, averages can be computed dividing by the number
+ * of frames (that is, calls to #mixer_poll).
+ *
+ * Collecting statistics is cheap (a few timer reads per channel refill),
+ * so they are always enabled.
+ */
+typedef struct {
+	uint32_t frames;          ///< Number of calls to #mixer_poll
+	uint32_t samples;         ///< Number of output samples produced
+	uint32_t underruns;       ///< Number of AI buffer underruns (see #audio_get_underruns)
+	uint32_t dma_bytes;       ///< Bytes fetched from ROM via PI DMA (all channels)
+	uint64_t poll_ticks;      ///< Ticks spent in #mixer_poll (total)
+	uint64_t poll_max_ticks;  ///< Maximum ticks spent in a single #mixer_poll call
+	uint64_t rsp_ticks;       ///< Ticks spent waiting for the RSP to mix the channels
+	uint64_t event_ticks;     ///< Ticks spent in mixer event callbacks (eg: sequencers)
+	uint64_t read_ticks;      ///< Ticks spent in waveform read callbacks (all channels)
+	uint64_t dma_ticks;       ///< Ticks spent waiting for PI DMA (all channels)
+	uint64_t decode_ticks;    ///< Ticks spent decoding or generating samples (all channels)
+	mixer_ch_stats_t ch[MIXER_MAX_CHANNELS]; ///< Per-channel statistics
+} mixer_stats_t;
+
+/**
+ * @brief Read the mixer statistics.
+ *
+ * @param[out]  stats           Structure that will be filled with the
+ *                              statistics accumulated so far.
+ *
+ * @see #mixer_stats_t
+ */
+void mixer_get_stats(mixer_stats_t *stats);
+
+/**
+ * @brief Reset the mixer statistics.
+ *
+ * @see #mixer_stats_t
+ */
+void mixer_reset_stats(void);
+
 
 /*********************************************************************
  *
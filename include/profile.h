@@ -0,0 +1,147 @@
+/**
+ * @file profile.h
+ * @brief Sampling CPU profiler
+ * @ingroup profile
+ */
+#ifndef __LIBDRAGON_PROFILE_H
+#define __LIBDRAGON_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @defgroup profile Sampling CPU profiler
+ * @ingroup lowlevel
+ * @brief Statistical profiler that samples the CPU program counter
+ *
+ * The profiler periodically interrupts the program through a continuous
+ * timer (see #new_timer), and records the address of the code that was
+ * running when the interrupt triggered. Optionally, it also walks the
+ * interrupted call stack (see #backtrace) to record a few of its callers.
+ * Over many samples, the number of times a function appears is proportional
+ * to the CPU time spent in it.
+ *
+ * Samples are stored in a ring buffer preallocated by #profile_init, so
+ * recording a sample never allocates memory. When the buffer is full, the
+ * oldest samples are overwritten. The samples are then written out as text
+ * with #profile_flush, for instance to stderr (which is connected to the
+ * USB and ISViewer debug channels, see #debug_init) or to a file on the SD
+ * card.
+ *
+ * The output can be converted into folded stacks (the input format of most
+ * flame graph tools) by the n64prof tool, which symbolizes the addresses
+ * using the symbol table created by n64sym:
+ *
+ * ```
+ *   $ n64prof game.sym profile.txt > game.folded
+ *   $ flamegraph.pl game.folded > game.svg
+ * ```
+ *
+ * The profiler is opt-in: it is linked into the program only if
+ * #profile_init is called.
+ *
+ * @code{.c}
+ *      debug_init_usblog();
+ *      profile_init(1000, 4, 16384);
+ *      profile_start();
+ *      for (int i=0; i<600; i++)
+ *          game_frame();
+ *      profile_stop();
+ *      profile_flush(stderr);
+ *      profile_close();
+ * @endcode
+ *
+ * @{
+ */
+
+/** @brief Maximum number of call frames recorded per sample */
+#define PROFILE_MAX_DEPTH       16
+
+/** @brief Profiler statistics */
+typedef struct {
+    uint32_t num_samples;       ///< Samples recorded since the last flush
+    uint32_t num_lost;          ///< Samples overwritten because the buffer was full
+    uint32_t sample_ticks;      ///< CPU ticks spent recording samples
+} profile_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the profiler
+ *
+ * Allocate the sample buffer, and configure the sampling timer. Sampling does
+ * not begin until #profile_start is called. The timer subsystem is initialized
+ * if needed.
+ *
+ * Recording only the interrupted address (depth 1) is very cheap. Each
+ * further level of call stack requires walking the stack from within the
+ * interrupt, which is slower, so higher depths are better combined with
+ * lower sampling rates. Walking through the interrupt requires a symbol table
+ * lookup, which is much faster if the symbol table was loaded in RAM with
+ * #backtrace_symbols_cache_init.
+ *
+ * @param rate_hz       Number of samples per second
+ * @param depth         Number of call frames to record per sample, starting
+ *                      from the interrupted address (1 to #PROFILE_MAX_DEPTH)
+ * @param max_samples   Capacity of the sample buffer
+ */
+void profile_init(int rate_hz, int depth, int max_samples);
+
+/**
+ * @brief Stop the profiler and free the sample buffer
+ */
+void profile_close(void);
+
+/**
+ * @brief Start (or resume) sampling
+ */
+void profile_start(void);
+
+/**
+ * @brief Stop sampling
+ *
+ * The samples recorded so far are kept, and can be written with
+ * #profile_flush.
+ */
+void profile_stop(void);
+
+/**
+ * @brief Write the recorded samples and empty the buffer
+ *
+ * The samples are written as text, one per line, with the call frames as
+ * hexadecimal addresses from the innermost outwards:
+ *
+ * ```
+ *   PROF1 <rate_hz> <depth>
+ *   S <addr> [<caller> ...]
+ *   ...
+ *   PROFEND <num_samples> <num_lost>
+ * ```
+ *
+ * Identical consecutive samples are merged into a single line prefixed by
+ * their count (`S*<count> <addr> ...`). Since the markers identify the
+ * profile, it can be mixed with other output on the same channel.
+ *
+ * Sampling is paused while flushing, and the statistics are reset.
+ *
+ * @param out       File to write to (eg: stderr, or a file on the SD card)
+ */
+void profile_flush(FILE *out);
+
+/**
+ * @brief Get the profiler statistics
+ *
+ * @return Statistics since the last flush
+ */
+profile_stats_t profile_get_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */ /* profile */
+
+#endif
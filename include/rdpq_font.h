@@ -0,0 +1,196 @@
+/**
+ * @file rdpq_font.h
+ * @brief RDP Command queue: bitmap font rendering
+ * @ingroup rdpq
+ *
+ * This file contains a simple bitmap text renderer built on top of rdpq.
+ * It is the hardware-accelerated counterpart of #graphics_draw_text: glyphs
+ * are stored in an atlas (a grid of equally sized cells, indexed by character
+ * code) and drawn as textured rectangles.
+ *
+ * The atlas is split into "pages": horizontal bands of glyph rows that fit
+ * TMEM at once. When printing a string, all the glyphs that belong to the
+ * same page are drawn together after a single TMEM load, so a string costs
+ * one load per distinct page it touches (and only one for ASCII text with the
+ * builtin font), plus one TEXTURE_RECTANGLE per visible glyph. The page left
+ * in TMEM is remembered, so consecutive strings printed within the same
+ * #rdpq_font_begin / #rdpq_font_end block often need no load at all.
+ *
+ * Fonts can be created from the builtin 8x8 font (the same used by the
+ * graphics and console modules), or from a sprite converted with mksprite
+ * whose horizontal and vertical slices define the glyph grid, following the
+ * same convention as #graphics_set_font_sprite.
+ *
+ * @code{.c}
+ *      rdpq_font_t *font = rdpq_font_load_builtin();
+ *
+ *      rdpq_attach(disp, NULL);
+ *      rdpq_font_begin(font, RGBA32(0xFF, 0xFF, 0xFF, 0xFF));
+ *      rdpq_font_print(font, 16, 16, "Score: 1234");
+ *      rdpq_font_printf(font, 16, 28, "Lives: %d", lives);
+ *      rdpq_font_end();
+ *      rdpq_detach_show();
+ * @endcode
+ */
+
+#ifndef LIBDRAGON_RDPQ_FONT_H
+#define LIBDRAGON_RDPQ_FONT_H
+
+#include <stdint.h>
+#include "graphics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///@cond
+typedef struct sprite_s sprite_t;
+///@endcond
+
+/** @brief A bitmap font (opaque type) */
+typedef struct rdpq_font_s rdpq_font_t;
+
+/**
+ * @brief Statistics on the RDP work required to print a string
+ *
+ * These are returned by #rdpq_font_print, and can be used to measure the
+ * cost of on-screen text.
+ */
+typedef struct {
+    int num_loads;      ///< Number of atlas pages loaded into TMEM
+    int num_rects;      ///< Number of TEXTURE_RECTANGLE commands emitted
+    float width;        ///< Width in pixels of the longest line of text
+} rdpq_font_stats_t;
+
+/**
+ * @brief Create a font from the builtin 8x8 font
+ *
+ * The glyphs are converted into a #FMT_I4 atlas, which is split into two TMEM
+ * pages: characters 0-127, and characters 128-255.
+ *
+ * @return The new font, to be freed with #rdpq_font_free
+ */
+rdpq_font_t *rdpq_font_load_builtin(void);
+
+/**
+ * @brief Create a font from a sprite
+ *
+ * The sprite is treated as a grid of glyphs, whose size is defined by the
+ * number of horizontal and vertical slices of the sprite (see mksprite
+ * --tiles). Glyphs are indexed by character code, starting from the top-left
+ * cell, as done by #graphics_set_font_sprite.
+ *
+ * A full row of glyphs must fit TMEM. Glyphs whose pixels are all zero are
+ * treated as empty and never drawn, and the drawn area of the other glyphs
+ * is trimmed to their non-zero pixels (except for palettized sprites, where
+ * index 0 is not necessarily transparent).
+ *
+ * The sprite is referenced, not copied: it must stay valid until the font is
+ * freed.
+ *
+ * @param sprite        Sprite containing the glyph grid
+ * @return The new font, to be freed with #rdpq_font_free
+ */
+rdpq_font_t *rdpq_font_load_sprite(sprite_t *sprite);
+
+/**
+ * @brief Free a font
+ *
+ * @param font          Font to free
+ */
+void rdpq_font_free(rdpq_font_t *font);
+
+/**
+ * @brief Set the horizontal advance of a glyph
+ *
+ * By default, all glyphs advance by the width of a cell (fixed-width font).
+ * Setting a per-glyph advance allows to render proportional fonts.
+ *
+ * @param font          Font to configure
+ * @param ch            Character to configure
+ * @param advance       Horizontal distance in pixels between the origin of
+ *                      this glyph and the next one
+ */
+void rdpq_font_set_advance(rdpq_font_t *font, char ch, int advance);
+
+/**
+ * @brief Set the kerning of a pair of characters
+ *
+ * The kerning is added to the advance of the first character when it is
+ * immediately followed by the second one. Setting a kerning of 0 removes
+ * the pair.
+ *
+ * @param font          Font to configure
+ * @param ch1           First character of the pair
+ * @param ch2           Second character of the pair
+ * @param kerning       Adjustment in pixels (usually negative)
+ */
+void rdpq_font_set_kerning(rdpq_font_t *font, char ch1, char ch2, int kerning);
+
+/**
+ * @brief Begin drawing text with a font
+ *
+ * This function saves the current render mode (via #rdpq_mode_push) and
+ * configures a mode suitable for text: the glyphs are multiplied by the
+ * specified color (via the PRIM register) and transparent pixels are
+ * discarded with alpha compare. For palettized fonts, the palette is also
+ * loaded in TMEM.
+ *
+ * Between #rdpq_font_begin and #rdpq_font_end, TMEM and TILE0 belong to the
+ * font: do not load other textures, or the font will not know that the atlas
+ * page it loaded was overwritten.
+ *
+ * @param font          Font to use
+ * @param color         Color of the text
+ */
+void rdpq_font_begin(rdpq_font_t *font, color_t color);
+
+/**
+ * @brief Change the color of the text
+ *
+ * @param color         Color of the text
+ */
+void rdpq_font_set_color(color_t color);
+
+/**
+ * @brief Draw a string
+ *
+ * Draw a string with the specified font, which must be the one passed to
+ * #rdpq_font_begin. A newline character moves the pen to the beginning of
+ * the next line.
+ *
+ * @param font          Font to use
+ * @param x0            X coordinate of the top-left corner of the text
+ * @param y0            Y coordinate of the top-left corner of the text
+ * @param text          Null-terminated string to draw
+ * @return Statistics on the RDP commands required to draw the string
+ */
+rdpq_font_stats_t rdpq_font_print(rdpq_font_t *font, float x0, float y0, const char *text);
+
+/**
+ * @brief Draw a formatted string
+ *
+ * This is the printf-like version of #rdpq_font_print. The formatted text is
+ * truncated to 255 characters.
+ *
+ * @param font          Font to use
+ * @param x0            X coordinate of the top-left corner of the text
+ * @param y0            Y coordinate of the top-left corner of the text
+ * @param fmt           Format string
+ * @return Statistics on the RDP commands required to draw the string
+ */
+rdpq_font_stats_t rdpq_font_printf(rdpq_font_t *font, float x0, float y0, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/**
+ * @brief Finish drawing text
+ *
+ * Restore the render mode that was active before #rdpq_font_begin.
+ */
+void rdpq_font_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
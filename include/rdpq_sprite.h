@@ -46,6 +46,8 @@ typedef struct rdpq_blitparms_s rdpq_blitparms_t;
  * will assert if the sprite does not fit TMEM. For larger sprites, either
  * use #rdpq_sprite_blit to directly draw then (handling partial uploads transparently),
  * or use #rdpq_tex_upload_sub to manually upload a smaller portion of the sprite.
+ * Sprites pre-tiled by `mksprite --tiled` into multiple blocks can only be drawn
+ * with #rdpq_sprite_blit, as their pixels are not stored as a single surface.
  * 
  * To load multiple sprites in TMEM at once (for instance, for multitexturing),
  * you can manually specify the @p parms->tmem_addr for the second sprite, or
@@ -109,7 +111,9 @@ int rdpq_sprite_upload(rdpq_tile_t tile, sprite_t *sprite, const rdpq_texparms_t
  * 
  * Just like #rdpq_tex_blit, this function is designed to work with sprites of
  * arbitrary sizes; those that won't fit in TMEM will be automatically split
- * in multiple chunks to perform the requested operation.
+ * in multiple chunks to perform the requested operation. If the sprite was
+ * created with `mksprite --tiled`, the chunks are precomputed and stored
+ * in TMEM order, so that each of them is loaded with a single LOAD_BLOCK.
  * 
  * Please refer to #rdpq_tex_blit for a full overview of the features.
  * 
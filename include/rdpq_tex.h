@@ -79,6 +79,7 @@ typedef struct tex_loader_s {
 } tex_loader_t;
 tex_loader_t tex_loader_init(rdpq_tile_t tile, const surface_t *tex);
 int tex_loader_load(tex_loader_t *tload, int s0, int t0, int s1, int t1);
+void tex_loader_set_texparms(tex_loader_t *tload, const rdpq_texparms_t *parms);
 void tex_loader_set_tmem_addr(tex_loader_t *tload, int tmem_addr);
 int tex_loader_calc_max_height(tex_loader_t *tload, int width);
 ///@endcond
@@ -83,8 +83,25 @@ typedef struct sprite_detail_s
     float           blend_factor;
 } sprite_detail_t;
 
+/**
+ * @brief A named rectangle within an atlas sprite.
+ * 
+ * An atlas is a sprite built by packing multiple images together, using
+ * the mksprite tool with the `--atlas` argument. Each original image can be
+ * looked up by name (its filename without extension) via #sprite_get_atlas_rect.
+ */
+typedef struct sprite_atlas_rect_s
+{
+    const char *name;       ///< Name of the image (points into the sprite data)
+    int x;                  ///< X coordinate of the image within the sprite
+    int y;                  ///< Y coordinate of the image within the sprite
+    int width;              ///< Width of the image
+    int height;             ///< Height of the image
+} sprite_atlas_rect_t;
+
 #define SPRITE_FLAGS_TEXFORMAT      0x1F    ///< Pixel format of the sprite
 #define SPRITE_FLAGS_OWNEDBUFFER    0x20    ///< Flag specifying that the sprite buffer must be freed by sprite_free
+#define SPRITE_FLAGS_TILED          0x40    ///< Pixels are stored pre-tiled in TMEM-sized blocks (mksprite --tiled)
 #define SPRITE_FLAGS_EXT            0x80    ///< Sprite contains extended information (new format)
 
 
@@ -144,6 +161,14 @@ inline tex_format_t sprite_get_format(sprite_t *sprite) {
  * Notice that no memory allocations or copies are performed:
  * the returned surface will point to the sprite contents.
  * 
+ * Sprites created with `mksprite --tiled` that are too large to fit TMEM
+ * (#SPRITE_FLAGS_TILED) store their pixels split into multiple blocks, so
+ * they cannot be accessed as a single surface: this function will assert,
+ * and so will all the functions built on it (#sprite_get_lod_pixels,
+ * #sprite_get_tile, #rdpq_sprite_upload). Draw them with #rdpq_sprite_blit
+ * instead. For the same reason, mksprite refuses to combine `--tiled` with
+ * `--tiles` or `--atlas`.
+ * 
  * @param  sprite      The sprite
  * @return             The surface pointing to the sprite
  */
@@ -202,6 +227,10 @@ surface_t sprite_get_detail_pixels(sprite_t *sprite, sprite_detail_t *info, rdpq
  * This function allows to get a surface that points to the specific sub-tile,
  * so that it can accessed directly.
  * 
+ * Spritemaps cannot be pre-tiled (`mksprite --tiled`), as the pixels of
+ * a pre-tiled sprite larger than TMEM cannot be accessed as a surface
+ * (see #sprite_get_pixels).
+ * 
  * @param   sprite      The sprite used as spritemap
  * @param   h           Horizontal index of the tile to access
  * @param   v           Vertical index of the tile to access
@@ -268,6 +297,67 @@ int sprite_get_lod_count(sprite_t *sprite);
  */
 bool sprite_fits_tmem(sprite_t *sprite);
 
+/**
+ * @brief Return the number of named images packed in an atlas sprite
+ * 
+ * @param sprite        The sprite to access
+ * @return              The number of images, or 0 if the sprite is not an atlas
+ */
+int sprite_get_atlas_count(sprite_t *sprite);
+
+/**
+ * @brief Get the rectangle of an atlas image, by index
+ * 
+ * Images are sorted by name. This is mostly useful to enumerate the
+ * contents of an atlas.
+ * 
+ * @param sprite        The sprite to access
+ * @param idx           Index of the image (0 to #sprite_get_atlas_count - 1)
+ * @param rect          Output rectangle
+ */
+void sprite_get_atlas_rect_by_index(sprite_t *sprite, int idx, sprite_atlas_rect_t *rect);
+
+/**
+ * @brief Lookup the rectangle of an image packed in an atlas sprite
+ * 
+ * Atlas sprites are created by mksprite with `--atlas <name>`: all the
+ * input images are packed into a single sprite, and their rectangles are
+ * saved in the sprite itself, indexed by filename (without extension).
+ * 
+ * The rectangle can be used to draw the image via #rdpq_sprite_blit:
+ * 
+ * @code{.c}
+ *      sprite_atlas_rect_t r;
+ *      if (sprite_get_atlas_rect(ui, "button_ok", &r)) {
+ *          rdpq_sprite_blit(ui, x, y, &(rdpq_blitparms_t){
+ *              .s0 = r.x, .t0 = r.y, .width = r.width, .height = r.height,
+ *          });
+ *      }
+ * @endcode
+ * 
+ * The lookup is a binary search on the name, so it is cheap but not free:
+ * for images drawn every frame, prefer doing it once and caching the result.
+ * 
+ * @param sprite        The sprite to access
+ * @param name          Name of the image
+ * @param rect          Output rectangle (can be NULL to just check for existence)
+ * @return              true if the image was found, false otherwise
+ */
+bool sprite_get_atlas_rect(sprite_t *sprite, const char *name, sprite_atlas_rect_t *rect);
+
+/**
+ * @brief Return a surface_t pointing to an image packed in an atlas sprite
+ * 
+ * This is similar to #sprite_get_tile, but for atlas sprites. The returned
+ * surface points to the sprite data, so no memory is allocated.
+ * 
+ * @param sprite        The sprite to access
+ * @param name          Name of the image
+ * @return              A surface pointing to the image, or a zero-initialized
+ *                      surface if the image was not found.
+ */
+surface_t sprite_get_atlas_pixels(sprite_t *sprite, const char *name);
+
 
 #ifdef __cplusplus
 }
@@ -47,6 +47,25 @@
  * Surfaces created by #surface_make_sub don't need to be freed as they
  * are just references to the parent surface; #surface_free does nothing
  * on them.
+ *
+ * Code that allocates and frees the same kind of surfaces over and over (for
+ * instance, offscreen render targets that only live for a frame) can use a
+ * surface pool instead, to recycle the buffers and avoid fragmenting the heap:
+ *
+ * @code{.c}
+ *      surface_pool_t *pool = surface_pool_new(60);
+ *
+ *      while (1) {
+ *          // Get a temporary render target, released at the end of the frame
+ *          surface_t blur = surface_pool_alloc_frame(pool, FMT_RGBA16, 160, 120);
+ *          rdpq_attach(&blur, NULL);
+ *          [...]
+ *          rdpq_detach_wait();
+ *
+ *          // Recycle all the frame-scoped surfaces
+ *          surface_pool_end_frame(pool);
+ *      }
+ * @endcode
  */
 
 #ifndef __LIBDRAGON_SURFACE_H
@@ -246,6 +265,120 @@ surface_t surface_make_sub(surface_t *parent,
  */
 void surface_free(surface_t *surface);
 
+/** @brief A pool of recyclable surface buffers (opaque type) */
+typedef struct surface_pool_s surface_pool_t;
+
+/** @brief Memory statistics of a surface pool */
+typedef struct {
+    int num_buffers;            ///< Number of buffers owned by the pool
+    int num_in_use;             ///< Number of buffers currently allocated to surfaces
+    size_t bytes;               ///< Memory owned by the pool, in bytes
+    size_t bytes_in_use;        ///< Memory currently allocated to surfaces, in bytes
+    size_t peak_bytes;          ///< High-water mark of bytes
+    size_t peak_bytes_in_use;   ///< High-water mark of bytes_in_use
+    int num_allocs;             ///< Number of surfaces allocated from the pool
+    int num_reuses;             ///< Number of allocations that recycled an existing buffer
+} surface_pool_stats_t;
+
+/**
+ * @brief Create a surface pool
+ *
+ * A surface pool keeps the buffers of the surfaces that are released, and
+ * hands them out again when a surface with the same format, width, height and
+ * stride is allocated, instead of going through the heap.
+ *
+ * @param[in]  max_idle_frames  Buffers not used for more than this number of
+ *                              frames (see #surface_pool_end_frame) are given
+ *                              back to the heap. Use 0 to keep them until
+ *                              #surface_pool_trim is called.
+ * @return                      The new pool
+ */
+surface_pool_t *surface_pool_new(int max_idle_frames);
+
+/**
+ * @brief Free a surface pool and all its buffers
+ *
+ * All the surfaces allocated from the pool become invalid.
+ *
+ * @param[in]  pool     The pool to free
+ */
+void surface_pool_free(surface_pool_t *pool);
+
+/**
+ * @brief Allocate a surface from a pool
+ *
+ * This works like #surface_alloc, so the surface can be used as a RDP frame
+ * buffer, but the buffer is recycled from the pool if possible. The stride of
+ * the surface is rounded up to 8 bytes, so that every row can be loaded in
+ * TMEM.
+ *
+ * The surface must be given back with #surface_pool_release, not freed with
+ * #surface_free.
+ *
+ * @param[in]  pool     The pool
+ * @param[in]  format   Pixel format of the surface
+ * @param[in]  width    Width in pixels
+ * @param[in]  height   Height in pixels
+ * @return              The initialized surface
+ */
+surface_t surface_pool_alloc(surface_pool_t *pool, tex_format_t format, uint16_t width, uint16_t height);
+
+/**
+ * @brief Allocate a surface from a pool, for the current frame only
+ *
+ * This is like #surface_pool_alloc, but the surface is automatically released
+ * by the next call to #surface_pool_end_frame.
+ *
+ * @param[in]  pool     The pool
+ * @param[in]  format   Pixel format of the surface
+ * @param[in]  width    Width in pixels
+ * @param[in]  height   Height in pixels
+ * @return              The initialized surface
+ */
+surface_t surface_pool_alloc_frame(surface_pool_t *pool, tex_format_t format, uint16_t width, uint16_t height);
+
+/**
+ * @brief Give a surface back to its pool
+ *
+ * The buffer of the surface is kept by the pool, ready to be recycled by the
+ * next allocation of the same kind. The surface structure is cleared.
+ *
+ * Make sure that the RDP has finished using the surface before releasing it,
+ * as the buffer might be immediately reused.
+ *
+ * @param[in]  pool     The pool the surface was allocated from
+ * @param[in]  surface  The surface to release
+ */
+void surface_pool_release(surface_pool_t *pool, surface_t *surface);
+
+/**
+ * @brief Mark the end of a frame
+ *
+ * Release all the surfaces allocated with #surface_pool_alloc_frame, and give
+ * back to the heap the buffers that have been idle for too long.
+ *
+ * Like for #surface_pool_release, make sure that the RDP has finished using
+ * the frame-scoped surfaces before calling this function.
+ *
+ * @param[in]  pool     The pool
+ */
+void surface_pool_end_frame(surface_pool_t *pool);
+
+/**
+ * @brief Give all the idle buffers of a pool back to the heap
+ *
+ * @param[in]  pool     The pool
+ */
+void surface_pool_trim(surface_pool_t *pool);
+
+/**
+ * @brief Get the memory statistics of a pool
+ *
+ * @param[in]  pool     The pool
+ * @param[out] stats    Statistics
+ */
+void surface_pool_get_stats(surface_pool_t *pool, surface_pool_stats_t *stats);
+
 /**
  * @brief Returns the pixel format of a surface
  * 
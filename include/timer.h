@@ -48,7 +48,7 @@ typedef void (*timer_callback2_t)(int ovfl, void *ctx);
  */
 typedef struct timer_link
 {
-    /** @brief Absolute ticks value at which the timer expires. */
+    /** @brief Absolute ticks value at which the timer expires (low 32 bits). */
     uint32_t left;
     /** @brief Ticks to set if continuous */
     uint32_t set;
@@ -63,8 +63,10 @@ typedef struct timer_link
     };
     /** @brief Callback context parameter */
     void *ctx;
-    /** @brief Link to next timer */
-    struct timer_link *next;
+    /** @brief Absolute ticks value at which the timer expires (64-bit, internal) */
+    uint64_t deadline;
+    /** @brief Position in the queue of pending timers (-1 if not queued) */
+    int index;
 } timer_link_t;
 
 /** @brief Timer should fire only once */
@@ -199,6 +201,10 @@ timer_link_t *new_timer_context(int ticks, int flags, timer_callback2_t callback
  * If you need to associate some data with the timer, consider using
  * #start_timer_context to include a pointer in the callback.
  *
+ * @note The timer queue only grows when this is called outside of timer
+ *       callbacks. Starting a timer from a callback asserts if the queue is
+ *       full, so prefer #new_timer for timers that are started from callbacks.
+ *
  * @param[in] timer
  *            Pointer to timer structure to reinsert and start
  * @param[in] ticks
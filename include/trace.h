@@ -0,0 +1,180 @@
+/**
+ * @file trace.h
+ * @brief Binary event tracing
+ * @ingroup trace
+ */
+#ifndef __LIBDRAGON_TRACE_H
+#define __LIBDRAGON_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "pputils.h"
+
+/**
+ * @defgroup trace Binary event tracing
+ * @ingroup lowlevel
+ * @brief Low-overhead logging of events into a RAM ring buffer
+ *
+ * Logging with #debugf formats the message immediately and pushes it through
+ * the debug channels, which is very slow (the ISViewer and USB channels
+ * transfer the text while the caller waits). Logging from a hot loop or an
+ * interrupt handler thus distorts the timing of the code being observed.
+ *
+ * Event tracing instead records a fixed-size binary record for each event:
+ * a timestamp (see #TICKS_READ), a pointer to the format string that
+ * identifies the event, and up to #TRACE_MAX_ARGS 32-bit arguments. No
+ * formatting happens while recording. Records are stored in a ring buffer
+ * preallocated by #trace_init, and recording is lock-free so that it can
+ * be done from any context, including interrupt handlers.
+ *
+ * The records are written out later with #trace_flush, which the program
+ * should call when it has idle time (for instance, at the end of each frame,
+ * while waiting for vblank). Flushing can be done in small steps, and does
+ * not stop the recording. The output is a compact text stream, so it can go
+ * to stderr (and thus to the USB and ISViewer debug channels, see #debug_init)
+ * mixed with other log output, or to a file on the SD card. The format strings
+ * are not formatted on the N64: each one is written only once, the first time
+ * it is flushed, to build a string table that the n64trace tool uses to
+ * format the messages on the PC:
+ *
+ * ```
+ *   $ n64trace trace.txt
+ *   [    1.204511] frame 42 start
+ *   [    1.204730] dma done: 0x10101000 (4096 bytes)
+ * ```
+ *
+ * @code{.c}
+ *      trace_init(4096);
+ *      while (1) {
+ *          trace_event("frame %d start", frame);
+ *          game_frame();
+ *          trace_flush(stderr, 64);
+ *      }
+ * @endcode
+ *
+ * Arguments are converted to 32-bit integers. Floating point values must be
+ * wrapped with #trace_float, and strings cannot be used as arguments (their
+ * pointer would be logged).
+ *
+ * @{
+ */
+
+/** @brief Maximum number of arguments of an event */
+#define TRACE_MAX_ARGS      4
+
+/** @brief Tracing statistics */
+typedef struct {
+    uint32_t num_events;        ///< Events recorded since #trace_init
+    uint32_t num_lost;          ///< Events dropped because the buffer was full
+    uint32_t num_pending;       ///< Events recorded but not flushed yet
+} trace_stats_t;
+
+/**
+ * @brief Record an event
+ *
+ * The event is identified by its format string, which uses the printf syntax
+ * and must be a string literal. It is formatted by the n64trace tool with
+ * the event arguments (up to #TRACE_MAX_ARGS). Each argument is converted to
+ * a 32-bit integer; use #trace_float for floating point values.
+ *
+ * If tracing is not initialized, the event is ignored. If the buffer is full,
+ * the event is dropped and counted as lost.
+ *
+ * This macro can be used in any context, including interrupt handlers.
+ *
+ * @param fmt       Format string (string literal)
+ * @param ...       Arguments
+ */
+#define trace_event(fmt, ...) ({ \
+    _Static_assert(__COUNT_VARARGS(__VA_ARGS__) <= TRACE_MAX_ARGS, "too many arguments to trace_event"); \
+    uint32_t __trace_args[TRACE_MAX_ARGS] = { __CALL_FOREACH(__TRACE_ARG, ##__VA_ARGS__) }; \
+    __trace_event("" fmt "", __COUNT_VARARGS(__VA_ARGS__), __trace_args); \
+})
+
+/// @cond
+#define __TRACE_ARG(x)      (uint32_t)(x),
+/// @endcond
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @cond
+void __trace_event(const char *fmt, int nargs, const uint32_t *args);
+/// @endcond
+
+/**
+ * @brief Convert a floating point value into an argument for #trace_event
+ *
+ * The value is stored as the bit pattern of a single precision float, which
+ * is decoded by n64trace when formatted with %f, %e or %g.
+ */
+static inline uint32_t trace_float(float value)
+{
+    union { float f; uint32_t u; } cvt = { .f = value };
+    return cvt.u;
+}
+
+/**
+ * @brief Initialize event tracing
+ *
+ * Allocate the ring buffer. Each record takes 32 bytes.
+ *
+ * @param max_events    Capacity of the ring buffer, in number of events (it
+ *                      is rounded up to the next power of two)
+ */
+void trace_init(int max_events);
+
+/**
+ * @brief Stop tracing and free the ring buffer
+ *
+ * Events not flushed yet are discarded.
+ */
+void trace_close(void);
+
+/**
+ * @brief Write out the recorded events
+ *
+ * Write the oldest events that were not flushed yet, up to the specified
+ * number, and remove them from the buffer. The output is made of text
+ * lines between markers, so it can be mixed with other output on the
+ * same channel:
+ *
+ * ```
+ *   TRACE1 <ticks_per_second>
+ *   F <id> <format string>
+ *   E <ticks> <id> [<arg> ...]
+ *   ...
+ *   TRACEEND <num_events> <num_lost>
+ * ```
+ *
+ * Format strings (F lines) are written only the first time an event using
+ * them is flushed, so the whole output must be kept to decode it. Ticks and
+ * arguments are written in hexadecimal.
+ *
+ * This function must not be called from an interrupt handler. Events can be
+ * recorded while flushing; an event that is still being recorded by an
+ * interrupted context is left for the next flush.
+ *
+ * @param out           File to write to (eg: stderr, or a file on the SD card)
+ * @param max_events    Maximum number of events to write, or 0 to write
+ *                      all pending events
+ * @return              Number of events written
+ */
+int trace_flush(FILE *out, int max_events);
+
+/**
+ * @brief Get the tracing statistics
+ *
+ * @return Statistics since #trace_init
+ */
+trace_stats_t trace_get_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */ /* trace */
+
+#endif
@@ -12,6 +12,7 @@
     #define USE_OSRAW          0           // Use if you're doing USB operations without the PI Manager (libultra only)
     #define DEBUG_ADDRESS_SIZE 8*1024*1024 // Max size of USB I/O. The bigger this value, the more ROM you lose!
     #define CHECK_EMULATOR     0           // Stops the USB library from working if it detects an emulator to prevent problems
+    #define USB_BULK_MAXSIZE   (DEBUG_ADDRESS_SIZE/2) // Max size of a bulk packet. Two packets use the debug area in turn
     
     // Cart definitions
     #define CART_NONE      0
@@ -137,4 +138,85 @@
 
     extern void usb_sendheartbeat(void);
 
+
+    /*==============================
+        usb_write_bulk
+        Writes data to the USB, sending it directly from
+        the given buffer when possible and without waiting
+        for the transfer to finish. Packets bigger than
+        USB_BULK_MAXSIZE are sent with usb_write.
+        Will not write if there is data to read from USB
+        @param The DATATYPE that is being sent
+        @param A buffer with the data to send
+        @param The size of the data being sent
+    ==============================*/
+
+    extern void usb_write_bulk(int datatype, const void* data, int size);
+
+
+    /*==============================
+        usb_stream_begin
+        Starts sending a packet of known size through USB.
+        The data is then given with usb_stream_write,
+        in pieces of any size, and the packet is sent
+        with usb_stream_end
+        Will not start if there is data to read from USB
+        @param The DATATYPE that is being sent
+        @param The size of the whole packet, at most USB_BULK_MAXSIZE
+        @return 1 if the stream was started, 0 if not
+    ==============================*/
+
+    extern char usb_stream_begin(int datatype, int size);
+
+
+    /*==============================
+        usb_stream_write
+        Sends the next piece of the packet started
+        with usb_stream_begin. Data which is 8 byte
+        aligned in RDRAM is sent with DMA directly
+        from the given buffer, the rest is copied to
+        the global buffer first
+        @param A buffer with the data to send
+        @param The size of the data being sent
+    ==============================*/
+
+    extern void usb_stream_write(const void* data, int size);
+
+
+    /*==============================
+        usb_stream_end
+        Finishes the packet started with usb_stream_begin
+        and starts sending it through USB. Missing data
+        is sent as zeroes.
+        On the 64Drive and SC64, this returns without
+        waiting for the USB transfer to finish, so the
+        next packet can be prepared in the meantime
+    ==============================*/
+
+    extern void usb_stream_end(void);
+
+
+    /*==============================
+        usb_bulk_flush
+        Spins until the USB transfer started by
+        usb_stream_end or usb_write_bulk has finished
+    ==============================*/
+
+    extern void usb_bulk_flush(void);
+
+
+    /*==============================
+        usb_bulk_getstats
+        Returns the throughput achieved by bulk transfers
+        since the last call, and resets the statistics.
+        The transfer in progress is finished first, and
+        time is counted until then, so call this (or
+        usb_bulk_flush) right after a batch of transfers
+        @param Pointer to store the number of bytes sent, or NULL
+        @param Pointer to store the time spent sending them in microseconds, or NULL
+        @return The throughput in MB/s (millions of bytes per second)
+    ==============================*/
+
+    extern float usb_bulk_getstats(unsigned long* bytes, unsigned long* microseconds);
+
 #endif
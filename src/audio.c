@@ -75,6 +75,8 @@ static volatile int now_empty = 0;
 static volatile int now_writing = 0;
 /** @brief Bitmask of buffers indicating which buffers are full */
 static volatile int buf_full = 0;
+/** @brief Number of times the AI ran out of buffers to play */
+static volatile uint32_t underruns = 0;
 
 /** @brief Structure used to interact with the AI registers */
 static volatile struct AI_regs_s * const AI_regs = (struct AI_regs_s *)0xa4500000;
@@ -126,6 +128,10 @@ static void audio_callback()
     /* Check how many queued buffers were consumed, and update buf_full flags
        accordingly, to make them available for further writes. */
     uint32_t status = AI_regs->status;
+    /* If the AI is idle while there were buffers queued, it means that it has
+       played all of them and there was nothing else to play. */
+    if (playing_queue > 0 && !(status & AI_STATUS_BUSY))
+        underruns++;
     if (playing_queue > 1 && !(status & AI_STATUS_FULL)) {
         playing_queue--;
         now_empty = (now_empty + 1) % _num_buf;
@@ -257,6 +263,7 @@ void audio_init(const int frequency, int numbuffers)
     now_empty = 0;
     now_writing = 0;
     buf_full = 0;
+    underruns = 0;
     _paused = false;
 }
 
@@ -481,3 +488,8 @@ int audio_get_buffer_length()
 {
     return _buf_size;
 }
+
+uint32_t audio_get_underruns(void)
+{
+    return underruns;
+}
@@ -16,9 +16,24 @@
 #define V(f)  ((f) * AY8910_VOLUME_ATTENUATE)
 #endif
 
-static const float VOL_TABLE[16] = { V(0.0), V(0.002300939285824675), V(0.005554958830034992), V(0.010156837401684337), V(0.01666487649010497), V(0.02586863363340366), V(0.03888471181024493), V(0.05729222609684229), V(0.08332438245052481), V(0.12013941102371954), V(0.17220372373108456), V(0.24583378087747398), V(0.3499624062922039), V(0.4972225205849827), V(0.7054797714144425), V(1.0) };
+#define VOLUMES(V)  V(0.0), V(0.002300939285824675), V(0.005554958830034992), V(0.010156837401684337), V(0.01666487649010497), V(0.02586863363340366), V(0.03888471181024493), V(0.05729222609684229), V(0.08332438245052481), V(0.12013941102371954), V(0.17220372373108456), V(0.24583378087747398), V(0.3499624062922039), V(0.4972225205849827), V(0.7054797714144425), V(1.0)
+
+#if !AY8910_FIXED_POINT
+static const float VOL_TABLE[16] = { VOLUMES(V) };
+#else
+// Number of fractional bits used by the fixed-point generator.
+#define FX_BITS  8
+
+// Fixed-point volume table. Each entry is the contribution of a single channel
+// to the final 16-bit sample (that is, a third of the full range), so that
+// mixing the three channels requires just additions.
+#define VFX(f)  ((int32_t)(V(f) * (65535.0 / 3.0 * (1<<FX_BITS)) + 0.5))
+static const int32_t VOL_TABLE_FX[16] = { VOLUMES(VFX) };
+#undef VFX
+#endif
 
 #undef V
+#undef VOLUMES
 
 #define SAMPLE_CONV(f)   ((f) * 65535.0f - 32768.0f)
 
@@ -142,9 +157,39 @@ static uint32_t fastrand() {
 	return state = x;
 }
 
+#if !AY8910_FIXED_POINT
 static float fastrandf() {
 	return fastrand() * 2.3283064365386963e-10f;
 }
+#endif
+
+#if AY8910_FIXED_POINT
+// Fixed-point arithmetic. Samples carry FX_BITS fractional bits, and the random
+// values used for the fastnoise are 15-bit fractions.
+typedef int32_t sample_t;
+#define VOL(v)               VOL_TABLE_FX[v]
+// Offset to convert to signed 16-bit samples, including the rounding bias.
+#define MIX_OFFSET           ((32768 << FX_BITS) - (1 << (FX_BITS-1)))
+#define MIX_MONO(a,b,c)      ((a)+(b)+(c) - MIX_OFFSET)
+#define MIX_STEREO(a,b)      (2*(a)+(b) - MIX_OFFSET)
+#define AMP_MONO(a,b,c)      ((a)+(b)+(c))
+#define AMP_STEREO(a,b)      (2*(a)+(b))
+#define RANDF()              (fastrand() >> 17)
+#define NOISE(fn, fr)        ((int32_t)((((uint32_t)(fn) >> FX_BITS) * (fr)) >> (15-FX_BITS)))
+#define DECIM(s)             ((s) / AY8910_DECIMATE)
+#define SAMPLE(s)            ((s) >> FX_BITS)
+#else
+typedef float sample_t;
+#define VOL(v)               VOL_TABLE[v]
+#define MIX_MONO(a,b,c)      SAMPLE_CONV(((a)+(b)+(c)) * (1.f / 3.f))
+#define MIX_STEREO(a,b)      SAMPLE_CONV(((a)+(b)*0.5f) * (2.f / 3.f))
+#define AMP_MONO(a,b,c)      (((a)+(b)+(c)) * (1.f / 3.f) * 65535.f)
+#define AMP_STEREO(a,b)      (((a)+(b)*0.5f) * (2.f / 3.f) * 65535.f)
+#define RANDF()              fastrandf()
+#define NOISE(fn, fr)        ((fn)*(fr))
+#define DECIM(s)             ((s) * (1.f / AY8910_DECIMATE))
+#define SAMPLE(s)            (s)
+#endif
 
 // Optimized implementation, much faster.
 // This implementation is more complex compared to the reference once. It
@@ -156,10 +201,10 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 
 	int16_t *iout = out;
 	#if AY8910_OUTPUT_STEREO
-	float sample_accum_l = 0;
-	float sample_accum_r = 0;
+	sample_t sample_accum_l = 0;
+	sample_t sample_accum_r = 0;
 	#else
-	float sample_accum = 0;
+	sample_t sample_accum = 0;
 	#endif
 	int sample_accum_n = 0;
 	AYChannel *ch0 = &ay->ch[0];
@@ -171,9 +216,9 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 	int envelope = ((ch0->tone_vol == 0x10) || (ch1->tone_vol == 0x10) || (ch2->tone_vol == 0x10));
 	if (env->holding) envelope = 0;
 
-	float vol0 = VOL_TABLE[(ch0->tone_vol == 0x10) ? env->vol : ch0->tone_vol];
-	float vol1 = VOL_TABLE[(ch1->tone_vol == 0x10) ? env->vol : ch1->tone_vol];
-	float vol2 = VOL_TABLE[(ch2->tone_vol == 0x10) ? env->vol : ch2->tone_vol];
+	sample_t vol0 = VOL((ch0->tone_vol == 0x10) ? env->vol : ch0->tone_vol);
+	sample_t vol1 = VOL((ch1->tone_vol == 0x10) ? env->vol : ch1->tone_vol);
+	sample_t vol2 = VOL((ch2->tone_vol == 0x10) ? env->vol : ch2->tone_vol);
 
 	// If the period just changed, the counter might have overflown. Just cap next
 	// event to the period.
@@ -231,8 +276,14 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 
 	// If the chip is completely silent, just early exit
 	if (!noise && ch0->tone_en && ch1->tone_en && ch2->tone_en) {
-		for (int i=0; i<nsamples/AY8910_DECIMATE; i++)
-			OUTS(VOL_TABLE[0]);
+		sample_t silence = SAMPLE(MIX_MONO(VOL(0), VOL(0), VOL(0)));
+		for (int i=0; i<nsamples/AY8910_DECIMATE; i++) {
+			#if AY8910_OUTPUT_STEREO
+			OUT(silence, silence);
+			#else
+			OUT(silence);
+			#endif
+		}
 		return nsamples/AY8910_DECIMATE;
 	}
 
@@ -247,40 +298,40 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 	#endif
 
 	int changech = 0x7; // recalc the output of all channels once
-	float s0=0, s1=0, s2=0;
-	float fn0=0, fn1=0, fn2=0;
+	sample_t s0=0, s1=0, s2=0;
+	sample_t fn0=0, fn1=0, fn2=0;
 
 	while (nsamples > 0) {
 		if (changech & (1<<0)) {
 			if (fastnoise & (1<<0)) {
 				uint8_t gate = (ch0->out | ch0->tone_en) & 1;
-				s0 = !gate ? vol0 : VOL_TABLE[0];
-				fn0 = !gate ? (vol0-VOL_TABLE[0]) : 0;
+				s0 = !gate ? vol0 : VOL(0);
+				fn0 = !gate ? (vol0-VOL(0)) : 0;
 			} else {
 				uint8_t gate = (ch0->out | ch0->tone_en) & (ns->out | ch0->noise_en) & 1;
-				s0 = !gate ? vol0 : VOL_TABLE[0];
+				s0 = !gate ? vol0 : VOL(0);
 				fn0 = 0;
 			}
 		}
 		if (changech & (1<<1)) {
 			if (fastnoise & (1<<1)) {
 				uint8_t gate = (ch1->out | ch1->tone_en) & 1;
-				s1 = !gate ? vol1 : VOL_TABLE[0];
-				fn1 = !gate ? (vol1-VOL_TABLE[0]) : 0;
+				s1 = !gate ? vol1 : VOL(0);
+				fn1 = !gate ? (vol1-VOL(0)) : 0;
 			} else {
 				uint8_t gate = (ch1->out | ch1->tone_en) & (ns->out | ch1->noise_en) & 1;
-				s1 = !gate ? vol1 : VOL_TABLE[0];
+				s1 = !gate ? vol1 : VOL(0);
 				fn1 = 0;
 			}
 		}
 		if (changech & (1<<2)) {
 			if (fastnoise & (1<<2)) {
 				uint8_t gate = (ch2->out | ch2->tone_en) & 1;
-				s2 = !gate ? vol2 : VOL_TABLE[0];
-				fn2 = !gate ? (vol2-VOL_TABLE[0]) : 0;
+				s2 = !gate ? vol2 : VOL(0);
+				fn2 = !gate ? (vol2-VOL(0)) : 0;
 			} else {
 				uint8_t gate = (ch2->out | ch2->tone_en) & (ns->out | ch2->noise_en) & 1;
-				s2 = !gate ? vol2 : VOL_TABLE[0];
+				s2 = !gate ? vol2 : VOL(0);
 				fn2 = 0;
 			}
 		}
@@ -314,10 +365,10 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 
 			// Output the current sample value until the next state change.
 			#if AY8910_OUTPUT_STEREO
-			float samplel = SAMPLE_CONV((s0+s1*0.5f) * (2.f / 3.f));
-			float sampler = SAMPLE_CONV((s2+s1*0.5f) * (2.f / 3.f));
+			sample_t samplel = MIX_STEREO(s0, s1);
+			sample_t sampler = MIX_STEREO(s2, s1);
 			#else
-			float sample = SAMPLE_CONV((s0+s1+s2) * (1.f / 3.f));
+			sample_t sample = MIX_MONO(s0, s1, s2);
 			#endif
 
 			#if 0
@@ -328,32 +379,32 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 				// Calculate the fast-noise amplitude (if any). A random amplitude
 				// in the range [0..fn] must be subtracted from sample to apply the noise.
 				#if AY8910_OUTPUT_STEREO
-				float fnl = (fn0+fn1*0.5f) * (2.f / 3.f) * 65535.f;
-				float fnr = (fn2+fn1*0.5f) * (2.f / 3.f) * 65535.f;
+				sample_t fnl = AMP_STEREO(fn0, fn1);
+				sample_t fnr = AMP_STEREO(fn2, fn1);
 				#else
-				float fn = (fn0+fn1+fn2) * (1.f / 3.f) * 65535.f;
+				sample_t fn = AMP_MONO(fn0, fn1, fn2);
 				#endif
 
 				if (sample_accum_n) {
-					float fr = fastrandf();
+					sample_t fr = RANDF();
 					int sa = AY8910_DECIMATE-sample_accum_n;
 					if (sa > next) {
 						#if AY8910_OUTPUT_STEREO
-						sample_accum_l += (samplel - fnl*fr) * next;
-						sample_accum_r += (sampler - fnr*fr) * next;
+						sample_accum_l += (samplel - NOISE(fnl, fr)) * (int)next;
+						sample_accum_r += (sampler - NOISE(fnr, fr)) * (int)next;
 						#else
-						sample_accum += (sample - fn*fr) * next;
+						sample_accum += (sample - NOISE(fn, fr)) * (int)next;
 						#endif
 						sample_accum_n += next;
 						goto end_decim;
 					} else {					
 						#if AY8910_OUTPUT_STEREO
-						sample_accum_l += (samplel - fnl*fr) * sa;
-						sample_accum_r += (sampler - fnr*fr) * sa;
-						OUT(sample_accum_l * (1.f / AY8910_DECIMATE), sample_accum_r * (1.f / AY8910_DECIMATE));
+						sample_accum_l += (samplel - NOISE(fnl, fr)) * sa;
+						sample_accum_r += (sampler - NOISE(fnr, fr)) * sa;
+						OUT(SAMPLE(DECIM(sample_accum_l)), SAMPLE(DECIM(sample_accum_r)));
 						#else
-						sample_accum += (sample - fn*fr) * sa;
-						OUT(sample_accum * (1.f / AY8910_DECIMATE));
+						sample_accum += (sample - NOISE(fn, fr)) * sa;
+						OUT(SAMPLE(DECIM(sample_accum)));
 						#endif
 						next -= sa;
 						sample_accum_n = 0;
@@ -363,40 +414,40 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 				int nn = next / AY8910_DECIMATE;
 				if (fastnoise) {
 					for (int i=0; i<nn; i++) {
-						float fr = fastrandf();
+						sample_t fr = RANDF();
 						#if AY8910_OUTPUT_STEREO
-						OUT(samplel - fnl*fr, sampler - fnr*fr);
+						OUT(SAMPLE(samplel - NOISE(fnl, fr)), SAMPLE(sampler - NOISE(fnr, fr)));
 						#else
-						OUT(sample - fn*fr);
+						OUT(SAMPLE(sample - NOISE(fn, fr)));
 						#endif
 					}
 				} else {
 					for (int i=0; i<nn; i++) {
 						#if AY8910_OUTPUT_STEREO
-						OUT(samplel, sampler);
+						OUT(SAMPLE(samplel), SAMPLE(sampler));
 						#else
-						OUT(sample);
+						OUT(SAMPLE(sample));
 						#endif
 					}
 				}
 
 				next -= nn*AY8910_DECIMATE;
 				sample_accum_n = next;
-				float fr = fastrandf();
+				sample_t fr = RANDF();
 				#if AY8910_OUTPUT_STEREO
-				sample_accum_l = (samplel - fnl*fr) * next;
-				sample_accum_r = (sampler - fnr*fr) * next;
+				sample_accum_l = (samplel - NOISE(fnl, fr)) * (int)next;
+				sample_accum_r = (sampler - NOISE(fnr, fr)) * (int)next;
 				#else
-				sample_accum = (sample - fn*fr) * next;
+				sample_accum = (sample - NOISE(fn, fr)) * (int)next;
 				#endif
 				end_decim: (void)0;
 
 			} else {
 				for (int i=0; i<next; i++) {
 					#if AY8910_OUTPUT_STEREO
-					OUT(samplel, sampler);
+					OUT(SAMPLE(samplel), SAMPLE(sampler));
 					#else
-					OUT(sample);
+					OUT(SAMPLE(sample));
 					#endif
 				}
 			}
@@ -447,7 +498,7 @@ int ay8910_gen(AY8910 *ay, int16_t *out, int nsamples) {
 				ne = 0xFFFFFFFF;
 			}
 
-			float v = VOL_TABLE[env->vol];
+			sample_t v = VOL(env->vol);
 			if (ch0->tone_vol == 0x10) { vol0 = v; changech |= (1<<0); }
 			if (ch1->tone_vol == 0x10) { vol1 = v; changech |= (1<<1); }
 			if (ch2->tone_vol == 0x10) { vol2 = v; changech |= (1<<2); }
@@ -9,6 +9,9 @@
 #include "xm_internal.h"
 #include <stdio.h>
 #include <assert.h>
+#if XM_STREAM_PATTERNS
+#include "dma.h"
+#endif
 
 
 int xm_create_context(xm_context_t** ctxp, const char* moddata, uint32_t rate) {
@@ -470,7 +473,9 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 	uint32_t alloc_bytes = ctx_size;
 	#if XM_STREAM_PATTERNS
 	alloc_bytes -= ctx_size_all_patterns;
-	alloc_bytes += ctx_size_stream_pattern_buf;
+	// Two slot buffers (double buffering), each with slack for ROM alignment
+	// and cacheline alignment of both ends.
+	alloc_bytes += 2 * (ctx_size_stream_pattern_buf + XM_STREAM_PATTERN_SLACK + 32);
 	#endif
 	#if XM_STREAM_WAVEFORMS
 	alloc_bytes -= ctx_size_all_samples;
@@ -666,10 +671,22 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 		return 1;
 	}
 #else
+	// Allocate two slot buffers: one for the pattern being played, and one
+	// where the next pattern is prefetched. They are target of asynchronous
+	// DMA, so both ends must be cacheline-aligned.
+	uint32_t slot_buffer_size = (ctx->ctx_size_stream_pattern_buf + XM_STREAM_PATTERN_SLACK + 15) & ~15;
+	xm_pattern_slot_t *slot_buffers[2];
+	for (int i=0;i<2;i++) {
+		if ((size_t)mempool & 15) mempool += 16 - ((size_t)mempool & 15);
+		slot_buffers[i] = (xm_pattern_slot_t*)mempool;
+		mempool += slot_buffer_size;
+	}
 	ctx->slot_buffer_index = -1;
-	ctx->slot_buffer = (xm_pattern_slot_t*)mempool;
-	mempool += ctx->ctx_size_stream_pattern_buf;
-	if ((size_t)mempool & 7) mempool += 8 - ((size_t)mempool & 7);
+	ctx->slot_buffer = slot_buffers[0];
+	ctx->slot_buffer_next_index = -1;
+	ctx->slot_buffer_next = slot_buffers[1];
+	ctx->slot_buffer_next_cmp = NULL;
+	ctx->stream_rom_addr = 0;
 #endif
 
 	ctx->rate = rate;
@@ -728,6 +745,10 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 }
 
 void xm_free_context(xm_context_t* context) {
+#if XM_STREAM_PATTERNS
+	/* A pattern prefetch might still be writing into the context */
+	if(context->slot_buffer_next_cmp) dma_wait();
+#endif
 	free(context);
 }
 
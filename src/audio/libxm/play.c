@@ -10,6 +10,10 @@
 #include "xm_internal.h"
 #include <inttypes.h>
 #include <assert.h>
+#if XM_STREAM_PATTERNS
+#include "n64sys.h"
+#include "dma.h"
+#endif
 
 /* ----- Static functions ----- */
 
@@ -43,6 +47,13 @@ static void xm_key_off(xm_channel_context_t*);
 static void xm_post_pattern_change(xm_context_t*);
 static void xm_row(xm_context_t*);
 
+#if XM_STREAM_PATTERNS
+static uint8_t* xm_pattern_cmp_data(xm_context_t*, xm_pattern_slot_t*, xm_pattern_t*, uint32_t);
+static void xm_pattern_load(xm_context_t*, xm_pattern_slot_t*, xm_pattern_t*);
+static void xm_pattern_prefetch(xm_context_t*);
+static void xm_pattern_prefetch_finish(xm_context_t*);
+#endif
+
 static float xm_sample_at(xm_sample_t*, size_t);
 static float xm_next_of_sample(xm_channel_context_t*);
 static void xm_sample(xm_context_t*, float*, float*);
@@ -77,6 +88,103 @@ static const float multi_retrig_multiply[] = {
 	1.f,   1.f,  1.5f,       2.f   /* C, D, E, F */
 };
 
+#if XM_FIXED_POINT
+/* -sin(2*pi*step/64), in 1.15 fixed point */
+static const int16_t xm_sine_table[64] = {
+	     0,  -3212,  -6393,  -9512, -12539, -15446, -18204, -20787,
+	-23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+	-32767, -32609, -32137, -31356, -30273, -28898, -27245, -25329,
+	-23170, -20787, -18204, -15446, -12539,  -9512,  -6393,  -3212,
+	     0,   3212,   6393,   9512,  12539,  15446,  18204,  20787,
+	 23170,  25329,  27245,  28898,  30273,  31356,  32137,  32609,
+	 32767,  32609,  32137,  31356,  30273,  28898,  27245,  25329,
+	 23170,  20787,  18204,  15446,  12539,   9512,   6393,   3212,
+};
+
+/* 2^(i/12), in 2.30 fixed point */
+static const uint32_t xm_exp2_semitone[12] = {
+	1073741824, 1137589835, 1205234447, 1276901417,
+	1352829926, 1433273380, 1518500250, 1608794974,
+	1704458901, 1805811301, 1913190429, 2026954652,
+};
+
+/* 2^(i/768), in 2.30 fixed point (1/64th of semitone steps) */
+static const uint32_t xm_exp2_finetune[64] = {
+	1073741824, 1074711351, 1075681754, 1076653033,
+	1077625190, 1078598223, 1079572136, 1080546928,
+	1081522600, 1082499153, 1083476588, 1084454905,
+	1085434106, 1086414191, 1087395161, 1088377016,
+	1089359758, 1090343388, 1091327906, 1092313312,
+	1093299609, 1094286796, 1095274874, 1096263845,
+	1097253708, 1098244466, 1099236118, 1100228665,
+	1101222108, 1102216449, 1103211687, 1104207825,
+	1105204861, 1106202798, 1107201636, 1108201375,
+	1109202018, 1110203564, 1111206014, 1112209370,
+	1113213631, 1114218799, 1115224875, 1116231859,
+	1117239753, 1118248556, 1119258271, 1120268897,
+	1121280436, 1122292888, 1123306254, 1124320536,
+	1125335733, 1126351846, 1127368878, 1128386827,
+	1129405696, 1130425485, 1131446194, 1132467826,
+	1133490379, 1134513856, 1135538257, 1136563583,
+};
+
+/* sqrt(i/256), in 1.15 fixed point. Used for the panning law. */
+static const uint16_t xm_sqrt_table[257] = {
+	    0,  2048,  2896,  3547,  4096,  4579,  5016,  5418,
+	 5792,  6144,  6476,  6792,  7094,  7384,  7663,  7932,
+	 8192,  8444,  8689,  8927,  9159,  9385,  9606,  9822,
+	10033, 10240, 10442, 10641, 10837, 11028, 11217, 11402,
+	11585, 11765, 11941, 12116, 12288, 12457, 12624, 12789,
+	12952, 13113, 13272, 13429, 13584, 13738, 13890, 14040,
+	14189, 14336, 14481, 14625, 14768, 14909, 15049, 15188,
+	15325, 15462, 15597, 15731, 15863, 15995, 16125, 16255,
+	16384, 16511, 16638, 16763, 16888, 17011, 17134, 17256,
+	17377, 17498, 17617, 17736, 17854, 17971, 18087, 18202,
+	18317, 18431, 18545, 18658, 18770, 18881, 18992, 19102,
+	19211, 19320, 19428, 19536, 19643, 19750, 19855, 19961,
+	20066, 20170, 20274, 20377, 20479, 20582, 20683, 20784,
+	20885, 20985, 21085, 21184, 21283, 21381, 21479, 21576,
+	21673, 21770, 21866, 21962, 22057, 22152, 22246, 22340,
+	22434, 22527, 22620, 22713, 22805, 22897, 22988, 23079,
+	23170, 23260, 23350, 23440, 23529, 23618, 23707, 23795,
+	23883, 23970, 24058, 24145, 24232, 24318, 24404, 24490,
+	24575, 24660, 24745, 24830, 24914, 24998, 25082, 25165,
+	25249, 25332, 25414, 25497, 25579, 25661, 25742, 25824,
+	25905, 25985, 26066, 26146, 26226, 26306, 26386, 26465,
+	26544, 26623, 26702, 26780, 26858, 26936, 27014, 27092,
+	27169, 27246, 27323, 27400, 27476, 27552, 27628, 27704,
+	27780, 27855, 27930, 28005, 28080, 28154, 28229, 28303,
+	28377, 28451, 28524, 28598, 28671, 28744, 28817, 28890,
+	28962, 29035, 29107, 29179, 29250, 29322, 29393, 29465,
+	29536, 29607, 29677, 29748, 29818, 29889, 29959, 30029,
+	30098, 30168, 30237, 30307, 30376, 30445, 30514, 30582,
+	30651, 30719, 30787, 30855, 30923, 30991, 31059, 31126,
+	31193, 31260, 31327, 31394, 31461, 31528, 31594, 31660,
+	31727, 31793, 31858, 31924, 31990, 32055, 32121, 32186,
+	32251, 32316, 32381, 32445, 32510, 32574, 32639, 32703,
+	32767,
+};
+
+static float xm_pan_sqrt(float x) {
+	int32_t fx = (int32_t)(x * 65536.f);
+	if(fx <= 0) return .0f;
+	if(fx >= 65536) return 1.f;
+
+	/* The curve is too steep near 0 for interpolation: there,
+	 * sqrt(fx/65536) = sqrt(fx/256)/16 is an exact table entry. */
+	if(fx < 256) return (float)xm_sqrt_table[fx] * (1.f / (32767.f * 16.f));
+
+	/* Linear interpolation between table entries, 8 bits of fraction */
+	int32_t idx = fx >> 8, frac = fx & 0xFF;
+	int32_t v = xm_sqrt_table[idx];
+	v += ((xm_sqrt_table[idx+1] - v) * frac) >> 8;
+	return (float)v * (1.f / 32767.f);
+}
+#define XM_PAN_SQRT(x) xm_pan_sqrt(x)
+#else
+#define XM_PAN_SQRT(x) sqrt(x)
+#endif
+
 #define XM_CLAMP_UP1F(vol, limit) do {			\
 		if((vol) > (limit)) (vol) = (limit);	\
 	} while(0)
@@ -127,7 +235,11 @@ static float xm_waveform(xm_waveform_type_t waveform, uint8_t step) {
 	case XM_SINE_WAVEFORM:
 		/* Why not use a table? For saving space, and because there's
 		 * very very little actual performance gain. */
+#if XM_FIXED_POINT
+		return (float)xm_sine_table[step] * (1.f / 32767.f);
+#else
 		return -sinf(2.f * 3.141592f * (float)step / (float)0x40);
+#endif
 
 	case XM_RAMP_DOWN_WAVEFORM:
 		/* Ramp down: 1.0f when step = 0; -1.0f when step = 0x40 */
@@ -301,12 +413,102 @@ static void xm_post_pattern_change(xm_context_t* ctx) {
 	}
 }
 
+#if XM_STREAM_PATTERNS
+static uint8_t* xm_pattern_cmp_data(xm_context_t* ctx, xm_pattern_slot_t* buf, xm_pattern_t* pat, uint32_t rom_addr) {
+	/* Read the compressed data at the end of the pattern buffer, that is
+	 * at the end of the buffer where data will be uncompressed. The chosen
+	 * RLE compression guarantees that this is safe. Use the slack space
+	 * to keep the same alignment of the data in ROM, so that DMA is fast. */
+	int dec_size = sizeof(xm_pattern_slot_t) * pat->num_rows * ctx->module.num_channels;
+	uint8_t *cmp_data = (uint8_t*)buf + dec_size + XM_STREAM_PATTERN_SLACK - pat->slots_size;
+	return cmp_data - (((uint32_t)cmp_data - rom_addr) & 7);
+}
+
+static void xm_pattern_decompress(xm_context_t* ctx, xm_pattern_slot_t* buf, xm_pattern_t* pat, uint8_t* cmp_data) {
+	int dec_size = sizeof(xm_pattern_slot_t) * pat->num_rows * ctx->module.num_channels;
+	int sz = xm_context_decompress_pattern(cmp_data, pat->slots_size, buf);
+	assert(sz == dec_size); (void)sz; (void)dec_size;
+}
+
+static void xm_pattern_load(xm_context_t* ctx, xm_pattern_slot_t* buf, xm_pattern_t* pat) {
+	/* Synchronous load, used when the pattern was not prefetched (eg: after
+	 * a position jump, or if the module is not in ROM). */
+	uint8_t *cmp_data = xm_pattern_cmp_data(ctx, buf, pat, 0);
+	fseek(ctx->fh, pat->slots_offset, SEEK_SET);
+	fread(cmp_data, pat->slots_size, 1, ctx->fh);
+	xm_pattern_decompress(ctx, buf, pat, cmp_data);
+}
+
+static void xm_pattern_prefetch_finish(xm_context_t* ctx) {
+	/* Wait for the prefetch DMA (if still in flight) and decompress */
+	if(ctx->slot_buffer_next_cmp == NULL) return;
+	dma_wait();
+	xm_pattern_decompress(ctx, ctx->slot_buffer_next,
+		ctx->module.patterns + ctx->slot_buffer_next_index,
+		ctx->slot_buffer_next_cmp);
+	ctx->slot_buffer_next_cmp = NULL;
+}
+
+static void xm_pattern_prefetch(xm_context_t* ctx) {
+	if(!ctx->stream_rom_addr) return;
+
+	/* A prefetch is in progress: decompress it as soon as the DMA is done,
+	 * so that the cost is spread over a different row than the DMA. */
+	if(ctx->slot_buffer_next_cmp) {
+		if(!dma_busy()) xm_pattern_prefetch_finish(ctx);
+		return;
+	}
+
+	/* Find the next pattern in the order table (ignoring jumps, which we
+	 * cannot predict) */
+	int next_table_index = ctx->current_table_index + 1;
+	if(next_table_index >= ctx->module.length) {
+		next_table_index = ctx->module.restart_position;
+	}
+	int next_idx = ctx->module.pattern_table[next_table_index];
+	if(next_idx == ctx->slot_buffer_index || next_idx == ctx->slot_buffer_next_index) return;
+
+	xm_pattern_t* pat = ctx->module.patterns + next_idx;
+	uint32_t rom_addr = ((ctx->stream_rom_addr + pat->slots_offset) | 0x10000000) & 0x1FFFFFFF;
+	uint8_t *cmp_data = xm_pattern_cmp_data(ctx, ctx->slot_buffer_next, pat, rom_addr);
+
+	ctx->slot_buffer_next_index = next_idx;
+	ctx->slot_buffer_next_cmp = cmp_data;
+	data_cache_hit_writeback_invalidate(cmp_data, pat->slots_size);
+	dma_read_async(cmp_data, rom_addr, pat->slots_size);
+}
+#endif
+
 static float xm_linear_period(float note) {
 	return 7680.f - note * 64.f;
 }
 
 static float xm_linear_frequency(float period) {
+#if XM_FIXED_POINT
+	/* Exponent in units of 1/(768*256) octave. Split it into octave,
+	 * semitone and 1/64th of semitone for the table lookups, and apply
+	 * the remaining 8 bits of fraction as a first-order correction
+	 * (2^(x/196608) ~= 1 + x*ln(2)/196608, 3786 is that in 2.30). */
+	int32_t x = (int32_t)((4608.f - period) * 256.f);
+	int32_t octave = x / (768*256);
+	int32_t frac = x - octave * (768*256);
+	if(frac < 0) {
+		frac += 768*256;
+		octave--;
+	}
+
+	uint32_t idx = frac >> 8;
+	uint64_t mant = ((uint64_t)xm_exp2_semitone[idx >> 6] * xm_exp2_finetune[idx & 63]) >> 30;
+	mant += (mant * (frac & 0xFF) * 3786) >> 30;
+
+	/* 8363 * mant in 16.16 fixed point */
+	uint64_t freq = 8363 * mant;
+	int shift = 14 - octave;
+	freq = (shift >= 0) ? (freq >> shift) : (freq << -shift);
+	return (float)freq * (1.f / 65536.f);
+#else
 	return 8363.f * powf(2.f, (4608.f - period) / 768.f);
+#endif
 }
 
 static float xm_amiga_period(float note) {
@@ -879,21 +1081,20 @@ static void xm_row(xm_context_t* ctx) {
 
 #if XM_STREAM_PATTERNS
 	if (ctx->slot_buffer_index != pat_idx) {
-		// Read the compressed data at the end of the pattern buffer, that is
-		// at the end of the buffer where data will be uncompressed. The chosen
-		// RLE compression guarantees that this is safe.
-		int cmp_size = cur->slots_size;
-		int dec_size = sizeof(xm_pattern_slot_t) * cur->num_rows * ctx->module.num_channels;
-		uint8_t *cmp_data = (uint8_t*)ctx->slot_buffer + dec_size - cmp_size;
-
-		fseek(ctx->fh, cur->slots_offset, SEEK_SET);
-		fread(cmp_data, cmp_size, 1, ctx->fh);
-
-		int sz = xm_context_decompress_pattern(cmp_data, cmp_size, ctx->slot_buffer);
-		assert(sz == dec_size);
-
+		if (ctx->slot_buffer_next_index == pat_idx) {
+			// The pattern was prefetched: just swap the buffers. The old
+			// one stays valid, in case the order table goes back to it.
+			xm_pattern_prefetch_finish(ctx);
+			xm_pattern_slot_t *buf = ctx->slot_buffer;
+			ctx->slot_buffer = ctx->slot_buffer_next;
+			ctx->slot_buffer_next = buf;
+			ctx->slot_buffer_next_index = ctx->slot_buffer_index;
+		} else {
+			xm_pattern_load(ctx, ctx->slot_buffer, cur);
+		}
 		ctx->slot_buffer_index = pat_idx;
 	}
+	xm_pattern_prefetch(ctx);
 #endif
 
 	/* Read notes… */
@@ -1253,11 +1454,11 @@ void xm_tick(xm_context_t* ctx) {
 #if XM_RAMPING
 		/* See https://modarchive.org/forums/index.php?topic=3517.0
 		 * and https://github.com/Artefact2/libxm/pull/16 */
-		ch->target_volume[0] = volume * sqrt(1.f - panning);
-		ch->target_volume[1] = volume * sqrt(panning);
+		ch->target_volume[0] = volume * XM_PAN_SQRT(1.f - panning);
+		ch->target_volume[1] = volume * XM_PAN_SQRT(panning);
 #else
-		ch->actual_volume[0] = volume * sqrt(1.f - panning);
-		ch->actual_volume[1] = volume * sqrt(panning);
+		ch->actual_volume[0] = volume * XM_PAN_SQRT(1.f - panning);
+		ch->actual_volume[1] = volume * XM_PAN_SQRT(panning);
 #endif
 	}
 
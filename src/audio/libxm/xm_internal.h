@@ -16,6 +16,12 @@
 // this amount of bytes. See also rspxm.S for details.
 #define XM_WAVEFORM_OVERREAD      64
 
+// When streaming patterns, compressed pattern data is loaded at the end of
+// the slot buffer. This is the extra space at the end of each slot buffer,
+// used to place it with the same alignment of the data in ROM (so that DMA
+// is fast).
+#define XM_STREAM_PATTERN_SLACK   16
+
 #if XM_STREAM_WAVEFORMS
 typedef struct waveform_s waveform_t;
 #endif
@@ -332,6 +338,13 @@ struct xm_context_s {
 #if XM_STREAM_PATTERNS
 	xm_pattern_slot_t *slot_buffer;
 	int slot_buffer_index;
+
+	/* Double-buffering: while a pattern is played from slot_buffer, the
+	 * next one in the order table is prefetched into slot_buffer_next. */
+	xm_pattern_slot_t *slot_buffer_next;
+	int slot_buffer_next_index;
+	uint8_t *slot_buffer_next_cmp; /* Compressed data being DMA'd, or NULL if done */
+	uint32_t stream_rom_addr; /* ROM address of the XM64 file (0 = not in ROM, no prefetch) */
 #endif
 };
 
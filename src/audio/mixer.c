@@ -167,10 +167,11 @@ static struct {
 
 	rsp_mixer_settings_t ucode_settings __attribute__((aligned(16)));
 
-} Mixer;
+	mixer_stats_t stats;
+	int stats_ch;              ///< Channel being refilled (-1 if none)
+	uint32_t stats_underruns;  ///< Underrun count at the last stats reset
 
-/** @brief Count of ticks spent in mixer RSP, used for debugging purposes. */
-int64_t __mixer_profile_rsp = 0;
+} Mixer;
 
 uint32_t __mixer_overlay_id;
 
@@ -184,6 +185,8 @@ void mixer_init(int num_channels) {
 	Mixer.sample_rate = audio_get_frequency();  // actual sample rate obtained via DAC clock
 	assertf(Mixer.sample_rate > 0, "audio_init() must be called before mixer_init()");
 	Mixer.vol = 1.0f;
+	Mixer.stats_ch = -1;
+	Mixer.stats_underruns = audio_get_underruns();
 
 	for (int ch=0;ch<MIXER_MAX_CHANNELS;ch++) {
 		mixer_ch_set_vol(ch, 1.0f, 1.0f);
@@ -319,6 +322,8 @@ static int waveform_wrap_wpos(int wpos, int len, int loop_len) {
 // in the range [0, len].
 static void waveform_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking) {
 	waveform_t *wave = (waveform_t*)ctx;
+	int widx = sbuf->widx;
+	uint32_t t0 = TICKS_READ();
 
 	if (!wave->loop_len) {
 		// No loop defined: just call the waveform's read function.
@@ -368,6 +373,42 @@ static void waveform_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, b
 			len2 -= ns;
 		}
 	}
+
+	if (Mixer.stats_ch >= 0) {
+		uint32_t dt = TICKS_READ() - t0;
+		mixer_ch_stats_t *st = &Mixer.stats.ch[Mixer.stats_ch];
+		st->samples += sbuf->widx - widx;
+		st->reads++;
+		st->read_ticks += dt;
+		Mixer.stats.read_ticks += dt;
+	}
+}
+
+void __mixer_stats_dma(int bytes, uint32_t ticks) {
+	Mixer.stats.dma_bytes += bytes;
+	Mixer.stats.dma_ticks += ticks;
+	if (Mixer.stats_ch >= 0) {
+		mixer_ch_stats_t *st = &Mixer.stats.ch[Mixer.stats_ch];
+		st->dma_bytes += bytes;
+		st->dma_ticks += ticks;
+	}
+}
+
+void mixer_get_stats(mixer_stats_t *stats) {
+	*stats = Mixer.stats;
+	stats->underruns = audio_get_underruns() - Mixer.stats_underruns;
+
+	// Whatever is not DMA within a waveform read is considered decoding.
+	stats->decode_ticks = stats->read_ticks - stats->dma_ticks;
+	for (int i=0; i<MIXER_MAX_CHANNELS; i++) {
+		mixer_ch_stats_t *st = &stats->ch[i];
+		st->decode_ticks = st->read_ticks - st->dma_ticks;
+	}
+}
+
+void mixer_reset_stats(void) {
+	memset(&Mixer.stats, 0, sizeof(Mixer.stats));
+	Mixer.stats_underruns = audio_get_underruns();
 }
 
 void mixer_ch_play(int ch, waveform_t *wave) {
@@ -578,7 +619,9 @@ static void mixer_exec(int32_t *out, int num_samples) {
 				fake_loop |= 1<<i;
 			}
 
+			Mixer.stats_ch = i;
 			void* ptr = samplebuffer_get(sbuf, wpos, &wlen);
+			Mixer.stats_ch = -1;
 			assert(ptr);
 			ch->ptr = (uint8_t*)ptr - (wpos<<bps);
 		}
@@ -677,7 +720,7 @@ static void mixer_exec(int32_t *out, int num_samples) {
 
 	rspq_highpri_sync();
 
-	__mixer_profile_rsp += TICKS_READ() - t0;
+	Mixer.stats.rsp_ticks += TICKS_READ() - t0;
 
 	for (int i=0;i<Mixer.num_channels;i++) {
 		mixer_channel_t *ch = &Mixer.channels[i];
@@ -724,6 +767,10 @@ void mixer_poll(int16_t *out16, int num_samples) {
 	// otherwise buffering might become complicated / impossible.
 	assert(num_samples % 2 == 0);
 
+	uint32_t t0 = TICKS_READ();
+	Mixer.stats.frames++;
+	Mixer.stats.samples += num_samples;
+
 	while (num_samples > 0) {
 		mixer_event_t *e = mixer_next_event();
 
@@ -734,11 +781,18 @@ void mixer_poll(int16_t *out16, int num_samples) {
 			num_samples -= ns;
 		}
 		if (e && Mixer.ticks == e->ticks) {
+			uint32_t te = TICKS_READ();
 			int64_t repeat = e->cb(e->ctx);
+			Mixer.stats.event_ticks += TICKS_READ() - te;
 			if (repeat)
 				e->ticks += repeat;
 			else
 				mixer_remove_event(e->cb, e->ctx);
 		}
 	}
+
+	uint32_t dt = TICKS_READ() - t0;
+	Mixer.stats.poll_ticks += dt;
+	if (dt > Mixer.stats.poll_max_ticks)
+		Mixer.stats.poll_max_ticks = dt;
 }
@@ -6,4 +6,12 @@
 /** @brief RSPQ overlay ID assigned to the mixer ucode */
 extern uint32_t __mixer_overlay_id;
 
+/** @brief Account a PI DMA transfer performed by a waveform read callback.
+ *
+ * This is used by waveform implementations to report DMA usage in the
+ * mixer statistics (see #mixer_get_stats). If called during a channel
+ * refill, the transfer is also attributed to that channel.
+ */
+void __mixer_stats_dma(int bytes, uint32_t ticks);
+
 #endif
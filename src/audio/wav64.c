@@ -31,9 +31,6 @@
 /** ID of a WAVX file (big-endian WAV) */
 #define WAV_RIFX_ID   "RIFX"
 
-/** @brief Profile of DMA usage by WAV64, used for debugging purposes. */
-int64_t __wav64_profile_dma = 0;
-
 #if VADPCM_REFERENCE_DECODER
 /** @brief VADPCM decoding errors */
 typedef enum {
@@ -157,8 +154,9 @@ void raw_waveform_read(samplebuffer_t *sbuf, int base_rom_addr, int wpos, int wl
 	// also for misaligned addresses and odd lengths.
 	// The mixer/samplebuffer guarantees that ROM/RAM addresses are always
 	// on the same 2-byte phase, as the only requirement of dma_read.
-	dma_read(ram_addr, rom_addr, bytes);
-	__wav64_profile_dma += TICKS_READ() - t0;
+	// Audio refills have the highest priority in the DMA queue (if active).
+	dma_read_prio(ram_addr, rom_addr, bytes, DMA_PRIO_AUDIO);
+	__mixer_stats_dma(bytes, TICKS_READ() - t0);
 }
 
 static void waveform_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking) {
@@ -207,7 +205,9 @@ static void waveform_vadpcm_read(void *ctx, samplebuffer_t *sbuf, int wpos, int
 		void *src = (void*)dest + ((nframes*16) << SAMPLES_BPS_SHIFT(sbuf)) - src_bytes;
 
 		// Fetch compressed data
-		dma_read(src, vhead->current_rom_addr, src_bytes);
+		uint32_t t0 = TICKS_READ();
+		dma_read_prio(src, vhead->current_rom_addr, src_bytes, DMA_PRIO_AUDIO);
+		__mixer_stats_dma(src_bytes, TICKS_READ() - t0);
 		vhead->current_rom_addr += src_bytes;
 
 		#if VADPCM_REFERENCE_DECODER
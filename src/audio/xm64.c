@@ -129,6 +129,9 @@ void xm64player_open(xm64player_t *player, const char *fn) {
 	assertf(strncmp(fn, "rom:/", 5) == 0, "xm64player only supports files in ROM (rom:/)");
 	uint32_t base_rom_addr = dfs_rom_addr(fn+5);
 
+	// Allow libxm to prefetch patterns via asynchronous DMA
+	player->ctx->stream_rom_addr = base_rom_addr;
+
 	// Count samples
 	int ninst = xm_get_number_of_instruments(player->ctx);
 	for (int i=0;i<ninst;i++)
@@ -54,11 +54,20 @@
  * To see more details on how the symbol table is structured in the ROM, see
  * #symtable_header_t and the source code of the n64sym tool.
  * 
+ * Querying the ROM is fine for a crash screen, but each probe of the binary
+ * search is a PI access, so symbolizing many addresses (eg: for a profiler or an
+ * allocation tracker) is slow. #backtrace_symbols_cache_init can be used to copy
+ * the symbol table into RAM within a memory budget: the tables are loaded in
+ * order of importance (address table, symbol table, string table), and the
+ * remaining budget is used as a direct-mapped cache of fixed-size blocks of
+ * the SYMT file, which serves the tables that did not fit.
+ * 
  */
 #include <stdint.h>
 #include <stdalign.h>
 #include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
 #include "backtrace.h"
 #include "backtrace_internal.h"
 #include "debug.h"
@@ -78,6 +87,9 @@
  */
 #define FUNCTION_ALIGNMENT      32
 
+/** @brief Size of a block in the symbol table block cache (see #backtrace_symbols_cache_init) */
+#define SYMT_CACHE_BLOCK_SIZE   64
+
 /** 
  * @brief Symbol table file header
  * 
@@ -156,6 +168,18 @@ static uint32_t SYMT_ROM = 0xFFFFFFFF;
 /** @brief Placeholder used in frames where symbols are not available */
 static const char *UNKNOWN_SYMBOL = "???";
 
+/** @brief Symbol table cached in RAM (see #backtrace_symbols_cache_init) */
+static struct {
+    symtable_header_t header;       ///< Copy of the SYMT header
+    void *mem;                      ///< Single allocation holding all the cached data (NULL if disabled)
+    addrtable_entry_t *addrtab;     ///< Address table (NULL if not loaded)
+    symtable_entry_t *symtab;       ///< Symbol table (NULL if not loaded)
+    char *strtab;                   ///< String table (NULL if not loaded)
+    uint8_t *blocks;                ///< Block cache for the tables that were not loaded
+    uint32_t *block_tags;           ///< Index+1 of the block cached in each slot (0 = empty)
+    int num_blocks;                 ///< Number of slots in the block cache
+} symt_cache;
+
 /** @brief Check if addr is a valid PC address */
 static bool is_valid_address(uint32_t addr)
 {
@@ -170,6 +194,9 @@ static bool is_valid_address(uint32_t addr)
  * If not found, return a null header.
  */
 static symtable_header_t symt_open(void) {
+    if (symt_cache.mem)
+        return symt_cache.header;
+
     if (SYMT_ROM == 0xFFFFFFFF) {
         SYMT_ROM = rompak_search_ext(".sym");
         if (!SYMT_ROM)
@@ -198,6 +225,38 @@ static symtable_header_t symt_open(void) {
     return symt_header;
 }
 
+/**
+ * @brief Read a range of the SYMT file through the block cache
+ * 
+ * @param dst       Destination buffer
+ * @param off       Offset within the SYMT file
+ * @param len       Number of bytes to read
+ */
+static void symt_cache_read(void *dst, uint32_t off, int len)
+{
+    uint8_t *out = dst;
+    while (len > 0) {
+        uint32_t block = off / SYMT_CACHE_BLOCK_SIZE;
+        int slot = block % symt_cache.num_blocks;
+        uint8_t *data = symt_cache.blocks + slot * SYMT_CACHE_BLOCK_SIZE;
+        int boff = off % SYMT_CACHE_BLOCK_SIZE;
+        int n = MIN(len, SYMT_CACHE_BLOCK_SIZE - boff);
+
+        // Symbolization can happen within an exception handler, so make sure
+        // that refilling a slot is not interrupted halfway.
+        disable_interrupts();
+        if (symt_cache.block_tags[slot] != block + 1) {
+            data_cache_hit_writeback_invalidate(data, SYMT_CACHE_BLOCK_SIZE);
+            dma_read(data, SYMT_ROM + block * SYMT_CACHE_BLOCK_SIZE, SYMT_CACHE_BLOCK_SIZE);
+            symt_cache.block_tags[slot] = block + 1;
+        }
+        memcpy(out, data + boff, n);
+        enable_interrupts();
+
+        out += n; off += n; len -= n;
+    }
+}
+
 /**
  * @brief Return an entry in the address table by index
  * 
@@ -208,6 +267,13 @@ static symtable_header_t symt_open(void) {
 static addrtable_entry_t symt_addrtab_entry(symtable_header_t *symt, int idx)
 {
     assert(idx >= 0 && idx < symt->addrtab_size);
+    if (symt_cache.addrtab)
+        return symt_cache.addrtab[idx];
+    if (symt_cache.num_blocks) {
+        addrtable_entry_t entry;
+        symt_cache_read(&entry, symt->addrtab_off + idx * 4, 4);
+        return entry;
+    }
     return io_read(SYMT_ROM + symt->addrtab_off + idx * 4);
 }
 
@@ -257,6 +323,16 @@ static addrtable_entry_t symt_addrtab_search(symtable_header_t *symt, uint32_t a
  */
 static char* symt_string(symtable_header_t *symt, int sidx, int slen, char *buf, int size)
 {
+    if (symt_cache.strtab || symt_cache.num_blocks) {
+        int n = MIN(slen, size);
+        if (symt_cache.strtab)
+            memcpy(buf, symt_cache.strtab + sidx, n);
+        else
+            symt_cache_read(buf, symt->strtab_off + sidx, n);
+        buf[n] = 0;
+        return buf;
+    }
+
     // Align 2-byte phase of the RAM buffer with the ROM address. This is required
     // for dma_read.
     int tweak = (sidx ^ (uint32_t)buf) & 1;
@@ -278,6 +354,14 @@ static char* symt_string(symtable_header_t *symt, int sidx, int slen, char *buf,
  */
 static void symt_entry_fetch(symtable_header_t *symt, symtable_entry_t *entry, int idx)
 {
+    if (symt_cache.symtab) {
+        *entry = symt_cache.symtab[idx];
+        return;
+    }
+    if (symt_cache.num_blocks) {
+        symt_cache_read(entry, symt->symtab_off + idx * sizeof(symtable_entry_t), sizeof(symtable_entry_t));
+        return;
+    }
     data_cache_hit_writeback_invalidate(entry, sizeof(symtable_entry_t));
     dma_read(entry, SYMT_ROM + symt->symtab_off + idx * sizeof(symtable_entry_t), sizeof(symtable_entry_t));
 }
@@ -323,6 +407,85 @@ char* __symbolize(void *vaddr, char *buf, int size)
     return buf;
 }
 
+int backtrace_symbols_cache_init(int max_bytes)
+{
+    assertf(!symt_cache.mem, "symbol table cache already initialized");
+    assertf(max_bytes >= 0, "invalid memory budget: %d", max_bytes);
+
+    symtable_header_t symt = symt_open();
+    if (!symt.head[0])
+        return 0;
+
+    // Decide what to load, in order of importance. Every part is rounded to
+    // 16 bytes so that DMA transfers never share a cacheline with other data.
+    int addrtab_size = ROUND_UP(symt.addrtab_size * sizeof(addrtable_entry_t), 16);
+    int symtab_size = ROUND_UP(symt.symtab_size * sizeof(symtable_entry_t), 16);
+    int strtab_size = ROUND_UP(symt.strtab_size, 16);
+    int budget = max_bytes, uncached = 0;
+
+    bool load_addrtab = addrtab_size <= budget;
+    if (load_addrtab) budget -= addrtab_size; else uncached += addrtab_size;
+    bool load_symtab = symtab_size <= budget;
+    if (load_symtab) budget -= symtab_size; else uncached += symtab_size;
+    bool load_strtab = strtab_size <= budget;
+    if (load_strtab) budget -= strtab_size; else uncached += strtab_size;
+
+    // Use the rest of the budget as block cache, but not more than needed
+    // to hold everything that was not loaded. Keep 12 bytes aside for the
+    // padding of the tags array.
+    int num_blocks = MAX(budget - 12, 0) / (int)(SYMT_CACHE_BLOCK_SIZE + sizeof(uint32_t));
+    num_blocks = MIN(num_blocks, uncached / SYMT_CACHE_BLOCK_SIZE + 1);
+    if (!uncached) num_blocks = 0;
+
+    int size = (load_addrtab ? addrtab_size : 0) + (load_symtab ? symtab_size : 0) +
+        (load_strtab ? strtab_size : 0) + num_blocks * SYMT_CACHE_BLOCK_SIZE +
+        ROUND_UP(num_blocks * sizeof(uint32_t), 16);
+    if (size == 0)
+        return 0;
+
+    uint8_t *mem = memalign(16, size);
+    assertf(mem, "out of memory for the symbol table cache (%d bytes)", size);
+    data_cache_hit_writeback_invalidate(mem, size);
+
+    uint8_t *ptr = mem;
+    if (load_addrtab) {
+        dma_read(ptr, SYMT_ROM + symt.addrtab_off, symt.addrtab_size * sizeof(addrtable_entry_t));
+        symt_cache.addrtab = (addrtable_entry_t*)ptr;
+        ptr += addrtab_size;
+    }
+    if (load_symtab) {
+        dma_read(ptr, SYMT_ROM + symt.symtab_off, symt.symtab_size * sizeof(symtable_entry_t));
+        symt_cache.symtab = (symtable_entry_t*)ptr;
+        ptr += symtab_size;
+    }
+    if (load_strtab) {
+        dma_read(ptr, SYMT_ROM + symt.strtab_off, symt.strtab_size);
+        symt_cache.strtab = (char*)ptr;
+        ptr += strtab_size;
+    }
+    if (num_blocks) {
+        symt_cache.blocks = ptr;
+        ptr += num_blocks * SYMT_CACHE_BLOCK_SIZE;
+        symt_cache.block_tags = (uint32_t*)ptr;
+        memset(symt_cache.block_tags, 0, num_blocks * sizeof(uint32_t));
+        symt_cache.num_blocks = num_blocks;
+    }
+
+    // Enable the cache only now that it is complete
+    symt_cache.header = symt;
+    symt_cache.mem = mem;
+    return size;
+}
+
+void backtrace_symbols_cache_close(void)
+{
+    void *mem = symt_cache.mem;
+    disable_interrupts();
+    memset(&symt_cache, 0, sizeof(symt_cache));
+    enable_interrupts();
+    free(mem);
+}
+
 /**
  * @brief Analyze a function to find out its stack frame layout and properties (useful for backtracing).
  * 
@@ -16,6 +16,7 @@
 #include "cop0.h"
 #include "console.h"
 #include "graphics.h"
+#include "surface.h"
 
 /* Prototypes */
 static void __console_render(void);
@@ -33,6 +34,47 @@ static int render_now;
 /** @brief True if the console output is sent to debug channel as well */
 static bool console_redirect_debug = true;
 
+/** @brief Maximum number of framebuffers whose contents are tracked */
+#define CONSOLE_MAX_FRAMEBUFFERS    4
+
+/**
+ * @brief Contents of a framebuffer, as last rendered by the console
+ *
+ * Display framebuffers are persistent, so each of them still contains what
+ * the console drew the last time it was rendered there. By keeping a copy of
+ * the characters drawn, only the cells that changed since then (including
+ * those moved by a scroll) need to be redrawn.
+ */
+typedef struct {
+    void *buffer;           ///< Pixels of the framebuffer (NULL if the slot is unused)
+    int generation;         ///< Value of #render_generation when last rendered
+    uint8_t len[CONSOLE_HEIGHT];    ///< Number of characters drawn in each line
+    char *cells;            ///< Characters drawn (CONSOLE_WIDTH * CONSOLE_HEIGHT)
+} console_fb_t;
+
+/** @brief Framebuffers tracked by the console */
+static console_fb_t render_fbs[CONSOLE_MAX_FRAMEBUFFERS];
+/** @brief Next slot of #render_fbs to reuse for an untracked framebuffer */
+static int render_fb_next;
+/** @brief Incremented every time the console buffer changes */
+static int render_generation;
+/** @brief Colors used for the contents of #render_fbs */
+static uint32_t render_colors[2];
+
+/**
+ * @brief Forget the contents of all the framebuffers
+ *
+ * The next render to each framebuffer will clear it and draw everything again.
+ */
+static void __console_invalidate(void)
+{
+    for(int i = 0; i < CONSOLE_MAX_FRAMEBUFFERS; i++)
+    {
+        render_fbs[i].buffer = NULL;
+    }
+    render_generation++;
+}
+
 void console_set_render_mode(int mode)
 {
     /* Allow manual buffering somewhat like curses */
@@ -122,6 +164,7 @@ static int __console_write( char *buf, unsigned int len )
 
     /* Cap off the end! */
     render_buffer[pos] = 0;
+    render_generation++;
     
     /* Out to screen! */
     if(render_now == RENDER_AUTOMATIC)
@@ -141,6 +184,14 @@ void console_init()
 
     render_buffer = malloc(CONSOLE_SIZE);
 
+    /* The display was just initialized, so no framebuffer contains the console */
+    char *cells = malloc(CONSOLE_WIDTH * CONSOLE_HEIGHT * CONSOLE_MAX_FRAMEBUFFERS);
+    for(int i = 0; i < CONSOLE_MAX_FRAMEBUFFERS; i++)
+    {
+        render_fbs[i] = (console_fb_t){ .cells = cells + i * CONSOLE_WIDTH * CONSOLE_HEIGHT };
+    }
+    render_fb_next = 0;
+
     console_set_render_mode(RENDER_AUTOMATIC);
     console_clear();
     console_set_debug(true);
@@ -160,6 +211,9 @@ void console_close()
         /* Nuke the console buffer */
         free(render_buffer);
         render_buffer = 0;
+
+        free(render_fbs[0].cells);
+        memset(render_fbs, 0, sizeof(render_fbs));
     }
 
     /* Unregister ourselves from newlib */
@@ -181,8 +235,9 @@ void console_clear()
     /* Return to original */
     render_now = render;
 
-    /* Remove all data */
+    /* Remove all data, and repaint the screen from scratch */
     memset(render_buffer, 0, CONSOLE_SIZE);
+    __console_invalidate();
     
     /* Should we display? */
     if(render_now == RENDER_AUTOMATIC)
@@ -191,37 +246,103 @@ void console_clear()
     }
 }
 
+/**
+ * @brief Find the tracked contents of a framebuffer
+ *
+ * If the framebuffer is not tracked yet, a slot is reused for it, and the
+ * framebuffer is cleared so that its contents are known.
+ *
+ * @param[in] dc
+ *            The framebuffer to render to
+ *
+ * @return The tracked contents of the framebuffer
+ */
+static console_fb_t *__console_get_fb(surface_t *dc)
+{
+    for(int i = 0; i < CONSOLE_MAX_FRAMEBUFFERS; i++)
+    {
+        if(render_fbs[i].buffer == dc->buffer)
+        {
+            return &render_fbs[i];
+        }
+    }
+
+    console_fb_t *fb = &render_fbs[render_fb_next];
+    render_fb_next = (render_fb_next + 1) % CONSOLE_MAX_FRAMEBUFFERS;
+
+    /* Background color! */
+    graphics_fill_screen( dc, 0 );
+
+    fb->buffer = dc->buffer;
+    fb->generation = render_generation - 1;
+    memset(fb->len, 0, sizeof(fb->len));
+    memset(fb->cells, 0, CONSOLE_WIDTH * CONSOLE_HEIGHT);
+    return fb;
+}
+
 /**
  * @brief Helper function to render the console
+ *
+ * Only the cells that changed since the last time the framebuffer was rendered
+ * are redrawn.
  */
 static void __console_render(void)
 {
     if(!render_buffer) { return; }
 
+    /* If the colors changed, everything must be drawn again */
+    extern void __graphics_get_color(uint32_t *forecolor, uint32_t *backcolor);
+    uint32_t colors[2];
+    __graphics_get_color(&colors[0], &colors[1]);
+    if(memcmp(colors, render_colors, sizeof(colors)) != 0)
+    {
+        memcpy(render_colors, colors, sizeof(colors));
+        __console_invalidate();
+    }
+
     /* Wait until we get a valid context */
     surface_t *dc = display_get();
+    console_fb_t *fb = __console_get_fb(dc);
 
-    /* Background color! */
-    graphics_fill_screen( dc, 0 );
+    /* Characters after the terminator are stale, and are not displayed */
+    int len = fb->generation != render_generation ? strlen(render_buffer) : 0;
 
-    for(int y = 0; y < CONSOLE_HEIGHT; y++)
+    for(int y = 0; y < CONSOLE_HEIGHT && fb->generation != render_generation; y++)
     {
-        for(int x = 0; x < CONSOLE_WIDTH; x++)
+        const char *line = &render_buffer[y * CONSOLE_WIDTH];
+        char *cells = &fb->cells[y * CONSOLE_WIDTH];
+        int n = len - y * CONSOLE_WIDTH;
+        if(n < 0) { n = 0; }
+        if(n > CONSOLE_WIDTH) { n = CONSOLE_WIDTH; }
+
+        /* Skip lines that didn't change */
+        if(n == fb->len[y] && memcmp(line, cells, n) == 0)
         {
-            char t_buf = render_buffer[y * CONSOLE_WIDTH + x];
+            continue;
+        }
 
-            if(t_buf == 0)
+        int end = n > fb->len[y] ? n : fb->len[y];
+        for(int x = 0; x < end; x++)
+        {
+            char t_buf = x < n ? line[x] : 0;
+            if(t_buf == cells[x])
             {
-                goto end;
+                continue;
             }
 
-            /* Draw to the screen using the forecolor and backcolor set in the graphics
-             * subsystem */
-            graphics_draw_character( dc, HORIZONTAL_PADDING + 8 * x, VERTICAL_PADDING + 8 * y, t_buf );
+            /* Clear the cell, and draw to the screen using the forecolor and
+             * backcolor set in the graphics subsystem */
+            graphics_draw_box( dc, HORIZONTAL_PADDING + 8 * x, VERTICAL_PADDING + 8 * y, 8, 8, 0 );
+            if(t_buf)
+            {
+                graphics_draw_character( dc, HORIZONTAL_PADDING + 8 * x, VERTICAL_PADDING + 8 * y, t_buf );
+            }
+            cells[x] = t_buf;
         }
+        fb->len[y] = n;
     }
+    fb->generation = render_generation;
 
-end:;
     /* If the interrupts are disabled, the console wouldn't show to the screen.
      * Since the console is only used for development and emergency context,
      * it is better to force display irrespective of vblank. */
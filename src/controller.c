@@ -8,7 +8,11 @@
 #include "interrupt.h"
 #include "joybus.h"
 #include "joybus_internal.h"
+#include "controller_internal.h"
+#include "timer.h"
+#include "n64sys.h"
 #include "debug.h"
+#include "utils.h"
 #include <string.h>
 #include <stdbool.h>
 
@@ -36,6 +40,13 @@
  * return a number signifying the polar direction that the D-Pad is being
  * pressed in.
  *
+ * By default, the background scanning reads the controllers once per frame,
+ * at vblank. Games that need a lower input latency can call #controller_poll_init
+ * to read them multiple times per frame, or just before the point in the frame
+ * where the input is consumed. Each read is timestamped and kept in a short
+ * history (see #controller_poll_get_samples), and the occupancy of the SI bus
+ * is reported by #controller_poll_get_stats.
+ *
  * To perform direct reads to the controllers, call #controller_read.  This will
  * return a structure consisting of all button states on all controllers currently
  * inserted. Note that this function takes about 10% of a frame's worth of time.
@@ -72,32 +83,142 @@ static volatile bool controller_autoscan_in_progress = false;
 /** @brief True if the module was initialized */
 static bool controller_inited = false;
 
+/** @brief Joybus message to read the status of all N64 controllers */
+static const unsigned long long SI_read_con_block[8] =
+{
+    0xff010401ffffffff,
+    0xff010401ffffffff,
+    0xff010401ffffffff,
+    0xff010401ffffffff,
+    0xfe00000000000000,
+    0,
+    0,
+    1
+};
+
+/** @brief Polling engine state (see #controller_poll_init) */
+static struct {
+    bool enabled;                   ///< True if the polling engine is active
+    int polls_per_frame;            ///< Number of reads per frame
+    uint32_t deadline;              ///< Input deadline after vblank in ticks (0 = none)
+    timer_link_t *timer;            ///< Timer to issue the reads within the frame
+    uint32_t vi_ticks;              ///< Time of the last vblank
+    uint32_t frame_ticks;           ///< Measured duration of a frame
+    int next_poll;                  ///< Index within the frame of the next read to issue
+    uint32_t issue_ticks;           ///< Time at which the pending read was issued
+    uint32_t avg_latency;           ///< Running average of the read latency (ticks)
+    controller_sample_t history[CONTROLLER_POLL_HISTORY]; ///< Last samples (ring buffer)
+    uint32_t num_samples;           ///< Number of samples ever written into history
+    uint32_t num_polls;             ///< Completed reads since the stats reset
+    uint32_t num_skipped;           ///< Skipped reads since the stats reset
+    uint64_t sum_latency;           ///< Sum of the read latencies since the stats reset
+    uint64_t stats_ticks;           ///< Time of the stats reset
+    uint64_t stats_busy_ticks;      ///< SI busy time at the stats reset
+} poll;
+
 static void controller_interrupt_update(uint64_t *output, void *ctx)
 {
     memcpy((void*)&next, output, sizeof(struct controller_data));
+
+    if (poll.enabled) {
+        uint32_t now = TICKS_READ();
+        uint32_t latency = TICKS_DISTANCE(poll.issue_ticks, now);
+        controller_sample_t *sample = &poll.history[poll.num_samples % CONTROLLER_POLL_HISTORY];
+        memcpy(&sample->data, output, sizeof(struct controller_data));
+        sample->ticks = now;
+        sample->latency = latency;
+        poll.num_samples++;
+        poll.num_polls++;
+        poll.sum_latency += latency;
+        poll.avg_latency = poll.avg_latency ? (poll.avg_latency * 7 + latency) / 8 : latency;
+    }
+
     controller_autoscan_in_progress = false;
 }
 
-static void controller_interrupt(void) 
+/** @brief Issue a background read of the controllers, unless one is still pending */
+static void controller_autoscan(void)
 {
-    static const unsigned long long SI_read_con_block[8] =
-    {
-        0xff010401ffffffff,
-        0xff010401ffffffff,
-        0xff010401ffffffff,
-        0xff010401ffffffff,
-        0xfe00000000000000,
-        0,
-        0,
-        1
-    };
-    
-    if (!controller_autoscan_in_progress) {    
+    if (!controller_autoscan_in_progress) {
         controller_autoscan_in_progress = true;
+        poll.issue_ticks = TICKS_READ();
         joybus_exec_async(SI_read_con_block, controller_interrupt_update, NULL);
+    } else if (poll.enabled) {
+        poll.num_skipped++;
+    }
+}
+
+/**
+ * @brief Return the time after vblank at which a read of the polling engine must be issued
+ * 
+ * Reads are evenly spaced within the frame. Without a deadline, the first one
+ * is issued at vblank; with a deadline, they are shifted so that one of them
+ * completes (based on the measured latency) just before the deadline. The reads
+ * that would fall before vblank are wrapped to the end of the frame, that is
+ * after the deadline of the previous frame.
+ */
+static int32_t controller_poll_offset(int idx)
+{
+    int32_t interval = poll.frame_ticks / poll.polls_per_frame;
+    if (!poll.deadline)
+        return idx * interval;
+    int32_t phase = ((int32_t)poll.deadline - (int32_t)poll.avg_latency) % interval;
+    if (phase < 0) phase += interval;
+    return phase + idx * interval;
+}
+
+static void controller_poll_timer(int ovfl);
+
+/** @brief Issue the reads of the polling engine that are due, and schedule the next one */
+static void controller_poll_step(void)
+{
+    int32_t elapsed = TICKS_DISTANCE(poll.vi_ticks, TICKS_READ());
+    while (poll.next_poll < poll.polls_per_frame) {
+        int32_t delay = controller_poll_offset(poll.next_poll) - elapsed;
+        if (delay > 0) {
+            start_timer(poll.timer, delay, TF_ONE_SHOT, controller_poll_timer);
+            return;
+        }
+        // Multiple reads due at the same time (eg: the timer fired late)
+        // would just be skipped, so issue only the last one.
+        if (poll.next_poll + 1 == poll.polls_per_frame ||
+            controller_poll_offset(poll.next_poll + 1) > elapsed)
+            controller_autoscan();
+        else
+            poll.num_skipped++;
+        poll.next_poll++;
     }
 }
 
+/** @brief Timer callback of the polling engine */
+static void controller_poll_timer(int ovfl)
+{
+    controller_poll_step();
+}
+
+static void controller_interrupt(void) 
+{
+    if (!poll.enabled) {
+        controller_autoscan();
+        return;
+    }
+
+    uint32_t now = TICKS_READ();
+    uint32_t frame = TICKS_DISTANCE(poll.vi_ticks, now);
+    // Track the frame duration, ignoring outliers (eg: the first frame, or
+    // frames where the VI interrupt was delayed)
+    if (frame > poll.frame_ticks / 2 && frame < poll.frame_ticks * 2)
+        poll.frame_ticks = frame;
+    poll.vi_ticks = now;
+
+    // Reads of the previous frame that were not issued yet (eg: because the
+    // frame was shorter than measured) are skipped.
+    stop_timer(poll.timer);
+    poll.num_skipped += poll.polls_per_frame - poll.next_poll;
+    poll.next_poll = 0;
+    controller_poll_step();
+}
+
 /** 
  * @brief Initialize the controller subsystem.
  * 
@@ -247,6 +368,136 @@ void controller_scan( void )
     enable_interrupts();
 }
 
+/**
+ * @brief Start the controller polling engine
+ * 
+ * By default, the background scanning reads the controllers once per frame,
+ * at vblank. This means that the state returned by #controller_scan can be
+ * almost one frame old when the game consumes it. The polling engine instead
+ * issues multiple reads per frame (evenly spaced using a timer, see
+ * @ref timer), so that a recent sample is always available.
+ * 
+ * If the game reads the input at a known point in the frame, the reads can be
+ * aligned to it, so that one read completes just before the input deadline.
+ * The latency of the reads is measured and taken into account. The reads
+ * stay evenly spaced: those that would fall before vblank are issued at the
+ * end of the frame instead, after the deadline of the previous frame.
+ * 
+ * #controller_scan keeps working and returns the most recent sample. Each
+ * sample is also timestamped and stored in a short history that can be
+ * inspected with #controller_poll_get_samples, for instance to process all
+ * the reads that happened since the previous frame, so that presses shorter
+ * than a frame are not lost.
+ * 
+ * A read is skipped if the previous one is still pending (for instance, because
+ * the SI is busy with accessory I/O), or if it could not be issued in time.
+ * Skipped reads are reported in the statistics (see #controller_poll_get_stats).
+ * 
+ * @param[in] polls_per_frame
+ *            Number of reads per frame (1 to #CONTROLLER_POLL_MAX_PER_FRAME)
+ * @param[in] deadline_us
+ *            Time after vblank at which the game consumes the input, in
+ *            microseconds (it must be shorter than a frame), or 0 to start
+ *            reading at vblank.
+ */
+void controller_poll_init( int polls_per_frame, int deadline_us )
+{
+    assertf(controller_inited, "controller_init() was not called");
+    assertf(polls_per_frame >= 1 && polls_per_frame <= CONTROLLER_POLL_MAX_PER_FRAME,
+        "invalid number of polls per frame: %d", polls_per_frame);
+    assertf(deadline_us >= 0, "invalid deadline: %d", deadline_us);
+
+    controller_poll_close();
+    timer_init();
+
+    disable_interrupts();
+    memset(&poll, 0, sizeof(poll));
+    poll.polls_per_frame = polls_per_frame;
+    poll.deadline = TICKS_FROM_US(deadline_us);
+    poll.frame_ticks = TICKS_PER_SECOND / (get_tv_type() == TV_PAL ? 50 : 60);
+    poll.vi_ticks = TICKS_READ();
+    poll.next_poll = polls_per_frame;
+    poll.timer = new_timer(0, TF_ONE_SHOT | TF_DISABLED, controller_poll_timer);
+    poll.stats_ticks = get_ticks();
+    poll.stats_busy_ticks = joybus_busy_ticks_get();
+    poll.enabled = true;
+    enable_interrupts();
+}
+
+/**
+ * @brief Stop the controller polling engine
+ * 
+ * The background scanning goes back to reading the controllers once per frame.
+ */
+void controller_poll_close( void )
+{
+    if (!poll.enabled)
+        return;
+
+    disable_interrupts();
+    poll.enabled = false;
+    delete_timer(poll.timer);
+    poll.timer = NULL;
+    enable_interrupts();
+    timer_close();
+}
+
+/**
+ * @brief Get the most recent samples read by the polling engine
+ * 
+ * @param[out] samples
+ *             Array to fill with the samples, from the most recent
+ * @param[in]  max
+ *             Maximum number of samples to return (up to #CONTROLLER_POLL_HISTORY
+ *             samples are kept)
+ * 
+ * @return Number of samples returned
+ */
+int controller_poll_get_samples( controller_sample_t *samples, int max )
+{
+    assertf(poll.enabled, "controller_poll_init() was not called");
+
+    disable_interrupts();
+    int n = MIN(max, MIN(poll.num_samples, CONTROLLER_POLL_HISTORY));
+    for (int i = 0; i < n; i++)
+        samples[i] = poll.history[(poll.num_samples - 1 - i) % CONTROLLER_POLL_HISTORY];
+    enable_interrupts();
+    return n;
+}
+
+/**
+ * @brief Get the statistics of the polling engine
+ * 
+ * @param[in] reset
+ *            If true, reset the statistics after reading them
+ * 
+ * @return Statistics since #controller_poll_init or the last reset
+ */
+controller_poll_stats_t controller_poll_get_stats( bool reset )
+{
+    assertf(poll.enabled, "controller_poll_init() was not called");
+
+    uint64_t now = get_ticks();
+    uint64_t busy = joybus_busy_ticks_get();
+
+    disable_interrupts();
+    controller_poll_stats_t stats = {
+        .num_polls = poll.num_polls,
+        .num_skipped = poll.num_skipped,
+        .avg_latency_ticks = poll.num_polls ? poll.sum_latency / poll.num_polls : 0,
+        .si_busy_ticks = busy - poll.stats_busy_ticks,
+        .elapsed_ticks = now - poll.stats_ticks,
+    };
+    if (reset) {
+        poll.num_polls = poll.num_skipped = 0;
+        poll.sum_latency = 0;
+        poll.stats_ticks = now;
+        poll.stats_busy_ticks = busy;
+    }
+    enable_interrupts();
+    return stats;
+}
+
 /**
  * @brief Get keys that were pressed since the last inspection
  *
@@ -616,6 +867,109 @@ static uint8_t __calc_data_crc( uint8_t *data )
     return ret;
 }
 
+/**
+ * @brief Build the joybus block of a mempak transfer
+ *
+ * Prepare a joybus block that reads or writes 32 bytes at the specified
+ * address of the mempak in a controller. The block can be executed
+ * synchronously or asynchronously, and its output decoded with
+ * #__mempak_address_result.
+ *
+ * @param[out] block
+ *             Buffer of #JOYBUS_BLOCK_SIZE bytes to build the block into
+ * @param[in]  controller
+ *             Which controller to access (0-3)
+ * @param[in]  write
+ *             Nonzero to write data, zero to read
+ * @param[in]  address
+ *             A 32 byte aligned offset on the mempak
+ * @param[in]  data
+ *             32 bytes of data to write (ignored for reads)
+ */
+void __mempak_address_block( uint8_t *block, int controller, int write, uint16_t address, const uint8_t *data )
+{
+    /* Last byte must be 0x01 to signal to the SI to process data */
+    memset( block, 0, JOYBUS_BLOCK_SIZE );
+    block[56] = 0xfe;
+    block[63] = 0x01;
+
+    /* Start command at the correct channel to access the right mempak */
+    if( write )
+    {
+        block[controller]     = 0x23;
+        block[controller + 1] = 0x01;
+        block[controller + 2] = 0x03;
+    }
+    else
+    {
+        block[controller]     = 0x03;
+        block[controller + 1] = 0x21;
+        block[controller + 2] = 0x02;
+    }
+
+    /* Calculate CRC on address */
+    uint16_t crc_address = __calc_address_crc( address );
+    block[controller + 3] = (crc_address >> 8) & 0xFF;
+    block[controller + 4] = crc_address & 0xFF;
+
+    if( write )
+    {
+        /* Place the data to be written, and leave room for CRC to come back */
+        memcpy( &block[controller + 5], data, 32 );
+        block[controller + 5 + 32] = 0xFF;
+    }
+    else
+    {
+        /* Leave room for 33 bytes (32 bytes + CRC) to come back */
+        memset( &block[controller + 5], 0xFF, 33 );
+    }
+}
+
+/**
+ * @brief Decode the output of a mempak transfer
+ *
+ * Validate the CRC returned by the mempak for a transfer built by
+ * #__mempak_address_block, and extract the data in case of a read.
+ *
+ * @param[in]  output
+ *             Output block returned by the joybus
+ * @param[in]  controller
+ *             Which controller was accessed (0-3)
+ * @param[out] data
+ *             Buffer to place the 32 bytes of data read, or NULL
+ *
+ * @retval 0  if the transfer was successful
+ * @retval -2 if there was no mempak present in the controller
+ * @retval -3 if the mempak returned invalid data
+ */
+int __mempak_address_result( const uint8_t *output, int controller, uint8_t *data )
+{
+    /* Copy data correctly out of command */
+    if( data )
+    {
+        memcpy( data, &output[controller + 5], 32 );
+    }
+
+    /* Validate CRC */
+    uint8_t crc = __calc_data_crc( (uint8_t *)&output[controller + 5] );
+
+    if( crc == output[controller + 5 + 32] )
+    {
+        /* Data was transferred successfully */
+        return 0;
+    }
+    else if( crc == (output[controller + 5 + 32] ^ 0xFF) )
+    {
+        /* Pak not present! */
+        return -2;
+    }
+    else
+    {
+        /* Pak returned bad data */
+        return -3;
+    }
+}
+
 /**
  * @brief Read a chunk of data from a mempak
  *
@@ -636,59 +990,16 @@ static uint8_t __calc_data_crc( uint8_t *data )
  */
 int read_mempak_address( int controller, uint16_t address, uint8_t *data )
 {
-    uint8_t output[64];
-    uint8_t SI_read_mempak_block[64];
-    int ret;
+    uint8_t output[JOYBUS_BLOCK_SIZE];
+    uint8_t SI_read_mempak_block[JOYBUS_BLOCK_SIZE];
 
     /* Controller must be in range */
     if( controller < 0 || controller > 3 ) { return -1; }
 
-    /* Last byte must be 0x01 to signal to the SI to process data */
-    memset( SI_read_mempak_block, 0, 64 );
-    SI_read_mempak_block[56] = 0xfe;
-    SI_read_mempak_block[63] = 0x01;
-
-    /* Start command at the correct channel to read from the right mempak */
-    SI_read_mempak_block[controller]     = 0x03;
-    SI_read_mempak_block[controller + 1] = 0x21;
-    SI_read_mempak_block[controller + 2] = 0x02;
-
-    /* Calculate CRC on address */
-    uint16_t read_address = __calc_address_crc( address );
-    SI_read_mempak_block[controller + 3] = (read_address >> 8) & 0xFF;
-    SI_read_mempak_block[controller + 4] = read_address & 0xFF;
-
-    /* Leave room for 33 bytes (32 bytes + CRC) to come back */
-    memset( &SI_read_mempak_block[controller + 5], 0xFF, 33 );
-
+    __mempak_address_block( SI_read_mempak_block, controller, 0, address, NULL );
     joybus_exec( SI_read_mempak_block, &output );
 
-    /* Copy data correctly out of command */
-    memcpy( data, &output[controller + 5], 32 );
-
-    /* Validate CRC */
-    uint8_t crc = __calc_data_crc( &output[controller + 5] );
-
-    if( crc == output[controller + 5 + 32] )
-    {
-        /* Data was read successfully */
-        ret = 0;
-    }
-    else
-    {
-        if( crc == (output[controller + 5 + 32] ^ 0xFF) )
-        {
-            /* Pak not present! */
-            ret = -2;
-        }
-        else
-        {
-            /* Pak returned bad data */
-            ret = -3;
-        }
-    }
-
-    return ret;
+    return __mempak_address_result( output, controller, data );
 }
 
 /**
@@ -710,59 +1021,16 @@ int read_mempak_address( int controller, uint16_t address, uint8_t *data )
  */
 int write_mempak_address( int controller, uint16_t address, uint8_t *data )
 {
-    uint8_t output[64];
-    uint8_t SI_write_mempak_block[64];
-    int ret;
+    uint8_t output[JOYBUS_BLOCK_SIZE];
+    uint8_t SI_write_mempak_block[JOYBUS_BLOCK_SIZE];
 
     /* Controller must be in range */
     if( controller < 0 || controller > 3 ) { return -1; }
 
-    /* Last byte must be 0x01 to signal to the SI to process data */
-    memset( SI_write_mempak_block, 0, 64 );
-    SI_write_mempak_block[56] = 0xfe;
-    SI_write_mempak_block[63] = 0x01;
-
-    /* Start command at the correct channel to write from the right mempak */
-    SI_write_mempak_block[controller]     = 0x23;
-    SI_write_mempak_block[controller + 1] = 0x01;
-    SI_write_mempak_block[controller + 2] = 0x03;
-
-    /* Calculate CRC on address */
-    uint16_t write_address = __calc_address_crc( address );
-    SI_write_mempak_block[controller + 3] = (write_address >> 8) & 0xFF;
-    SI_write_mempak_block[controller + 4] = write_address & 0xFF;
-
-    /* Place the data to be written */
-    memcpy( &SI_write_mempak_block[controller + 5], data, 32 );
-
-    /* Leave room for CRC to come back */
-    SI_write_mempak_block[controller + 5 + 32] = 0xFF;
-
+    __mempak_address_block( SI_write_mempak_block, controller, 1, address, data );
     joybus_exec( SI_write_mempak_block, &output );
 
-    /* Calculate CRC on output */
-    uint8_t crc = __calc_data_crc( &output[controller + 5] );
-
-    if( crc == output[controller + 5 + 32] )
-    {
-        /* Data was written successfully */
-        ret = 0;
-    }
-    else
-    {
-        if( crc == (output[controller + 5 + 32] ^ 0xFF) )
-        {
-            /* Pak not present! */
-            ret = -2;
-        }
-        else
-        {
-            /* Pak returned bad data */
-            ret = -3;
-        }
-    }
-
-    return ret;
+    return __mempak_address_result( output, controller, NULL );
 }
 
 /**
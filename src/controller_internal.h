@@ -0,0 +1,15 @@
+/**
+ * @file controller_internal.h
+ * @brief Controller Subsystem internal API
+ * @ingroup controller
+ */
+
+#ifndef __LIBDRAGON_CONTROLLER_INTERNAL_H
+#define __LIBDRAGON_CONTROLLER_INTERNAL_H
+
+#include <stdint.h>
+
+void __mempak_address_block( uint8_t *block, int controller, int write, uint16_t address, const uint8_t *data );
+int __mempak_address_result( const uint8_t *output, int controller, uint8_t *data );
+
+#endif
@@ -5,6 +5,7 @@
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <malloc.h>
 #include <string.h>
 #include "regsinternal.h"
@@ -21,6 +22,8 @@
 #define NUM_BUFFERS         32
 /** @brief Number of past frames used to evaluate FPS */
 #define FPS_WINDOW          32
+/** @brief Number of past frames used for timing statistics */
+#define TIMING_WINDOW       64
 
 static surface_t *surfaces;
 /** @brief Currently active bit depth */
@@ -46,6 +49,33 @@ static int frame_times_index = 0;
 /** @brief Current duration of the frame window (time elapsed for FPS_WINDOW frames) */
 static uint32_t frame_times_duration;
 
+/** @brief Time at which #display_get started waiting for a buffer (0 if not waiting) */
+static uint32_t acquire_start;
+/** @brief Time at which #display_get started waiting for each buffer */
+static uint32_t buffer_wait_time[NUM_BUFFERS];
+/** @brief Time at which each buffer was acquired */
+static uint32_t buffer_get_time[NUM_BUFFERS];
+/** @brief Time at which each buffer was passed to #display_show */
+static uint32_t buffer_show_time[NUM_BUFFERS];
+/** @brief Timing of the last frames shown (ring buffer) */
+static display_frame_timing_t timings[TIMING_WINDOW];
+/** @brief Index of the next entry of #timings to write */
+static int timings_index;
+/** @brief Number of valid entries in #timings */
+static int timings_count;
+/** @brief Total number of frames shown */
+static uint32_t frames_shown;
+/** @brief Total number of vblanks where a frame was being drawn, but none was ready */
+static uint32_t missed_vblanks;
+/** @brief Time of the last vblank */
+static uint32_t last_vblank;
+/** @brief Time of the start of scanout of the last frame */
+static uint32_t last_scanout;
+/** @brief Measured duration of a field */
+static uint32_t vblank_period;
+/** @brief True if frame pacing is enabled */
+static bool pacing;
+
 /** @brief Get the next buffer index (with wraparound) */
 static inline int buffer_next(int idx) {
     idx += 1;
@@ -54,6 +84,24 @@ static inline int buffer_next(int idx) {
     return idx;
 }
 
+/** @brief Record the timing of a frame that is starting scanout */
+static void timing_record(int idx, uint32_t now)
+{
+    display_frame_timing_t *t = &timings[timings_index];
+    t->wait = TICKS_DISTANCE(buffer_wait_time[idx], buffer_get_time[idx]);
+    t->render = TICKS_DISTANCE(buffer_get_time[idx], buffer_show_time[idx]);
+    t->latency = TICKS_DISTANCE(buffer_show_time[idx], now);
+    t->interval = last_scanout ? TICKS_DISTANCE(last_scanout, now) : 0;
+    last_scanout = now;
+
+    timings_index++;
+    if (timings_index == TIMING_WINDOW)
+        timings_index = 0;
+    if (timings_count < TIMING_WINDOW)
+        timings_count++;
+    frames_shown++;
+}
+
 /**
  * @brief Interrupt handler for vertical blank
  *
@@ -66,12 +114,25 @@ static void __display_callback()
     bool field = (*VI_V_CURRENT) & 1;
     bool interlaced = (*VI_CTRL) & (VI_CTRL_SERRATE);
 
+    /* Measure the field duration. Ignore forced calls outside of vblank
+       (see #display_show_force), that would not match the refresh rate. */
+    uint32_t now = TICKS_READ();
+    if (last_vblank) {
+        uint32_t period = TICKS_DISTANCE(last_vblank, now);
+        if (period > TICKS_PER_SECOND / 65 && period < TICKS_PER_SECOND / 45)
+            vblank_period = period;
+    }
+    last_vblank = now;
+
     /* Check if the next buffer is ready to be displayed, otherwise just
        leave up the current frame */
     int next = buffer_next(now_showing);
     if (ready_mask & (1 << next)) {
         now_showing = next;
         ready_mask &= ~(1 << next);
+        timing_record(next, now);
+    } else if (drawing_mask) {
+        missed_vblanks++;
     }
 
     vi_write_dram_register(__safe_buffer[now_showing] + (interlaced && !field ? __width * __bitdepth : 0));
@@ -236,6 +297,15 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
     drawing_mask = 0;
     ready_mask = 0;
 
+    /* Reset frame timing statistics */
+    timings_index = 0;
+    timings_count = 0;
+    frames_shown = 0;
+    missed_vblanks = 0;
+    last_vblank = 0;
+    last_scanout = 0;
+    vblank_period = 0;
+
     /* Show our screen normally. If display is already active, do that during vblank
        to avoid confusing the VI chip with in-frame modifications. */
     if ( vi_is_active() ) { vi_wait_for_vblank(); }
@@ -312,6 +382,8 @@ surface_t* display_try_get(void)
         if (((drawing_mask | ready_mask) & (1 << next)) == 0)  {
             retval = &surfaces[next];
             drawing_mask |= 1 << next;
+            buffer_get_time[next] = TICKS_READ();
+            buffer_wait_time[next] = acquire_start ? acquire_start : buffer_get_time[next];
             break;
         }
         next = buffer_next(next);
@@ -323,17 +395,76 @@ surface_t* display_try_get(void)
     return retval;
 }
 
+/** @brief Compute the p-th percentile of an array of values (which is sorted in place) */
+static uint32_t percentile(uint32_t *values, int n, int p)
+{
+    // Insertion sort: the window is small, and the values are often almost sorted
+    for (int i = 1; i < n; i++) {
+        uint32_t v = values[i];
+        int j = i;
+        for (; j > 0 && values[j-1] > v; j--)
+            values[j] = values[j-1];
+        values[j] = v;
+    }
+    return n ? values[(n - 1) * p / 100] : 0;
+}
+
+/** @brief Copy a metric of the recorded frames into an array, and return the number of frames */
+static int timing_collect(uint32_t *values, size_t offset)
+{
+    disable_interrupts();
+    int n = timings_count;
+    for (int i = 0; i < n; i++)
+        values[i] = *(uint32_t*)((uint8_t*)&timings[i] + offset);
+    enable_interrupts();
+    return n;
+}
+
+/**
+ * @brief Delay the start of a frame, to reduce latency (see #display_set_pacing)
+ */
+static void display_pace(void)
+{
+    // Wait until all the completed frames have been shown
+    while (ready_mask) {}
+
+    // Predict the duration of the next frame from the recent ones, with a
+    // small safety margin.
+    uint32_t values[TIMING_WINDOW];
+    int n = timing_collect(values, offsetof(display_frame_timing_t, render));
+    uint32_t period = vblank_period;
+    if (n < 8 || !period) return;
+    uint32_t render = percentile(values, n, 90) + period / 16;
+
+    // If frames take more than a field, there is no slack to exploit
+    if (render >= period) return;
+
+    // Find the first vblank that the frame can reach if it starts now, and
+    // start the frame as late as possible to still reach it.
+    uint32_t now = TICKS_READ();
+    uint32_t since = TICKS_DISTANCE(last_vblank, now);
+    uint32_t target = last_vblank + period * ((since + render) / period + 1);
+    int32_t delay = TICKS_DISTANCE(now, target - render);
+    if (delay > 0)
+        wait_ticks(delay);
+}
+
 surface_t* display_get(void)
 {
+    if (pacing)
+        display_pace();
+
     // Wait until a buffer is available. We use a RSP_WAIT_LOOP as
     // it is common for display to become ready again after RSP+RDP
     // have finished processing the previous frame's commands.
     surface_t* disp;
+    acquire_start = TICKS_READ();
     RSP_WAIT_LOOP(200) {
          if ((disp = display_try_get())) {
              break;
          }
     }
+    acquire_start = 0;
     return disp;
 }
 
@@ -358,6 +489,7 @@ void display_show( surface_t* surf )
 
     drawing_mask &= ~(1 << i);
     ready_mask |= 1 << i;
+    buffer_show_time[i] = TICKS_READ();
 
     /* Record the time at which this frame was (asked to be) shown */
     uint32_t old_ticks = frame_times[frame_times_index];
@@ -418,3 +550,50 @@ float display_get_fps(void)
     if (!frame_times_duration) return 0;
     return (float)FPS_WINDOW * TICKS_PER_SECOND / frame_times_duration;
 }
+
+/** @brief Compute the percentiles of a metric of the recorded frames */
+static void timing_percentiles(display_timing_percentiles_t *out, size_t offset)
+{
+    uint32_t values[TIMING_WINDOW];
+    int n = timing_collect(values, offset);
+    if (!n) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+
+    // The first call sorts the values, so the others can index them directly
+    out->p50 = TICKS_TO_US(percentile(values, n, 50));
+    out->p90 = TICKS_TO_US(values[(n - 1) * 90 / 100]);
+    out->p99 = TICKS_TO_US(values[(n - 1) * 99 / 100]);
+    out->max = TICKS_TO_US(values[n - 1]);
+}
+
+void display_get_timing(display_timing_stats_t *stats)
+{
+    stats->num_frames = timings_count;
+    stats->frames_shown = frames_shown;
+    stats->missed_vblanks = missed_vblanks;
+    timing_percentiles(&stats->wait, offsetof(display_frame_timing_t, wait));
+    timing_percentiles(&stats->render, offsetof(display_frame_timing_t, render));
+    timing_percentiles(&stats->latency, offsetof(display_frame_timing_t, latency));
+    timing_percentiles(&stats->interval, offsetof(display_frame_timing_t, interval));
+}
+
+int display_get_frame_timings(display_frame_timing_t *frames, int max_frames)
+{
+    disable_interrupts();
+    int n = MIN(timings_count, max_frames);
+    int idx = timings_index - n;
+    if (idx < 0) idx += TIMING_WINDOW;
+    for (int i = 0; i < n; i++) {
+        frames[i] = timings[idx];
+        if (++idx == TIMING_WINDOW) idx = 0;
+    }
+    enable_interrupts();
+    return n;
+}
+
+void display_set_pacing(bool enable)
+{
+    pacing = enable;
+}
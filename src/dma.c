@@ -4,12 +4,14 @@
  * @ingroup dma
  */
 #include <stdbool.h>
+#include <string.h>
 #include "n64types.h"
 #include "n64sys.h"
 #include "interrupt.h"
 #include "debug.h"
 #include "utils.h"
 #include "regsinternal.h"
+#include "dma.h"
 
 /**
  * @name PI Status Register Bit Definitions
@@ -251,3 +253,279 @@ void io_write(uint32_t pi_address, uint32_t data)
 
     enable_interrupts();
 }
+
+/** @brief Default size of a chunk of a queued transfer */
+#define DMA_QUEUE_CHUNK_SIZE    8192
+
+/** @brief True if the DMA queue is initialized */
+static bool queue_initialized;
+/** @brief First request of each priority class */
+static dma_request_t *queue_head[DMA_PRIO_NUM];
+/** @brief Last request of each priority class */
+static dma_request_t *queue_tail[DMA_PRIO_NUM];
+/** @brief Request whose chunk is being transferred (NULL if none) */
+static dma_request_t *queue_cur;
+/** @brief Length of the chunk being transferred */
+static uint32_t queue_chunk_len;
+/** @brief Time at which the chunk being transferred was started */
+static uint32_t queue_chunk_start;
+/** @brief Maximum size of a chunk */
+static uint32_t queue_chunk_size = DMA_QUEUE_CHUNK_SIZE;
+/** @brief Statistics of each priority class */
+static dma_queue_stats_t queue_stats[DMA_PRIO_NUM];
+/** @brief True while #dma_queue_service is running (it can be re-entered by callbacks) */
+static bool queue_servicing;
+
+/**
+ * @brief Transfer with the CPU the bytes of a read request that DMA cannot handle
+ *
+ * Like #dma_read_async, transfer the bytes up to the first 8-byte aligned
+ * RAM address, and an odd trailing byte.
+ *
+ * @note This function must be called with interrupts disabled and the PI idle.
+ */
+static void dma_queue_read_fixup(dma_request_t *req)
+{
+    uint8_t *ram = req->ram;
+    void *rom = (void*)(req->pi_address | 0xA0000000);
+    uint32_t len = req->remaining;
+
+    if ((uint32_t)ram & 7) {
+        if ((uint32_t)ram & 1) {
+            *ram = __io_read16(rom - 1);
+            ram++; rom++; len--;
+        }
+        while ((uint32_t)ram & 7 && len > 0) {
+            *ram = __io_read8(rom);
+            ram++; rom++; len--;
+        }
+    }
+    if (len & 1) {
+        ram[len-1] = __io_read16(rom+len-1) >> 8;
+        len--;
+    }
+
+    req->ram = ram;
+    req->pi_address = PhysicalAddr(rom);
+    req->remaining = len;
+}
+
+/** @brief Complete the request at the head of its priority class */
+static void dma_queue_complete(dma_request_t *req, uint32_t now)
+{
+    queue_head[req->prio] = req->next;
+    if (!req->next)
+        queue_tail[req->prio] = NULL;
+
+    dma_queue_stats_t *st = &queue_stats[req->prio];
+    uint32_t latency = TICKS_DISTANCE(req->queued_time, now);
+    st->num_requests++;
+    st->bytes += req->len;
+    st->latency_ticks += latency;
+    st->max_latency_ticks = MAX(st->max_latency_ticks, latency);
+
+    req->done = true;
+    if (req->callback)
+        req->callback(req, req->arg);
+}
+
+/**
+ * @brief Advance the DMA queue
+ *
+ * If the PI is idle, account for the chunk that was being transferred (if
+ * any), and start the next chunk of the highest priority request.
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void dma_queue_service(void)
+{
+    // Another transfer is running (either ours, or a direct one). We will
+    // be called again by the PI interrupt when it is finished.
+    if (__dma_busy())
+        return;
+
+    // A completion callback queued a new request: the outer call will
+    // start it, as it looks for the next request after each completion.
+    if (queue_servicing)
+        return;
+    queue_servicing = true;
+
+    uint32_t now = TICKS_READ();
+    if (queue_cur) {
+        dma_request_t *req = queue_cur;
+        queue_cur = NULL;
+        queue_stats[req->prio].busy_ticks += TICKS_DISTANCE(queue_chunk_start, now);
+        req->ram += queue_chunk_len;
+        req->pi_address += queue_chunk_len;
+        req->remaining -= queue_chunk_len;
+        if (!req->remaining)
+            dma_queue_complete(req, now);
+    }
+
+    while (1) {
+        dma_request_t *req = NULL;
+        for (int prio = 0; prio < DMA_PRIO_NUM && !req; prio++)
+            req = queue_head[prio];
+        if (!req)
+            break;
+
+        if (!req->started) {
+            req->started = true;
+            if (!req->write)
+                dma_queue_read_fixup(req);
+        }
+        if (!req->remaining) {
+            dma_queue_complete(req, TICKS_READ());
+            continue;
+        }
+
+        queue_cur = req;
+        queue_chunk_len = MIN(req->remaining, queue_chunk_size);
+        queue_chunk_start = TICKS_READ();
+        if (req->write)
+            dma_write_raw_async(req->ram, req->pi_address, queue_chunk_len);
+        else
+            dma_read_raw_async(req->ram, req->pi_address, queue_chunk_len);
+        break;
+    }
+    queue_servicing = false;
+}
+
+/** @brief PI interrupt handler */
+static void dma_queue_interrupt(void)
+{
+    dma_queue_service();
+}
+
+void dma_queue_init(void)
+{
+    if (queue_initialized)
+        return;
+
+    memset(queue_stats, 0, sizeof(queue_stats));
+    register_PI_handler(dma_queue_interrupt);
+    set_PI_interrupt(1);
+    queue_initialized = true;
+}
+
+void dma_queue_close(void)
+{
+    if (!queue_initialized)
+        return;
+
+    // Wait for all the pending requests
+    while (1) {
+        disable_interrupts();
+        dma_queue_service();
+        bool empty = !queue_cur;
+        for (int prio = 0; prio < DMA_PRIO_NUM; prio++)
+            empty = empty && !queue_head[prio];
+        enable_interrupts();
+        if (empty) break;
+    }
+
+    set_PI_interrupt(0);
+    unregister_PI_handler(dma_queue_interrupt);
+    queue_initialized = false;
+}
+
+void dma_queue_set_chunk_size(uint32_t size)
+{
+    assertf(size >= 8, "invalid DMA chunk size: %ld", size);
+    queue_chunk_size = size & ~7;
+}
+
+/** @brief Add a request to the queue */
+static void dma_queue_push(dma_request_t *req, dma_prio_t prio, dma_callback_t callback, void *arg)
+{
+    assertf(queue_initialized, "DMA queue not initialized: call dma_queue_init");
+    assertf(prio >= 0 && prio < DMA_PRIO_NUM, "invalid DMA priority: %d", prio);
+
+    req->len = req->remaining;
+    req->prio = prio;
+    req->started = false;
+    req->done = false;
+    req->callback = callback;
+    req->arg = arg;
+    req->next = NULL;
+
+    disable_interrupts();
+    req->queued_time = TICKS_READ();
+    if (queue_tail[prio])
+        queue_tail[prio]->next = req;
+    else
+        queue_head[prio] = req;
+    queue_tail[prio] = req;
+
+    // Start the transfer immediately if the PI is idle
+    dma_queue_service();
+    enable_interrupts();
+}
+
+void dma_queue_read(dma_request_t *req, void *ram_address, unsigned long pi_address,
+    unsigned long len, dma_prio_t prio, dma_callback_t callback, void *arg)
+{
+    assert(len > 0);
+    assert((((uint32_t)ram_address ^ pi_address) & 1) == 0);
+    assertf(io_accessible(pi_address) || ((pi_address & 1) == 0 && ((uint32_t)ram_address & 7) == 0 && (len & 1) == 0),
+        "misaligned transfer not supported at this PI address");
+
+    req->ram = UncachedAddr(ram_address);
+    req->pi_address = pi_address;
+    req->remaining = len;
+    req->write = false;
+    dma_queue_push(req, prio, callback, arg);
+}
+
+void dma_queue_write(dma_request_t *req, const void *ram_address, unsigned long pi_address,
+    unsigned long len, dma_prio_t prio, dma_callback_t callback, void *arg)
+{
+    assert(len > 0);
+    assertf(((uint32_t)ram_address & 7) == 0 && (pi_address & 1) == 0 && (len & 1) == 0,
+        "misaligned DMA write: %p %08lx %ld", ram_address, pi_address, len);
+
+    req->ram = (uint8_t*)ram_address;
+    req->pi_address = pi_address;
+    req->remaining = len;
+    req->write = true;
+    dma_queue_push(req, prio, callback, arg);
+}
+
+bool dma_queue_done(dma_request_t *req)
+{
+    return req->done;
+}
+
+void dma_queue_wait(dma_request_t *req)
+{
+    assertf(!queue_servicing, "dma_queue_wait cannot be called from a DMA completion callback");
+    // Drive the queue while waiting, in case interrupts are disabled
+    while (!req->done) {
+        disable_interrupts();
+        dma_queue_service();
+        enable_interrupts();
+    }
+}
+
+void dma_read_prio(void *ram_address, unsigned long pi_address, unsigned long len, dma_prio_t prio)
+{
+    if (!queue_initialized) {
+        dma_read(ram_address, pi_address, len);
+        return;
+    }
+
+    assertf(!queue_servicing, "dma_read_prio cannot be called from a DMA completion callback");
+    pi_address = (pi_address | 0x10000000) & 0x1FFFFFFF;
+
+    dma_request_t req;
+    dma_queue_read(&req, ram_address, pi_address, len, prio, NULL, NULL);
+    dma_queue_wait(&req);
+}
+
+void dma_queue_get_stats(dma_prio_t prio, dma_queue_stats_t *stats)
+{
+    assertf(prio >= 0 && prio < DMA_PRIO_NUM, "invalid DMA priority: %d", prio);
+    disable_interrupts();
+    *stats = queue_stats[prio];
+    enable_interrupts();
+}
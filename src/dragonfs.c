@@ -868,7 +868,7 @@ int dfs_read(void * const buf, int size, int count, uint32_t handle)
         else
             data_cache_hit_writeback_invalidate(buf, to_read);
 
-        dma_read(buf, rom_address, to_read);
+        dma_read_prio(buf, rom_address, to_read, DMA_PRIO_NORMAL);
 
         file->loc += to_read;
         return to_read;
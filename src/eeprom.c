@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include "eeprom.h"
 #include "joybus.h"
+#include "joybus_internal.h"
+#include "eeprom_internal.h"
 
 /**
  * @brief Read the status of the EEPROM.
@@ -84,9 +86,19 @@ void eeprom_read( uint8_t block, uint8_t * dest )
     memcpy( dest, &output[1], EEPROM_BLOCK_SIZE );
 }
 
-uint8_t eeprom_write( uint8_t block, const uint8_t * src )
+/**
+ * @brief Prepare the Joybus block of an EEPROM block write.
+ *
+ * @param[out] input
+ *             Joybus block to fill
+ * @param[in]  block
+ *             Block to write data to
+ * @param[in]  src
+ *             Source buffer (8 bytes)
+ */
+static void eeprom_write_input( uint64_t * input, uint8_t block, const uint8_t * src )
 {
-    uint64_t input[JOYBUS_BLOCK_DWORDS] =
+    const uint64_t write_block[JOYBUS_BLOCK_DWORDS] =
     {
         0x000000000a010500 | block,
         0x0000000000000000,
@@ -97,15 +109,49 @@ uint8_t eeprom_write( uint8_t block, const uint8_t * src )
         0,
         1
     };
-    uint64_t output[JOYBUS_BLOCK_DWORDS];
 
+    memcpy( input, write_block, JOYBUS_BLOCK_SIZE );
     memcpy( &input[1], src, EEPROM_BLOCK_SIZE );
+}
+
+uint8_t eeprom_write( uint8_t block, const uint8_t * src )
+{
+    uint64_t input[JOYBUS_BLOCK_DWORDS];
+    uint64_t output[JOYBUS_BLOCK_DWORDS];
+
+    eeprom_write_input( input, block, src );
 
     joybus_exec( input, output );
 
     return output[2] >> 56;
 }
 
+/**
+ * @brief Write a block to EEPROM in background.
+ *
+ * The write is queued to the Joybus and the function returns immediately;
+ * the source buffer can be reused right away. The callback is called under
+ * interrupt when the write command has been sent.
+ *
+ * @param[in] block
+ *            Block to write data to
+ * @param[in] src
+ *            Source buffer (8 bytes)
+ * @param[in] callback
+ *            Completion callback, or NULL
+ * @param[in] ctx
+ *            Context passed to the callback
+ */
+void __eeprom_write_async( uint8_t block, const uint8_t * src,
+                           void (*callback)(uint64_t *output, void *ctx), void * ctx )
+{
+    uint64_t input[JOYBUS_BLOCK_DWORDS];
+
+    eeprom_write_input( input, block, src );
+
+    joybus_exec_async( input, callback, ctx );
+}
+
 void eeprom_read_bytes( uint8_t * dest, size_t start, size_t len )
 {
     size_t bytes_left = len;
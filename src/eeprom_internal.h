@@ -0,0 +1,15 @@
+/**
+ * @file eeprom_internal.h
+ * @brief EEPROM internal API
+ * @ingroup eeprom
+ */
+
+#ifndef __LIBDRAGON_EEPROM_INTERNAL_H
+#define __LIBDRAGON_EEPROM_INTERNAL_H
+
+#include <stdint.h>
+
+void __eeprom_write_async( uint8_t block, const uint8_t * src,
+                           void (*callback)(uint64_t *output, void *ctx), void * ctx );
+
+#endif
@@ -10,6 +10,18 @@
 #include "utils.h"
 #include "eeprom.h"
 #include "eepromfs.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "n64sys.h"
+#include "joybus_internal.h"
+#include "eeprom_internal.h"
+
+/**
+ * @brief Delay between background EEPROM block writes (in milliseconds).
+ *
+ * An EEPROM is busy for approximately 15 milliseconds after each block write.
+ */
+#define EEPFS_WRITE_DELAY_MS 15
 
 /**
  * @brief EEPROM Filesystem file descriptor.
@@ -65,6 +77,41 @@ static eepfs_file_t * eepfs_files = NULL;
  */
 static uint16_t eepfs_files_checksum = 0;
 
+/**
+ * @brief Write-back mode state.
+ *
+ * In write-back mode, the blocks used by the filesystem are kept in RAM:
+ * files are read and written in RAM, and flushes write to EEPROM only the
+ * blocks that differ from the last image known to be persisted.
+ *
+ * @see #eepfs_set_writeback
+ */
+static struct
+{
+    /** @brief Current contents of the filesystem blocks (NULL if write-back is disabled) */
+    uint8_t * data;
+    /** @brief Contents of the filesystem blocks last written to (or read from) EEPROM */
+    uint8_t * persisted;
+    /** @brief Number of filesystem blocks */
+    size_t num_blocks;
+    /** @brief Timer spacing the background writes */
+    timer_link_t * timer;
+    /** @brief A background flush is in progress */
+    volatile bool flushing;
+    /** @brief The background flush must scan all blocks again when done */
+    volatile bool rescan;
+    /** @brief A background block write is queued to the Joybus */
+    volatile bool inflight;
+    /** @brief Next block checked by the background flush */
+    size_t next_block;
+    /** @brief Contents of the block being written in background */
+    uint8_t inflight_buf[EEPROM_BLOCK_SIZE];
+    /** @brief Bytes written by the current flush */
+    size_t flush_bytes;
+    /** @brief Flush statistics */
+    eepfs_flush_stats_t stats;
+} eepfs_wb;
+
 /**
  * @brief Calculates a CRC-16 checksum from an array of bytes.
  * 
@@ -205,6 +252,8 @@ static const eepfs_file_t * eepfs_get_file(int handle)
     return NULL;
 }
 
+static bool eepfs_flush_cancel(void);
+
 int eepfs_init(const eepfs_entry_t * entries, size_t count)
 {
     /* Check if EEPROM FS has already been initialized */
@@ -289,6 +338,9 @@ int eepfs_close(void)
         return EEPFS_EBADFS;
     }
 
+    /* Write back pending changes */
+    eepfs_set_writeback(false);
+
     /* Clear the file descriptor table */
     free(eepfs_files);
     eepfs_files = NULL;
@@ -315,6 +367,11 @@ int eepfs_read(const char * path, void * dest, size_t size)
     }
 
     const size_t start_bytes = file->start_block * EEPROM_BLOCK_SIZE;
+    if ( eepfs_wb.data != NULL )
+    {
+        memcpy(dest, eepfs_wb.data + start_bytes, file->num_bytes);
+        return EEPFS_ESUCCESS;
+    }
     eeprom_read_bytes(dest, start_bytes, file->num_bytes);
 
     return EEPFS_ESUCCESS;
@@ -337,6 +394,14 @@ int eepfs_write(const char * path, const void * src, size_t size)
     }
 
     const size_t start_bytes = file->start_block * EEPROM_BLOCK_SIZE;
+    if ( eepfs_wb.data != NULL )
+    {
+        /* Don't let a background flush see a partially updated block */
+        disable_interrupts();
+        memcpy(eepfs_wb.data + start_bytes, src, file->num_bytes);
+        enable_interrupts();
+        return EEPFS_ESUCCESS;
+    }
     eeprom_write_bytes(src, start_bytes, file->num_bytes);
 
     return EEPFS_ESUCCESS;
@@ -356,6 +421,14 @@ int eepfs_erase(const char * path)
     const size_t num_blocks = DIVIDE_CEIL(file->num_bytes, EEPROM_BLOCK_SIZE);
     size_t current_block = file->start_block;
 
+    if ( eepfs_wb.data != NULL )
+    {
+        disable_interrupts();
+        memset(eepfs_wb.data + current_block * EEPROM_BLOCK_SIZE, 0, num_blocks * EEPROM_BLOCK_SIZE);
+        enable_interrupts();
+        return EEPFS_ESUCCESS;
+    }
+
     /* eeprom_buf is initialized to all zeroes */
     const uint8_t eeprom_buf[EEPROM_BLOCK_SIZE] = {0};
 
@@ -384,6 +457,12 @@ bool eepfs_verify_signature(void)
 
 void eepfs_wipe(void)
 {
+    /* Don't let a background flush interleave with the wipe */
+    if ( eepfs_wb.data != NULL )
+    {
+        eepfs_flush_cancel();
+    }
+
     /* Write the filesystem signature into the first block */
     const uint64_t signature = eepfs_generate_signature();
     eeprom_write(0, (uint8_t *)&signature);
@@ -399,5 +478,253 @@ void eepfs_wipe(void)
     {
         eeprom_write(current_block++, eeprom_buf);
     }
+
+    /* The RAM images now match the wiped EEPROM */
+    if ( eepfs_wb.data != NULL )
+    {
+        const size_t image_size = eepfs_wb.num_blocks * EEPROM_BLOCK_SIZE;
+        memset(eepfs_wb.data, 0, image_size);
+        memcpy(eepfs_wb.data, &signature, EEPROM_BLOCK_SIZE);
+        memcpy(eepfs_wb.persisted, eepfs_wb.data, image_size);
+    }
+}
+
+static void eepfs_flush_timer(int ovfl);
+static void eepfs_flush_written(uint64_t * output, void * ctx);
+
+/**
+ * @brief Write the next modified block in background.
+ *
+ * If no block is left to write, the background flush is complete.
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void eepfs_flush_next(void)
+{
+    while ( true )
+    {
+        for ( ; eepfs_wb.next_block < eepfs_wb.num_blocks; ++eepfs_wb.next_block )
+        {
+            const size_t offset = eepfs_wb.next_block * EEPROM_BLOCK_SIZE;
+            if ( memcmp(eepfs_wb.data + offset, eepfs_wb.persisted + offset, EEPROM_BLOCK_SIZE) != 0 )
+            {
+                memcpy(eepfs_wb.inflight_buf, eepfs_wb.data + offset, EEPROM_BLOCK_SIZE);
+                eepfs_wb.inflight = true;
+                __eeprom_write_async(eepfs_wb.next_block, eepfs_wb.inflight_buf, eepfs_flush_written, NULL);
+                return;
+            }
+        }
+
+        /* Blocks already checked were modified while flushing */
+        if ( !eepfs_wb.rescan ) break;
+        eepfs_wb.rescan = false;
+        eepfs_wb.next_block = 0;
+    }
+
+    eepfs_wb.flushing = false;
+    eepfs_wb.stats.last_flush_bytes = eepfs_wb.flush_bytes;
+    eepfs_wb.stats.num_flushes++;
+}
+
+/**
+ * @brief Completion of a background block write (called under interrupt).
+ */
+static void eepfs_flush_written(uint64_t * output, void * ctx)
+{
+    const size_t offset = eepfs_wb.next_block * EEPROM_BLOCK_SIZE;
+    memcpy(eepfs_wb.persisted + offset, eepfs_wb.inflight_buf, EEPROM_BLOCK_SIZE);
+    eepfs_wb.flush_bytes += EEPROM_BLOCK_SIZE;
+    eepfs_wb.stats.total_bytes += EEPROM_BLOCK_SIZE;
+    eepfs_wb.next_block++;
+    eepfs_wb.inflight = false;
+
+    /* Give the EEPROM time to complete the write before the next one */
+    if ( eepfs_wb.flushing )
+    {
+        start_timer(eepfs_wb.timer, TICKS_FROM_MS(EEPFS_WRITE_DELAY_MS), TF_ONE_SHOT, eepfs_flush_timer);
+    }
+}
+
+/**
+ * @brief Timer callback of the background flush.
+ */
+static void eepfs_flush_timer(int ovfl)
+{
+    if ( eepfs_wb.flushing && !eepfs_wb.inflight )
+    {
+        eepfs_flush_next();
+    }
+}
+
+/**
+ * @brief Stop the background flush, if any.
+ *
+ * Wait for the block write in progress, if any.
+ *
+ * @return Whether a background flush was interrupted
+ */
+static bool eepfs_flush_cancel(void)
+{
+    disable_interrupts();
+    const bool was_flushing = eepfs_wb.flushing;
+    eepfs_wb.flushing = false;
+    stop_timer(eepfs_wb.timer);
+    enable_interrupts();
+
+    while ( eepfs_wb.inflight )
+    {
+        joybus_exec_poll();
+    }
+
+    return was_flushing;
+}
+
+/**
+ * @brief Count the bytes that differ between the RAM and EEPROM images.
+ *
+ * @return The number of bytes in the modified blocks
+ */
+static size_t eepfs_pending_bytes(void)
+{
+    size_t bytes = 0;
+    for ( size_t i = 0; i < eepfs_wb.num_blocks * EEPROM_BLOCK_SIZE; i += EEPROM_BLOCK_SIZE )
+    {
+        if ( memcmp(eepfs_wb.data + i, eepfs_wb.persisted + i, EEPROM_BLOCK_SIZE) != 0 )
+        {
+            bytes += EEPROM_BLOCK_SIZE;
+        }
+    }
+    return bytes;
+}
+
+int eepfs_set_writeback(bool enabled)
+{
+    if ( eepfs_files == NULL || eepfs_files_count == 0 )
+    {
+        return EEPFS_EBADFS;
+    }
+
+    if ( enabled )
+    {
+        if ( eepfs_wb.data != NULL )
+        {
+            /* Already enabled */
+            return EEPFS_ESUCCESS;
+        }
+
+        /* The last file ends at the last filesystem block */
+        const eepfs_file_t * last = &eepfs_files[eepfs_files_count - 1];
+        const size_t num_blocks = last->start_block + DIVIDE_CEIL(last->num_bytes, EEPROM_BLOCK_SIZE);
+        const size_t image_size = num_blocks * EEPROM_BLOCK_SIZE;
+
+        uint8_t * images = malloc(image_size * 2);
+        if ( images == NULL )
+        {
+            return EEPFS_ENOMEM;
+        }
+
+        /* Both images start as the current EEPROM contents */
+        eeprom_read_bytes(images, 0, image_size);
+        memcpy(images + image_size, images, image_size);
+
+        memset(&eepfs_wb, 0, sizeof(eepfs_wb));
+        eepfs_wb.persisted = images + image_size;
+        eepfs_wb.num_blocks = num_blocks;
+        timer_init();
+        eepfs_wb.timer = new_timer(0, TF_ONE_SHOT | TF_DISABLED, eepfs_flush_timer);
+        eepfs_wb.data = images;
+        return EEPFS_ESUCCESS;
+    }
+
+    if ( eepfs_wb.data == NULL )
+    {
+        /* Already disabled */
+        return EEPFS_ESUCCESS;
+    }
+
+    eepfs_flush();
+
+    delete_timer(eepfs_wb.timer);
+    timer_close();
+    free(eepfs_wb.data);
+    memset(&eepfs_wb, 0, sizeof(eepfs_wb));
+    return EEPFS_ESUCCESS;
+}
+
+int eepfs_flush(void)
+{
+    if ( eepfs_wb.data == NULL )
+    {
+        /* Nothing to flush: writes go straight to EEPROM */
+        return 0;
+    }
+
+    /* Take over a background flush in progress, accounting its writes */
+    if ( !eepfs_flush_cancel() )
+    {
+        eepfs_wb.flush_bytes = 0;
+    }
+
+    uint8_t eeprom_buf[EEPROM_BLOCK_SIZE];
+    for ( size_t block = 0; block < eepfs_wb.num_blocks; ++block )
+    {
+        const size_t offset = block * EEPROM_BLOCK_SIZE;
+        if ( memcmp(eepfs_wb.data + offset, eepfs_wb.persisted + offset, EEPROM_BLOCK_SIZE) != 0 )
+        {
+            memcpy(eeprom_buf, eepfs_wb.data + offset, EEPROM_BLOCK_SIZE);
+            eeprom_write(block, eeprom_buf);
+            memcpy(eepfs_wb.persisted + offset, eeprom_buf, EEPROM_BLOCK_SIZE);
+            eepfs_wb.flush_bytes += EEPROM_BLOCK_SIZE;
+            eepfs_wb.stats.total_bytes += EEPROM_BLOCK_SIZE;
+        }
+    }
+
+    eepfs_wb.stats.last_flush_bytes = eepfs_wb.flush_bytes;
+    eepfs_wb.stats.num_flushes++;
+    return eepfs_wb.flush_bytes;
+}
+
+int eepfs_flush_async(void)
+{
+    if ( eepfs_wb.data == NULL )
+    {
+        return 0;
+    }
+
+    const int pending = eepfs_pending_bytes();
+
+    disable_interrupts();
+    if ( eepfs_wb.flushing )
+    {
+        /* Extend the flush in progress to the latest changes */
+        eepfs_wb.rescan = true;
+    }
+    else if ( pending > 0 )
+    {
+        eepfs_wb.flushing = true;
+        eepfs_wb.rescan = false;
+        eepfs_wb.next_block = 0;
+        eepfs_wb.flush_bytes = 0;
+        eepfs_flush_next();
+    }
+    enable_interrupts();
+
+    return pending;
+}
+
+eepfs_flush_stats_t eepfs_get_flush_stats(void)
+{
+    eepfs_flush_stats_t stats = {0};
+
+    if ( eepfs_wb.data != NULL )
+    {
+        disable_interrupts();
+        stats = eepfs_wb.stats;
+        stats.pending_bytes = eepfs_pending_bytes();
+        stats.flushing = eepfs_wb.flushing;
+        enable_interrupts();
+    }
+
+    return stats;
 }
 
@@ -4,6 +4,7 @@
  * @ingroup graphics
  */
 #include <stdint.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 #include <stdio.h>
@@ -22,6 +23,8 @@ static struct {
     sprite_t *sprite;
     int font_width;
     int font_height;
+    int num_glyphs;     ///< Number of glyphs in the font sprite
+    uint32_t *masks;    ///< Precomputed masks of active pixels for each glyph row (or NULL)
 } sprite_font = { .sprite = NULL, .font_width = 8, .font_height = 8 };
 
 
@@ -115,6 +118,17 @@ void graphics_set_color( uint32_t forecolor, uint32_t backcolor )
     b_color = backcolor;
 }
 
+/**
+ * @brief Return the colors set with #graphics_set_color
+ *
+ * This is used by the console to notice color changes.
+ */
+void __graphics_get_color( uint32_t *forecolor, uint32_t *backcolor )
+{
+    *forecolor = f_color;
+    *backcolor = b_color;
+}
+
 /**
  * @brief Return whether a color is fully transparent at a particular bit depth
  *
@@ -142,6 +156,121 @@ static int __is_transparent( int bitdepth, uint32_t color )
     return 0;
 }
 
+/**
+ * @brief Blend a color on top of a 32-bit pixel
+ *
+ * The source color components must be already multiplied by the source alpha,
+ * so that they can be computed once per span rather than once per pixel.
+ *
+ * @param[in] cur_color
+ *            Current 32-bit color of the pixel
+ * @param[in] sr
+ *            Red component of the new color, multiplied by its alpha
+ * @param[in] sg
+ *            Green component of the new color, multiplied by its alpha
+ * @param[in] sb
+ *            Blue component of the new color, multiplied by its alpha
+ * @param[in] ct
+ *            Inverse alpha of the new color (255 - alpha)
+ *
+ * @return The blended 32-bit color (always opaque)
+ */
+static inline uint32_t __blend32( uint32_t cur_color, uint32_t sr, uint32_t sg, uint32_t sb, uint32_t ct )
+{
+    uint32_t r = ((((cur_color >> 24) & 0xFF) * ct) + sr) >> 8;
+    uint32_t g = ((((cur_color >> 16) & 0xFF) * ct) + sg) >> 8;
+    uint32_t b = ((((cur_color >> 8) & 0xFF) * ct) + sb) >> 8;
+
+    /* Since we are doing mixing anyway */
+    return (r << 24) | (g << 16) | (b << 8) | 0xFF;
+}
+
+/**
+ * @brief Fill a span of 16-bit pixels with a color
+ *
+ * The aligned part of the span is filled with 64-bit stores.
+ *
+ * @param[out] buffer
+ *             Pointer to the first pixel of the span
+ * @param[in]  count
+ *             Number of pixels to fill
+ * @param[in]  color
+ *             16-bit color to fill the span with
+ */
+static void __fill_span16( uint16_t *buffer, int count, uint16_t color )
+{
+    while( count > 0 && ((uint32_t)buffer & 7) ) { *buffer++ = color; count--; }
+
+    uint64_t c64 = color * 0x0001000100010001ull;
+    uint64_t *buffer64 = (uint64_t *)buffer;
+    for( ; count >= 4; count -= 4 ) { *buffer64++ = c64; }
+
+    buffer = (uint16_t *)buffer64;
+    while( count-- > 0 ) { *buffer++ = color; }
+}
+
+/**
+ * @brief Fill a span of 32-bit pixels with a color
+ *
+ * The aligned part of the span is filled with 64-bit stores.
+ *
+ * @param[out] buffer
+ *             Pointer to the first pixel of the span
+ * @param[in]  count
+ *             Number of pixels to fill
+ * @param[in]  color
+ *             32-bit color to fill the span with
+ */
+static void __fill_span32( uint32_t *buffer, int count, uint32_t color )
+{
+    if( count > 0 && ((uint32_t)buffer & 7) ) { *buffer++ = color; count--; }
+
+    uint64_t c64 = ((uint64_t)color << 32) | color;
+    uint64_t *buffer64 = (uint64_t *)buffer;
+    for( ; count >= 2; count -= 2 ) { *buffer64++ = c64; }
+
+    if( count > 0 ) { *(uint32_t *)buffer64 = color; }
+}
+
+/**
+ * @brief Fill a rectangle of the surface with a color, one span per line
+ *
+ * @param[in] disp
+ *            The currently active display context
+ * @param[in] x
+ *            The X coordinate of the top left of the rectangle
+ * @param[in] y
+ *            The Y coordinate of the top left of the rectangle
+ * @param[in] width
+ *            The width in pixels of the rectangle
+ * @param[in] height
+ *            The height in pixels of the rectangle
+ * @param[in] color
+ *            The color of the rectangle
+ */
+static void __fill_rect( surface_t* disp, int x, int y, int width, int height, uint32_t color )
+{
+    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
+    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
+    {
+        uint16_t *buffer16 = (uint16_t *)__get_buffer( disp );
+
+        for( int j = y; j < y + height; j++ )
+        {
+            __fill_span16( &__get_pixel( buffer16, x, j ), width, color );
+        }
+    }
+    else
+    {
+        uint32_t *buffer32 = (uint32_t *)__get_buffer( disp );
+
+        for( int j = y; j < y + height; j++ )
+        {
+            __fill_span32( &__get_pixel( buffer32, x, j ), width, color );
+        }
+    }
+}
+
 void graphics_draw_pixel( surface_t* disp, int x, int y, uint32_t color )
 {
     if( disp == 0 ) { return; }
@@ -172,41 +301,102 @@ void graphics_draw_pixel_trans( surface_t* disp, int x, int y, uint32_t color )
     }
     else
     {
-        /* Get 32bit representations */
-        uint32_t cur_color = __get_pixel( (uint32_t *)__get_buffer( disp ), x, y );
-
-        /* Get current color */
-        uint32_t cr = (cur_color >> 24) & 0xFF;
-        uint32_t cg = (cur_color >> 16) & 0xFF;
-        uint32_t cb = (cur_color >> 8) & 0xFF;
-
-        /* Get new color */
-        uint32_t sr = (color >> 24) & 0xFF;
-        uint32_t sg = (color >> 16) & 0xFF;
-        uint32_t sb = (color >> 8) & 0xFF;
+        uint32_t *buffer32 = (uint32_t *)__get_buffer( disp );
 
         /* Transparencies */
         uint32_t st = color & 0xFF;
         uint32_t ct = 255 - st;
 
-        /* Mixed color */
-        uint32_t mixed_color;
-        uint8_t *final_color = (uint8_t *)(&mixed_color);
+        __set_pixel( buffer32, x, y, __blend32( __get_pixel( buffer32, x, y ),
+            ((color >> 24) & 0xFF) * st, ((color >> 16) & 0xFF) * st, ((color >> 8) & 0xFF) * st, ct ) );
+    }
+}
+
+/**
+ * @brief Blend a color on top of a rectangle of the surface, one span per line
+ *
+ * @param[in] disp
+ *            The currently active display context
+ * @param[in] x
+ *            The X coordinate of the top left of the rectangle
+ * @param[in] y
+ *            The Y coordinate of the top left of the rectangle
+ * @param[in] width
+ *            The width in pixels of the rectangle
+ * @param[in] height
+ *            The height in pixels of the rectangle
+ * @param[in] color
+ *            The color of the rectangle
+ */
+static void __blend_rect( surface_t* disp, int x, int y, int width, int height, uint32_t color )
+{
+    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
+    {
+        /* Only display the rectangle if alpha bit is set */
+        if( !__is_transparent( 2, color ) )
+        {
+            __fill_rect( disp, x, y, width, height, color );
+        }
+        return;
+    }
+
+    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
+    uint32_t *buffer32 = (uint32_t *)__get_buffer( disp );
 
-        final_color[0] = ((cr * ct) + (sr * st)) >> 8;
-        final_color[1] = ((cg * ct) + (sg * st)) >> 8;
-        final_color[2] = ((cb * ct) + (sb * st)) >> 8;
+    /* Source color and transparencies are the same for all pixels */
+    uint32_t st = color & 0xFF;
+    uint32_t ct = 255 - st;
+    uint32_t sr = ((color >> 24) & 0xFF) * st;
+    uint32_t sg = ((color >> 16) & 0xFF) * st;
+    uint32_t sb = ((color >> 8) & 0xFF) * st;
 
-        /* Since we are doing mixing anyway */
-        final_color[3] = 255;
+    for( int j = y; j < y + height; j++ )
+    {
+        uint32_t *span = &__get_pixel( buffer32, x, j );
 
-        __set_pixel( (uint32_t *)__get_buffer( disp ), x, y, mixed_color );
+        for( int i = 0; i < width; i++ )
+        {
+            span[i] = __blend32( span[i], sr, sg, sb, ct );
+        }
     }
 }
 
+/**
+ * @brief Draw a horizontal or vertical line as a rectangle, if possible
+ *
+ * @param[in] disp
+ *            The currently active display context
+ * @param[in] x0, y0, x1, y1
+ *            The coordinates of the line end points (inclusive)
+ * @param[in] color
+ *            The color of the line
+ * @param[in] rect
+ *            The function used to draw the rectangle
+ *
+ * @retval true if the line was drawn
+ * @retval false if the line is diagonal and must be drawn pixel by pixel
+ */
+static bool __draw_line_span( surface_t* disp, int x0, int y0, int x1, int y1, uint32_t color,
+    void (*rect)(surface_t*, int, int, int, int, uint32_t) )
+{
+    if( x0 > x1 ) { int t = x0; x0 = x1; x1 = t; }
+    if( y0 > y1 ) { int t = y0; y0 = y1; y1 = t; }
+
+    if( y0 == y1 || x0 == x1 )
+    {
+        rect( disp, x0, y0, x1 - x0 + 1, y1 - y0 + 1, color );
+        return true;
+    }
+    return false;
+}
+
 void graphics_draw_line( surface_t* disp, int x0, int y0, int x1, int y1, uint32_t color )
 {
+	if( disp == 0 ) { return; }
+	if( __draw_line_span( disp, x0, y0, x1, y1, color, __fill_rect ) ) { return; }
+
 	int dy = y1 - y0;
+
 	int dx = x1 - x0;
 	int sx, sy;
 
@@ -264,6 +454,9 @@ void graphics_draw_line( surface_t* disp, int x0, int y0, int x1, int y1, uint32
 
 void graphics_draw_line_trans( surface_t* disp, int x0, int y0, int x1, int y1, uint32_t color )
 {
+	if( disp == 0 ) { return; }
+	if( __draw_line_span( disp, x0, y0, x1, y1, color, __blend_rect ) ) { return; }
+
 	int dy = y1 - y0;
 	int dx = x1 - x0;
 	int sx, sy;
@@ -324,94 +517,14 @@ void graphics_draw_box( surface_t* disp, int x, int y, int width, int height, ui
 {
     if( disp == 0 ) { return; }
 
-    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
-    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
-    {
-        uint16_t *buffer16 = (uint16_t *)__get_buffer( disp );
-
-        for(int j = y; j < y + height; j++)
-        {
-            for(int i = x; i < x + width; i++)
-            {
-                __set_pixel( buffer16, i, j, color );
-            }
-        }
-    }
-    else
-    {
-        uint32_t *buffer32 = (uint32_t *)__get_buffer( disp );
-
-        for(int j = y; j < y + height; j++)
-        {
-            for(int i = x; i < x + width; i++)
-            {
-                __set_pixel( buffer32, i, j, color );
-            }
-        }
-    }
+    __fill_rect( disp, x, y, width, height, color );
 }
 
 void graphics_draw_box_trans( surface_t* disp, int x, int y, int width, int height, uint32_t color )
 {
     if( disp == 0 ) { return; }
 
-    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
-    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
-    {
-        uint16_t *buffer16 = (uint16_t *)__get_buffer( disp );
-
-        for(int j = y; j < y + height; j++)
-        {
-            for(int i = x; i < x + width; i++)
-            {
-                /* Only display the pixel if alpha bit is set */
-                if( !__is_transparent( 2, color ) )
-                {
-                    __set_pixel( buffer16, i, j, color );
-                }
-            }
-        }
-    }
-    else
-    {
-        uint32_t *buffer32 = (uint32_t *)__get_buffer( disp );
-
-        for(int j = y; j < y + height; j++)
-        {
-            for(int i = x; i < x + width; i++)
-            {
-                /* Get 32bit representations */
-                uint32_t cur_color = __get_pixel( buffer32, i, j );
-
-                /* Get current color */
-                uint32_t cr = (cur_color >> 24) & 0xFF;
-                uint32_t cg = (cur_color >> 16) & 0xFF;
-                uint32_t cb = (cur_color >> 8) & 0xFF;
-
-                /* Get new color */
-                uint32_t sr = (color >> 24) & 0xFF;
-                uint32_t sg = (color >> 16) & 0xFF;
-                uint32_t sb = (color >> 8) & 0xFF;
-
-                /* Transparencies */
-                uint32_t st = color & 0xFF;
-                uint32_t ct = 255 - st;
-
-                /* Mixed color */
-                uint32_t mixed_color;
-                uint8_t *final_color = (uint8_t *)(&mixed_color);
-
-                final_color[0] = ((cr * ct) + (sr * st)) >> 8;
-                final_color[1] = ((cg * ct) + (sg * st)) >> 8;
-                final_color[2] = ((cb * ct) + (sb * st)) >> 8;
-
-                /* Since we are doing mixing anyway */
-                final_color[3] = 255;
-
-                __set_pixel( buffer32, i, j, mixed_color );
-            }
-        }
-    }
+    __blend_rect( disp, x, y, width, height, color );
 }
 
 void graphics_fill_screen( surface_t* disp, uint32_t c )
@@ -428,16 +541,143 @@ void graphics_fill_screen( surface_t* disp, uint32_t c )
 
 void graphics_set_default_font( void )
 {
+    free( sprite_font.masks );
+    sprite_font.masks = NULL;
     sprite_font.sprite = NULL;
     sprite_font.font_width = 8;
     sprite_font.font_height = 8;
 }
 
+/**
+ * @brief Compute the mask of the active pixels of a row of a sprite font
+ *
+ * @param[in] font
+ *            Pixels of the sprite font
+ * @param[in] x
+ *            X coordinate of the first pixel of the row
+ * @param[in] y
+ *            Y coordinate of the row
+ * @param[in] width
+ *            Number of pixels in the row (max 32)
+ *
+ * @return Mask of the active pixels, starting from the most significant bit
+ */
+static uint32_t __font_row_mask( surface_t *font, int x, int y, int width )
+{
+    uint32_t mask = 0;
+    int depth = TEX_FORMAT_BITDEPTH(surface_get_format( font ));
+
+    for( int i = 0; i < width; i++ )
+    {
+        uint32_t c = (depth == 16) ?
+            ((uint16_t *)(font->buffer + y * font->stride))[x + i] :
+            ((uint32_t *)(font->buffer + y * font->stride))[x + i];
+        if( !__is_transparent( depth / 8, c ) ) { mask |= 0x80000000u >> i; }
+    }
+    return mask;
+}
+
 void graphics_set_font_sprite( sprite_t *font )
 {
+    graphics_set_default_font();
+    __sprite_upgrade( font );
     sprite_font.sprite = font;
     sprite_font.font_width = sprite_font.sprite->width / sprite_font.sprite->hslices;
     sprite_font.font_height = sprite_font.sprite->height / sprite_font.sprite->vslices;
+
+    /* Precompute the masks of active pixels of each glyph row, so that
+       drawing a character doesn't need to check the font pixels. Fonts
+       wider than 32 pixels compute them while drawing. */
+    if( sprite_font.font_width <= 32 )
+    {
+        surface_t pixels = sprite_get_pixels( font );
+
+        sprite_font.num_glyphs = font->hslices * font->vslices;
+        sprite_font.masks = malloc( sprite_font.num_glyphs * sprite_font.font_height * sizeof(uint32_t) );
+        for( int ch = 0; ch < sprite_font.num_glyphs; ch++ )
+        {
+            const int sx = ( ch % font->hslices ) * sprite_font.font_width;
+            const int sy = ( ch / font->hslices ) * sprite_font.font_height;
+
+            for( int row = 0; row < sprite_font.font_height; row++ )
+            {
+                sprite_font.masks[ch * sprite_font.font_height + row] =
+                    __font_row_mask( &pixels, sx, sy + row, sprite_font.font_width );
+            }
+        }
+    }
+}
+
+/**
+ * @brief Draw a row of a glyph on a 16-bit buffer
+ *
+ * @param[out] buffer
+ *             Pointer to the first pixel of the row
+ * @param[in]  mask
+ *             Mask of the active pixels, starting from the most significant bit
+ * @param[in]  width
+ *             Number of pixels of the row
+ * @param[in]  trans
+ *             Whether the background is transparent
+ */
+static void __draw_glyph_row16( uint16_t *buffer, uint32_t mask, int width, int trans )
+{
+    if( trans )
+    {
+        /* Only draw the runs of active pixels */
+        while( mask )
+        {
+            int skip = __builtin_clz( mask );
+            mask <<= skip; buffer += skip;
+            int run = ~mask ? __builtin_clz( ~mask ) : 32;
+            __fill_span16( buffer, run, f_color );
+            mask = (run < 32) ? mask << run : 0; buffer += run;
+        }
+    }
+    else
+    {
+        /* Display foreground or background depending on font data */
+        for( int col = 0; col < width; col++, mask <<= 1 )
+        {
+            buffer[col] = (mask & 0x80000000u) ? f_color : b_color;
+        }
+    }
+}
+
+/**
+ * @brief Draw a row of a glyph on a 32-bit buffer
+ *
+ * @param[out] buffer
+ *             Pointer to the first pixel of the row
+ * @param[in]  mask
+ *             Mask of the active pixels, starting from the most significant bit
+ * @param[in]  width
+ *             Number of pixels of the row
+ * @param[in]  trans
+ *             Whether the background is transparent
+ */
+static void __draw_glyph_row32( uint32_t *buffer, uint32_t mask, int width, int trans )
+{
+    if( trans )
+    {
+        /* Only draw the runs of active pixels */
+        while( mask )
+        {
+            int skip = __builtin_clz( mask );
+            mask <<= skip; buffer += skip;
+            int run = ~mask ? __builtin_clz( ~mask ) : 32;
+            __fill_span32( buffer, run, f_color );
+            mask = (run < 32) ? mask << run : 0; buffer += run;
+        }
+    }
+    else
+    {
+        /* Display foreground or background depending on font data */
+        for( int col = 0; col < width; col++, mask <<= 1 )
+        {
+            buffer[col] = (mask & 0x80000000u) ? f_color : b_color;
+        }
+    }
 }
 
 void graphics_draw_character( surface_t* disp, int x, int y, char ch )
@@ -456,135 +696,42 @@ void graphics_draw_character( surface_t* disp, int x, int y, char ch )
     /* Figure out if they want the background to be transparent */
     int trans = __is_transparent( depth, b_color );
 
-    if ( sprite_font.sprite != NULL )
+    for( int row = 0; row < sprite_font.font_height; row++ )
     {
-        // Use custom font
-        const int sx = ( ch % sprite_font.sprite->hslices ) * sprite_font.font_width;
-        const int sy = ( ch / sprite_font.sprite->hslices ) * sprite_font.font_height;
-        const int ex = sx + sprite_font.font_width;
-        const int ey = sy + sprite_font.font_height;
-
-        const int tx = x - sx;
-        const int ty = y - sy;
-
-        if( depth == 2 )
+        /* Draw the glyph in chunks of (at most) 32 pixels, as that's the size of the masks */
+        for( int col = 0; col < sprite_font.font_width; col += 32 )
         {
-            uint16_t *buffer = (uint16_t *)__get_buffer( disp );
-            uint16_t *sp_data = (uint16_t *)sprite_font.sprite->data;
+            int width = sprite_font.font_width - col;
+            if( width > 32 ) { width = 32; }
 
-            for( int yp = sy; yp < ey; yp++ )
+            uint32_t mask;
+            if( sprite_font.sprite == NULL )
             {
-                const register int run = yp * sprite_font.sprite->width;
-
-                for( int xp = sx; xp < ex; xp++ )
-                {
-                    const char c = sp_data[xp + run];
-                    int active = !__is_transparent (depth, c);
-                    if( trans )
-                    {
-                        if( active )
-                        {
-                            /* Only draw it if it is active */
-                            __set_pixel( buffer, tx + xp, ty + yp, f_color );
-                        }
-                    }
-                    else
-                    {
-                        /* Display foreground or background depending on font data */
-                        __set_pixel( buffer, tx + xp, ty + yp, active ? f_color : b_color );
-                    }
-                }
+                // Use 1bpp default font
+                mask = (uint32_t)__font_data[(ch * 8) + row] << 24;
             }
-        }
-        else
-        {
-            uint32_t *buffer = (uint32_t *)__get_buffer( disp );
-            uint32_t *sp_data = (uint32_t *)sprite_font.sprite->data;
-
-            for( int yp = sy; yp < ey; yp++ )
+            else if( sprite_font.masks != NULL )
             {
-                const register int run = yp * sprite_font.sprite->width;
-
-                for( int xp = sx; xp < ex; xp++ )
-                {
-                    const char c = sp_data[xp + run];
-                    int active = !__is_transparent (depth, c);
-                    if( trans )
-                    {
-                        if( active )
-                        {
-                            /* Only draw it if it is active */
-                            __set_pixel( buffer, tx + xp, ty + yp, f_color );
-                        }
-                    }
-                    else
-                    {
-                        /* Display foreground or background depending on font data */
-                        __set_pixel( buffer, tx + xp, ty + yp, active ? f_color : b_color );
-                    }
-                }
+                // Use custom font, with precomputed masks
+                if( (unsigned char)ch >= sprite_font.num_glyphs ) { return; }
+                mask = sprite_font.masks[(unsigned char)ch * sprite_font.font_height + row];
             }
-        }
-    } else {
-        // Use 1bpp default font
-        int trans = __is_transparent( depth, b_color );
-
-        if( depth == 2 )
-        {
-            uint16_t *buffer = (uint16_t *)__get_buffer( disp );
-
-            for( int row = 0; row < 8; row++ )
+            else
             {
-                unsigned char c = __font_data[(ch * 8) + row];
-
-                for( int col = 0; col < 8; col++ )
-                {
-                    int active = (c & 0x80) != 0;
-                    if( trans )
-                    {
-                        if( active )
-                        {
-                            /* Only draw it if it is active */
-                            __set_pixel( buffer, x + col, y + row, f_color );
-                        }
-                    }
-                    else
-                    {
-                        /* Display foreground or background depending on font data */
-                        __set_pixel( buffer, x + col, y + row, active ? f_color : b_color );
-                    }
-
-                    c <<= 1;
-                }
+                // Use custom font
+                surface_t pixels = sprite_get_pixels( sprite_font.sprite );
+                const int sx = ( ch % sprite_font.sprite->hslices ) * sprite_font.font_width;
+                const int sy = ( ch / sprite_font.sprite->hslices ) * sprite_font.font_height;
+                mask = __font_row_mask( &pixels, sx + col, sy + row, width );
             }
-        }
-        else
-        {
-            uint32_t *buffer = (uint32_t *)__get_buffer( disp );
 
-            for( int row = 0; row < 8; row++ )
+            if( depth == 2 )
             {
-                unsigned char c = __font_data[(ch * 8) + row];
-
-                for( int col = 0; col < 8; col++ )
-                {
-                    int active = (c & 0x80) != 0;
-                    if( trans )
-                    {
-                        if( active )
-                        {
-                            /* Only draw it if it is active */
-                            __set_pixel( buffer, x + col, y + row, f_color );
-                        }
-                    }
-                    else
-                    {
-                        /* Display foreground or background depending on font data */
-                        __set_pixel( buffer, x + col, y + row, active ? f_color : b_color );
-                    }
-
-                    c <<= 1;
-                }
+                __draw_glyph_row16( &__get_pixel( (uint16_t *)__get_buffer( disp ), x + col, y + row ), mask, width, trans );
+            }
+            else
+            {
+                __draw_glyph_row32( &__get_pixel( (uint32_t *)__get_buffer( disp ), x + col, y + row ), mask, width, trans );
             }
         }
     }
@@ -707,35 +854,20 @@ void graphics_draw_sprite_stride( surface_t* disp, int x, int y, sprite_t *sprit
     int depth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
 
     /* Only display sprite if it matches the bitdepth */
-    if( depth == 16 && TEX_FORMAT_BITDEPTH(sprite_get_format(sprite)) == 16 )
-    {
-        uint16_t *buffer = (uint16_t *)__get_buffer( disp );
-        uint16_t *sp_data = (uint16_t *)sprite->data;
+    int sp_depth = TEX_FORMAT_BITDEPTH(sprite_get_format(sprite));
+    if( depth != sp_depth || (depth != 16 && depth != 32) ) { return; }
+    if( sx >= ex ) { return; }
 
-        for( int yp = sy; yp < ey; yp++ )
-        {
-            const register int run = yp * sprite->width;
+    /* Copy the sprite one row at a time */
+    surface_t src = sprite_get_pixels( sprite );
+    int bpp = depth / 8;
+    uint8_t *buffer = (uint8_t *)__get_buffer( disp );
 
-            for( int xp = sx; xp < ex; xp++ )
-            {
-                __set_pixel( buffer, tx + xp, ty + yp, sp_data[xp + run] );
-            }
-        }
-    }
-    else if( depth == 32 && TEX_FORMAT_BITDEPTH(sprite_get_format(sprite)) == 32 )
+    for( int yp = sy; yp < ey; yp++ )
     {
-        uint32_t *buffer = (uint32_t *)__get_buffer( disp );
-        uint32_t *sp_data = (uint32_t *)sprite->data;
-
-        for( int yp = sy; yp < ey; yp++ )
-        {
-            const register int run = yp * sprite->width;
-
-            for( int xp = sx; xp < ex; xp++ )
-            {
-                __set_pixel( buffer, tx + xp, ty + yp, sp_data[xp + run] );
-            }
-        }
+        memcpy( buffer + ((ty + yp) * pix_stride + tx + sx) * bpp,
+                (uint8_t *)src.buffer + yp * src.stride + sx * bpp,
+                (ex - sx) * bpp );
     }
 }
 
@@ -822,66 +954,53 @@ void graphics_draw_sprite_trans_stride( surface_t* disp, int x, int y, sprite_t
     int depth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
 
     /* Only display sprite if it matches the bitdepth */
+    surface_t src = sprite_get_pixels( sprite );
     if( depth == 16 && TEX_FORMAT_BITDEPTH(sprite_get_format(sprite)) == 16 )
     {
         uint16_t *buffer = (uint16_t *)__get_buffer( disp );
-        uint16_t *sp_data = (uint16_t *)sprite->data;
 
         for( int yp = sy; yp < ey; yp++ )
         {
-            const register int run = yp * sprite->width;
+            const uint16_t *sp_row = (const uint16_t *)(src.buffer + yp * src.stride);
+            uint16_t *row = &__get_pixel( buffer, tx, ty + yp );
 
-            for( int xp = sx; xp < ex; xp++ )
+            /* Skip runs of transparent pixels, and copy runs of opaque ones */
+            for( int xp = sx; xp < ex; )
             {
-                /* Only display the pixel if alpha bit is set */
-                if( !__is_transparent( 2, sp_data[xp + run] ) )
-                {
-                    __set_pixel( buffer, tx + xp, ty + yp, sp_data[xp + run] );
-                }
+                while( xp < ex && __is_transparent( 2, sp_row[xp] ) ) { xp++; }
+                int start = xp;
+                while( xp < ex && !__is_transparent( 2, sp_row[xp] ) ) { xp++; }
+                if( xp > start ) { memcpy( &row[start], &sp_row[start], (xp - start) * 2 ); }
             }
         }
     }
     else if( depth == 32 && TEX_FORMAT_BITDEPTH(sprite_get_format(sprite)) == 32 )
     {
         uint32_t *buffer = (uint32_t *)__get_buffer( disp );
-        uint32_t *sp_data = (uint32_t *)sprite->data;
 
         for( int yp = sy; yp < ey; yp++ )
         {
-            const int run = yp * sprite->width;
+            const uint32_t *sp_row = (const uint32_t *)(src.buffer + yp * src.stride);
+            uint32_t *row = &__get_pixel( buffer, tx, ty + yp );
 
-            for( int xp = sx; xp < ex; xp++ )
+            /* Skip runs of transparent pixels, copy runs of opaque ones,
+               and blend the translucent ones */
+            for( int xp = sx; xp < ex; )
             {
-                /* Get 32bit representations */
-                uint8_t *new_color = (uint8_t *)(&sp_data[xp + run]);
-                uint32_t cur_color = __get_pixel( buffer, tx + xp, ty + yp );
+                while( xp < ex && (sp_row[xp] & 0xFF) == 0x00 ) { xp++; }
+                int start = xp;
+                while( xp < ex && (sp_row[xp] & 0xFF) == 0xFF ) { xp++; }
+                if( xp > start ) { memcpy( &row[start], &sp_row[start], (xp - start) * 4 ); }
 
-                /* Get current color */
-                uint32_t cr = (cur_color >> 24) & 0xFF;
-                uint32_t cg = (cur_color >> 16) & 0xFF;
-                uint32_t cb = (cur_color >> 8) & 0xFF;
-
-                /* Get new color */
-                uint32_t sr = new_color[0];
-                uint32_t sg = new_color[1];
-                uint32_t sb = new_color[2];
-
-                /* Transparencies */
-                uint32_t st = new_color[3];
-                uint32_t ct = 255 - st;
-
-                /* Mixed color */
-                uint32_t mixed_color;
-                uint8_t *final_color = (uint8_t *)(&mixed_color);
-
-                final_color[0] = ((cr * ct) + (sr * st)) >> 8;
-                final_color[1] = ((cg * ct) + (sg * st)) >> 8;
-                final_color[2] = ((cb * ct) + (sb * st)) >> 8;
-
-                /* Since we are doing mixing anyway */
-                final_color[3] = 255;
+                for( ; xp < ex; xp++ )
+                {
+                    uint32_t color = sp_row[xp];
+                    uint32_t st = color & 0xFF;
+                    if( st == 0x00 || st == 0xFF ) { break; }
 
-                __set_pixel( buffer, tx + xp, ty + yp, mixed_color );
+                    row[xp] = __blend32( row[xp], ((color >> 24) & 0xFF) * st,
+                        ((color >> 16) & 0xFF) * st, ((color >> 8) & 0xFF) * st, 255 - st );
+                }
             }
         }
     }
@@ -68,6 +68,10 @@ static joybus_msg_t joybus_msgs[MAX_JOYBUS_MSGS];
 static volatile int msgs_widx;
 /** @brief Pending messages read index */
 static volatile int msgs_ridx;
+/** @brief Time at which the SI became busy (only valid if not idle) */
+static uint32_t joybus_busy_start;
+/** @brief Total time spent by the SI processing joybus messages */
+static volatile uint64_t joybus_busy_ticks;
 
 static void si_interrupt(void);
 
@@ -158,6 +162,7 @@ static void joybus_poll(void) {
 
     // Queue is empty, switch to idle state
     joybus_state = JOYBUS_STATE_IDLE;
+    joybus_busy_ticks += TICKS_DISTANCE(joybus_busy_start, TICKS_READ());
 }
 
 /**
@@ -242,9 +247,49 @@ void joybus_exec_async(const void * input, void (*callback)(uint64_t *output, vo
     // Increment the write index. If the joybus subsystem is idle, poll immediately
     // so that we can begin sending the message.
     msgs_widx = (msgs_widx + 1) % MAX_JOYBUS_MSGS;
-    if (joybus_state == JOYBUS_STATE_IDLE)
+    if (joybus_state == JOYBUS_STATE_IDLE) {
+        joybus_busy_start = TICKS_READ();
         joybus_poll();
+    }
+
+    enable_interrupts();
+}
+
+/**
+ * @brief Return the total time spent by the SI processing joybus messages
+ * 
+ * The time is measured from when a message is sent to the PIF to when the
+ * reply is received (including any other queued message in between), and
+ * can be used to compute the occupancy of the SI bus.
+ * 
+ * @return Number of ticks (see #TICKS_READ) since boot
+ */
+uint64_t joybus_busy_ticks_get(void)
+{
+    disable_interrupts();
+    uint64_t ticks = joybus_busy_ticks;
+    if (joybus_state != JOYBUS_STATE_IDLE)
+        ticks += TICKS_DISTANCE(joybus_busy_start, TICKS_READ());
+    enable_interrupts();
+    return ticks;
+}
 
+/**
+ * @brief Process a pending SI interrupt while spin-waiting for a message
+ * 
+ * Blocking functions that wait for the completion of asynchronous joybus
+ * messages should call this function in their spin loop, so that they also
+ * work with interrupts disabled.
+ */
+void joybus_exec_poll(void)
+{
+    // Poll SI interrupts manually in case they are disabled.
+    disable_interrupts();
+    unsigned long status = *MI_INTERRUPT & *MI_MASK;
+    if (status & MI_INTERRUPT_SI) {
+        SI_regs->status = 0;    // clear interrupt
+        si_interrupt();
+    }
     enable_interrupts();
 }
 
@@ -258,16 +303,6 @@ void joybus_exec( const void * input, void * output )
     }
 
     joybus_exec_async(input, callback, NULL);
-    while (!done) {
-        // We want the blocking function to also work with interrupts disabled.
-        // So while we spin loop, poll SI interrupts manually in case they
-        // are disabled.
-        disable_interrupts();
-        unsigned long status = *MI_INTERRUPT & *MI_MASK;
-        if (status & MI_INTERRUPT_SI) {
-            SI_regs->status = 0;    // clear interrupt
-            si_interrupt();
-        }
-        enable_interrupts();
-    }
+    while (!done)
+        joybus_exec_poll();
 }
@@ -10,5 +10,7 @@
 #include <stdint.h>
 
 void joybus_exec_async(const void * input, void (*callback)(uint64_t *output, void *ctx), void *ctx);
+uint64_t joybus_busy_ticks_get(void);
+void joybus_exec_poll(void);
 
 #endif
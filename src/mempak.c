@@ -4,10 +4,16 @@
  * @ingroup controllerpak
  */
 #include <string.h>
+#include <stdlib.h>
 #include "regsinternal.h"
 #include <unistd.h>
 #include "controller.h"
 #include "mempak.h"
+#include "interrupt.h"
+#include "joybus.h"
+#include "joybus_internal.h"
+#include "controller_internal.h"
+#include "debug.h"
 
 /**
  * @name Inode values
@@ -24,19 +30,479 @@
 #define BLOCK_VALID_LAST    0x7F
 /** @} */
 
+/** @brief Number of sectors holding the filesystem metadata (ID, TOC, backup TOC and note index) */
+#define MEMPAK_META_SECTORS     5
+/** @brief Number of 32-byte chunks in the metadata sectors */
+#define MEMPAK_META_CHUNKS      (MEMPAK_META_SECTORS * MEMPAK_BLOCK_SIZE / 32)
+/** @brief Maximum number of Controller Pak transfers queued to the joybus at the same time */
+#define MEMPAK_MAX_INFLIGHT     4
+
+/**
+ * @brief RAM copy of the metadata sectors of a Controller Pak
+ *
+ * @see #mempak_cache_init
+ */
+typedef struct
+{
+    /** @brief Contents of the metadata sectors */
+    uint8_t data[MEMPAK_META_SECTORS * MEMPAK_BLOCK_SIZE];
+    /** @brief Chunks modified in RAM and not written to the Controller Pak yet (one bit per chunk) */
+    uint64_t dirty;
+    /** @brief TOC sector (1 or 2) known to be valid on the Controller Pak, written last */
+    int toc;
+    /** @brief Whether the contents match the Controller Pak (cleared after an error) */
+    volatile int valid;
+} mempak_cache_t;
+
+/**
+ * @brief A batch of Controller Pak transfers
+ *
+ * A job transfers whole sectors to or from a buffer, and then writes a list
+ * of metadata chunks from the cache. Transfers are queued to the joybus
+ * without waiting for each other, and the job completes under interrupt.
+ *
+ * The metadata is only written once all the sectors were transferred
+ * successfully, and each metadata sector only once the previous one was
+ * (see #__job_barrier), so that a failure never leaves the TOC pointing to
+ * data that was not written.
+ */
+typedef struct
+{
+    /** @brief Whether the job is in progress */
+    volatile int busy;
+    /** @brief Result of the job (0, or the error of the first failed transfer) */
+    volatile int result;
+    /** @brief Nonzero if the sectors are written, zero if they are read */
+    int write;
+    /** @brief Buffer of the sectors (consecutive in memory) */
+    uint8_t *data;
+    /** @brief Sectors to transfer */
+    uint8_t sectors[128];
+    /** @brief Number of sectors to transfer */
+    int num_sectors;
+    /** @brief Metadata chunks to write after the sectors, in order */
+    uint8_t meta[MEMPAK_META_CHUNKS];
+    /** @brief Number of metadata chunks to write */
+    int num_meta;
+    /** @brief Next transfer to queue */
+    volatile int next;
+    /** @brief Number of completed transfers */
+    volatile int done;
+    /** @brief Completion callback (called under interrupt) */
+    mempak_write_callback_t callback;
+    /** @brief Context of the completion callback */
+    void *ctx;
+} mempak_job_t;
+
+/** @brief Cache of the metadata sectors for each controller, or NULL if disabled */
+static mempak_cache_t *mempak_cache[4];
+/** @brief Transfer job of each controller */
+static mempak_job_t mempak_jobs[4];
+/** @brief Number of transfers currently queued to the joybus */
+static volatile int mempak_inflight;
+/** @brief Next controller to queue a transfer for (round robin) */
+static int mempak_next_controller;
+
+static void __job_pump( void );
+static int __validate_toc( uint8_t *sector );
+
+/**
+ * @brief Compute a transfer of a job
+ *
+ * @param[in]  controller
+ *             The controller (0-3) of the job
+ * @param[in]  idx
+ *             Index of the transfer in the job
+ * @param[out] address
+ *             Address of the transfer on the Controller Pak
+ * @param[out] data
+ *             32 byte buffer of the transfer
+ *
+ * @return Nonzero if the transfer is a write, zero if it is a read
+ */
+static int __job_xfer( int controller, int idx, uint16_t *address, uint8_t **data )
+{
+    mempak_job_t *job = &mempak_jobs[controller];
+
+    if( idx < job->num_sectors * 8 )
+    {
+        *address = (job->sectors[idx >> 3] * MEMPAK_BLOCK_SIZE) + ((idx & 7) * 32);
+        *data = job->data + (idx * 32);
+        return job->write;
+    }
+
+    int chunk = job->meta[idx - job->num_sectors * 8];
+    *address = chunk * 32;
+    *data = mempak_cache[controller]->data + (chunk * 32);
+    return 1;
+}
+
+/**
+ * @brief Check whether a transfer of a job must wait for the previous ones
+ *
+ * The first metadata chunk, and the first chunk of each metadata sector,
+ * are queued only after all the previous transfers completed.
+ *
+ * @param[in] job
+ *            The job
+ * @param[in] idx
+ *            Index of the transfer in the job
+ *
+ * @return Nonzero if the transfer is a barrier
+ */
+static int __job_barrier( mempak_job_t *job, int idx )
+{
+    int k = idx - job->num_sectors * 8;
+
+    if( k < 0 ) { return 0; }
+    return k == 0 || ( job->meta[k] / 8 ) != ( job->meta[k - 1] / 8 );
+}
+
+/**
+ * @brief Completion of a transfer (called under interrupt)
+ *
+ * @param[in] output
+ *            Output block returned by the joybus
+ * @param[in] ctx
+ *            Controller and index of the transfer
+ */
+static void __job_xfer_done( uint64_t *output, void *ctx )
+{
+    int controller = (uintptr_t)ctx & 3;
+    int idx = (uintptr_t)ctx >> 2;
+    mempak_job_t *job = &mempak_jobs[controller];
+    uint16_t address;
+    uint8_t *data;
+
+    int write = __job_xfer( controller, idx, &address, &data );
+    int ret = __mempak_address_result( (uint8_t *)output, controller, write ? NULL : data );
+
+    mempak_inflight--;
+    job->done++;
+
+    if( ret && !job->result )
+    {
+        /* Stop queueing transfers. Writes of the data are reported as write
+           errors, writes of the metadata as a bad Controller Pak */
+        job->result = ( idx < job->num_sectors * 8 ) ? ( job->write ? -3 : -2 ) : -2;
+    }
+
+    if( job->done == job->next && (job->result || job->next == job->num_sectors * 8 + job->num_meta) )
+    {
+        mempak_cache_t *cache = mempak_cache[controller];
+
+        if( cache && job->num_meta )
+        {
+            if( job->result )
+            {
+                /* The Controller Pak is in an unknown state, reload the cache */
+                cache->valid = 0;
+            }
+            else
+            {
+                /* The Controller Pak now matches the cache */
+                cache->toc = __validate_toc( &cache->data[1 * MEMPAK_BLOCK_SIZE] ) ? 2 : 1;
+            }
+        }
+
+        if( job->callback )
+        {
+            job->callback( controller, job->result, job->ctx );
+        }
+
+        job->busy = 0;
+    }
+
+    __job_pump();
+}
+
+/**
+ * @brief Queue the next transfers of the running jobs to the joybus
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void __job_pump( void )
+{
+    /* Serve controllers in turn, so that all jobs progress */
+    for( int idle = 0; idle < 4 && mempak_inflight < MEMPAK_MAX_INFLIGHT; )
+    {
+        int controller = mempak_next_controller;
+        mempak_job_t *job = &mempak_jobs[controller];
+
+        mempak_next_controller = (controller + 1) & 3;
+
+        if( job->busy && !job->result && job->next < job->num_sectors * 8 + job->num_meta &&
+            !( __job_barrier( job, job->next ) && job->done < job->next ) )
+        {
+            uint8_t block[JOYBUS_BLOCK_SIZE];
+            uint16_t address;
+            uint8_t *data;
+            int idx = job->next++;
+
+            int write = __job_xfer( controller, idx, &address, &data );
+            __mempak_address_block( block, controller, write, address, data );
+
+            mempak_inflight++;
+            joybus_exec_async( block, __job_xfer_done, (void *)(uintptr_t)(controller | (idx << 2)) );
+            idle = 0;
+        }
+        else
+        {
+            idle++;
+        }
+    }
+}
+
+/**
+ * @brief Wait for the job of a controller to complete
+ *
+ * @param[in] controller
+ *            The controller (0-3) to wait for
+ *
+ * @return The result of the job
+ */
+static int __job_wait( int controller )
+{
+    mempak_job_t *job = &mempak_jobs[controller];
+
+    while( job->busy )
+    {
+        joybus_exec_poll();
+    }
+
+    return job->result;
+}
+
+/**
+ * @brief Start the job of a controller
+ *
+ * The job must have been filled in by the caller after waiting for the
+ * previous one with #__job_wait.
+ *
+ * @param[in] controller
+ *            The controller (0-3) of the job
+ */
+static void __job_start( int controller )
+{
+    mempak_job_t *job = &mempak_jobs[controller];
+
+    job->result = 0;
+    job->next = 0;
+    job->done = 0;
+
+    if( job->num_sectors * 8 + job->num_meta == 0 )
+    {
+        /* Nothing to transfer */
+        if( job->callback )
+        {
+            job->callback( controller, 0, job->ctx );
+        }
+        return;
+    }
+
+    disable_interrupts();
+    job->busy = 1;
+    __job_pump();
+    enable_interrupts();
+}
+
+/**
+ * @brief Append the dirty chunks of the cache to the job of a controller
+ *
+ * The chunks are written in the same order used by the non cached code:
+ * the TOC that is not known to be valid is written before the valid one,
+ * so that a valid TOC exists on the Controller Pak at any time. Each
+ * sector is started only after the previous one was written successfully
+ * (see #__job_barrier).
+ *
+ * @param[in] controller
+ *            The controller (0-3) of the job
+ */
+static void __job_add_dirty( int controller )
+{
+    mempak_job_t *job = &mempak_jobs[controller];
+    mempak_cache_t *cache = mempak_cache[controller];
+    int alt = ( cache->toc == 2 ) ? 1 : 2;
+    int order[MEMPAK_META_SECTORS] = { 0, alt, 3 - alt, 3, 4 };
+
+    job->num_meta = 0;
+
+    for( int i = 0; i < MEMPAK_META_SECTORS; i++ )
+    {
+        for( int j = 0; j < 8; j++ )
+        {
+            int chunk = (order[i] * 8) + j;
+
+            if( cache->dirty & (1ULL << chunk) )
+            {
+                job->meta[job->num_meta++] = chunk;
+            }
+        }
+    }
+
+    cache->dirty = 0;
+}
+
+/**
+ * @brief Make sure the cache of a controller is ready to be used
+ *
+ * Wait for any pending job, and reload the metadata sectors if the cache
+ * was invalidated by an error.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to prepare the cache of
+ *
+ * @return The cache, or NULL if the cache is disabled or couldn't be loaded
+ */
+static mempak_cache_t *__cache_get( int controller )
+{
+    if( controller < 0 || controller > 3 ) { return NULL; }
+
+    __job_wait( controller );
+
+    mempak_cache_t *cache = mempak_cache[controller];
+    if( !cache || cache->valid ) { return cache; }
+
+    /* Read all metadata sectors in a single job */
+    mempak_job_t *job = &mempak_jobs[controller];
+    job->write = 0;
+    job->data = cache->data;
+    job->num_sectors = MEMPAK_META_SECTORS;
+    job->num_meta = 0;
+    job->callback = NULL;
+    for( int i = 0; i < MEMPAK_META_SECTORS; i++ )
+    {
+        job->sectors[i] = i;
+    }
+
+    __job_start( controller );
+    if( __job_wait( controller ) )
+    {
+        /* Couldn't read metadata, try again next time */
+        return NULL;
+    }
+
+    cache->dirty = 0;
+    cache->toc = __validate_toc( &cache->data[1 * MEMPAK_BLOCK_SIZE] ) ? 2 : 1;
+    cache->valid = 1;
+
+    return cache;
+}
+
+/**
+ * @brief Update metadata in the cache
+ *
+ * Only the chunks whose contents actually change are marked as dirty.
+ *
+ * @param[in] cache
+ *            The cache to update
+ * @param[in] address
+ *            A 32 byte aligned offset on the Controller Pak (within the metadata sectors)
+ * @param[in] data
+ *            The new data
+ * @param[in] len
+ *            Length of the data (multiple of 32 bytes)
+ */
+static void __cache_write( mempak_cache_t *cache, int address, const uint8_t *data, int len )
+{
+    for( int i = 0; i < len; i += 32 )
+    {
+        int chunk = (address + i) / 32;
+
+        if( memcmp( &cache->data[chunk * 32], data + i, 32 ) )
+        {
+            memcpy( &cache->data[chunk * 32], data + i, 32 );
+            cache->dirty |= 1ULL << chunk;
+        }
+    }
+}
+
+/**
+ * @brief Write the dirty chunks of the cache to the Controller Pak
+ *
+ * Does nothing if the Controller Pak is not cached.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to write the metadata to
+ *
+ * @retval 0 if the metadata was written successfully
+ * @retval -2 if the Controller Pak was bad or not present
+ */
+static int __cache_flush( int controller )
+{
+    mempak_job_t *job = &mempak_jobs[controller];
+
+    if( !mempak_cache[controller] ) { return 0; }
+
+    job->num_sectors = 0;
+    job->callback = NULL;
+    __job_add_dirty( controller );
+
+    __job_start( controller );
+    return __job_wait( controller ) ? -2 : 0;
+}
+
+int mempak_cache_init( int controller )
+{
+    if( controller < 0 || controller > 3 ) { return -1; }
+    if( mempak_cache[controller] ) { return 0; }
+
+    mempak_cache_t *cache = malloc( sizeof(mempak_cache_t) );
+    if( !cache ) { return -1; }
+
+    cache->valid = 0;
+    mempak_cache[controller] = cache;
+
+    if( !__cache_get( controller ) )
+    {
+        /* Couldn't read metadata */
+        mempak_cache[controller] = NULL;
+        free( cache );
+        return -2;
+    }
+
+    return 0;
+}
+
+void mempak_cache_close( int controller )
+{
+    if( controller < 0 || controller > 3 ) { return; }
+
+    __job_wait( controller );
+
+    free( mempak_cache[controller] );
+    mempak_cache[controller] = NULL;
+}
+
 int read_mempak_sector( int controller, int sector, uint8_t *sector_data )
 {
     if( sector < 0 || sector >= 128 ) { return -1; }
     if( sector_data == 0 ) { return -1; }
+    if( controller < 0 || controller > 3 ) { return -2; }
 
-    /* Sectors are 256 bytes, a Controller Pak reads 32 bytes at a time */
-    for( int i = 0; i < 8; i++ )
+    mempak_cache_t *cache = __cache_get( controller );
+
+    if( cache && sector < MEMPAK_META_SECTORS )
     {
-        if( read_mempak_address( controller, (sector * MEMPAK_BLOCK_SIZE) + (i * 32), sector_data + (i * 32) ) )
-        {
-            /* Failed to read a block */
-            return -2;
-        }
+        memcpy( sector_data, &cache->data[sector * MEMPAK_BLOCK_SIZE], MEMPAK_BLOCK_SIZE );
+        return 0;
+    }
+
+    /* Sectors are 256 bytes, a Controller Pak reads 32 bytes at a time:
+       queue all of them at once */
+    mempak_job_t *job = &mempak_jobs[controller];
+    job->write = 0;
+    job->data = sector_data;
+    job->sectors[0] = sector;
+    job->num_sectors = 1;
+    job->num_meta = 0;
+    job->callback = NULL;
+
+    __job_start( controller );
+    if( __job_wait( controller ) )
+    {
+        /* Failed to read a block */
+        return -2;
     }
 
     return 0;
@@ -46,15 +512,33 @@ int write_mempak_sector( int controller, int sector, uint8_t *sector_data )
 {
     if( sector < 0 || sector >= 128 ) { return -1; }
     if( sector_data == 0 ) { return -1; }
+    if( controller < 0 || controller > 3 ) { return -2; }
 
-    /* Sectors are 256 bytes, a Controller Pak writes 32 bytes at a time */
-    for( int i = 0; i < 8; i++ )
+    mempak_cache_t *cache = __cache_get( controller );
+
+    if( cache && sector < MEMPAK_META_SECTORS )
     {
-        if( write_mempak_address( controller, (sector * MEMPAK_BLOCK_SIZE) + (i * 32), sector_data + (i * 32) ) )
-        {
-            /* Failed to read a block */
-            return -2;
-        }
+        /* Keep the cache coherent, and write the whole sector as requested */
+        memcpy( &cache->data[sector * MEMPAK_BLOCK_SIZE], sector_data, MEMPAK_BLOCK_SIZE );
+        cache->dirty |= 0xFFULL << (sector * 8);
+        return __cache_flush( controller );
+    }
+
+    /* Sectors are 256 bytes, a Controller Pak writes 32 bytes at a time:
+       queue all of them at once */
+    mempak_job_t *job = &mempak_jobs[controller];
+    job->write = 1;
+    job->data = sector_data;
+    job->sectors[0] = sector;
+    job->num_sectors = 1;
+    job->num_meta = 0;
+    job->callback = NULL;
+
+    __job_start( controller );
+    if( __job_wait( controller ) )
+    {
+        /* Failed to write a block */
+        return -2;
     }
 
     return 0;
@@ -587,6 +1071,70 @@ static int __get_note_block( uint8_t *sector, int inode, int block )
     return -3;
 }
 
+/**
+ * @brief Read an entry of the note index
+ *
+ * @param[in]  controller
+ *             The controller (0-3) to read the entry from
+ * @param[in]  entry
+ *             The entry index (0-15) to read
+ * @param[out] data
+ *             Buffer to place the 32 bytes of the entry
+ *
+ * @retval 0 if the entry was read successfully
+ * @retval nonzero if the entry couldn't be read
+ */
+static int __read_index( int controller, int entry, uint8_t *data )
+{
+    mempak_cache_t *cache = __cache_get( controller );
+
+    if( cache )
+    {
+        memcpy( data, &cache->data[(3 * MEMPAK_BLOCK_SIZE) + (entry * 32)], 32 );
+        return 0;
+    }
+
+    /* Entries are spread across two sectors, but we can luckly grab just one
+       with a single Controller Pak read */
+    return read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry * 32), data );
+}
+
+/**
+ * @brief Write filesystem metadata
+ *
+ * If the Controller Pak is cached, the data is only written to the cache, and
+ * must be written to the Controller Pak with #__cache_flush.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to write the metadata to
+ * @param[in] address
+ *            A 32 byte aligned offset on the Controller Pak (within the metadata sectors)
+ * @param[in] data
+ *            The data to write
+ * @param[in] len
+ *            Length of the data (either 32 bytes or a whole sector)
+ *
+ * @retval 0 if the metadata was written successfully
+ * @retval nonzero if the metadata couldn't be written
+ */
+static int __write_meta( int controller, int address, uint8_t *data, int len )
+{
+    mempak_cache_t *cache = __cache_get( controller );
+
+    if( cache )
+    {
+        __cache_write( cache, address, data, len );
+        return 0;
+    }
+
+    if( len == MEMPAK_BLOCK_SIZE )
+    {
+        return write_mempak_sector( controller, address / MEMPAK_BLOCK_SIZE, data );
+    }
+
+    return write_mempak_address( controller, address, data );
+}
+
 /**
  * @brief Retrieve the sector number of the first valid TOC found
  *
@@ -681,9 +1229,7 @@ int get_mempak_entry( int controller, int entry, entry_structure_t *entry_data )
         return -2;
     }
 
-    /* Entries are spread across two sectors, but we can luckly grab just one
-       with a single Controller Pak read */
-    if( read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry * 32), data ) )
+    if( __read_index( controller, entry, data ) )
     {
         /* Couldn't read note database */
         return -2;
@@ -841,16 +1387,31 @@ int read_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *d
         return -2;
     }
 
-    /* Now loop through blocks and grab each one */
+    /* Now loop through blocks and grab all of them in a single job */
+    mempak_job_t *job = &mempak_jobs[controller];
+    job->write = 0;
+    job->data = data;
+    job->num_sectors = entry->blocks;
+    job->num_meta = 0;
+    job->callback = NULL;
+
     for( int i = 0; i < entry->blocks; i++ )
     {
         int block = __get_note_block( tocdata, entry->inode, i );
 
-        if( read_mempak_sector( controller, block, data + (i * MEMPAK_BLOCK_SIZE) ) )
+        if( block < BLOCK_VALID_FIRST || block > BLOCK_VALID_LAST )
         {
-            /* Couldn't read a sector */
+            /* Corrupted TOC */
             return -3;
         }
+        job->sectors[i] = block;
+    }
+
+    __job_start( controller );
+    if( __job_wait( controller ) )
+    {
+        /* Couldn't read a sector */
+        return -3;
     }
 
     /* Fetched all blocks successfully */
@@ -860,10 +1421,9 @@ int read_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *d
 /**
  * @brief Write associated data to a Controller Pak entry
  *
- * Given a Controller Pak entry structure with a valid region, name and block count, writes the
- * entry and associated data to the Controller Pak.  This function will not overwrite any existing
- * user data.  To update an existing entry, use #delete_mempak_entry followed by
- * #write_mempak_entry_data with the same entry structure.
+ * Common implementation of #write_mempak_entry_data and
+ * #write_mempak_entry_data_async.  The entry is allocated synchronously;
+ * the data is then written, followed by the updated TOC and note index.
  *
  * @param[in] controller
  *            The controller (0-3) to write the entry and data to
@@ -871,15 +1431,17 @@ int read_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *d
  *            The entry structure containing a region, name and block count
  * @param[in] data
  *            The associated data to write to to the created entry
+ * @param[in] callback
+ *            Completion callback, or NULL
+ * @param[in] ctx
+ *            Context passed to the completion callback
+ * @param[in] async
+ *            Nonzero to return as soon as the writes are queued
  *
- * @retval 0 if the entry was created and written successfully
- * @retval -1 if the parameters were invalid or the note has no length
- * @retval -2 if the Controller Pak wasn't present or was bad
- * @retval -3 if there was an error writing to the Controller Pak
- * @retval -4 if there wasn't enough space to store the note
- * @retval -5 if there is no room in the TOC to add a new entry
+ * @return 0 or a negative error code, as documented in #write_mempak_entry_data
  */
-int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *data )
+static int __write_entry( int controller, entry_structure_t *entry, uint8_t *data,
+                          mempak_write_callback_t callback, void *ctx, int async )
 {
     uint8_t sector[MEMPAK_BLOCK_SIZE];
     uint8_t tmp_data[32];
@@ -950,24 +1512,12 @@ int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *
         entry->game_id = 0x4535;
     }
 
-    /* Loop through allocated blocks and write data to sectors */
-    for( int i = 0; i < entry->blocks; i++ )
-    {
-        int block = __get_note_block( sector, entry->inode, i );
-
-        if( write_mempak_sector( controller, block, data + (i * MEMPAK_BLOCK_SIZE) ) )
-        {
-            /* Couldn't write a sector */
-            return -3;
-        }
-    }
-
-    /* Find an empty entry to store to */
+    /* Find an empty entry to store to, before writing any data */
     for( int i = 0; i < 16; i++ )
     {
         entry_structure_t tmp_entry;
 
-        if( read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (i * 32), tmp_data ) )
+        if( __read_index( controller, i, tmp_data ) )
         {
             /* Couldn't read note database */
             return -2;
@@ -989,28 +1539,71 @@ int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *
         return -5;
     }
 
+    /* Queue all data sectors in a single job */
+    mempak_job_t *job = &mempak_jobs[controller];
+    job->write = 1;
+    job->data = data;
+    job->num_sectors = entry->blocks;
+    job->num_meta = 0;
+    job->callback = callback;
+    job->ctx = ctx;
+
+    for( int i = 0; i < entry->blocks; i++ )
+    {
+        job->sectors[i] = __get_note_block( sector, entry->inode, i );
+    }
+
     /* Update CRC on newly updated TOC */
     sector[1] = __get_toc_checksum( sector );
 
+    /* Convert entry structure to proper entry data */
+    __write_note( entry, tmp_data );
+
+    mempak_cache_t *cache = mempak_cache[controller];
+
+    if( cache )
+    {
+        /* The cache was reloaded by __get_valid_toc, unless the Controller Pak
+           couldn't be read */
+        if( !cache->valid ) { return -2; }
+
+        /* Update the metadata in the cache, and write the modified chunks in
+           the same job once all the data was written successfully */
+        __cache_write( cache, (( toc == 1 ) ? 2 : 1) * MEMPAK_BLOCK_SIZE, sector, MEMPAK_BLOCK_SIZE );
+        __cache_write( cache, toc * MEMPAK_BLOCK_SIZE, sector, MEMPAK_BLOCK_SIZE );
+        __cache_write( cache, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), tmp_data, 32 );
+        __job_add_dirty( controller );
+
+        __job_start( controller );
+        return async ? 0 : __job_wait( controller );
+    }
+
+    assertf( !async, "asynchronous writes require the Controller Pak cache (see mempak_cache_init)" );
+
+    /* Write all data sectors */
+    __job_start( controller );
+    if( __job_wait( controller ) )
+    {
+        /* Couldn't write a sector */
+        return -3;
+    }
+
     /* Write back to alternate TOC first before erasing the known valid one */
-    if( write_mempak_sector( controller, ( toc == 1 ) ? 2 : 1, sector ) )
+    if( __write_meta( controller, (( toc == 1 ) ? 2 : 1) * MEMPAK_BLOCK_SIZE, sector, MEMPAK_BLOCK_SIZE ) )
     {
         /* Failed to write alternate TOC */
         return -2;
     }
 
     /* Write back to good TOC now that alternate is updated */
-    if( write_mempak_sector( controller, toc, sector ) )
+    if( __write_meta( controller, toc * MEMPAK_BLOCK_SIZE, sector, MEMPAK_BLOCK_SIZE ) )
     {
         /* Failed to write alternate TOC */
         return -2;
     }
 
-    /* Convert entry structure to proper entry data */
-    __write_note( entry, tmp_data );
-
     /* Store entry to empty slot on Controller Pak */
-    if( write_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), tmp_data ) )
+    if( __write_meta( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), tmp_data, 32 ) )
     {
         /* Couldn't update note database */
         return -2;
@@ -1019,6 +1612,17 @@ int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *
     return 0;
 }
 
+int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *data )
+{
+    return __write_entry( controller, entry, data, NULL, NULL, 0 );
+}
+
+int write_mempak_entry_data_async( int controller, entry_structure_t *entry, uint8_t *data,
+                                   mempak_write_callback_t callback, void *ctx )
+{
+    return __write_entry( controller, entry, data, callback, ctx, 1 );
+}
+
 int delete_mempak_entry( int controller, entry_structure_t *entry )
 {
     entry_structure_t tmp_entry;
@@ -1032,7 +1636,7 @@ int delete_mempak_entry( int controller, entry_structure_t *entry )
     if( entry->inode < BLOCK_VALID_FIRST || entry->inode > BLOCK_VALID_LAST ) { return -1; }
 
     /* Ensure that the entry passed in matches what's on the Controller Pak */
-    if( read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data ) )
+    if( __read_index( controller, entry->entry_id, data ) )
     {
         /* Couldn't read note database */
         return -2;
@@ -1050,9 +1654,10 @@ int delete_mempak_entry( int controller, entry_structure_t *entry )
         return -2;
     }
 
-    /* The entry matches, so blank it */
+    /* The entry matches, so blank it (before freeing its blocks) */
     memset( data, 0, 32 );
-    if( write_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data ) )
+    if( __write_meta( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data, 32 ) ||
+        __cache_flush( controller ) )
     {
         /* Couldn't update note database */
         return -2;
@@ -1110,14 +1715,15 @@ int delete_mempak_entry( int controller, entry_structure_t *entry )
     data[1] = __get_toc_checksum( data );
 
     /* Write back to alternate TOC first before erasing the known valid one */
-    if( write_mempak_sector( controller, ( toc == 1 ) ? 2 : 1, data ) )
+    if( __write_meta( controller, (( toc == 1 ) ? 2 : 1) * MEMPAK_BLOCK_SIZE, data, MEMPAK_BLOCK_SIZE ) )
     {
         /* Failed to write alternate TOC */
         return -2;
     }
 
     /* Write back to good TOC now that alternate is updated */
-    if( write_mempak_sector( controller, toc, data ) )
+    if( __write_meta( controller, toc * MEMPAK_BLOCK_SIZE, data, MEMPAK_BLOCK_SIZE ) ||
+        __cache_flush( controller ) )
     {
         /* Failed to write alternate TOC */
         return -2;
@@ -0,0 +1,179 @@
+/**
+ * @file profile.c
+ * @brief Sampling CPU profiler
+ * @ingroup profile
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "backtrace.h"
+#include "exception.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "debug.h"
+#include "n64sys.h"
+#include "cop0.h"
+
+/** @brief Exception handler (see inthandler.S) */
+extern uint32_t inthandler[];
+/** @brief End of exception handler (see inthandler.S) */
+extern uint32_t inthandler_end[];
+/** @brief Stack pointer of the interrupt being serviced (see inthandler.S) */
+extern uint32_t interrupt_exception_frame;
+
+/** @brief Profiler state */
+static struct {
+    uint32_t *samples;          ///< Ring buffer of samples (depth words each)
+    int depth;                  ///< Number of words per sample
+    int capacity;               ///< Capacity of the ring buffer (in samples)
+    int wpos;                   ///< Index of the next sample to write
+    int count;                  ///< Number of valid samples in the buffer
+    int rate_hz;                ///< Sampling rate
+    bool running;               ///< True if sampling is active
+    timer_link_t *timer;        ///< Sampling timer
+    profile_stats_t stats;      ///< Statistics since the last flush
+} prof;
+
+/** @brief Return true if the address is within the interrupt handler */
+static bool is_inthandler(void *addr)
+{
+    return (uint32_t*)addr >= inthandler && (uint32_t*)addr < inthandler_end;
+}
+
+/** @brief Timer callback: record the interrupted context */
+static void profile_sample(int ovfl)
+{
+    uint32_t t0 = TICKS_READ();
+    uint32_t *rec = &prof.samples[prof.wpos * prof.depth];
+
+    // The register block saved by the interrupt handler is just above the
+    // 32 bytes of scratch space at the top of its stack frame.
+    reg_block_t *regs = (reg_block_t*)(interrupt_exception_frame + 32);
+    uint32_t pc = regs->epc;
+    if (regs->cr & C0_CAUSE_BD) pc += 4;
+    rec[0] = pc;
+
+    if (prof.depth > 1) {
+        // Walk the stack through the interrupt handler, and keep only the
+        // frames that belong to the interrupted code.
+        void *frames[PROFILE_MAX_DEPTH + 8];
+        int n = backtrace(frames, prof.depth + 8);
+        int i = 0;
+        while (i < n && !is_inthandler(frames[i]))
+            i++;
+        // frames[i+1] is the interrupted address, already stored.
+        int d = 1;
+        for (i += 2; i < n && d < prof.depth; i++)
+            rec[d++] = (uint32_t)frames[i];
+        while (d < prof.depth)
+            rec[d++] = 0;
+    }
+
+    if (++prof.wpos == prof.capacity)
+        prof.wpos = 0;
+    if (prof.count < prof.capacity)
+        prof.count++;
+    else
+        prof.stats.num_lost++;
+    prof.stats.num_samples++;
+    prof.stats.sample_ticks += TICKS_DISTANCE(t0, TICKS_READ());
+}
+
+void profile_init(int rate_hz, int depth, int max_samples)
+{
+    assertf(!prof.samples, "profiler already initialized");
+    assertf(rate_hz > 0 && rate_hz <= 100000, "invalid sampling rate: %d", rate_hz);
+    assertf(depth >= 1 && depth <= PROFILE_MAX_DEPTH, "invalid profile depth: %d", depth);
+    assertf(max_samples > 0, "invalid number of samples: %d", max_samples);
+
+    prof.samples = malloc(max_samples * depth * sizeof(uint32_t));
+    assertf(prof.samples, "out of memory for %d profile samples", max_samples);
+    prof.depth = depth;
+    prof.capacity = max_samples;
+    prof.wpos = prof.count = 0;
+    prof.rate_hz = rate_hz;
+    prof.running = false;
+    memset(&prof.stats, 0, sizeof(prof.stats));
+
+    timer_init();
+    prof.timer = new_timer(TIMER_TICKS(1000000 / rate_hz), TF_CONTINUOUS | TF_DISABLED, profile_sample);
+}
+
+void profile_close(void)
+{
+    if (!prof.samples)
+        return;
+    profile_stop();
+    delete_timer(prof.timer);
+    timer_close();
+    free(prof.samples);
+    memset(&prof, 0, sizeof(prof));
+}
+
+void profile_start(void)
+{
+    assertf(prof.samples, "profiler not initialized");
+    if (!prof.running) {
+        prof.running = true;
+        restart_timer(prof.timer);
+    }
+}
+
+void profile_stop(void)
+{
+    if (prof.running) {
+        stop_timer(prof.timer);
+        prof.running = false;
+    }
+}
+
+void profile_flush(FILE *out)
+{
+    assertf(prof.samples, "profiler not initialized");
+    bool was_running = prof.running;
+    profile_stop();
+
+    fprintf(out, "PROF1 %d %d\n", prof.rate_hz, prof.depth);
+
+    int idx = prof.wpos - prof.count;
+    if (idx < 0) idx += prof.capacity;
+    for (int i = 0; i < prof.count; ) {
+        // Merge identical consecutive samples
+        uint32_t *rec = &prof.samples[idx * prof.depth];
+        int run = 1;
+        while (i + run < prof.count) {
+            int next = (idx + run) % prof.capacity;
+            if (memcmp(rec, &prof.samples[next * prof.depth], prof.depth * sizeof(uint32_t)) != 0)
+                break;
+            run++;
+        }
+
+        if (run > 1)
+            fprintf(out, "S*%d", run);
+        else
+            fprintf(out, "S");
+        for (int d = 0; d < prof.depth && rec[d]; d++)
+            fprintf(out, " %08lx", rec[d]);
+        fprintf(out, "\n");
+
+        i += run;
+        idx = (idx + run) % prof.capacity;
+    }
+
+    fprintf(out, "PROFEND %lu %lu\n", prof.stats.num_samples, prof.stats.num_lost);
+    fflush(out);
+
+    prof.wpos = prof.count = 0;
+    memset(&prof.stats, 0, sizeof(prof.stats));
+
+    if (was_running)
+        profile_start();
+}
+
+profile_stats_t profile_get_stats(void)
+{
+    disable_interrupts();
+    profile_stats_t stats = prof.stats;
+    enable_interrupts();
+    return stats;
+}
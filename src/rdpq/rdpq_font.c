@@ -0,0 +1,345 @@
+/**
+ * @file rdpq_font.c
+ * @brief RDP Command queue: bitmap font rendering
+ * @ingroup rdpq
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "rdpq.h"
+#include "rdpq_font.h"
+#include "rdpq_mode.h"
+#include "rdpq_rect.h"
+#include "rdpq_tex.h"
+#include "sprite.h"
+#include "surface.h"
+#include "font.h"
+#include "debug.h"
+#include "utils.h"
+
+/** @brief Maximum number of TMEM pages of a font */
+#define MAX_PAGES       64
+
+/** @brief Glyph metrics */
+typedef struct {
+    uint8_t x0, y0;     ///< Top-left corner of the drawn area, within the cell
+    uint8_t x1, y1;     ///< Bottom-right corner (exclusive) of the drawn area (x1 == 0: empty glyph)
+    int16_t advance;    ///< Horizontal advance after the glyph
+    uint8_t page;       ///< TMEM page containing the glyph
+} glyph_t;
+
+/** @brief Kerning of a pair of characters */
+typedef struct {
+    uint16_t pair;      ///< First character in the high byte, second in the low byte
+    int8_t kerning;     ///< Adjustment of the advance of the first character
+} kerning_t;
+
+/** @brief A bitmap font */
+typedef struct rdpq_font_s {
+    sprite_t *sprite;           ///< Sprite containing the atlas (NULL for the builtin font)
+    surface_t atlas;            ///< Pixels of the atlas
+    tex_loader_t tload;         ///< Texture loader for the atlas
+    int glyph_width;            ///< Width of a cell
+    int glyph_height;           ///< Height of a cell
+    int columns;                ///< Number of cells per row of the atlas
+    int num_glyphs;             ///< Number of cells in the atlas
+    int page_rows;              ///< Number of rows of cells per TMEM page
+    int loaded_page;            ///< Page currently in TMEM (-1 if unknown)
+    int num_kernings;           ///< Number of kerning pairs
+    kerning_t *kernings;        ///< Kerning pairs, sorted by pair
+    glyph_t glyphs[256];        ///< Glyph metrics, indexed by character
+} rdpq_font_t;
+
+/** @brief Font between #rdpq_font_begin and #rdpq_font_end */
+static rdpq_font_t *cur_font;
+
+/** @brief Check if a pixel of a surface is non-zero */
+static bool pixel_is_set(const surface_t *surf, int x, int y)
+{
+    const uint8_t *row = (const uint8_t*)surf->buffer + y * surf->stride;
+    int bpp = TEX_FORMAT_BITDEPTH(surface_get_format(surf));
+
+    if (bpp == 4)
+        return (row[x/2] >> ((x & 1) ? 0 : 4)) & 0xF;
+
+    const uint8_t *pix = row + x * bpp / 8;
+    for (int i = 0; i < bpp / 8; i++)
+        if (pix[i]) return true;
+    return false;
+}
+
+/** @brief Common initialization of a font, once the atlas is configured */
+static rdpq_font_t *font_init(rdpq_font_t *font, bool trim)
+{
+    assertf(font->glyph_width < 256 && font->glyph_height < 256,
+        "font glyphs are too big (%dx%d)", font->glyph_width, font->glyph_height);
+
+    font->tload = tex_loader_init(TILE0, &font->atlas);
+    int max_height = tex_loader_calc_max_height(&font->tload, font->atlas.width);
+    font->page_rows = max_height / font->glyph_height;
+    assertf(font->page_rows > 0, "a row of glyphs of the font does not fit TMEM");
+
+    int rows = DIVIDE_CEIL(font->num_glyphs, font->columns);
+    assertf(DIVIDE_CEIL(rows, font->page_rows) <= MAX_PAGES, "font atlas is too big");
+
+    for (int i = 0; i < 256; i++) {
+        glyph_t *g = &font->glyphs[i];
+        g->advance = font->glyph_width;
+        if (i >= font->num_glyphs)
+            continue;
+
+        int sx = (i % font->columns) * font->glyph_width;
+        int sy = (i / font->columns) * font->glyph_height;
+        g->page = (i / font->columns) / font->page_rows;
+
+        if (!trim) {
+            g->x1 = font->glyph_width;
+            g->y1 = font->glyph_height;
+            continue;
+        }
+
+        // Find the bounding box of the non-zero pixels, to avoid drawing
+        // empty glyphs and to reduce the fill of the others.
+        int x0 = font->glyph_width, y0 = font->glyph_height, x1 = 0, y1 = 0;
+        for (int y = 0; y < font->glyph_height; y++) {
+            for (int x = 0; x < font->glyph_width; x++) {
+                if (pixel_is_set(&font->atlas, sx + x, sy + y)) {
+                    x0 = MIN(x0, x); x1 = MAX(x1, x+1);
+                    y0 = MIN(y0, y); y1 = MAX(y1, y+1);
+                }
+            }
+        }
+        if (x1 > 0) {
+            g->x0 = x0; g->y0 = y0;
+            g->x1 = x1; g->y1 = y1;
+        }
+    }
+
+    font->loaded_page = -1;
+    return font;
+}
+
+rdpq_font_t *rdpq_font_load_builtin(void)
+{
+    rdpq_font_t *font = calloc(1, sizeof(rdpq_font_t));
+
+    // Convert the 1bpp font into a 16x16 grid of I4 glyphs. Each glyph row
+    // is exactly 8 bytes, and a page of 128 glyphs is 4 KiB.
+    font->glyph_width = 8;
+    font->glyph_height = 8;
+    font->columns = 16;
+    font->num_glyphs = 256;
+    font->atlas = surface_alloc(FMT_I4, 16*8, 16*8);
+
+    for (int ch = 0; ch < 256; ch++) {
+        int sx = (ch % 16) * 8;
+        int sy = (ch / 16) * 8;
+        for (int y = 0; y < 8; y++) {
+            uint8_t bits = __font_data[ch * 8 + y];
+            uint8_t *row = (uint8_t*)font->atlas.buffer + (sy + y) * font->atlas.stride + sx / 2;
+            for (int x = 0; x < 8; x += 2) {
+                row[x/2] = ((bits & (0x80 >> x)) ? 0xF0 : 0) | ((bits & (0x40 >> x)) ? 0x0F : 0);
+            }
+        }
+    }
+
+    return font_init(font, true);
+}
+
+rdpq_font_t *rdpq_font_load_sprite(sprite_t *sprite)
+{
+    rdpq_font_t *font = calloc(1, sizeof(rdpq_font_t));
+
+    font->sprite = sprite;
+    font->atlas = sprite_get_pixels(sprite);
+    font->glyph_width = sprite->width / sprite->hslices;
+    font->glyph_height = sprite->height / sprite->vslices;
+    font->columns = sprite->hslices;
+    font->num_glyphs = MIN(sprite->hslices * sprite->vslices, 256);
+
+    tex_format_t fmt = sprite_get_format(sprite);
+    return font_init(font, fmt != FMT_CI4 && fmt != FMT_CI8);
+}
+
+void rdpq_font_free(rdpq_font_t *font)
+{
+    assertf(font != cur_font, "cannot free a font between rdpq_font_begin and rdpq_font_end");
+    if (!font->sprite)
+        surface_free(&font->atlas);
+    free(font->kernings);
+    free(font);
+}
+
+void rdpq_font_set_advance(rdpq_font_t *font, char ch, int advance)
+{
+    assertf(advance >= INT16_MIN && advance <= INT16_MAX, "invalid advance: %d", advance);
+    font->glyphs[(uint8_t)ch].advance = advance;
+}
+
+/** @brief Find the index of a kerning pair, or where it should be inserted */
+static int kerning_find(rdpq_font_t *font, uint16_t pair)
+{
+    int lo = 0, hi = font->num_kernings;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (font->kernings[mid].pair < pair)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void rdpq_font_set_kerning(rdpq_font_t *font, char ch1, char ch2, int kerning)
+{
+    assertf(kerning >= -128 && kerning < 128, "invalid kerning: %d", kerning);
+    uint16_t pair = ((uint8_t)ch1 << 8) | (uint8_t)ch2;
+    int idx = kerning_find(font, pair);
+    bool found = idx < font->num_kernings && font->kernings[idx].pair == pair;
+
+    if (kerning == 0) {
+        if (found) {
+            memmove(&font->kernings[idx], &font->kernings[idx+1], (font->num_kernings - idx - 1) * sizeof(kerning_t));
+            font->num_kernings--;
+        }
+        return;
+    }
+
+    if (!found) {
+        font->kernings = realloc(font->kernings, (font->num_kernings + 1) * sizeof(kerning_t));
+        memmove(&font->kernings[idx+1], &font->kernings[idx], (font->num_kernings - idx) * sizeof(kerning_t));
+        font->num_kernings++;
+    }
+    font->kernings[idx] = (kerning_t){ .pair = pair, .kerning = kerning };
+}
+
+void rdpq_font_begin(rdpq_font_t *font, color_t color)
+{
+    assertf(!cur_font, "rdpq_font_begin called twice without rdpq_font_end");
+    cur_font = font;
+
+    rdpq_mode_push();
+    rdpq_set_mode_standard();
+    rdpq_mode_combiner(RDPQ_COMBINER_TEX_FLAT);
+    rdpq_mode_alphacompare(1);
+    rdpq_set_prim_color(color);
+
+    if (font->sprite) {
+        tex_format_t fmt = sprite_get_format(font->sprite);
+        rdpq_tlut_t tlut = rdpq_tlut_from_format(fmt);
+        if (tlut != TLUT_NONE) {
+            rdpq_mode_tlut(tlut);
+            uint16_t *pal = sprite_get_palette(font->sprite);
+            if (pal) rdpq_tex_upload_tlut(pal, 0, fmt == FMT_CI4 ? 16 : 256);
+        }
+    }
+
+    // We don't know what TMEM contains
+    font->loaded_page = -1;
+}
+
+void rdpq_font_set_color(color_t color)
+{
+    rdpq_set_prim_color(color);
+}
+
+void rdpq_font_end(void)
+{
+    assertf(cur_font, "rdpq_font_end called without rdpq_font_begin");
+    cur_font = NULL;
+    rdpq_mode_pop();
+}
+
+/**
+ * @brief Walk a string, drawing the glyphs that belong to a page
+ *
+ * @param font      Font to use
+ * @param x0        X coordinate of the top-left corner of the text
+ * @param y0        Y coordinate of the top-left corner of the text
+ * @param text      Text to draw
+ * @param page      Page to draw, or -1 to only compute the pages used
+ * @param stats     Statistics to update
+ * @return          Bitmask of the pages used by the string
+ */
+static uint64_t font_draw_page(rdpq_font_t *font, float x0, float y0, const uint8_t *text,
+    int page, rdpq_font_stats_t *stats)
+{
+    uint64_t pages = 0;
+    float x = x0, y = y0;
+
+    for (; *text; text++) {
+        uint8_t ch = *text;
+        if (ch == '\n') {
+            stats->width = MAX(stats->width, x - x0);
+            x = x0;
+            y += font->glyph_height;
+            continue;
+        }
+
+        const glyph_t *g = &font->glyphs[ch];
+        if (g->x1) {
+            pages |= 1ull << g->page;
+            if (g->page == page) {
+                int sx = (ch % font->columns) * font->glyph_width;
+                int sy = (ch / font->columns) * font->glyph_height;
+                rdpq_texture_rectangle(TILE0,
+                    x + g->x0, y + g->y0, x + g->x1, y + g->y1,
+                    sx + g->x0, sy + g->y0);
+                stats->num_rects++;
+            }
+        }
+
+        x += g->advance;
+        if (font->num_kernings && text[1]) {
+            uint16_t pair = (ch << 8) | text[1];
+            int idx = kerning_find(font, pair);
+            if (idx < font->num_kernings && font->kernings[idx].pair == pair)
+                x += font->kernings[idx].kerning;
+        }
+    }
+
+    stats->width = MAX(stats->width, x - x0);
+    return pages;
+}
+
+rdpq_font_stats_t rdpq_font_print(rdpq_font_t *font, float x0, float y0, const char *text)
+{
+    assertf(font == cur_font, "rdpq_font_print must be called between rdpq_font_begin and rdpq_font_end");
+    rdpq_font_stats_t stats = {0};
+
+    // Draw first the glyphs of the page already in TMEM (if any), and find
+    // out which other pages are needed.
+    uint64_t pages = font_draw_page(font, x0, y0, (const uint8_t*)text, font->loaded_page, &stats);
+    if (font->loaded_page >= 0)
+        pages &= ~(1ull << font->loaded_page);
+
+    // Then load each of the other pages once, and draw all its glyphs
+    while (pages) {
+        int page = __builtin_ctzll(pages);
+        pages &= pages - 1;
+
+        int t0 = page * font->page_rows * font->glyph_height;
+        int t1 = MIN(t0 + font->page_rows * font->glyph_height, font->atlas.height);
+        tex_loader_set_tmem_addr(&font->tload, 0);
+        tex_loader_load(&font->tload, 0, t0, font->atlas.width, t1);
+        font->loaded_page = page;
+        stats.num_loads++;
+
+        font_draw_page(font, x0, y0, (const uint8_t*)text, page, &stats);
+    }
+
+    return stats;
+}
+
+rdpq_font_stats_t rdpq_font_printf(rdpq_font_t *font, float x0, float y0, const char *fmt, ...)
+{
+    char buf[256];
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+
+    return rdpq_font_print(font, x0, y0, buf);
+}
@@ -10,8 +10,10 @@
 #include "rdpq_sprite_internal.h"
 #include "rdpq_mode.h"
 #include "rdpq_tex.h"
+#include "rdpq_tex_internal.h"
 #include "sprite.h"
 #include "sprite_internal.h"
+#include "utils.h"
 
 static void sprite_upload_palette(sprite_t *sprite, int palidx, bool set_mode)
 {
@@ -128,12 +130,83 @@ int rdpq_sprite_upload(rdpq_tile_t tile, sprite_t *sprite, const rdpq_texparms_t
     return __rdpq_sprite_upload(tile, sprite, parms, true);
 }
 
+/** @brief Layout of a pre-tiled sprite along one axis (see #sprite_tiles_t) */
+typedef struct {
+    int size;       ///< Size of a block
+    int step;       ///< Number of image pixels drawn by each block
+    int count;      ///< Number of blocks
+} tiled_axis_t;
+
+static tiled_axis_t tiled_axis(int block_size, int image_size)
+{
+    if (block_size >= image_size)
+        return (tiled_axis_t){ .size = block_size, .step = image_size, .count = 1 };
+    int step = block_size - 2;
+    return (tiled_axis_t){ .size = block_size, .step = step, .count = (image_size + step - 1) / step };
+}
+
+/** @brief First image pixel stored in block number idx (blocks have one pixel of overlap on each side) */
+static inline int tiled_origin(tiled_axis_t *axis, int idx)
+{
+    return idx ? idx * axis->step - 1 : 0;
+}
+
 void rdpq_sprite_blit(sprite_t *sprite, float x0, float y0, const rdpq_blitparms_t *parms)
 {
     // Upload the palette and configure the render mode
     sprite_upload_palette(sprite, 0, true);
 
-    // Get the sprite surface
-    surface_t surf = sprite_get_pixels(sprite);
-    rdpq_tex_blit(&surf, x0, y0, parms);
+    sprite_tiles_t *tiles = __sprite_tiles(sprite);
+    if (!tiles || tiles->num_blocks == 1) {
+        // Get the sprite surface
+        surface_t surf = sprite_get_pixels(sprite);
+        rdpq_tex_blit(&surf, x0, y0, parms);
+        return;
+    }
+
+    // Pre-tiled sprite. Go through the blocks that intersect the rectangle
+    // to draw, and load each of them with a single LOAD_BLOCK. This replaces
+    // the generic strip splitting done by the texloader.
+    tex_format_t fmt = sprite_get_format(sprite);
+    tiled_axis_t ax = tiled_axis(tiles->block_width, sprite->width);
+    tiled_axis_t ay = tiled_axis(tiles->block_height, sprite->height);
+    assertf(ax.count * ay.count == tiles->num_blocks, "corrupted pre-tiled sprite");
+    int block_bytes = tiles->block_stride * tiles->block_height;
+
+    // Rotated blits with repetitions draw the whole width of the image at
+    // once. mksprite uses full-width blocks whenever a line fits TMEM, and
+    // larger images cannot be blitted this way by rdpq_tex_blit either.
+    assertf(ax.count == 1 || !parms || F2I(parms->theta) == 0 || !(parms->nx || parms->ny),
+        "rotated blit with repetitions of a pre-tiled sprite split in %d columns is not supported", ax.count);
+
+    void ltd_tiled(rdpq_tile_t tile, const surface_t *tex, int s0, int t0, int s1, int t1, 
+        void (*draw_cb)(rdpq_tile_t tile, int s0, int t0, int s1, int t1), bool filtering)
+    {
+        surface_t block = surface_make(tiles->data, fmt, tiles->block_width, tiles->block_height, tiles->block_stride);
+        tex_loader_t tload = tex_loader_init(tile, &block);
+        rdpq_texparms_t texparms = {0};
+
+        for (int by = t0 / ay.step; by < ay.count && by * ay.step < t1; by++) {
+            int oy = tiled_origin(&ay, by);
+            int dt0 = MAX(t0, by * ay.step), dt1 = MIN(t1, (by+1) * ay.step);
+            for (int bx = s0 / ax.step; bx < ax.count && bx * ax.step < s1; bx++) {
+                int ox = tiled_origin(&ax, bx);
+                int ds0 = MAX(s0, bx * ax.step), ds1 = MIN(s1, (bx+1) * ax.step);
+
+                // Load the whole block, translating the tile so that texture
+                // coordinates are those of the full image.
+                block.buffer = tiles->data + (by * ax.count + bx) * block_bytes;
+                texparms.s.translate = ox;
+                texparms.t.translate = oy;
+                tex_loader_set_texparms(&tload, &texparms);
+                tex_loader_set_tmem_addr(&tload, 0);
+                tex_loader_load(&tload, 0, 0, block.width, block.height);
+
+                draw_cb(tile, ds0, dt0, ds1, dt1);
+            }
+        }
+    }
+
+    surface_t surf = surface_make(tiles->data, fmt, sprite->width, sprite->height, tiles->block_stride);
+    __rdpq_tex_blit(&surf, x0, y0, parms, ltd_tiled);
 }
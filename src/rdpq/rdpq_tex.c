@@ -135,11 +135,13 @@ static int texload_set_rect(tex_loader_t *tload, int s0, int t0, int s1, int t1)
 
             // Verify whether we can use LOAD_BLOCK. The conditions we can verify just by looking at the
             // width are:
-            //   * The rectangle to load cover the whole texture horizontally, and the texture does not
-            //     contain extraneous data at the end of each line.
-            //   * The width of the texture is a multiple of 8 bytes (or 16 bytes, in case of RGBA32).
+            //   * The rectangle to load cover the whole texture horizontally. The texture can contain
+            //     extraneous data at the end of each line only if it is just the padding to the next
+            //     8-byte boundary (or 16 bytes, in case of RGBA32): LOAD_BLOCK will transfer it
+            //     into the TMEM line padding, which is unused anyway.
+            //   * The stride of the texture is a multiple of 8 bytes (or 16 bytes, in case of RGBA32).
             bool can_load_block_width =
-                TEX_FORMAT_PIX2BYTES(fmt, width) == tload->tex->stride &&
+                ROUND_UP(TEX_FORMAT_PIX2BYTES(fmt, width), stride_mask+1) == tload->tex->stride &&
                 (tload->tex->stride & stride_mask) == 0;
 
             if (can_load_block_width) {
@@ -187,7 +189,8 @@ static int texload_set_rect(tex_loader_t *tload, int s0, int t0, int s1, int t1)
             "A rectangle of size %dx%d format %s is too big to fit in TMEM", width, height, tex_format_name(fmt));
         tload->rect.width = width;
         tload->rect.height = height;
-        tload->rect.num_texels = width * height;
+        // Number of texels transferred by LOAD_BLOCK: full lines, including the stride padding (if any)
+        tload->rect.num_texels = TEX_FORMAT_BYTES2PIX(fmt, tload->tex->stride) * height;
         tload->rect.can_load_block = height <= tload->rect.block_max_lines;
         tload->rect.s0fx = tload->rect.s1fx = tload->rect.t0fx = tload->rect.t1fx = 0;
         if (tload->texparms) texload_recalc_tileparms(tload);
@@ -202,8 +205,8 @@ static void texload_block_4bpp(tex_loader_t *tload, int s0, int t0, int s1, int
         // Use LOAD_BLOCK if we are uploading a full texture. Notice the weirdness of LOAD_BLOCK:
         // * SET_TILE must be configured with tmem_pitch=0, as that is weirdly used as the number of
         //   texels to skip per line, which we don't need.
-        assertf(ROUND_UP(tload->tex->width, 2) % 4 == 0, "Internal Error: invalid width for LOAD_BLOCK (%d)", tload->tex->width);
-        rdpq_set_texture_image_raw(surface_get_placeholder_index(tload->tex), PhysicalAddr(tload->tex->buffer), FMT_RGBA16, (tload->tex->width+1)/4, tload->tex->height);
+        assertf(tload->tex->stride % 2 == 0, "Internal Error: invalid stride for LOAD_BLOCK (%d)", tload->tex->stride);
+        rdpq_set_texture_image_raw(surface_get_placeholder_index(tload->tex), PhysicalAddr(tload->tex->buffer), FMT_RGBA16, tload->tex->stride/2, tload->tex->height);
         rdpq_set_tile(tile_internal, FMT_RGBA16, tload->tmem_addr, 0, NULL);
         rdpq_set_tile(tload->tile, tload->fmt, tload->tmem_addr, tload->rect.tmem_pitch, &(tload->tileparms));
         tload->load_mode = TEX_LOAD_BLOCK;
@@ -227,7 +230,7 @@ static void texload_block_8bpp(tex_loader_t *tload, int s0, int t0, int s1, int
         // Use LOAD_BLOCK if we are uploading a full texture. Notice the weirdness of LOAD_BLOCK:
         // * SET_TILE must be configured with tmem_pitch=0, as that is weirdly used as the number of
         //   texels to skip per line, which we don't need.
-        rdpq_set_texture_image_raw(surface_get_placeholder_index(tload->tex), PhysicalAddr(tload->tex->buffer), FMT_RGBA16, tload->tex->width/2, tload->tex->height);
+        rdpq_set_texture_image_raw(surface_get_placeholder_index(tload->tex), PhysicalAddr(tload->tex->buffer), FMT_RGBA16, tload->tex->stride/2, tload->tex->height);
         rdpq_set_tile(tile_internal, FMT_RGBA16, tload->tmem_addr, 0, NULL);
         rdpq_set_tile(tload->tile, fmt, tload->tmem_addr, tload->rect.tmem_pitch, &(tload->tileparms));
         tload->load_mode = TEX_LOAD_BLOCK;
@@ -250,7 +253,7 @@ static void texload_block(tex_loader_t *tload, int s0, int t0, int s1, int t1)
         // Use LOAD_BLOCK if we are uploading a full texture. Notice the weirdness of LOAD_BLOCK:
         // * SET_TILE must be configured with tmem_pitch=0, as that is weirdly used as the number of
         //   texels to skip per line, which we don't need.
-        rdpq_set_texture_image_raw(surface_get_placeholder_index(tload->tex), PhysicalAddr(tload->tex->buffer), fmt, tload->tex->width, tload->tex->height);
+        rdpq_set_texture_image_raw(surface_get_placeholder_index(tload->tex), PhysicalAddr(tload->tex->buffer), fmt, TEX_FORMAT_BYTES2PIX(fmt, tload->tex->stride), tload->tex->height);
         rdpq_set_tile(tile_internal, fmt, tload->tmem_addr, 0, NULL);
         rdpq_set_tile(tload->tile, fmt, tload->tmem_addr, tload->rect.tmem_pitch,  &(tload->tileparms));
         tload->load_mode = TEX_LOAD_BLOCK;
@@ -322,7 +325,9 @@ int tex_loader_load(tex_loader_t *tload, int s0, int t0, int s1, int t1)
     assertf(s0 <= s1, "Invalid texture load: s0:%d s1:%d", s0, s1);
     assertf(t0 <= t1, "Invalid texture load: t0:%d t1:%d", t0, t1);
     int mem = texload_set_rect(tload, s0, t0, s1, t1);
-    if (tload->rect.can_load_block && (t0 & 1) == 0)
+    // LOAD_BLOCK transfers whole lines, so it must start at the beginning of a line
+    int sb = TEX_FORMAT_BITDEPTH(tload->fmt) == 4 ? (s0 & ~1) : s0;
+    if (tload->rect.can_load_block && (t0 & 1) == 0 && sb == 0)
         tload->load_block(tload, s0, t0, s1, t1);
     else
         tload->load_tile(tload, s0, t0, s1, t1);
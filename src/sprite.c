@@ -22,8 +22,13 @@ sprite_ext_t *__sprite_ext(sprite_t *sprite)
         return NULL;
 
     uint8_t *data = (uint8_t*)sprite->data;
-    tex_format_t format = sprite_get_format(sprite);
-    data += ROUND_UP(TEX_FORMAT_PIX2BYTES(format, sprite->width) * sprite->height, 8);
+    sprite_tiles_t *tiles = __sprite_tiles(sprite);
+    if (tiles) {
+        data += sizeof(sprite_tiles_t) + tiles->num_blocks * tiles->block_stride * tiles->block_height;
+    } else {
+        tex_format_t format = sprite_get_format(sprite);
+        data += ROUND_UP(TEX_FORMAT_PIX2BYTES(format, sprite->width) * sprite->height, 8);
+    }
 
     // Access extended header
     sprite_ext_t *sx = (sprite_ext_t*)data;
@@ -31,6 +36,13 @@ sprite_ext_t *__sprite_ext(sprite_t *sprite)
     return sx;
 }
 
+sprite_tiles_t *__sprite_tiles(sprite_t *sprite)
+{
+    if (!(sprite->flags & SPRITE_FLAGS_TILED))
+        return NULL;
+    return (sprite_tiles_t*)sprite->data;
+}
+
 bool __sprite_upgrade(sprite_t *sprite)
 {
     // Check if the sprite header begins with ASSET_MAGIC, which indicates a 
@@ -90,6 +102,14 @@ void sprite_free(sprite_t *s)
 }
 
 surface_t sprite_get_pixels(sprite_t *sprite) {
+    sprite_tiles_t *tiles = __sprite_tiles(sprite);
+    if (tiles) {
+        // A pre-tiled sprite made by a single block is just a linear image
+        // with a padded stride.
+        assertf(tiles->num_blocks == 1, "cannot access the pixels of a pre-tiled sprite made of %d blocks: use rdpq_sprite_blit", tiles->num_blocks);
+        return surface_make(tiles->data, sprite_get_format(sprite),
+            sprite->width, sprite->height, tiles->block_stride);
+    }
     return surface_make_linear(sprite->data, sprite_get_format(sprite),
         sprite->width, sprite->height);
 }
@@ -224,4 +244,69 @@ bool sprite_fits_tmem(sprite_t *sprite)
     return (sx->flags & SPRITE_FLAG_FITS_TMEM) != 0;
 }
 
+/** @brief Access the atlas table of the sprite, or NULL if the sprite is not an atlas */
+static sprite_atlas_t *__sprite_atlas(sprite_t *sprite)
+{
+    sprite_ext_t *sx = __sprite_ext(sprite);
+    // Sprites created before the atlas support have a smaller extended header
+    if (!sx || sx->size < sizeof(sprite_ext_t) || !sx->atlas_file_pos)
+        return NULL;
+    return (void*)sprite + sx->atlas_file_pos;
+}
+
+static void __sprite_atlas_rect(sprite_t *sprite, struct sprite_atlas_entry_s *e, sprite_atlas_rect_t *rect)
+{
+    rect->name = (const char*)sprite + e->name_file_pos;
+    rect->x = e->x;
+    rect->y = e->y;
+    rect->width = e->width;
+    rect->height = e->height;
+}
+
+int sprite_get_atlas_count(sprite_t *sprite)
+{
+    sprite_atlas_t *atlas = __sprite_atlas(sprite);
+    return atlas ? atlas->num_entries : 0;
+}
+
+void sprite_get_atlas_rect_by_index(sprite_t *sprite, int idx, sprite_atlas_rect_t *rect)
+{
+    sprite_atlas_t *atlas = __sprite_atlas(sprite);
+    assertf(atlas, "sprite is not an atlas");
+    assertf(idx >= 0 && idx < atlas->num_entries, "invalid atlas index %d (count: %lu)", idx, atlas->num_entries);
+    __sprite_atlas_rect(sprite, &atlas->entries[idx], rect);
+}
+
+bool sprite_get_atlas_rect(sprite_t *sprite, const char *name, sprite_atlas_rect_t *rect)
+{
+    sprite_atlas_t *atlas = __sprite_atlas(sprite);
+    if (!atlas)
+        return false;
+
+    // Entries are sorted by name: do a binary search
+    int lo = 0, hi = atlas->num_entries - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        struct sprite_atlas_entry_s *e = &atlas->entries[mid];
+        int cmp = strcmp(name, (const char*)sprite + e->name_file_pos);
+        if (cmp == 0) {
+            if (rect) __sprite_atlas_rect(sprite, e, rect);
+            return true;
+        }
+        if (cmp < 0) hi = mid - 1;
+        else         lo = mid + 1;
+    }
+    return false;
+}
+
+surface_t sprite_get_atlas_pixels(sprite_t *sprite, const char *name)
+{
+    sprite_atlas_rect_t r;
+    if (!sprite_get_atlas_rect(sprite, name, &r))
+        return (surface_t){0};
+
+    surface_t surf = sprite_get_pixels(sprite);
+    return surface_make_sub(&surf, r.x, r.y, r.width, r.height);
+}
+
 extern inline tex_format_t sprite_get_format(sprite_t *sprite);
@@ -49,9 +49,60 @@ typedef struct sprite_ext_s {
         bool              use_main_texture; ///< True if the detail texture is the same as the LOD0 of the main texture
         uint8_t           padding[3];    ///< Padding
     } detail;                    ///< Detail texture parameters
+    uint32_t atlas_file_pos;     ///< Position of the atlas table in the file (0 if none; only valid if size >= 128)
 } sprite_ext_t;
 
-_Static_assert(sizeof(sprite_ext_t) == 124, "invalid sizeof(sprite_ext_t)");
+_Static_assert(sizeof(sprite_ext_t) == 128, "invalid sizeof(sprite_ext_t)");
+
+/**
+ * @brief Table of named rectangles of an atlas sprite
+ * 
+ * This is created by mksprite in atlas mode (`--atlas`). Entries are sorted
+ * by name, so that they can be looked up with a binary search. Names are
+ * stored as NUL-terminated strings after the entries.
+ */
+typedef struct sprite_atlas_s {
+    uint32_t num_entries;       ///< Number of entries in the table
+    uint32_t padding;           ///< Padding
+    /// Entries of the table
+    struct sprite_atlas_entry_s {
+        uint32_t name_file_pos;     ///< Position of the name in the file
+        uint16_t x, y;              ///< Position of the rectangle within the sprite
+        uint16_t width, height;     ///< Size of the rectangle
+    } entries[];
+} sprite_atlas_t;
+
+/**
+ * @brief Header of the pixel data of a pre-tiled sprite
+ * 
+ * This is created by mksprite with `--tiled`, and signaled by #SPRITE_FLAGS_TILED.
+ * The image is split into a grid of blocks of the same size, each one small
+ * enough to be loaded in TMEM with a single LOAD_BLOCK command. Blocks are
+ * stored one after the other (rows of blocks from top to bottom, each row
+ * from left to right), and each block is stored in TMEM line order, with
+ * its stride padded to 8 bytes (16 bytes for RGBA32).
+ * 
+ * If the image is split along an axis, consecutive blocks overlap: each block
+ * covers `block_width-2` pixels (resp. `block_height-2`) of the image, plus
+ * one more pixel on each side, so that bilinear filtering has the correct
+ * neighbors at block boundaries. The first block along an axis starts at
+ * pixel 0, and the last one is padded by repeating the border pixels.
+ * If the image is not split along an axis, the block covers it exactly, except
+ * that blocks spanning the full width can be padded with the border pixels, to
+ * get a stride that LOAD_BLOCK can load in full.
+ */
+typedef struct sprite_tiles_s {
+    uint16_t block_width;       ///< Width of a block in pixels
+    uint16_t block_height;      ///< Height of a block in pixels
+    uint16_t block_stride;      ///< Length of a line of a block in bytes
+    uint16_t num_blocks;        ///< Total number of blocks
+    uint8_t data[];             ///< Pixels of the blocks
+} sprite_tiles_t;
+
+_Static_assert(sizeof(sprite_tiles_t) == 8, "invalid sizeof(sprite_tiles_t)");
+
+/** @brief Access the pre-tiled pixel header of the sprite, or NULL if the sprite is not pre-tiled */
+sprite_tiles_t *__sprite_tiles(sprite_t *sprite);
 
 /** @brief Convert a sprite from the old format with implicit texture format */ 
 bool __sprite_upgrade(sprite_t *sprite);
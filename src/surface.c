@@ -7,7 +7,9 @@
 #include "surface.h"
 #include "n64sys.h"
 #include "debug.h"
+#include "utils.h"
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 
@@ -54,6 +56,165 @@ void surface_free(surface_t *surface)
     memset(surface, 0, sizeof(surface_t));
 }
 
+/** @brief State of a buffer in a surface pool */
+typedef enum {
+    POOL_BUFFER_IDLE,           ///< Buffer available for recycling
+    POOL_BUFFER_IN_USE,         ///< Buffer allocated to a surface
+    POOL_BUFFER_IN_USE_FRAME,   ///< Buffer allocated to a surface until the end of the frame
+} pool_buffer_state_t;
+
+/** @brief A buffer owned by a surface pool */
+typedef struct {
+    void *buffer;               ///< Pixels
+    tex_format_t format;        ///< Pixel format of the surface
+    uint16_t width;             ///< Width of the surface
+    uint16_t height;            ///< Height of the surface
+    uint16_t stride;            ///< Stride of the surface
+    pool_buffer_state_t state;  ///< Current state
+    uint32_t last_frame;        ///< Last frame the buffer was used in
+} pool_buffer_t;
+
+/** @brief A pool of recyclable surface buffers */
+typedef struct surface_pool_s {
+    pool_buffer_t *buffers;     ///< Buffers owned by the pool
+    int num_buffers;            ///< Number of buffers
+    int max_buffers;            ///< Allocated size of the buffers array
+    int max_idle_frames;        ///< Idle frames after which a buffer is freed (0: never)
+    uint32_t frame;             ///< Current frame number
+    surface_pool_stats_t stats; ///< Statistics
+} surface_pool_t;
+
+surface_pool_t *surface_pool_new(int max_idle_frames)
+{
+    surface_pool_t *pool = calloc(1, sizeof(surface_pool_t));
+    pool->max_idle_frames = max_idle_frames;
+    return pool;
+}
+
+/** @brief Free the buffer at the specified index of the pool */
+static void surface_pool_drop(surface_pool_t *pool, int idx)
+{
+    pool_buffer_t *b = &pool->buffers[idx];
+    free_uncached(b->buffer);
+    pool->stats.bytes -= b->height * b->stride;
+    pool->stats.num_buffers--;
+    pool->buffers[idx] = pool->buffers[--pool->num_buffers];
+}
+
+void surface_pool_free(surface_pool_t *pool)
+{
+    for (int i = 0; i < pool->num_buffers; i++)
+        free_uncached(pool->buffers[i].buffer);
+    free(pool->buffers);
+    free(pool);
+}
+
+/** @brief Allocate a surface from the pool, in the specified state */
+static surface_t surface_pool_get(surface_pool_t *pool, tex_format_t format, uint16_t width, uint16_t height, pool_buffer_state_t state)
+{
+    assertf((format & ~SURFACE_FLAGS_TEXFORMAT) == 0,
+        "invalid surface format: 0x%x (%d)", format, format);
+    uint16_t stride = ROUND_UP(TEX_FORMAT_PIX2BYTES(format, width), 8);
+
+    pool->stats.num_allocs++;
+
+    pool_buffer_t *b = NULL;
+    for (int i = 0; i < pool->num_buffers; i++) {
+        pool_buffer_t *bi = &pool->buffers[i];
+        if (bi->state == POOL_BUFFER_IDLE && bi->format == format &&
+            bi->width == width && bi->height == height && bi->stride == stride) {
+            b = bi;
+            pool->stats.num_reuses++;
+            break;
+        }
+    }
+
+    if (!b) {
+        if (pool->num_buffers == pool->max_buffers) {
+            pool->max_buffers = pool->max_buffers ? pool->max_buffers * 2 : 8;
+            pool->buffers = realloc(pool->buffers, pool->max_buffers * sizeof(pool_buffer_t));
+        }
+        b = &pool->buffers[pool->num_buffers++];
+        *b = (pool_buffer_t){
+            .buffer = malloc_uncached_aligned(64, height * stride),
+            .format = format,
+            .width = width,
+            .height = height,
+            .stride = stride,
+        };
+        pool->stats.num_buffers++;
+        pool->stats.bytes += height * stride;
+        pool->stats.peak_bytes = MAX(pool->stats.peak_bytes, pool->stats.bytes);
+    }
+
+    b->state = state;
+    b->last_frame = pool->frame;
+    pool->stats.num_in_use++;
+    pool->stats.bytes_in_use += height * stride;
+    pool->stats.peak_bytes_in_use = MAX(pool->stats.peak_bytes_in_use, pool->stats.bytes_in_use);
+
+    return surface_make(b->buffer, format, width, height, stride);
+}
+
+surface_t surface_pool_alloc(surface_pool_t *pool, tex_format_t format, uint16_t width, uint16_t height)
+{
+    return surface_pool_get(pool, format, width, height, POOL_BUFFER_IN_USE);
+}
+
+surface_t surface_pool_alloc_frame(surface_pool_t *pool, tex_format_t format, uint16_t width, uint16_t height)
+{
+    return surface_pool_get(pool, format, width, height, POOL_BUFFER_IN_USE_FRAME);
+}
+
+/** @brief Mark a buffer of the pool as idle */
+static void surface_pool_put(surface_pool_t *pool, pool_buffer_t *b)
+{
+    b->state = POOL_BUFFER_IDLE;
+    b->last_frame = pool->frame;
+    pool->stats.num_in_use--;
+    pool->stats.bytes_in_use -= b->height * b->stride;
+}
+
+void surface_pool_release(surface_pool_t *pool, surface_t *surface)
+{
+    for (int i = 0; i < pool->num_buffers; i++) {
+        pool_buffer_t *b = &pool->buffers[i];
+        if (b->buffer == surface->buffer) {
+            assertf(b->state != POOL_BUFFER_IDLE, "surface %p released twice", surface->buffer);
+            surface_pool_put(pool, b);
+            memset(surface, 0, sizeof(surface_t));
+            return;
+        }
+    }
+    assertf(0, "surface %p was not allocated from this pool", surface->buffer);
+}
+
+void surface_pool_end_frame(surface_pool_t *pool)
+{
+    pool->frame++;
+    for (int i = pool->num_buffers - 1; i >= 0; i--) {
+        pool_buffer_t *b = &pool->buffers[i];
+        if (b->state == POOL_BUFFER_IN_USE_FRAME)
+            surface_pool_put(pool, b);
+        else if (b->state == POOL_BUFFER_IDLE && pool->max_idle_frames &&
+                 pool->frame - b->last_frame > (uint32_t)pool->max_idle_frames)
+            surface_pool_drop(pool, i);
+    }
+}
+
+void surface_pool_trim(surface_pool_t *pool)
+{
+    for (int i = pool->num_buffers - 1; i >= 0; i--) {
+        if (pool->buffers[i].state == POOL_BUFFER_IDLE)
+            surface_pool_drop(pool, i);
+    }
+}
+
+void surface_pool_get_stats(surface_pool_t *pool, surface_pool_stats_t *stats)
+{
+    *stats = pool->stats;
+}
+
 surface_t surface_make_sub(surface_t *parent, uint16_t x0, uint16_t y0, uint16_t width, uint16_t height)
 {
     assert(x0 + width <= parent->width);
@@ -4,6 +4,7 @@
  * @ingroup timer
  */
 #include <malloc.h>
+#include <stdlib.h>
 #include "timer.h"
 #include "interrupt.h"
 #include "debug.h"
@@ -13,160 +14,250 @@
 /** @brief Refcount of #timer_init vs #timer_close calls. */
 static int timer_init_refcount = 0;
 
-/** @brief Internal linked list of timers */
-static timer_link_t *TI_timers = NULL;
+/** @brief Pending timers, as a binary min-heap ordered by deadline */
+static timer_link_t **TI_heap = NULL;
+/** @brief Number of timers in #TI_heap */
+static int TI_heap_size = 0;
+/** @brief Allocated size of #TI_heap */
+static int TI_heap_cap = 0;
+/** @brief Number of live timers allocated by #new_timer / #new_timer_context */
+static int TI_timer_count = 0;
+/** @brief Nesting level of timer callbacks being run (see #__proc_timers) */
+static int TI_callback_depth = 0;
+
+/** @brief 64-bit extension of the COUNT register (see #timer_now) */
+static uint64_t TI_ticks64 = 0;
+/** @brief Value of the COUNT register at the last #timer_now call */
+static uint32_t TI_ticks64_last = 0;
 
 /** @brief Timer callback expects a context parameter */
 #define TF_CONTEXT     0x20
 
-/** @brief Timer is the special overflow timer. */
-#define TF_OVERFLOW    0x40
-
-/** @brief Timer has been called once in this interrupt. */
-#define TF_CALLED      0x80
+/**
+ * @brief Return the current time as a 64-bit ticks value
+ *
+ * Deadlines are kept as 64-bit values so that they can be totally ordered
+ * in the heap, irrespective of COUNT wrapping around. This is correct as long
+ * as this function is called at least once every 2**32 ticks while timers are
+ * pending, which is guaranteed by the compare interrupt.
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static uint64_t timer_now(void)
+{
+	uint32_t now = TICKS_READ();
+	TI_ticks64 += (uint32_t)(now - TI_ticks64_last);
+	TI_ticks64_last = now;
+	return TI_ticks64;
+}
 
-/** @brief Update the compare register to match the first expiring timer. */
-__attribute__((noinline))
-static void timer_update_compare(timer_link_t *head, uint32_t now)
+/** @brief Move the timer at the specified heap position towards the root */
+static void heap_sift_up(int idx)
 {
-	uint32_t smallest = 0xFFFFFFFF;
+	timer_link_t *t = TI_heap[idx];
+	while (idx > 0)
+	{
+		int parent = (idx - 1) / 2;
+		if (TI_heap[parent]->deadline <= t->deadline)
+			break;
+		TI_heap[idx] = TI_heap[parent];
+		TI_heap[idx]->index = idx;
+		idx = parent;
+	}
+	TI_heap[idx] = t;
+	t->index = idx;
+}
 
-	while (head)
+/** @brief Move the timer at the specified heap position towards the leaves */
+static void heap_sift_down(int idx)
+{
+	timer_link_t *t = TI_heap[idx];
+	while (1)
 	{
-		/* See how much time is left before the timer expires. Notice that
-		   the subtraction is also safe with overflows. */
-		uint32_t left = head->left - now;
-		if (left < smallest)
-			smallest = left;
-
-		/* Go to next */
-		head = head->next;
+		int child = idx * 2 + 1;
+		if (child >= TI_heap_size)
+			break;
+		if (child + 1 < TI_heap_size && TI_heap[child + 1]->deadline < TI_heap[child]->deadline)
+			child++;
+		if (t->deadline <= TI_heap[child]->deadline)
+			break;
+		TI_heap[idx] = TI_heap[child];
+		TI_heap[idx]->index = idx;
+		idx = child;
 	}
+	TI_heap[idx] = t;
+	t->index = idx;
+}
 
-	/* set compare to shortest time left */
-	C0_WRITE_COMPARE(now + smallest);
+/**
+ * @brief Make sure the heap can hold the specified number of timers
+ *
+ * Growing the heap calls realloc, so it must never happen from a timer
+ * callback (interrupt context). Capacity is reserved in advance by
+ * #timer_reserve whenever a timer is created or started outside callbacks.
+ */
+static void heap_reserve(int size)
+{
+	if (size <= TI_heap_cap)
+		return;
+	assertf(TI_callback_depth == 0, "timer queue cannot grow from a timer callback\n"
+		"Create the timer with new_timer, or start it once outside of callbacks");
+	int cap = TI_heap_cap ? TI_heap_cap * 2 : 16;
+	while (cap < size)
+		cap *= 2;
+	TI_heap = realloc(TI_heap, cap * sizeof(timer_link_t*));
+	assertf(TI_heap, "out of memory for timer queue");
+	TI_heap_cap = cap;
 }
 
 /**
- * @brief Process linked list of timers
+ * @brief Reserve room for all the timers that might be queued later
  *
- * Walk the linked list of timers and call the callbacks of any that
- * have expired.
+ * The heap can hold at most the timers currently queued plus all the timers
+ * allocated by #new_timer, so that restarting any of them from a callback
+ * does not need to grow it.
+ */
+static void timer_reserve(void)
+{
+	if (TI_callback_depth == 0)
+		heap_reserve(TI_heap_size + TI_timer_count + 1);
+}
+
+/** @brief Add a timer to the heap */
+static void heap_insert(timer_link_t *timer)
+{
+	heap_reserve(TI_heap_size + 1);
+	TI_heap[TI_heap_size] = timer;
+	heap_sift_up(TI_heap_size++);
+}
+
+/**
+ * @brief Remove a timer from the heap (if queued)
  *
- * @note This function will remove one-shot timers from the list after
- *       they have fired.
+ * The index is validated against the heap, as timers passed to #start_timer
+ * might be allocated by the caller and never initialized.
+ */
+static void heap_remove(timer_link_t *timer)
+{
+	int idx = timer->index;
+	timer->index = -1;
+	if (idx < 0 || idx >= TI_heap_size || TI_heap[idx] != timer)
+		return;
+
+	timer_link_t *last = TI_heap[--TI_heap_size];
+	if (idx == TI_heap_size)
+		return;
+	TI_heap[idx] = last;
+	last->index = idx;
+	if (idx > 0 && TI_heap[(idx - 1) / 2]->deadline > last->deadline)
+		heap_sift_up(idx);
+	else
+		heap_sift_down(idx);
+}
+
+/** @brief Update the compare register to match the first expiring timer. */
+static void timer_update_compare(void)
+{
+	/* With no pending timers, trigger anyway before COUNT wraps around, to
+	   keep the 64-bit time updated. */
+	if (TI_heap_size)
+		C0_WRITE_COMPARE((uint32_t)TI_heap[0]->deadline);
+	else
+		C0_WRITE_COMPARE(TICKS_READ() - 1);
+}
+
+/**
+ * @brief Run callbacks for the expired timers
  *
- * @param[in] head
- *            Head of the linked list of timers
+ * Pop the expired timers from the heap in deadline order and call their
+ * callbacks. Continuous timers are queued again with their next deadline.
  *
- * @retval 1 The list needs reprocessing
- * @retval 0 All timer operations were handled successfully
+ * Consider a timer as expired if its deadline is up to 5 microseconds after
+ * the current time. This 5 microseconds window is useful to cluster timers
+ * that expire close to each other; eg: if the client creates many timers
+ * with the same period, they will be created in a fast sequence and have a
+ * little delay between each other.
  */
-static int __proc_timers(timer_link_t * thead)
+static void __proc_timers(void)
 {
-	timer_link_t *head = thead;
-	timer_link_t *last = 0;
-	uint32_t start = C0_COMPARE();
-	uint32_t now = TICKS_READ();
+	uint32_t loop_count = 0;
 
-	while (head)
+	while (TI_heap_size)
 	{
-		/* Consider a timer as expired if its deadline is at the
-		 * COMPARE value (time at which the interrupt triggered) or up to 5
-		 * microseconds after. This 5 microseconds window is useful to cluster
-		 * timers that expire close to each other; eg: if the client creates
-		 * many timers with the same period, they will be created in a fast
-		 * sequence and have a little delay between each other. */
-		if (!(head->flags & TF_CALLED) && 
-			!(head->flags & TF_DISABLED) &&
-			TICKS_DISTANCE(start, head->left) >= 0 && 
-			TICKS_DISTANCE(head->left, now+TIMER_TICKS(5)) >= 0)
+		timer_link_t *head = TI_heap[0];
+		uint64_t now = timer_now();
+		if (head->deadline > now + TIMER_TICKS(5))
+			break;
+
+		/* If the callback was slow, other timers might have expired in the
+		   meantime: they will be processed by the next iterations. The
+		   number of iterations is bounded unless some continuous timer has
+		   a period shorter than the callbacks. */
+		++loop_count; (void)loop_count; // avoid warning (loop_count is used in assertf)
+		assertf(loop_count < 1000 + (uint32_t)TI_heap_size, "timer interrupt is stuck in an infinite loop.\n"
+			"Check continuous timers with a very short period.\n");
+
+		/* Dequeue the timer before calling the callback, so that the
+		   callback can freely stop or restart it. */
+		heap_remove(head);
+		head->ovfl = (int32_t)(now - head->deadline);
+
+		/* invoke the appropriate callback function */
+		TI_callback_depth++;
+		if (head->flags & TF_CONTEXT && head->callback_with_context)
+			head->callback_with_context(head->ovfl, head->ctx);
+		else if (head->callback)
+			head->callback(head->ovfl);
+		TI_callback_depth--;
+
+		/* Requeue continuous timers, unless they were stopped or
+		   restarted during the callback. */
+		if ((head->flags & TF_CONTINUOUS) && !(head->flags & TF_DISABLED) && head->index < 0)
 		{
-			/* yes - timed out, do callback */
-			head->ovfl = TICKS_DISTANCE(head->left, now);
-
-			/* invoke the appropriate callback function */
-			if (head->flags & TF_CONTEXT && head->callback_with_context)
-				head->callback_with_context(head->ovfl, head->ctx);
-			else if (head->callback)
-				head->callback(head->ovfl);
-
-			if (head->flags & TF_DISABLED)
-			{
-				/* Timer was disabled during the callback. We need to
-				 * reprocess the list to see if there are other timers
-				 * that need to be called. */
-				return 1;
-			}
-
-			/* reset ticks if continuous */
-			if (head->flags & TF_CONTINUOUS)
-			{
-				head->left += head->set;
-				last = head;
-
-				/* Special case: the internal overflow timer has a period
-				 * of 2**32, so next occurrence will look exactly like the
-				 * current one. Since we're going to reprocess the list, we
-				 * would keep executing it many times until we eventually
-				 * exit the 5 microseconds window.
-				 * So we mark this timer as already called (TF_CALLED) and
-				 * avoid calling it again. 
-				 *
-				 * Notice that we do this only for overflow because other timers
-				 * with a short period might actually be called multiple times
-				 * under interrupt. For instance, if a continuous timer with
-				 * a short period is followed by a very slow one-shot timer,
-				 * when the latter is finished the former might need to fire again.
-				 */
-				if (head->flags & TF_OVERFLOW)
-					head->flags |= TF_CALLED;
-			}
-			else
-			{
-				/* one-shot, remove from list */
-				if (last)
-					last->next = head->next;
-				else
-					TI_timers = head->next;
-			}
-
-			/* Go through timer list again. If the callback was slow, maybe
-			   other timers have expired. */
-			return 1;
+			head->deadline += head->set;
+			head->left = head->deadline;
+			heap_insert(head);
 		}
-
-		/* Go to next */
-		last = head;
-		head = head->next;
 	}
-
-	/* Clear the TF_CALLED flag from the overflow timer (if any) */
-	while (thead) {
-		thead->flags &= ~TF_CALLED;
-		thead = thead->next;
-	}
-	return 0;							// exit timer callback
 }
 
 /**
- * @brief Poll the timer list and run callbacks for expired timers
+ * @brief Poll the timer queue and run callbacks for expired timers
  *
  * This function is called by the interrupt handler whenever 
- * compare == count, and also when inserting into or removing
- * from the timers list to improve handling timers with tiny delays
+ * compare == count, and also when inserting into the timer queue to
+ * improve handling timers with tiny delays
  */
 static void timer_poll(void)
 {
-	uint32_t loop_count = 0;
-	while (__proc_timers(TI_timers)) {
-		++loop_count; (void)loop_count; // avoid warning (loop_count is used in assertf)
-		assertf(loop_count < 1000, "timer interrupt is stuck in an infinite loop.\n"
-			"Check continuous timers with a very short period.\n");
-	}
+	// Keep the 64-bit time updated even if no timer is pending.
+	timer_now();
+	__proc_timers();
 
 	// Update counter for next interrupt.
-	timer_update_compare(TI_timers, TICKS_READ());
+	timer_update_compare();
+}
+
+/**
+ * @brief Configure and queue a timer
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void timer_start(timer_link_t *timer, int ticks, int flags)
+{
+	/* The timer might be already queued (eg: start_timer on a running timer) */
+	heap_remove(timer);
+
+	timer->deadline = timer_now() + (int32_t)ticks;
+	timer->left = timer->deadline;
+	timer->set = ticks;
+	timer->flags = flags;
+
+	if (!(flags & TF_DISABLED))
+	{
+		heap_insert(timer);
+		timer_poll();
+	}
 }
 
 void timer_init(void)
@@ -177,6 +268,7 @@ void timer_init(void)
 	// Reset the compare register and enable timer interrupts in COP0.
 	// Do not write the COUNT register to avoid interfering with get_ticks().
 	disable_interrupts();
+	TI_ticks64_last = TICKS_READ();
 	C0_WRITE_COMPARE(0);
 	set_TI_interrupt(1);
 	register_TI_handler(timer_poll);
@@ -191,20 +283,14 @@ timer_link_t *new_timer(int ticks, int flags, timer_callback1_t callback)
 	{
 		disable_interrupts();
 
-		uint32_t now = TICKS_READ();
-		timer->left = now + (int32_t)ticks;
-		timer->set = ticks;
-		timer->flags = flags;
+		/* Grow the queue now rather than in a callback */
+		timer->index = -1;
+		TI_timer_count++;
+		timer_reserve();
+
 		timer->callback = callback;
 		timer->ctx = NULL;
-
-		if (!(flags & TF_DISABLED))
-		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
-			timer_poll();
-		}
+		timer_start(timer, ticks, flags);
 
 		enable_interrupts();
 	}
@@ -219,20 +305,14 @@ timer_link_t *new_timer_context(int ticks, int flags, timer_callback2_t callback
 	{
 		disable_interrupts();
 
-		uint32_t now = TICKS_READ();
-		timer->left = now + (int32_t)ticks;
-		timer->set = ticks;
-		timer->flags = flags | TF_CONTEXT;
+		/* Grow the queue now rather than in a callback */
+		timer->index = -1;
+		TI_timer_count++;
+		timer_reserve();
+
 		timer->callback_with_context = callback;
 		timer->ctx = ctx;
-
-		if (!(flags & TF_DISABLED))
-		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
-			timer_poll();
-		}
+		timer_start(timer, ticks, flags | TF_CONTEXT);
 
 		enable_interrupts();
 	}
@@ -246,20 +326,10 @@ void start_timer(timer_link_t *timer, int ticks, int flags, timer_callback1_t ca
 	{
 		disable_interrupts();
 
-		uint32_t now = TICKS_READ();
-		timer->left = now + (int32_t)ticks;
-		timer->set = ticks;
-		timer->flags = flags;
 		timer->callback = callback;
 		timer->ctx = NULL;
-
-		if (!(flags & TF_DISABLED))
-		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
-			timer_poll();
-		}
+		timer_reserve();
+		timer_start(timer, ticks, flags);
 
 		enable_interrupts();
 	}
@@ -272,20 +342,10 @@ void start_timer_context(timer_link_t *timer, int ticks, int flags, timer_callba
 	{
 		disable_interrupts();
 
-		uint32_t now = TICKS_READ();
-		timer->left = now + (int32_t)ticks;
-		timer->set = ticks;
-		timer->flags = flags | TF_CONTEXT;
 		timer->callback_with_context = callback;
 		timer->ctx = ctx;
-
-		if (flags & TF_DISABLED)
-		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
-			timer_poll();
-		}
+		timer_reserve();
+		timer_start(timer, ticks, flags | TF_CONTEXT);
 
 		enable_interrupts();
 	}
@@ -296,48 +356,20 @@ void restart_timer(timer_link_t *timer)
 	if (timer)
 	{
 		disable_interrupts();
-
-		uint32_t now = TICKS_READ();
-		timer->left = now + (int32_t)timer->set;
-		timer->flags &= ~TF_DISABLED;
-
-		timer->next = TI_timers;
-		TI_timers = timer;
-		timer_update_compare(TI_timers, now);
-		timer_poll();
-
+		timer_start(timer, timer->set, timer->flags & ~TF_DISABLED);
 		enable_interrupts();
 	}
 }
 
 void stop_timer(timer_link_t *timer)
 {
-	timer_link_t *head;
-	timer_link_t *last = 0;
-
 	assertf(timer_init_refcount > 0, "timer module not initialized");
 	if (timer)
 	{
 		disable_interrupts();
-		head = TI_timers;
-		while (head)
-		{
-			if (head == timer)
-			{
-				/* remove from list */
-				if (last)
-					last->next = head->next;
-				else
-					TI_timers = head->next;
-
-				break;
-			}
-
-			last = head;
-			head = head->next;
-		}
+		heap_remove(timer);
 		timer->flags |= TF_DISABLED;
-		timer_update_compare(TI_timers, TICKS_READ());
+		timer_update_compare();
 		enable_interrupts();
 	}
 }
@@ -348,6 +380,9 @@ void delete_timer(timer_link_t *timer)
 	if (timer)
 	{
 		stop_timer(timer);
+		disable_interrupts();
+		TI_timer_count--;
+		enable_interrupts();
 		free(timer);
 	}
 }
@@ -365,13 +400,12 @@ void timer_close(void)
 	set_TI_interrupt(0);
 	unregister_TI_handler(timer_poll);
 
-	timer_link_t *head = TI_timers;
-	while (head)
+	for (int i = 0; i < TI_heap_size; i++)
 	{
-		timer_link_t *last = head;
-		head = head->next;
+		timer_link_t *timer = TI_heap[i];
+		timer->index = -1;
 
-		if (last->flags & TF_CONTINUOUS)
+		if (timer->flags & TF_CONTINUOUS)
 		{
 			/* Only free if it is a continuous timer as one-shot timers are
 			 * freed by the user.  If we free a timer here, the user will
@@ -380,10 +414,13 @@ void timer_close(void)
 			 * condition by ensuring that the timer system never frees a 
 			 * one shot timer.
 			 */
-			free(last);
+			free(timer);
 		}
 	}
-	TI_timers = 0;
+	free(TI_heap);
+	TI_heap = NULL;
+	TI_heap_size = TI_heap_cap = 0;
+	TI_timer_count = 0;
 	enable_interrupts();
 }
 
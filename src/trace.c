@@ -0,0 +1,178 @@
+/**
+ * @file trace.c
+ * @brief Binary event tracing
+ * @ingroup trace
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "debug.h"
+#include "n64sys.h"
+#include "utils.h"
+
+/** @brief A recorded event */
+typedef struct {
+    uint32_t seq;                       ///< Position of the record in the stream + 1 (written last)
+    uint32_t ticks;                     ///< Timestamp (TICKS_READ)
+    const char *fmt;                    ///< Format string, identifying the event
+    uint32_t nargs;                     ///< Number of valid arguments
+    uint32_t args[TRACE_MAX_ARGS];      ///< Arguments
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == 32, "invalid trace_record_t size");
+
+/** @brief Tracing state */
+static struct {
+    trace_record_t *records;    ///< Ring buffer of records
+    uint32_t mask;              ///< Capacity of the ring buffer - 1 (power of two)
+    uint32_t wpos;              ///< Position of the next record to reserve
+    uint32_t rpos;              ///< Position of the next record to flush
+    uint32_t num_lost;          ///< Records dropped because the buffer was full
+    uint32_t flushed_lost;      ///< Value of num_lost at the last flush
+    const char **fmts;          ///< Format strings already written, in order of id
+    int num_fmts;               ///< Number of format strings already written
+} tr;
+
+void __trace_event(const char *fmt, int nargs, const uint32_t *args)
+{
+    if (!tr.records)
+        return;
+
+    // Reserve a record. Compare-and-swap is implemented with LL/SC, which
+    // fails if an interrupt happens in between, so this works from any
+    // context without disabling interrupts.
+    uint32_t pos = __atomic_load_n(&tr.wpos, __ATOMIC_RELAXED);
+    do {
+        if (pos - __atomic_load_n(&tr.rpos, __ATOMIC_RELAXED) > tr.mask) {
+            __atomic_fetch_add(&tr.num_lost, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&tr.wpos, &pos, pos+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    trace_record_t *rec = &tr.records[pos & tr.mask];
+    rec->ticks = TICKS_READ();
+    rec->fmt = fmt;
+    rec->nargs = nargs;
+    for (int i = 0; i < nargs; i++)
+        rec->args[i] = args[i];
+
+    // Publish the record to trace_flush
+    MEMORY_BARRIER();
+    rec->seq = pos + 1;
+}
+
+void trace_init(int max_events)
+{
+    assertf(!tr.records, "tracing already initialized");
+    assertf(max_events > 0, "invalid number of events: %d", max_events);
+
+    int capacity = 1;
+    while (capacity < max_events)
+        capacity *= 2;
+
+    trace_record_t *records = malloc(capacity * sizeof(trace_record_t));
+    assertf(records, "out of memory for %d trace events", capacity);
+    memset(records, 0, capacity * sizeof(trace_record_t));
+
+    tr.mask = capacity - 1;
+    tr.wpos = tr.rpos = 0;
+    tr.num_lost = tr.flushed_lost = 0;
+    tr.fmts = NULL;
+    tr.num_fmts = 0;
+    MEMORY_BARRIER();
+    tr.records = records;
+}
+
+void trace_close(void)
+{
+    if (!tr.records)
+        return;
+    trace_record_t *records = tr.records;
+    tr.records = NULL;
+    MEMORY_BARRIER();
+    free(records);
+    free(tr.fmts);
+    memset(&tr, 0, sizeof(tr));
+}
+
+/** @brief Write a format string, escaping the characters that would break the line */
+static void trace_write_fmt(FILE *out, int id, const char *fmt)
+{
+    fprintf(out, "F %x ", id);
+    for (const char *s = fmt; *s; s++) {
+        switch (*s) {
+        case '\n': fputs("\\n", out); break;
+        case '\r': fputs("\\r", out); break;
+        case '\t': fputs("\\t", out); break;
+        case '\\': fputs("\\\\", out); break;
+        default:   fputc(*s, out); break;
+        }
+    }
+    fputc('\n', out);
+}
+
+/** @brief Return the id of a format string, writing it if it is new */
+static int trace_fmt_id(FILE *out, const char *fmt)
+{
+    // Formats are few, and the most frequent ones are found first.
+    for (int i = 0; i < tr.num_fmts; i++)
+        if (tr.fmts[i] == fmt)
+            return i;
+
+    if ((tr.num_fmts & (tr.num_fmts - 1)) == 0) {
+        tr.fmts = realloc(tr.fmts, MAX(tr.num_fmts * 2, 16) * sizeof(const char*));
+        assertf(tr.fmts, "out of memory for trace format strings");
+    }
+    int id = tr.num_fmts++;
+    tr.fmts[id] = fmt;
+    trace_write_fmt(out, id, fmt);
+    return id;
+}
+
+int trace_flush(FILE *out, int max_events)
+{
+    assertf(tr.records, "tracing not initialized");
+
+    uint32_t num_lost = __atomic_load_n(&tr.num_lost, __ATOMIC_RELAXED);
+    int n = 0;
+    while (max_events == 0 || n < max_events) {
+        if (tr.rpos == __atomic_load_n(&tr.wpos, __ATOMIC_RELAXED))
+            break;
+
+        // Stop at a record which is still being written by an interrupted
+        // context. It will be flushed next time.
+        trace_record_t *rec = &tr.records[tr.rpos & tr.mask];
+        if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != tr.rpos + 1)
+            break;
+        trace_record_t r = *rec;
+        MEMORY_BARRIER();
+        __atomic_store_n(&tr.rpos, tr.rpos + 1, __ATOMIC_RELAXED);
+
+        if (n++ == 0)
+            fprintf(out, "TRACE1 %d\n", TICKS_PER_SECOND);
+        int id = trace_fmt_id(out, r.fmt);
+        fprintf(out, "E %lx %x", r.ticks, id);
+        for (int i = 0; i < r.nargs; i++)
+            fprintf(out, " %lx", r.args[i]);
+        fputc('\n', out);
+    }
+
+    if (n > 0 || num_lost != tr.flushed_lost) {
+        if (n == 0)
+            fprintf(out, "TRACE1 %d\n", TICKS_PER_SECOND);
+        fprintf(out, "TRACEEND %d %lu\n", n, num_lost - tr.flushed_lost);
+        fflush(out);
+        tr.flushed_lost = num_lost;
+    }
+    return n;
+}
+
+trace_stats_t trace_get_stats(void)
+{
+    uint32_t wpos = __atomic_load_n(&tr.wpos, __ATOMIC_RELAXED);
+    return (trace_stats_t){
+        .num_events = wpos,
+        .num_lost = __atomic_load_n(&tr.num_lost, __ATOMIC_RELAXED),
+        .num_pending = wpos - tr.rpos,
+    };
+}
@@ -67,7 +67,7 @@ https://github.com/buu342/N64-UNFLoader
     #define IO_READ(addr)       (*(vu32 *)PHYS_TO_K1(addr))
     
     // Data alignment
-    #define OS_DCACHE_ROUNDUP_ADDR(x) (void *)(((((u32)(x)+0xf)/0x10)*0x10))
+    #define OS_DCACHE_ROUNDUP_ADDR(x) (void *)(((((uintptr_t)(x)+0xf)/0x10)*0x10))
     #define OS_DCACHE_ROUNDUP_SIZE(x) (u32)(((((u32)(x)+0xf)/0x10)*0x10))
 #endif
 
@@ -248,6 +248,22 @@ static int usb_datasize = 0;
 static int usb_dataleft = 0;
 static int usb_readblock = -1;
 
+// Bulk transfer globals
+static char usb_stream_open = FALSE;
+static int  usb_stream_datatype = 0;
+static int  usb_stream_size = 0;
+static int  usb_stream_written = 0;
+static u32  usb_stream_offset = 0;
+static int  usb_stream_staged = 0;
+static u32  usb_stream_writable = 0;
+static u32  usb_bulk_region = 0;
+static char usb_bulk_pending = FALSE;
+static u32  usb_bulk_pendingsize = 0;
+static char usb_bulk_timing = FALSE;
+static u32  usb_bulk_timingstart = 0;
+static u64  usb_bulk_ticks = 0;
+static u64  usb_bulk_bytes = 0;
+
 #ifndef LIBDRAGON
     // Message globals
     #if !USE_OSRAW
@@ -577,10 +593,13 @@ void usb_write(int datatype, const void* data, int size)
     if (usb_cart == CART_NONE)
         return;
     
-    // If there's data to read first, stop
-    if (usb_dataleft != 0)
+    // If there's data to read first, or a stream is being sent, stop
+    if (usb_dataleft != 0 || usb_stream_open)
         return;
     
+    // Wait for the bulk transfer in progress, as it uses the same area
+    usb_bulk_flush();
+    
     // Call the correct write function
     funcPointer_write(datatype, data, size);
 }
@@ -593,7 +612,7 @@ void usb_write(int datatype, const void* data, int size)
     @return The data header, or 0
 ==============================*/
 
-u32 usb_poll(void)
+unsigned long usb_poll(void)
 {
     // If no debug cart exists, stop
     if (usb_cart == CART_NONE)
@@ -611,6 +630,13 @@ u32 usb_poll(void)
     // If there's still data that needs to be read, return the header with the data left
     if (usb_dataleft != 0)
         return USBHEADER_CREATE(usb_datatype, usb_dataleft);
+    
+    // Incoming data would overwrite the stream being sent
+    if (usb_stream_open)
+        return 0;
+    
+    // Wait for the bulk transfer in progress, as it uses the same area
+    usb_bulk_flush();
         
     // Call the correct read function
     return funcPointer_poll();
@@ -658,7 +684,7 @@ void usb_read(void* buffer, int nbytes)
         }
         
         // Copy from the USB buffer to the supplied buffer
-        memcpy((void*)(((u32)buffer)+read), usb_buffer+copystart, block);
+        memcpy((char*)buffer+read, usb_buffer+copystart, block);
         
         // Increment/decrement all our counters
         read += block;
@@ -958,7 +984,7 @@ static void usb_64drive_write(int datatype, const void* data, int size)
         usb_dma_write(usb_buffer, pi_address, ALIGN(block, 2));
 
         // Update pointers and variables
-        data = (void*)(((u32)data) + block);
+        data = (const char*)data + block;
         left -= block;
         pi_address += block;
     }
@@ -1370,7 +1396,7 @@ static void usb_sc64_write(int datatype, const void* data, int size)
         usb_dma_write(usb_buffer, pi_address, ALIGN(block, 2));
 
         // Update pointers and variables
-        data = (void*)(((u32)data) + block);
+        data = (const char*)data + block;
         left -= block;
         pi_address += block;
     }
@@ -1461,3 +1487,393 @@ static void usb_sc64_read(void)
     // Set up DMA transfer between RDRAM and the PI
     usb_dma_read(usb_buffer, SC64_BASE + DEBUG_ADDRESS + usb_readblock, BUFFER_SIZE);
 }
+
+
+/*********************************
+     Bulk transfer functions
+*********************************/
+
+/*==============================
+    usb_bulk_address
+    Returns the PI address of the debug area half used by the current stream
+    @return The PI address
+==============================*/
+
+static u32 usb_bulk_address(void)
+{
+    if (usb_cart == CART_64DRIVE)
+        return D64_BASE + DEBUG_ADDRESS + usb_bulk_region;
+    return SC64_BASE + DEBUG_ADDRESS + usb_bulk_region;
+}
+
+
+/*==============================
+    usb_bulk_waitpending
+    Spins until the USB transfer started by the last stream has finished
+==============================*/
+
+static void usb_bulk_waitpending(void)
+{
+    u32 timeout;
+    u32 duration;
+    u32 result[2];
+
+    if (!usb_bulk_pending)
+        return;
+
+    // Allow for at least 1MB/s on top of the regular timeout
+    duration = usb_bulk_pendingsize/1024;
+    duration += (usb_cart == CART_64DRIVE) ? D64_WRITE_TIMEOUT : SC64_WRITE_TIMEOUT;
+
+    timeout = usb_timeout_start();
+    while (1)
+    {
+        if (usb_cart == CART_64DRIVE)
+        {
+            if ((usb_io_read(D64_REG_USBCOMSTAT) & D64_CUI_WRITE_MASK) == D64_CUI_WRITE_IDLE)
+                break;
+        }
+        else
+        {
+            usb_sc64_execute_cmd(SC64_CMD_USB_WRITE_STATUS, NULL, result);
+            if (!(result[0] & SC64_USB_WRITE_STATUS_BUSY))
+                break;
+        }
+
+        // Took too long, abort
+        if (usb_timeout_check(timeout, duration))
+        {
+            usb_didtimeout = TRUE;
+            break;
+        }
+    }
+    usb_bulk_pending = FALSE;
+}
+
+
+/*==============================
+    usb_stream_flushstage
+    Sends the data staged in the global buffer to the
+    flashcart, either to SDRAM or to the EverDrive's FIFO
+==============================*/
+
+static void usb_stream_flushstage(void)
+{
+    u32 len = ALIGN(usb_stream_staged, 2);
+
+    if (usb_stream_staged == 0)
+        return;
+
+    if (usb_cart == CART_EVERDRIVE)
+    {
+        u32 baddr = BUFFER_SIZE - len;
+
+        // Don't insist if the USB already timed out during this stream
+        if (!usb_didtimeout)
+        {
+            // Set USB to write mode and send data through USB
+            usb_io_write(ED_REG_USBCFG, ED_USBMODE_WRNOP);
+            usb_dma_write(usb_buffer, ED_REG_USBDAT + baddr, len);
+            usb_io_write(ED_REG_USBCFG, ED_USBMODE_WR | baddr);
+            usb_everdrive_usbbusy();
+        }
+    }
+    else
+    {
+        // Copy the staged data from RDRAM to SDRAM. The only odd-sized block is the last one
+        usb_dma_write(usb_buffer, usb_bulk_address() + usb_stream_offset, len);
+        usb_stream_offset += usb_stream_staged;
+    }
+    usb_stream_staged = 0;
+}
+
+
+/*==============================
+    usb_stream_begin
+    Starts sending a packet of known size through USB.
+    The data is then given with usb_stream_write,
+    in pieces of any size, and the packet is sent
+    with usb_stream_end
+    Will not start if there is data to read from USB
+    @param The DATATYPE that is being sent
+    @param The size of the whole packet, at most USB_BULK_MAXSIZE
+    @return 1 if the stream was started, 0 if not
+==============================*/
+
+char usb_stream_begin(int datatype, int size)
+{
+    u32 header = USBHEADER_CREATE(datatype, size);
+
+    // If no debug cart exists, or there's data to read first, stop
+    if (usb_cart == CART_NONE || usb_dataleft != 0 || usb_stream_open)
+        return 0;
+    if (size < 0 || size > USB_BULK_MAXSIZE)
+        return 0;
+
+    // Start timing the transfers if they were idle
+    if (!usb_bulk_timing)
+    {
+        usb_bulk_timing = TRUE;
+        usb_bulk_timingstart = usb_timeout_start();
+    }
+
+    usb_stream_open = TRUE;
+    usb_stream_datatype = datatype;
+    usb_stream_size = size;
+    usb_stream_written = 0;
+    usb_stream_offset = 0;
+    usb_stream_staged = 0;
+    usb_didtimeout = FALSE;
+
+    // The previous transfer, if still in progress, uses the other
+    // half of the debug area, so SDRAM can be filled right away
+    switch (usb_cart)
+    {
+        case CART_64DRIVE:
+            usb_64drive_set_writable(TRUE);
+            break;
+        case CART_EVERDRIVE:
+            // Put in the DMA header along with length and type information
+            usb_buffer[0] = 'D';
+            usb_buffer[1] = 'M';
+            usb_buffer[2] = 'A';
+            usb_buffer[3] = '@';
+            usb_buffer[4] = (header >> 24) & 0xFF;
+            usb_buffer[5] = (header >> 16) & 0xFF;
+            usb_buffer[6] = (header >> 8)  & 0xFF;
+            usb_buffer[7] = header & 0xFF;
+            usb_stream_staged = 8;
+            break;
+        case CART_SC64:
+            usb_stream_writable = usb_sc64_set_writable(TRUE);
+            break;
+    }
+    return 1;
+}
+
+
+/*==============================
+    usb_stream_write
+    Sends the next piece of the packet started
+    with usb_stream_begin. Data which is 8 byte
+    aligned in RDRAM is sent with DMA directly
+    from the given buffer, the rest is copied to
+    the global buffer first
+    @param A buffer with the data to send
+    @param The size of the data being sent
+==============================*/
+
+void usb_stream_write(const void* data, int size)
+{
+    const char* src = (const char*)data;
+    int limit = (usb_cart == CART_EVERDRIVE) ? BUFFER_SIZE : BUFFER_SIZE-8; // Leave room for the 64Drive padding
+
+    if (!usb_stream_open)
+        return;
+
+    // Ignore anything past the size given to usb_stream_begin
+    if (size > usb_stream_size - usb_stream_written)
+        size = usb_stream_size - usb_stream_written;
+    usb_stream_written += size;
+
+    while (size > 0)
+    {
+        int block;
+
+        // Copy from RDRAM to SDRAM directly when the PI allows it
+        if (usb_cart != CART_EVERDRIVE && usb_stream_staged == 0 && size >= 2 && ((unsigned long)src & 7) == 0)
+        {
+            block = size & ~1;
+            usb_dma_write((void*)src, usb_bulk_address() + usb_stream_offset, block);
+            usb_stream_offset += block;
+            src += block;
+            size -= block;
+            continue;
+        }
+
+        // Otherwise stage the data in the global buffer, up to the
+        // next 8 byte boundary so that direct copies can resume
+        block = MIN(size, limit - usb_stream_staged);
+        if (usb_cart != CART_EVERDRIVE)
+        {
+            int misalign = (8 - ((unsigned long)src & 7)) & 7;
+            if (misalign > 0 && misalign < block)
+                block = misalign;
+        }
+        memcpy(usb_buffer + usb_stream_staged, src, block);
+        usb_stream_staged += block;
+        src += block;
+        size -= block;
+
+        // Send the staged data when full, or when it can be followed by a direct copy
+        if (usb_stream_staged == limit)
+            usb_stream_flushstage();
+        else if (usb_cart != CART_EVERDRIVE && (usb_stream_staged%2) == 0 && size >= 2 && ((unsigned long)src & 7) == 0)
+            usb_stream_flushstage();
+    }
+}
+
+
+/*==============================
+    usb_stream_end
+    Finishes the packet started with usb_stream_begin
+    and starts sending it through USB. Missing data
+    is sent as zeroes.
+    On the 64Drive and SC64, this returns without
+    waiting for the USB transfer to finish, so the
+    next packet can be prepared in the meantime
+==============================*/
+
+void usb_stream_end(void)
+{
+    char cmp[] = {'C', 'M', 'P', 'H'};
+    int limit = (usb_cart == CART_EVERDRIVE) ? BUFFER_SIZE : BUFFER_SIZE-8;
+    u32 args[2];
+    int i;
+
+    if (!usb_stream_open)
+        return;
+
+    // Pad the packet with zeroes if the caller didn't send all of it
+    while (usb_stream_written < usb_stream_size)
+    {
+        int block = MIN(usb_stream_size - usb_stream_written, limit - usb_stream_staged);
+        memset(usb_buffer + usb_stream_staged, 0, block);
+        usb_stream_staged += block;
+        usb_stream_written += block;
+        if (usb_stream_staged == limit)
+            usb_stream_flushstage();
+    }
+
+    switch (usb_cart)
+    {
+        case CART_64DRIVE:
+            // Pad the data with zeroes to 4 bytes, due to bugs in the firmware
+            while ((usb_stream_offset + usb_stream_staged)%4)
+                usb_buffer[usb_stream_staged++] = 0;
+            usb_stream_flushstage();
+            usb_64drive_set_writable(FALSE);
+
+            // Only one USB transfer can be in progress
+            usb_bulk_waitpending();
+            usb_io_write(D64_REG_USBP0R0, (DEBUG_ADDRESS + usb_bulk_region) >> 1);
+            usb_io_write(D64_REG_USBP1R1, USBHEADER_CREATE(usb_stream_datatype, ALIGN(usb_stream_size, 4)));
+            usb_io_write(D64_REG_USBCOMSTAT, D64_CUI_WRITE);
+            usb_bulk_pending = TRUE;
+            break;
+        case CART_EVERDRIVE:
+            // Append the CMP signal, which might not fit in the last block
+            for (i=0; i<4; i++)
+            {
+                if (usb_stream_staged == BUFFER_SIZE)
+                    usb_stream_flushstage();
+                usb_buffer[usb_stream_staged++] = cmp[i];
+            }
+            usb_stream_flushstage();
+            break;
+        case CART_SC64:
+            usb_stream_flushstage();
+            usb_sc64_set_writable(usb_stream_writable);
+
+            // Only one USB transfer can be in progress
+            usb_bulk_waitpending();
+            args[0] = usb_bulk_address();
+            args[1] = USBHEADER_CREATE(usb_stream_datatype, usb_stream_size);
+            if (usb_sc64_execute_cmd(SC64_CMD_USB_WRITE, args, NULL))
+                usb_didtimeout = TRUE;
+            else
+                usb_bulk_pending = TRUE;
+            break;
+    }
+
+    // The next stream goes to the other half of the debug area
+    usb_bulk_pendingsize = usb_stream_size;
+    usb_bulk_region ^= USB_BULK_MAXSIZE;
+    usb_stream_open = FALSE;
+    if (!usb_didtimeout)
+        usb_bulk_bytes += usb_stream_size;
+
+    // The EverDrive is done already
+    if (usb_cart == CART_EVERDRIVE)
+        usb_bulk_flush();
+}
+
+
+/*==============================
+    usb_write_bulk
+    Writes data to the USB, sending it directly from
+    the given buffer when possible and without waiting
+    for the transfer to finish. Packets bigger than
+    USB_BULK_MAXSIZE are sent with usb_write.
+    Will not write if there is data to read from USB
+    @param The DATATYPE that is being sent
+    @param A buffer with the data to send
+    @param The size of the data being sent
+==============================*/
+
+void usb_write_bulk(int datatype, const void* data, int size)
+{
+    if (size > USB_BULK_MAXSIZE)
+    {
+        usb_write(datatype, data, size);
+        return;
+    }
+
+    if (!usb_stream_begin(datatype, size))
+        return;
+    usb_stream_write(data, size);
+    usb_stream_end();
+}
+
+
+/*==============================
+    usb_bulk_flush
+    Spins until the USB transfer started by
+    usb_stream_end or usb_write_bulk has finished
+==============================*/
+
+void usb_bulk_flush(void)
+{
+    usb_bulk_waitpending();
+
+    // The transfers are now idle, stop timing them
+    if (usb_bulk_timing && !usb_stream_open)
+    {
+        usb_bulk_ticks += (u32)(usb_timeout_start() - usb_bulk_timingstart);
+        usb_bulk_timing = FALSE;
+    }
+}
+
+
+/*==============================
+    usb_bulk_getstats
+    Returns the throughput achieved by bulk transfers
+    since the last call, and resets the statistics.
+    The transfer in progress is finished first
+    @param Pointer to store the number of bytes sent, or NULL
+    @param Pointer to store the time spent sending them in microseconds, or NULL
+    @return The throughput in MB/s (millions of bytes per second)
+==============================*/
+
+float usb_bulk_getstats(unsigned long* bytes, unsigned long* microseconds)
+{
+    u64 usecs;
+    float mbps = 0;
+
+    usb_bulk_flush();
+    #ifndef LIBDRAGON
+        usecs = OS_CYCLES_TO_USEC(usb_bulk_ticks);
+    #else
+        usecs = TICKS_TO_US(usb_bulk_ticks);
+    #endif
+    if (usecs > 0)
+        mbps = (float)usb_bulk_bytes/(float)usecs;
+
+    if (bytes != NULL)
+        *bytes = usb_bulk_bytes;
+    if (microseconds != NULL)
+        *microseconds = usecs;
+    usb_bulk_bytes = 0;
+    usb_bulk_ticks = 0;
+    return mbps;
+}
@@ -205,3 +205,45 @@ void test_backtrace_analyze(TestContext *ctx)
     ASSERT_EQUAL_UNSIGNED(func.ra_offset, 0, "invalid RA offset");
     ASSERT_EQUAL_UNSIGNED(func.fp_offset, 0, "invalid FP offset");
 }
+
+void test_backtrace_symbols_cache(TestContext *ctx)
+{
+    DEFER(backtrace_symbols_cache_close());
+    btt_register_syscall();
+
+    const char *expected[] = {
+        "btt_end", "btt_syscall_handler", "__onSyscallException", "<EXCEPTION HANDLER>", "btt_e2", "btt_e1", "btt_start", NULL
+    };
+
+    // Symbolize from ROM to get reference line numbers
+    int ref_lines[32], num_ref = 0;
+    btt_start(ctx, btt_e1, expected);
+    if (ctx->result == TEST_FAILED) return;
+    void cb_ref(void *user, backtrace_frame_t *frame) {
+        if (num_ref < 32) ref_lines[num_ref++] = frame->source_line;
+    }
+    backtrace_symbols_cb(bt_buf, bt_buf_len, 0, cb_ref, NULL);
+
+    // Whole table in RAM, tables partially in RAM, block cache only
+    const int budgets[] = { 1024*1024, 32*1024, 1024 };
+    for (int k = 0; k < sizeof(budgets) / sizeof(budgets[0]); k++) {
+        int used = backtrace_symbols_cache_init(budgets[k]);
+        ASSERT(used > 0 && used <= budgets[k], "invalid cache size %d for budget %d", used, budgets[k]);
+
+        btt_start(ctx, btt_e1, expected);
+        if (ctx->result == TEST_FAILED) return;
+
+        int i = 0;
+        void cb(void *user, backtrace_frame_t *frame) {
+            if (ctx->result == TEST_FAILED) return;
+            ASSERT(i < num_ref, "backtrace too long");
+            ASSERT_EQUAL_SIGNED(frame->source_line, ref_lines[i], "invalid line for frame %d (budget: %d)", i, budgets[k]);
+            i++;
+        }
+        backtrace_symbols_cb(bt_buf, bt_buf_len, 0, cb, NULL);
+        if (ctx->result == TEST_FAILED) return;
+        ASSERT_EQUAL_SIGNED(i, num_ref, "invalid number of frames (budget: %d)", budgets[k]);
+
+        backtrace_symbols_cache_close();
+    }
+}
@@ -33,3 +33,77 @@ void test_dma_read_misalign(TestContext *ctx) {
 		}
 	}
 }
+
+void test_dma_queue(TestContext *ctx) {
+	uint32_t rom = dfs_rom_addr("counter.dat");
+	uint8_t *ref = memalign(16, 4096);
+	DEFER(free(ref));
+	uint8_t *bulk = memalign(16, 4096);
+	DEFER(free(bulk));
+	uint8_t *audio = memalign(16, 64);
+	DEFER(free(audio));
+
+	data_cache_hit_writeback_invalidate(ref, 4096);
+	dma_read(ref, rom, 4096);
+
+	dma_queue_init();
+	DEFER(dma_queue_close());
+	dma_queue_set_chunk_size(256);
+	DEFER(dma_queue_set_chunk_size(8192));
+
+	int order = 0, bulk_order = -1, audio_order = -1;
+	void done(dma_request_t *req, void *arg) {
+		*(int*)arg = order++;
+	}
+
+	memset(bulk, 0xAA, 4096);
+	memset(audio, 0xAA, 64);
+	data_cache_hit_writeback_invalidate(bulk, 4096);
+	data_cache_hit_writeback_invalidate(audio, 64);
+
+	// Queue a bulk transfer, and then a misaligned audio one. The audio one
+	// must be served between two chunks of the bulk one.
+	dma_request_t req_bulk, req_audio;
+	disable_interrupts();
+	dma_queue_read(&req_bulk, bulk, rom & 0x1FFFFFFF, 4096, DMA_PRIO_BULK, done, &bulk_order);
+	dma_queue_read(&req_audio, audio+1, (rom & 0x1FFFFFFF)+1, 33, DMA_PRIO_AUDIO, done, &audio_order);
+	enable_interrupts();
+
+	dma_queue_wait(&req_bulk);
+	ASSERT(dma_queue_done(&req_audio), "audio request not completed");
+	ASSERT_EQUAL_SIGNED(audio_order, 0, "audio request was not prioritized");
+	ASSERT_EQUAL_SIGNED(bulk_order, 1, "bulk request completed in the wrong order");
+
+	ASSERT_EQUAL_MEM(bulk, ref, 4096, "invalid bulk data");
+	ASSERT_EQUAL_MEM(audio+1, ref+1, 33, "invalid audio data");
+	ASSERT_EQUAL_HEX(audio[0], 0xAA, "audio prefix overwritten");
+	ASSERT_EQUAL_HEX(audio[34], 0xAA, "audio suffix overwritten");
+
+	dma_queue_stats_t stats;
+	dma_queue_get_stats(DMA_PRIO_BULK, &stats);
+	ASSERT_EQUAL_SIGNED(stats.num_requests, 1, "invalid number of bulk requests");
+	ASSERT_EQUAL_SIGNED(stats.bytes, 4096, "invalid number of bulk bytes");
+
+	// Completion callbacks can queue new requests. Chain reads of 1KB from
+	// the callbacks: each one must be transferred exactly once.
+	static dma_request_t req_chain[4];
+	volatile int chained = 0;
+	void chain(dma_request_t *req, void *arg) {
+		if (++chained < 4)
+			dma_queue_read(&req_chain[chained], bulk + chained*1024, (rom & 0x1FFFFFFF) + chained*1024,
+				1024, DMA_PRIO_BULK, chain, NULL);
+	}
+
+	memset(bulk, 0xAA, 4096);
+	data_cache_hit_writeback_invalidate(bulk, 4096);
+	disable_interrupts();
+	dma_queue_read(&req_chain[0], bulk, rom & 0x1FFFFFFF, 1024, DMA_PRIO_BULK, chain, NULL);
+	enable_interrupts();
+
+	while (chained < 4) {}
+	dma_queue_wait(&req_chain[3]);
+	ASSERT_EQUAL_MEM(bulk, ref, 4096, "invalid chained data");
+	dma_queue_get_stats(DMA_PRIO_BULK, &stats);
+	ASSERT_EQUAL_SIGNED(stats.num_requests, 5, "invalid number of bulk requests after chaining");
+	ASSERT_EQUAL_SIGNED(stats.bytes, 8192, "invalid number of bulk bytes after chaining");
+}
@@ -99,3 +99,87 @@ void test_eepromfs(TestContext *ctx) {
     eepfs_wipe();
     ASSERT(eepfs_verify_signature() == true, "expected valid eepfs signature"); 
 }
+
+void test_eepromfs_writeback(TestContext *ctx) {
+    // Skip these tests if no EEPROM is present
+    const size_t eeprom_capacity = eeprom_total_blocks();
+    if (eeprom_capacity == 0) {
+        SKIP("EEPROM not found; skipping eepfs tests");
+    }
+
+    uint8_t file1_src[64] = {0};
+    uint8_t file1_dst[64] = {0};
+    uint8_t file2_src[20] = {0};
+    const uint8_t zeroes[64] = {0};
+
+    const eepfs_entry_t eeprom_files[] = {
+        { "/file1", sizeof(file1_src) },
+        { "/file2", sizeof(file2_src) },
+    };
+
+    int result;
+
+    result = eepfs_init(eeprom_files, sizeof(eeprom_files) / sizeof(eepfs_entry_t));
+    ASSERT_EQUAL_SIGNED(result, EEPFS_ESUCCESS, "eepfs init failed");
+    DEFER(eepfs_close());
+    eepfs_wipe();
+
+    result = eepfs_set_writeback(true);
+    ASSERT_EQUAL_SIGNED(result, EEPFS_ESUCCESS, "eepfs writeback failed");
+
+    // Writes only go to RAM until flushed
+    for (int i = 0; i < sizeof(file1_src); i++) {
+        file1_src[i] = i + 1;
+    }
+    result = eepfs_write("file1", file1_src, sizeof(file1_src));
+    ASSERT_EQUAL_SIGNED(result, EEPFS_ESUCCESS, "eepfs write failed");
+    result = eepfs_read("file1", file1_dst, sizeof(file1_dst));
+    ASSERT_EQUAL_SIGNED(result, EEPFS_ESUCCESS, "eepfs read failed");
+    result = memcmp(file1_src, file1_dst, sizeof(file1_src));
+    ASSERT_EQUAL_SIGNED(result, 0, "eepfs write/read mismatch");
+    eeprom_read_bytes(file1_dst, EEPROM_BLOCK_SIZE, sizeof(file1_dst));
+    result = memcmp(zeroes, file1_dst, sizeof(file1_dst));
+    ASSERT_EQUAL_SIGNED(result, 0, "EEPROM modified before flush");
+
+    // Flush writes the whole file, then nothing
+    ASSERT_EQUAL_SIGNED(eepfs_get_flush_stats().pending_bytes, 64, "invalid pending bytes");
+    result = eepfs_flush();
+    ASSERT_EQUAL_SIGNED(result, 64, "invalid flushed bytes");
+    result = eepfs_flush();
+    ASSERT_EQUAL_SIGNED(result, 0, "invalid flushed bytes");
+    eeprom_read_bytes(file1_dst, EEPROM_BLOCK_SIZE, sizeof(file1_dst));
+    result = memcmp(file1_src, file1_dst, sizeof(file1_src));
+    ASSERT_EQUAL_SIGNED(result, 0, "EEPROM/flush mismatch");
+
+    // Only the modified blocks are written
+    file1_src[3] = 0xAA;
+    file1_src[60] = 0xBB;
+    eepfs_write("file1", file1_src, sizeof(file1_src));
+    eepfs_write("file2", file2_src, sizeof(file2_src));
+    result = eepfs_flush_async();
+    ASSERT_EQUAL_SIGNED(result, 16, "invalid pending bytes");
+
+    uint32_t t0 = TICKS_READ();
+    while (eepfs_get_flush_stats().flushing) {
+        ASSERT(TICKS_DISTANCE(t0, TICKS_READ()) < TICKS_FROM_MS(1000), "background flush timeout");
+    }
+
+    eepfs_flush_stats_t stats = eepfs_get_flush_stats();
+    ASSERT_EQUAL_SIGNED(stats.last_flush_bytes, 16, "invalid flushed bytes");
+    ASSERT_EQUAL_SIGNED(stats.total_bytes, 80, "invalid total bytes");
+    ASSERT_EQUAL_SIGNED(stats.num_flushes, 3, "invalid number of flushes");
+    ASSERT_EQUAL_SIGNED(stats.pending_bytes, 0, "invalid pending bytes");
+    eeprom_read_bytes(file1_dst, EEPROM_BLOCK_SIZE, sizeof(file1_dst));
+    result = memcmp(file1_src, file1_dst, sizeof(file1_src));
+    ASSERT_EQUAL_SIGNED(result, 0, "EEPROM/flush mismatch");
+
+    // Disabling write-back flushes pending changes
+    eepfs_erase("file1");
+    result = eepfs_set_writeback(false);
+    ASSERT_EQUAL_SIGNED(result, EEPFS_ESUCCESS, "eepfs writeback failed");
+    memset(file1_src, 0, sizeof(file1_src));
+    result = eepfs_read("file1", file1_dst, sizeof(file1_dst));
+    ASSERT_EQUAL_SIGNED(result, EEPFS_ESUCCESS, "eepfs read failed");
+    result = memcmp(file1_src, file1_dst, sizeof(file1_src));
+    ASSERT_EQUAL_SIGNED(result, 0, "eepfs erase/read mismatch");
+}
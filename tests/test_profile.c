@@ -0,0 +1,59 @@
+
+__attribute__((noinline))
+static void profile_spin(int ms)
+{
+    uint32_t t0 = TICKS_READ();
+    while (TICKS_DISTANCE(t0, TICKS_READ()) < TICKS_FROM_MS(ms)) {}
+}
+
+void test_profile(TestContext *ctx)
+{
+    profile_init(5000, 4, 1024);
+    DEFER(profile_close());
+
+    profile_start();
+    profile_spin(20);
+    profile_stop();
+
+    profile_stats_t stats = profile_get_stats();
+    ASSERT(stats.num_samples >= 90 && stats.num_samples <= 110, "invalid number of samples: %lu", stats.num_samples);
+    ASSERT_EQUAL_UNSIGNED(stats.num_lost, 0, "samples lost");
+
+    // Sampling is stopped: no more samples must be recorded
+    wait_ms(5);
+    ASSERT_EQUAL_UNSIGNED(profile_get_stats().num_samples, stats.num_samples, "sample recorded while stopped");
+
+    const int bufsize = 64*1024;
+    char *buf = malloc(bufsize);
+    DEFER(free(buf));
+    FILE *f = fmemopen(buf, bufsize, "w");
+    profile_flush(f);
+    fclose(f);
+
+    ASSERT(strncmp(buf, "PROF1 5000 4\n", 13) == 0, "invalid profile header");
+
+    // Parse the samples: almost all of them must be in profile_spin
+    int total = 0, in_spin = 0;
+    char *line = buf;
+    while ((line = strchr(line, '\n')) && *++line == 'S') {
+        int run = 1;
+        uint32_t pc;
+        char *p = line + 1;
+        if (*p == '*') run = strtol(p+1, &p, 10);
+        pc = strtoul(p, &p, 16);
+        total += run;
+        if (pc >= (uint32_t)profile_spin && pc < (uint32_t)profile_spin + 256)
+            in_spin += run;
+    }
+    ASSERT_EQUAL_SIGNED(total, stats.num_samples, "invalid number of samples in the output");
+    ASSERT(in_spin >= total * 9 / 10, "samples not in profile_spin: %d/%d", in_spin, total);
+    ASSERT_EQUAL_UNSIGNED(profile_get_stats().num_samples, 0, "flush did not reset the statistics");
+
+    // Overflow the ring buffer
+    profile_start();
+    profile_spin(250);
+    profile_stop();
+    stats = profile_get_stats();
+    ASSERT(stats.num_lost > 0, "samples not lost with a full buffer");
+    ASSERT_EQUAL_UNSIGNED(stats.num_samples - stats.num_lost, 1024, "invalid number of samples kept");
+}
@@ -0,0 +1,67 @@
+#include "font.h"
+
+void test_rdpq_font_builtin(TestContext *ctx)
+{
+    RDPQ_INIT();
+
+    rdpq_font_t *font = rdpq_font_load_builtin();
+    DEFER(rdpq_font_free(font));
+
+    surface_t fb = surface_alloc(FMT_RGBA32, 64, 16);
+    DEFER(surface_free(&fb));
+    surface_clear(&fb, 0);
+
+    const char *text = "Hi, N64\n\x80";
+    rdpq_font_stats_t stats1, stats2, stats3;
+
+    rdpq_attach(&fb, NULL);
+    rdpq_font_begin(font, RGBA32(0xFF, 0xFF, 0xFF, 0xFF));
+    // Draw the first line twice: the second time, the page is already in TMEM.
+    stats1 = rdpq_font_print(font, 0, 0, "Hi, N64");
+    stats2 = rdpq_font_print(font, 0, 0, "Hi, N64");
+    // Draw the whole text, which also requires the second page (0x80): the
+    // glyphs of the page in TMEM must be drawn before loading it.
+    stats3 = rdpq_font_print(font, 0, 0, text);
+    rdpq_font_end();
+    rdpq_detach_wait();
+
+    ASSERT_EQUAL_SIGNED(stats1.num_loads, 1, "invalid number of loads");
+    ASSERT_EQUAL_SIGNED(stats1.num_rects, 6, "invalid number of rectangles (spaces must be skipped)");
+    ASSERT_EQUAL_SIGNED((int)stats1.width, 7*8, "invalid text width");
+    ASSERT_EQUAL_SIGNED(stats2.num_loads, 0, "the page in TMEM was not reused");
+    ASSERT_EQUAL_SIGNED(stats3.num_loads, 1, "only the second page should be loaded");
+    ASSERT_EQUAL_SIGNED(stats3.num_rects, 7, "invalid number of rectangles");
+
+    ASSERT_SURFACE_THRESHOLD(&fb, 1, {
+        int ch = y < 8 ? (x/8 < 7 ? text[x/8] : 0) : (x/8 == 0 ? 0x80 : 0);
+        if (__font_data[ch*8 + y%8] & (0x80 >> (x%8)))
+            return RGBA32(0xFF, 0xFF, 0xFF, 0xE0);
+        return color_from_packed32(0);
+    });
+}
+
+void test_rdpq_font_kerning(TestContext *ctx)
+{
+    RDPQ_INIT();
+
+    rdpq_font_t *font = rdpq_font_load_builtin();
+    DEFER(rdpq_font_free(font));
+
+    surface_t fb = surface_alloc(FMT_RGBA32, 32, 8);
+    DEFER(surface_free(&fb));
+    surface_clear(&fb, 0);
+
+    rdpq_font_set_advance(font, 'i', 4);
+    rdpq_font_set_kerning(font, 'A', 'V', -2);
+    rdpq_font_set_kerning(font, 'V', 'A', -1);
+    rdpq_font_set_kerning(font, 'V', 'A', 0);
+
+    rdpq_attach(&fb, NULL);
+    rdpq_font_begin(font, RGBA32(0xFF, 0xFF, 0xFF, 0xFF));
+    rdpq_font_stats_t stats = rdpq_font_print(font, 0, 0, "AVAi");
+    rdpq_font_end();
+    rdpq_detach_wait();
+
+    // A at 0, V at 6 (kerned), A at 14 (kerning removed), i at 22 (advance 4)
+    ASSERT_EQUAL_SIGNED((int)stats.width, 26, "invalid text width");
+}
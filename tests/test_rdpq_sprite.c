@@ -1,3 +1,5 @@
+#include "../src/sprite_internal.h"
+
 
 
 void test_rdpq_sprite_upload(TestContext *ctx)
@@ -77,3 +79,101 @@ void test_rdpq_sprite_lod(TestContext *ctx)
         return color_from_packed32(0);
     });
 }
+
+/** @brief Create a pre-tiled sprite from a surface, splitting it like mksprite --tiled does (see sprite_tiles_t) */
+static sprite_t *sprite_create_tiled(surface_t *surf, int block_width, int block_height)
+{
+    tex_format_t fmt = surface_get_format(surf);
+    int stride = TEX_FORMAT_PIX2BYTES(fmt, block_width);
+    int nx = block_width >= surf->width ? 1 : (surf->width + block_width - 3) / (block_width - 2);
+    int ny = block_height >= surf->height ? 1 : (surf->height + block_height - 3) / (block_height - 2);
+
+    sprite_t *sprite = malloc_uncached(sizeof(sprite_t) + sizeof(sprite_tiles_t) + nx * ny * stride * block_height);
+    memset(sprite, 0, sizeof(sprite_t));
+    sprite->width = surf->width;
+    sprite->height = surf->height;
+    sprite->flags = fmt | SPRITE_FLAGS_TILED;
+    sprite->hslices = sprite->vslices = 1;
+
+    sprite_tiles_t *tiles = (sprite_tiles_t*)sprite->data;
+    tiles->block_width = block_width;
+    tiles->block_height = block_height;
+    tiles->block_stride = stride;
+    tiles->num_blocks = nx * ny;
+
+    surface_t block = surface_make(tiles->data, fmt, block_width, block_height, stride);
+    for (int by=0; by<ny; by++) {
+        int oy = by ? by * (block_height - 2) - 1 : 0;
+        for (int bx=0; bx<nx; bx++) {
+            int ox = bx ? bx * (block_width - 2) - 1 : 0;
+            for (int y=0; y<block_height; y++) {
+                int sy = oy + y < surf->height ? oy + y : surf->height - 1;
+                for (int x=0; x<block_width; x++) {
+                    int sx = ox + x < surf->width ? ox + x : surf->width - 1;
+                    surface_set_pixel(&block, x, y, surface_get_pixel(surf, sx, sy));
+                }
+            }
+            block.buffer += stride * block_height;
+        }
+    }
+    return sprite;
+}
+
+void test_rdpq_sprite_blit_tiled(TestContext *ctx)
+{
+    RDPQ_INIT();
+
+    // Create a RGBA16 image whose lines are 300 bytes, with the stride padded
+    // to 304 bytes: the texloader draws it with LOAD_BLOCK where possible.
+    const int WIDTH = 150, HEIGHT = 40;
+    SRAND(35);
+    surface_t surf_full = surface_create_random(152, HEIGHT, FMT_RGBA16);
+    DEFER(surface_free(&surf_full));
+    surface_t surf = surface_make_sub(&surf_full, 0, 0, WIDTH, HEIGHT);
+
+    surface_t fb = surface_alloc(FMT_RGBA32, WIDTH*2, HEIGHT*2);
+    DEFER(surface_free(&fb));
+    surface_t fb_ref = surface_alloc(FMT_RGBA32, WIDTH*2, HEIGHT*2);
+    DEFER(surface_free(&fb_ref));
+
+    // Full-width blocks (the layout chosen by mksprite), and blocks split in
+    // columns as well.
+    static const int layouts[][2] = { { 152, 13 }, { 56, 14 } };
+
+    for (int i=0; i<sizeof(layouts) / sizeof(layouts[0]); i++) {
+        LOG("Testing blocks of %dx%d\n", layouts[i][0], layouts[i][1]);
+        sprite_t *sprite = sprite_create_tiled(&surf, layouts[i][0], layouts[i][1]);
+        DEFER(free_uncached(sprite));
+
+        for (int filtering=0; filtering<2; filtering++) {
+            LOG("  filtering: %d\n", filtering);
+            // When filtering, draw the image scaled 2x, so that every other pixel
+            // is interpolated with the next texel, across the seams between blocks.
+            // Skip the last texel, as the linear path would sample past the image.
+            rdpq_blitparms_t parms = {
+                .filtering = filtering,
+                .scale_x = filtering ? 2.0f : 1.0f,
+                .scale_y = filtering ? 2.0f : 1.0f,
+            };
+
+            surface_t *targets[2] = { &fb_ref, &fb };
+            for (int j=0; j<2; j++) {
+                surface_clear(targets[j], 0);
+                rdpq_attach(targets[j], NULL);
+                rdpq_set_mode_standard();
+                rdpq_mode_filter(filtering ? FILTER_BILINEAR : FILTER_POINT);
+                if (filtering)
+                    rdpq_set_scissor(0, 0, WIDTH*2-2, HEIGHT*2-2);
+                if (j == 0)
+                    rdpq_tex_blit(&surf, 0, 0, &parms);
+                else
+                    rdpq_sprite_blit(sprite, 0, 0, &parms);
+                rdpq_detach_wait();
+            }
+
+            ASSERT_SURFACE(&fb, {
+                return color_from_packed32(((uint32_t*)fb_ref.buffer)[y*fb_ref.width + x]);
+            });
+        }
+    }
+}
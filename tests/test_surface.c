@@ -0,0 +1,43 @@
+
+void test_surface_pool(TestContext *ctx)
+{
+    surface_pool_t *pool = surface_pool_new(2);
+    DEFER(surface_pool_free(pool));
+    surface_pool_stats_t stats;
+
+    // Frame 0: allocate two surfaces of the same kind, and a persistent one
+    surface_t sa = surface_pool_alloc_frame(pool, FMT_RGBA16, 30, 20);
+    surface_t sb = surface_pool_alloc_frame(pool, FMT_RGBA16, 30, 20);
+    surface_t sc = surface_pool_alloc(pool, FMT_I8, 16, 16);
+    ASSERT(sa.buffer != sb.buffer, "same buffer returned twice");
+    ASSERT_EQUAL_UNSIGNED(sa.stride, 64, "stride not rounded to 8 bytes");
+    ASSERT_EQUAL_UNSIGNED((uint32_t)sa.buffer & 63, 0, "buffer not aligned");
+    ASSERT(!surface_has_owned_buffer(&sa), "pool surfaces must not be freed with surface_free");
+
+    surface_pool_get_stats(pool, &stats);
+    ASSERT_EQUAL_SIGNED(stats.num_buffers, 3, "invalid number of buffers");
+    ASSERT_EQUAL_SIGNED(stats.bytes_in_use, 64*20*2 + 16*16, "invalid memory in use");
+    surface_pool_end_frame(pool);
+
+    // Frame 1: the frame-scoped buffers are recycled
+    surface_t sa1 = surface_pool_alloc_frame(pool, FMT_RGBA16, 30, 20);
+    ASSERT(sa1.buffer == sa.buffer || sa1.buffer == sb.buffer, "buffer was not recycled");
+    surface_t sd = surface_pool_alloc_frame(pool, FMT_RGBA16, 20, 30);
+    ASSERT(sd.buffer != sa.buffer && sd.buffer != sb.buffer, "buffer of a different size was recycled");
+    surface_pool_release(pool, &sc);
+    ASSERT(sc.buffer == NULL, "released surface was not cleared");
+
+    surface_pool_get_stats(pool, &stats);
+    ASSERT_EQUAL_SIGNED(stats.num_buffers, 4, "invalid number of buffers");
+    ASSERT_EQUAL_SIGNED(stats.num_in_use, 2, "invalid number of buffers in use");
+    ASSERT_EQUAL_SIGNED(stats.num_reuses, 1, "invalid number of reuses");
+    ASSERT_EQUAL_SIGNED(stats.peak_bytes_in_use, 64*20*2 + 16*16, "invalid peak memory in use");
+    surface_pool_end_frame(pool);
+
+    // After a few idle frames, the unused buffers are freed
+    for (int i = 0; i < 3; i++)
+        surface_pool_end_frame(pool);
+    surface_pool_get_stats(pool, &stats);
+    ASSERT_EQUAL_SIGNED(stats.num_buffers, 0, "idle buffers were not freed");
+    ASSERT_EQUAL_SIGNED(stats.bytes, 0, "invalid memory owned by the pool");
+}
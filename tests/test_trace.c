@@ -0,0 +1,102 @@
+
+static volatile int trace_irq_count;
+
+static void trace_timer_cb(int ovfl)
+{
+    trace_event("timer %d", trace_irq_count);
+    trace_irq_count++;
+}
+
+void test_trace(TestContext *ctx)
+{
+    trace_init(256);
+    DEFER(trace_close());
+
+    // Record events from the main context, while a timer records more of
+    // them from its interrupt.
+    timer_init();
+    DEFER(timer_close());
+    trace_irq_count = 0;
+    timer_link_t *tt = new_timer(TICKS_FROM_US(500), TF_CONTINUOUS, trace_timer_cb);
+    for (int i = 0; i < 100; i++) {
+        trace_event("main %d %x", i, 0x1234);
+        wait_ticks(TICKS_FROM_US(20));
+    }
+    delete_timer(tt);
+    trace_event("float %f", trace_float(1.5f));
+
+    trace_stats_t stats = trace_get_stats();
+    int num_irq = trace_irq_count;
+    ASSERT(num_irq > 0, "no events recorded from the timer");
+    ASSERT_EQUAL_UNSIGNED(stats.num_events, 101 + num_irq, "invalid number of events");
+    ASSERT_EQUAL_UNSIGNED(stats.num_lost, 0, "events lost");
+    ASSERT_EQUAL_UNSIGNED(stats.num_pending, stats.num_events, "invalid number of pending events");
+
+    const int bufsize = 64*1024;
+    char *buf = malloc(bufsize);
+    DEFER(free(buf));
+
+    // Flush in two steps
+    FILE *f = fmemopen(buf, bufsize, "w");
+    ASSERT_EQUAL_SIGNED(trace_flush(f, 50), 50, "invalid number of events flushed");
+    ASSERT_EQUAL_UNSIGNED(trace_get_stats().num_pending, stats.num_events - 50, "invalid number of pending events");
+    ASSERT_EQUAL_SIGNED(trace_flush(f, 0), stats.num_events - 50, "invalid number of events flushed");
+    ASSERT_EQUAL_SIGNED(trace_flush(f, 0), 0, "events flushed twice");
+    fclose(f);
+
+    // Parse the output: check that each format is defined once before use,
+    // that main events are in order, and that timestamps are monotonic
+    // (within main events).
+    int num_fmts = 0, num_main = 0, num_timer = 0, num_float = 0, num_chunks = 0;
+    char *fmt_by_id[8] = {0};
+    uint32_t last_ticks = 0;
+    char *line = buf;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = 0;
+        if (!strncmp(line, "TRACE1 ", 7)) {
+            num_chunks++;
+        } else if (line[0] == 'F') {
+            char *p;
+            int id = strtol(line+2, &p, 16);
+            ASSERT(id == num_fmts && id < 8, "invalid format id: %d", id);
+            fmt_by_id[id] = p+1;
+            num_fmts++;
+        } else if (line[0] == 'E') {
+            char *p;
+            uint32_t ticks = strtoul(line+2, &p, 16);
+            int id = strtol(p, &p, 16);
+            ASSERT(id < num_fmts, "format used before definition: %d", id);
+            uint32_t arg0 = strtoul(p, &p, 16);
+            if (!strcmp(fmt_by_id[id], "main %d %x")) {
+                ASSERT_EQUAL_UNSIGNED(arg0, num_main, "invalid main event order");
+                ASSERT_EQUAL_UNSIGNED(strtoul(p, &p, 16), 0x1234, "invalid second argument");
+                if (num_main)
+                    ASSERT(TICKS_DISTANCE(last_ticks, ticks) >= 0, "timestamps not monotonic");
+                last_ticks = ticks;
+                num_main++;
+            } else if (!strcmp(fmt_by_id[id], "timer %d")) {
+                ASSERT_EQUAL_UNSIGNED(arg0, num_timer, "invalid timer event order");
+                num_timer++;
+            } else if (!strcmp(fmt_by_id[id], "float %f")) {
+                ASSERT_EQUAL_HEX(arg0, 0x3fc00000, "invalid float argument");
+                num_float++;
+            } else {
+                ASSERT(0, "unknown format: %s", fmt_by_id[id]);
+            }
+        }
+        line = next;
+    }
+    ASSERT_EQUAL_SIGNED(num_chunks, 2, "invalid number of chunks");
+    ASSERT_EQUAL_SIGNED(num_fmts, 3, "invalid number of formats");
+    ASSERT_EQUAL_SIGNED(num_main, 100, "invalid number of main events");
+    ASSERT_EQUAL_SIGNED(num_timer, num_irq, "invalid number of timer events");
+    ASSERT_EQUAL_SIGNED(num_float, 1, "invalid number of float events");
+
+    // Overflow the ring buffer: new events are dropped
+    for (int i = 0; i < 300; i++)
+        trace_event("overflow %d", i);
+    stats = trace_get_stats();
+    ASSERT_EQUAL_UNSIGNED(stats.num_pending, 256, "invalid number of pending events");
+    ASSERT_EQUAL_UNSIGNED(stats.num_lost, 300 - 256, "invalid number of lost events");
+}
@@ -205,12 +205,16 @@ int assert_equal_mem(TestContext *ctx, const char *file, int line, const uint8_t
 #include "test_cop1.c"
 #include "test_constructors.c"
 #include "test_backtrace.c"
+#include "test_profile.c"
+#include "test_trace.c"
+#include "test_surface.c"
 #include "test_rspq.c"
 #include "test_rdpq.c"
 #include "test_rdpq_tri.c"
 #include "test_rdpq_tex.c"
 #include "test_rdpq_attach.c"
 #include "test_rdpq_sprite.c"
+#include "test_rdpq_font.c"
 
 /**********************************************************************
  * MAIN
@@ -248,9 +252,11 @@ static const struct Testsuite
 	TEST_FUNC(test_dfs_read,                 948, TEST_FLAGS_IO),
 	TEST_FUNC(test_dfs_rom_addr,              25, TEST_FLAGS_IO),
 	TEST_FUNC(test_eepromfs,                   0, TEST_FLAGS_IO),
+	TEST_FUNC(test_eepromfs_writeback,         0, TEST_FLAGS_IO),
 	TEST_FUNC(test_cache_invalidate,        1763, TEST_FLAGS_NONE),
 	TEST_FUNC(test_debug_sdfs,                 0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_dma_read_misalign,      18591, TEST_FLAGS_NONE),
+	TEST_FUNC(test_dma_queue,                  0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_cop1_denormalized_float,    0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_backtrace_analyze,          0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_backtrace_basic,            0, TEST_FLAGS_NO_BENCHMARK),
@@ -259,6 +265,10 @@ static const struct Testsuite
 	TEST_FUNC(test_backtrace_exception_leaf,   0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_backtrace_exception_fp,     0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_backtrace_invalidptr,       0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_backtrace_symbols_cache,    0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_profile,                    0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_trace,                      0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_surface_pool,               0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rspq_queue_single,          0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rspq_queue_multiple,        0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rspq_queue_rapid,           0, TEST_FLAGS_NO_BENCHMARK),
@@ -321,6 +331,9 @@ static const struct Testsuite
 	TEST_FUNC(test_rdpq_tex_upload_tlut,       0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rdpq_sprite_upload,         0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rdpq_sprite_lod,            0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rdpq_sprite_blit_tiled,     0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rdpq_font_builtin,          0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rdpq_font_kerning,          0, TEST_FLAGS_NO_BENCHMARK),
 };
 
 int main() {
@@ -8,9 +8,14 @@
 #include <dirent.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 bool flag_verbose = false;
 bool flag_debug = false;
+int flag_jobs = 1;
 
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 	#define LE32_TO_HOST(i) __builtin_bswap32(i)
@@ -72,6 +77,9 @@ void usage(void) {
 	printf("   -o / --output <dir>       Specify output directory\n");
 	printf("   -v / --verbose            Verbose mode\n");
 	printf("   -d / --debug              Dump uncompressed files in output directory for debugging\n");
+	printf("   -j / --jobs <N>           Convert up to N files in parallel or, with a single\n");
+	printf("                             input file, use N threads for VADPCM compression\n");
+	printf("                             (default: 1)\n");
 	printf("\n");
 	printf("WAV/MP3 options:\n");
 	printf("   --wav-mono                Force mono output\n");
@@ -117,6 +125,66 @@ void convert(char *infn, char *outfn1) {
 	}
 }
 
+/************************************************************************************
+ *  JOB POOL
+ ************************************************************************************/
+
+// Conversions run in child processes, so that each one gets a snapshot of the
+// global flags as they were when the file was found on the command line, and
+// so that converters are free to keep global state or call fatal().
+// Each child uses a single VADPCM thread, so that no more than flag_jobs
+// threads run in total; a single input file gets all of them instead.
+static int jobs_running = 0;
+static bool jobs_failed = false;
+static bool jobs_fork = false;
+
+#ifndef __MINGW32__
+static void job_wait_one(void) {
+	int status;
+	if (wait(&status) > 0) {
+		jobs_running--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			jobs_failed = true;
+	}
+}
+#endif
+
+void convert_job(char *infn, char *outfn) {
+	#ifndef __MINGW32__
+	if (jobs_fork && flag_jobs > 1) {
+		while (jobs_running >= flag_jobs)
+			job_wait_one();
+
+		fflush(stdout);
+		fflush(stderr);
+		pid_t pid = fork();
+		if (pid == 0) {
+			flag_jobs = 1;
+			convert(infn, outfn);
+			exit(0);
+		}
+		if (pid > 0) {
+			jobs_running++;
+			return;
+		}
+		// fork() failed: just convert in this process, as one more job.
+		int jobs = flag_jobs;
+		flag_jobs = 1;
+		convert(infn, outfn);
+		flag_jobs = jobs;
+		return;
+	}
+	#endif
+	convert(infn, outfn);
+}
+
+void jobs_wait_all(void) {
+	#ifndef __MINGW32__
+	while (jobs_running > 0)
+		job_wait_one();
+	#endif
+}
+
 bool exists(const char *path) {
 	struct stat st;
 	return stat(path, &st) == 0;
@@ -181,6 +249,26 @@ void walkdir(char *inpath, char *outpath, void (*func)(char *, char*)) {
 		fprintf(stderr, "WARNING: ignoring special file: %s\n", inpath);
 	}
 }
+
+// Check whether the command line names more than one input file, in which
+// case files are converted in parallel rather than using threads.
+static bool jobs_multiple_inputs(int argc, char *argv[]) {
+	static const char *opts_with_arg[] = {
+		"-o", "--output", "-j", "--jobs", "--wav-loop", "--wav-loop-offset",
+		"--wav-compress", "--wav-resample", "--ym-compress", NULL
+	};
+	int inputs = 0;
+	for (int i=1; i<argc; i++) {
+		if (argv[i][0] == '-') {
+			for (int j=0; opts_with_arg[j]; j++)
+				if (!strcmp(argv[i], opts_with_arg[j])) { i++; break; }
+		} else if (++inputs > 1 || (exists(argv[i]) && isdir(argv[i]))) {
+			return true;
+		}
+	}
+	return false;
+}
+
 int main(int argc, char *argv[]) {
 	if (argc < 2) {
 		usage();
@@ -189,6 +277,8 @@ int main(int argc, char *argv[]) {
 
 	char *outdir = ".";
 
+	jobs_fork = jobs_multiple_inputs(argc, argv);
+
 	int i;
 	for (i=1; i<argc; i++) {
 		if (argv[i][0] == '-') {	
@@ -205,6 +295,16 @@ int main(int argc, char *argv[]) {
 				outdir = argv[i];
 			} else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--debug")) {
 				flag_debug = true;
+			} else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for -j/--jobs\n");
+					return 1;
+				}
+				char extra;
+				if (sscanf(argv[i], "%d%c", &flag_jobs, &extra) != 1 || flag_jobs < 1) {
+					fprintf(stderr, "invalid argument for -j/--jobs: %s\n", argv[i]);
+					return 1;
+				}
 			} else if (!strcmp(argv[i], "--wav-loop")) {
 				if (++i == argc) {
 					fprintf(stderr, "missing argument for --wav-loop\n");
@@ -273,10 +373,11 @@ int main(int argc, char *argv[]) {
 			if (!exists(argv[i])) {
 				fprintf(stderr, "ERROR: file %s does not exist\n", argv[i]);
 			} else {
-				walkdir(argv[i], outdir, convert);
+				walkdir(argv[i], outdir, convert_job);
 			}
 		}
 	}
 
-	return 0;
+	jobs_wait_all();
+	return jobs_failed ? 1 : 0;
 }
@@ -268,7 +268,7 @@ int wav_convert(const char *infn, const char *outfn) {
 		int nframes = cnt / kVADPCMFrameSampleCount;
 		void *scratch = malloc(vadpcm_encode_scratch_size(nframes));
 		struct vadpcm_vector *codebook = alloca(kPREDICTORS * kVADPCMEncodeOrder * wav.channels * sizeof(struct vadpcm_vector));
-		struct vadpcm_params parms = { .predictor_count = kPREDICTORS };
+		struct vadpcm_params parms = { .predictor_count = kPREDICTORS, .thread_count = flag_jobs };
 		void *dest = malloc(nframes * kVADPCMFrameByteSize * wav.channels);
 		
 		if (flag_verbose)
@@ -5,7 +5,9 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
 
 enum {
     // Order of predictor to use. Other orders are not supported.
@@ -16,8 +18,83 @@ enum {
 
     // Iterations for predictor assignment.
     kVADPCMIterations = 20,
+
+    // Maximum number of threads used by the analysis passes.
+    kVADPCMMaxThreads = 64,
+
+    // Minimum number of frames processed by each thread. Below this, the cost
+    // of spawning a thread is not worth it.
+    kVADPCMMinFramesPerThread = 4096,
+};
+
+// A pass over a range of frames [start, end). The slot is the index of the
+// thread executing it (0..thread_count-1), for per-thread accumulators.
+typedef void (*vadpcm_range_func)(void *arg, size_t start, size_t end,
+                                  int slot);
+
+struct vadpcm_range_job {
+    vadpcm_range_func func;
+    void *arg;
+    size_t start, end;
+    int slot;
 };
 
+static void *vadpcm_range_thread(void *p) {
+    struct vadpcm_range_job *job = p;
+    job->func(job->arg, job->start, job->end, job->slot);
+    return NULL;
+}
+
+// Return the number of threads that vadpcm_parallel_for will use.
+static int vadpcm_thread_count(int thread_count, size_t frame_count) {
+    size_t max = frame_count / kVADPCMMinFramesPerThread;
+    if (thread_count > kVADPCMMaxThreads) {
+        thread_count = kVADPCMMaxThreads;
+    }
+    if ((size_t)thread_count > max) {
+        thread_count = max;
+    }
+    return thread_count < 1 ? 1 : thread_count;
+}
+
+// Run func over [0, frame_count), split into contiguous ranges across
+// threads. The calling thread processes the first range. Since each frame is
+// processed exactly as in the serial case, the result does not depend on the
+// number of threads.
+static void vadpcm_parallel_for(int thread_count, size_t frame_count,
+                                vadpcm_range_func func, void *arg) {
+    thread_count = vadpcm_thread_count(thread_count, frame_count);
+    if (thread_count == 1) {
+        func(arg, 0, frame_count, 0);
+        return;
+    }
+
+    struct vadpcm_range_job jobs[kVADPCMMaxThreads];
+    pthread_t threads[kVADPCMMaxThreads];
+    bool spawned[kVADPCMMaxThreads];
+    for (int i = 0; i < thread_count; i++) {
+        jobs[i].func = func;
+        jobs[i].arg = arg;
+        jobs[i].start = frame_count * i / thread_count;
+        jobs[i].end = frame_count * (i + 1) / thread_count;
+        jobs[i].slot = i;
+    }
+    for (int i = 1; i < thread_count; i++) {
+        spawned[i] = pthread_create(&threads[i], NULL, vadpcm_range_thread,
+                                    &jobs[i]) == 0;
+        if (!spawned[i]) {
+            // Out of resources: just run this range in the caller.
+            vadpcm_range_thread(&jobs[i]);
+        }
+    }
+    vadpcm_range_thread(&jobs[0]);
+    for (int i = 1; i < thread_count; i++) {
+        if (spawned[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
 // Autocorrelation is a symmetric 3x3 matrix.
 //
 // The upper triangle is stored. Indexes:
@@ -26,14 +103,21 @@ enum {
 // [_ 2 4]
 // [_ _ 5]
 
-// Calculate the autocorrelation matrix for each frame.
-static void vadpcm_autocorr(size_t frame_count, float (*restrict corr)[6],
-                            const int16_t *restrict src) {
+// Calculate the autocorrelation matrix for each frame in [start, end).
+static void vadpcm_autocorr_range(size_t start, size_t end,
+                                  float (*restrict corr)[6],
+                                  const int16_t *restrict src) {
     float x0 = 0.0f, x1 = 0.0f, x2 = 0.0f, m[6];
     size_t frame;
     int i;
 
-    for (frame = 0; frame < frame_count; frame++) {
+    // The history carries over from the previous frame.
+    if (start > 0) {
+        x0 = src[start * kVADPCMFrameSampleCount - 1] * (1.0f / 32768.0f);
+        x1 = src[start * kVADPCMFrameSampleCount - 2] * (1.0f / 32768.0f);
+    }
+
+    for (frame = start; frame < end; frame++) {
         for (i = 0; i < 6; i++) {
             m[i] = 0.0f;
         }
@@ -54,6 +138,18 @@ static void vadpcm_autocorr(size_t frame_count, float (*restrict corr)[6],
     }
 }
 
+struct vadpcm_autocorr_args {
+    float (*corr)[6];
+    const int16_t *src;
+};
+
+static void vadpcm_autocorr_job(void *arg, size_t start, size_t end,
+                                int slot) {
+    struct vadpcm_autocorr_args *a = arg;
+    (void)slot;
+    vadpcm_autocorr_range(start, end, a->corr, a->src);
+}
+
 // Get the mean autocorrelation matrix for each predictor. If the predictor for
 // a frame is out of range, that frame is ignored.
 static void vadpcm_meancorrs(size_t frame_count, int predictor_count,
@@ -203,12 +299,12 @@ static double vadpcm_eval_solved(const double corr[restrict static 6],
     return corr[0] - corr[1] * coeff[0] - corr[3] * coeff[1];
 }
 
-// Calculate the best-case error for each frame, given the autocorrelation
-// matrixes.
-static void vadpcm_best_error(size_t frame_count,
-                              const float (*restrict corr)[6],
-                              float *restrict best_error) {
-    for (size_t frame = 0; frame < frame_count; frame++) {
+// Calculate the best-case error for each frame in [start, end), given the
+// autocorrelation matrixes.
+static void vadpcm_best_error_range(size_t start, size_t end,
+                                    const float (*restrict corr)[6],
+                                    float *restrict best_error) {
+    for (size_t frame = start; frame < end; frame++) {
         double fcorr[6];
         for (int i = 0; i < 6; i++) {
             fcorr[i] = (double)corr[frame][i];
@@ -219,6 +315,51 @@ static void vadpcm_best_error(size_t frame_count,
     }
 }
 
+struct vadpcm_best_error_args {
+    const float (*corr)[6];
+    float *best_error;
+};
+
+static void vadpcm_best_error_job(void *arg, size_t start, size_t end,
+                                  int slot) {
+    struct vadpcm_best_error_args *a = arg;
+    (void)slot;
+    vadpcm_best_error_range(start, end, a->corr, a->best_error);
+}
+
+struct vadpcm_assign_args {
+    const float (*corr)[6];
+    const float (*coeff)[2];
+    int active_count;
+    float *error;
+    uint8_t *predictors;
+    int (*count)[kVADPCMMaxPredictorCount]; // One row per thread slot
+};
+
+// Assign frames in [start, end) to the best predictor for each frame, and
+// record the amount of error.
+static void vadpcm_assign_job(void *arg, size_t start, size_t end, int slot) {
+    struct vadpcm_assign_args *a = arg;
+    int *count = a->count[slot];
+    for (int i = 0; i < a->active_count; i++) {
+        count[i] = 0;
+    }
+    for (size_t frame = start; frame < end; frame++) {
+        int fpredictor = 0;
+        float ferror = 0.0f;
+        for (int i = 0; i < a->active_count; i++) {
+            float e = vadpcm_eval(a->corr[frame], a->coeff[i]);
+            if (i == 0 || e < ferror) {
+                fpredictor = i;
+                ferror = e;
+            }
+        }
+        a->predictors[frame] = fpredictor;
+        a->error[frame] = ferror;
+        count[fpredictor]++;
+    }
+}
+
 // Refine (improve) the existing predictor assignments. Does not assign
 // unassigned predictors. Record the amount of error, squared, for each frame.
 // Returns the index of an unassigned predictor, or predictor_count, if no
@@ -226,7 +367,8 @@ static void vadpcm_best_error(size_t frame_count,
 static int vadpcm_refine_predictors(size_t frame_count, int predictor_count,
                                     const float (*restrict corr)[6],
                                     float *restrict error,
-                                    uint8_t *restrict predictors) {
+                                    uint8_t *restrict predictors,
+                                    int thread_count) {
     // Calculate optimal predictor coefficients for each predictor.
     double pcorr[kVADPCMMaxPredictorCount][6];
     int count[kVADPCMMaxPredictorCount];
@@ -248,23 +390,24 @@ static int vadpcm_refine_predictors(size_t frame_count, int predictor_count,
 
     // Assign frames to the best predictor for each frame, and record the amount
     // of error.
+    int thread_counts[kVADPCMMaxThreads][kVADPCMMaxPredictorCount];
+    struct vadpcm_assign_args args = {
+        .corr = corr,
+        .coeff = (const float(*)[2])coeff,
+        .active_count = active_count,
+        .error = error,
+        .predictors = predictors,
+        .count = thread_counts,
+    };
+    vadpcm_parallel_for(thread_count, frame_count, vadpcm_assign_job, &args);
+
     int count2[kVADPCMMaxPredictorCount];
+    int nthreads = vadpcm_thread_count(thread_count, frame_count);
     for (int i = 0; i < active_count; i++) {
         count2[i] = 0;
-    }
-    for (size_t frame = 0; frame < frame_count; frame++) {
-        int fpredictor = 0;
-        float ferror = 0.0f;
-        for (int i = 0; i < active_count; i++) {
-            float e = vadpcm_eval(corr[frame], coeff[i]);
-            if (i == 0 || e < ferror) {
-                fpredictor = i;
-                ferror = e;
-            }
+        for (int t = 0; t < nthreads; t++) {
+            count2[i] += thread_counts[t][i];
         }
-        predictors[frame] = fpredictor;
-        error[frame] = ferror;
-        count2[fpredictor]++;
     }
     for (int i = 0; i < active_count; i++) {
         if (count2[i] == 0) {
@@ -296,7 +439,8 @@ static void vadpcm_assign_predictors(size_t frame_count, int predictor_count,
                                      const float (*restrict corr)[6],
                                      const float *restrict best_error,
                                      float *restrict error,
-                                     uint8_t *restrict predictors) {
+                                     uint8_t *restrict predictors,
+                                     int thread_count) {
     int unassigned = predictor_count;
     int active_count = 1;
     for (int iter = 0; iter < kVADPCMIterations; iter++) {
@@ -308,7 +452,7 @@ static void vadpcm_assign_predictors(size_t frame_count, int predictor_count,
             }
         }
         unassigned = vadpcm_refine_predictors(frame_count, active_count, corr,
-                                              error, predictors);
+                                              error, predictors, thread_count);
     }
 }
 
@@ -519,14 +663,23 @@ vadpcm_error vadpcm_encode(const struct vadpcm_params *restrict params,
         predictors = (void *)ptr;
     }
 
-    vadpcm_autocorr(frame_count, corr, src);
+    // The analysis passes are parallelized across frames. The final encoding
+    // pass is inherently serial, as the decoder state of each frame depends on
+    // how the previous one was encoded.
+    int thread_count = params->thread_count;
+    struct vadpcm_autocorr_args autocorr_args = {corr, src};
+    vadpcm_parallel_for(thread_count, frame_count, vadpcm_autocorr_job,
+                        &autocorr_args);
     for (size_t i = 0; i < frame_count; i++) {
         predictors[i] = 0;
     }
     if (predictor_count > 1) {
-        vadpcm_best_error(frame_count, corr, best_error);
+        struct vadpcm_best_error_args best_error_args = {
+            (const float(*)[6])corr, best_error};
+        vadpcm_parallel_for(thread_count, frame_count, vadpcm_best_error_job,
+                            &best_error_args);
         vadpcm_assign_predictors(frame_count, predictor_count, corr, best_error,
-                                 error, predictors);
+                                 error, predictors, thread_count);
     }
     vadpcm_make_codebook(frame_count, predictor_count, corr, predictors,
                          codebook);
@@ -571,7 +724,7 @@ static void test_autocorr(void) {
 
         // Get the autocorrelation.
         float corr[2][6];
-        vadpcm_autocorr(2, corr, data);
+        vadpcm_autocorr_range(0, 2, corr, data);
 
         // Calculate error directly.
         float s1 = (float)data[kVADPCMFrameSampleCount - 2] * (1.0f / 32768.0f);
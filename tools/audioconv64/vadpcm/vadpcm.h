@@ -131,6 +131,11 @@ vadpcm_error vadpcm_decode(int predictor_count, int order,
 struct vadpcm_params {
     // The number of predictors to put in the codebook.
     int predictor_count;
+
+    // The number of threads to use for the analysis passes (autocorrelation
+    // and predictor assignment). 0 or 1 means single-threaded. The output is
+    // bit-identical regardless of the number of threads.
+    int thread_count;
 };
 
 // Return the amount of scratch space needed to encode a file with the given
@@ -0,0 +1,316 @@
+#include "mcquant.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MCQ_MAX_COLORS      256
+#define MCQ_KMEANS_ITERS    8
+
+// Histogram key for a RGBA32 pixel. Alpha is 1-bit like conv_rgb5551,
+// and all transparent pixels share the same key.
+#define MCQ_KEY(r, g, b, a)  ((a) ? ((((r)>>3)<<11) | (((g)>>3)<<6) | (((b)>>3)<<1) | 1) : 0)
+#define MCQ_KEY_R(k)         (((k) >> 11) & 0x1F)
+#define MCQ_KEY_G(k)         (((k) >> 6) & 0x1F)
+#define MCQ_KEY_B(k)         (((k) >> 1) & 0x1F)
+
+// Expand a 5-bit component to 8-bit, like the RDP does
+#define MCQ_EXPAND(v)        (((v) << 3) | ((v) >> 2))
+
+typedef struct {
+    uint8_t c[3];           // RGB components (5-bit)
+    uint32_t count;         // Number of pixels
+} mcq_bin_t;
+
+typedef struct {
+    int start, end;         // Range of bins in the box
+    double sse;             // Sum of squared errors from the box mean
+    int axis;               // Axis with the largest error (split axis)
+} mcq_box_t;
+
+struct mcq_data_s {
+    uint32_t *hist;         // Histogram, indexed by RGBA5551 key
+    int16_t *lut;           // Nearest palette entry per key (-1 = not computed yet)
+    int num_colors;         // Number of palette entries
+    int transparent;        // Index of the transparent entry (-1 if none)
+    uint8_t pal[MCQ_MAX_COLORS][4]; // Palette (RGBA32)
+
+    // Opaque palette entries in SoA layout for the nearest-color search.
+    // The arrays are padded to a multiple of 8 with far away colors, so
+    // that the distance loop has no tail and can be vectorized.
+    int num_soa;
+    int32_t soa_r[MCQ_MAX_COLORS], soa_g[MCQ_MAX_COLORS], soa_b[MCQ_MAX_COLORS];
+    uint8_t soa_idx[MCQ_MAX_COLORS];
+};
+
+mcq_data *mcq_init(void) {
+    mcq_data *mcq = calloc(1, sizeof(mcq_data));
+    mcq->hist = calloc(65536, sizeof(uint32_t));
+    mcq->lut = malloc(65536 * sizeof(int16_t));
+    mcq->transparent = -1;
+    return mcq;
+}
+
+void mcq_free(mcq_data *mcq) {
+    free(mcq->hist);
+    free(mcq->lut);
+    free(mcq);
+}
+
+void mcq_feed(mcq_data *mcq, const uint8_t *rgba, int num_pixels) {
+    for (int i=0; i<num_pixels; i++, rgba += 4)
+        mcq->hist[MCQ_KEY(rgba[0], rgba[1], rgba[2], rgba[3])]++;
+}
+
+// Rebuild the search structures after the palette has changed
+static void mcq_palette_changed(mcq_data *mcq) {
+    int n = 0;
+    mcq->transparent = -1;
+    for (int i=0; i<mcq->num_colors; i++) {
+        if (mcq->pal[i][3] == 0) {
+            if (mcq->transparent < 0) mcq->transparent = i;
+            continue;
+        }
+        mcq->soa_r[n] = mcq->pal[i][0] >> 3;
+        mcq->soa_g[n] = mcq->pal[i][1] >> 3;
+        mcq->soa_b[n] = mcq->pal[i][2] >> 3;
+        mcq->soa_idx[n] = i;
+        n++;
+    }
+    mcq->num_soa = n;
+    for (; n & 7; n++) {
+        mcq->soa_r[n] = mcq->soa_g[n] = mcq->soa_b[n] = 1000;
+        mcq->soa_idx[n] = 0;
+    }
+    memset(mcq->lut, 0xFF, 65536 * sizeof(int16_t));
+}
+
+// Find the nearest opaque palette entry (returns the SoA index)
+static int mcq_nearest_soa(mcq_data *mcq, int r, int g, int b) {
+    int32_t dist[MCQ_MAX_COLORS];
+    int n = (mcq->num_soa + 7) & ~7;
+
+    for (int i=0; i<n; i++) {
+        int32_t dr = mcq->soa_r[i] - r;
+        int32_t dg = mcq->soa_g[i] - g;
+        int32_t db = mcq->soa_b[i] - b;
+        dist[i] = dr*dr + dg*dg + db*db;
+    }
+    int32_t best = dist[0];
+    for (int i=1; i<n; i++)
+        best = dist[i] < best ? dist[i] : best;
+    for (int i=0; ; i++)
+        if (dist[i] == best) return i;
+}
+
+// Find the palette entry for a histogram key, through the LUT
+static int mcq_lookup(mcq_data *mcq, int key) {
+    if (mcq->lut[key] >= 0)
+        return mcq->lut[key];
+
+    int idx;
+    if (mcq->num_soa == 0)
+        idx = mcq->transparent >= 0 ? mcq->transparent : 0;
+    else if (key == 0 && mcq->transparent >= 0)
+        idx = mcq->transparent;
+    else
+        idx = mcq->soa_idx[mcq_nearest_soa(mcq, MCQ_KEY_R(key), MCQ_KEY_G(key), MCQ_KEY_B(key))];
+    mcq->lut[key] = idx;
+    return idx;
+}
+
+static void mcq_box_stats(mcq_bin_t *bins, mcq_box_t *box) {
+    double sum[3] = {0}, sum2[3] = {0}, count = 0;
+    for (int i=box->start; i<box->end; i++) {
+        double c = bins[i].count;
+        for (int j=0; j<3; j++) {
+            sum[j] += c * bins[i].c[j];
+            sum2[j] += c * bins[i].c[j] * bins[i].c[j];
+        }
+        count += c;
+    }
+    box->sse = 0;
+    box->axis = 0;
+    double best = -1;
+    for (int j=0; j<3; j++) {
+        double sse = sum2[j] - sum[j] * sum[j] / count;
+        box->sse += sse;
+        if (sse > best) { best = sse; box->axis = j; }
+    }
+}
+
+// Sort the bins of a box along an axis (counting sort, as components are 5-bit)
+static void mcq_box_sort(mcq_bin_t *bins, mcq_bin_t *tmp, mcq_box_t *box) {
+    int pos[33] = {0};
+    int axis = box->axis;
+    for (int i=box->start; i<box->end; i++)
+        pos[bins[i].c[axis]+1]++;
+    for (int i=1; i<33; i++)
+        pos[i] += pos[i-1];
+    for (int i=box->start; i<box->end; i++)
+        tmp[pos[bins[i].c[axis]]++] = bins[i];
+    memcpy(&bins[box->start], tmp, (box->end - box->start) * sizeof(mcq_bin_t));
+}
+
+void mcq_quantize(mcq_data *mcq, int num_colors) {
+    if (num_colors > MCQ_MAX_COLORS) num_colors = MCQ_MAX_COLORS;
+    memset(mcq->pal, 0, sizeof(mcq->pal));
+    mcq->num_colors = num_colors;
+
+    // Reserve the first entry for transparent pixels, if any
+    int first = 0;
+    if (mcq->hist[0])
+        first = 1;
+
+    // Collect the opaque colors
+    int num_bins = 0;
+    mcq_bin_t *bins = malloc(32768 * sizeof(mcq_bin_t));
+    for (int k=1; k<65536; k+=2) {
+        if (!mcq->hist[k]) continue;
+        bins[num_bins++] = (mcq_bin_t){ .c = { MCQ_KEY_R(k), MCQ_KEY_G(k), MCQ_KEY_B(k) }, .count = mcq->hist[k] };
+    }
+
+    // Median cut: repeatedly split the box with the largest error along its
+    // widest axis, at the weighted median.
+    int target = num_colors - first;
+    mcq_box_t *boxes = malloc(target * sizeof(mcq_box_t));
+    mcq_bin_t *tmp = malloc(32768 * sizeof(mcq_bin_t));
+    int num_boxes = 0;
+    if (num_bins > 0 && target > 0) {
+        boxes[0] = (mcq_box_t){ .start = 0, .end = num_bins };
+        mcq_box_stats(bins, &boxes[0]);
+        num_boxes = 1;
+    }
+    while (num_boxes < target) {
+        int best = -1;
+        for (int i=0; i<num_boxes; i++)
+            if (boxes[i].end - boxes[i].start > 1 && (best < 0 || boxes[i].sse > boxes[best].sse))
+                best = i;
+        if (best < 0 || boxes[best].sse <= 0)
+            break;
+
+        mcq_box_t *box = &boxes[best];
+        mcq_box_sort(bins, tmp, box);
+
+        uint64_t total = 0, half = 0;
+        for (int i=box->start; i<box->end; i++)
+            total += bins[i].count;
+        int split = box->start + 1;
+        for (int i=box->start; i<box->end-1; i++) {
+            half += bins[i].count;
+            split = i+1;
+            if (half*2 >= total) break;
+        }
+
+        boxes[num_boxes] = (mcq_box_t){ .start = split, .end = box->end };
+        box->end = split;
+        mcq_box_stats(bins, box);
+        mcq_box_stats(bins, &boxes[num_boxes]);
+        num_boxes++;
+    }
+
+    // Initial palette: weighted mean of each box
+    int32_t pal5[MCQ_MAX_COLORS][3];
+    for (int i=0; i<num_boxes; i++) {
+        double sum[3] = {0}, count = 0;
+        for (int j=boxes[i].start; j<boxes[i].end; j++) {
+            for (int c=0; c<3; c++)
+                sum[c] += (double)bins[j].count * bins[j].c[c];
+            count += bins[j].count;
+        }
+        for (int c=0; c<3; c++)
+            pal5[i][c] = (int)(sum[c] / count + 0.5);
+    }
+
+    // Refine with a few k-means (Lloyd) iterations over the histogram
+    for (int iter=0; iter<MCQ_KMEANS_ITERS && num_boxes > 1; iter++) {
+        int n = num_boxes;
+        mcq->num_soa = n;
+        for (int i=0; i<n; i++) {
+            mcq->soa_r[i] = pal5[i][0];
+            mcq->soa_g[i] = pal5[i][1];
+            mcq->soa_b[i] = pal5[i][2];
+        }
+        for (; n & 7; n++)
+            mcq->soa_r[n] = mcq->soa_g[n] = mcq->soa_b[n] = 1000;
+
+        double sum[MCQ_MAX_COLORS][3] = {{0}}, count[MCQ_MAX_COLORS] = {0};
+        for (int j=0; j<num_bins; j++) {
+            int i = mcq_nearest_soa(mcq, bins[j].c[0], bins[j].c[1], bins[j].c[2]);
+            for (int c=0; c<3; c++)
+                sum[i][c] += (double)bins[j].count * bins[j].c[c];
+            count[i] += bins[j].count;
+        }
+
+        bool changed = false;
+        for (int i=0; i<num_boxes; i++) {
+            if (!count[i]) continue;
+            for (int c=0; c<3; c++) {
+                int v = (int)(sum[i][c] / count[i] + 0.5);
+                if (v != pal5[i][c]) { pal5[i][c] = v; changed = true; }
+            }
+        }
+        if (!changed) break;
+    }
+
+    for (int i=0; i<num_boxes; i++) {
+        mcq->pal[first+i][0] = MCQ_EXPAND(pal5[i][0]);
+        mcq->pal[first+i][1] = MCQ_EXPAND(pal5[i][1]);
+        mcq->pal[first+i][2] = MCQ_EXPAND(pal5[i][2]);
+        mcq->pal[first+i][3] = 0xFF;
+    }
+    mcq_palette_changed(mcq);
+
+    free(tmp);
+    free(boxes);
+    free(bins);
+}
+
+void mcq_set_palette(mcq_data *mcq, const uint8_t *pal, int num_colors) {
+    if (num_colors > MCQ_MAX_COLORS) num_colors = MCQ_MAX_COLORS;
+    memset(mcq->pal, 0, sizeof(mcq->pal));
+    memcpy(mcq->pal, pal, num_colors * 4);
+    mcq->num_colors = num_colors;
+    mcq_palette_changed(mcq);
+}
+
+void mcq_get_palette(mcq_data *mcq, uint8_t *pal, int num_colors) {
+    memset(pal, 0, num_colors * 4);
+    memcpy(pal, mcq->pal, (num_colors < mcq->num_colors ? num_colors : mcq->num_colors) * 4);
+}
+
+void mcq_map_image(mcq_data *mcq, int num_pixels, const uint8_t *in, uint8_t *out) {
+    for (int i=0; i<num_pixels; i++, in += 4)
+        out[i] = mcq_lookup(mcq, MCQ_KEY(in[0], in[1], in[2], in[3]));
+}
+
+void mcq_map_image_dither(mcq_data *mcq, int width, int height, const uint8_t *in, uint8_t *out, bool ordered) {
+    static const int bayer[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+
+    // Scale the dithering pattern with the average quantization error of the
+    // fed pixels, so that it adapts to the density of the palette.
+    double err = 0, count = 0;
+    for (int k=1; k<65536; k+=2) {
+        if (!mcq->hist[k]) continue;
+        const uint8_t *p = mcq->pal[mcq_lookup(mcq, k)];
+        int dr = MCQ_EXPAND(MCQ_KEY_R(k)) - p[0];
+        int dg = MCQ_EXPAND(MCQ_KEY_G(k)) - p[1];
+        int db = MCQ_EXPAND(MCQ_KEY_B(k)) - p[2];
+        err += (double)mcq->hist[k] * (dr*dr + dg*dg + db*db) / 3;
+        count += mcq->hist[k];
+    }
+    int spread = count ? (int)(2 * sqrt(err / count)) : 0;
+    if (spread < 8) spread = 8;
+    if (spread > 48) spread = 48;
+
+    for (int y=0; y<height; y++) {
+        for (int x=0; x<width; x++, in += 4) {
+            int t = ordered ? bayer[(y & 3) * 4 + (x & 3)] : (rand() & 15);
+            int d = (2 * t - 15) * spread / 32;
+            int r = in[0] + d, g = in[1] + d, b = in[2] + d;
+            r = r < 0 ? 0 : r > 255 ? 255 : r;
+            g = g < 0 ? 0 : g > 255 ? 255 : g;
+            b = b < 0 ? 0 : b > 255 ? 255 : b;
+            *out++ = mcq_lookup(mcq, MCQ_KEY(r, g, b, in[3]));
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MCQUANT_H
+#define MCQUANT_H
+
+/**
+ * @file mcquant.h
+ * @brief Median-cut palette quantizer for RGBA5551 palettes
+ *
+ * This is a fast alternative to exoquant. Since N64 palettes are stored as
+ * RGBA5551, colors are first reduced into a RGBA5551 histogram (at most
+ * 64K bins): all the following work (median cut, k-means refinement and
+ * pixel mapping) is performed on the histogram rather than on pixels,
+ * and the palette produced is exactly representable in RGBA5551.
+ *
+ * Alpha is treated as 1-bit (like the RGBA5551 conversion): all fully
+ * transparent pixels share a single transparent palette entry.
+ *
+ * The API mirrors exoquant's, so that the two can be easily swapped.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct mcq_data_s mcq_data;
+
+/** @brief Allocate a quantizer */
+mcq_data *mcq_init(void);
+/** @brief Free a quantizer */
+void mcq_free(mcq_data *mcq);
+/** @brief Feed RGBA32 pixels into the histogram */
+void mcq_feed(mcq_data *mcq, const uint8_t *rgba, int num_pixels);
+/** @brief Compute a palette of (at most) num_colors colors for the fed pixels */
+void mcq_quantize(mcq_data *mcq, int num_colors);
+/** @brief Force a palette (RGBA32) instead of computing one */
+void mcq_set_palette(mcq_data *mcq, const uint8_t *pal, int num_colors);
+/** @brief Get the palette (RGBA32). Unused entries are set to transparent black. */
+void mcq_get_palette(mcq_data *mcq, uint8_t *pal, int num_colors);
+/** @brief Map RGBA32 pixels to palette indices */
+void mcq_map_image(mcq_data *mcq, int num_pixels, const uint8_t *in, uint8_t *out);
+/** @brief Map RGBA32 pixels to palette indices with ordered (4x4 Bayer) or random dithering */
+void mcq_map_image_dither(mcq_data *mcq, int width, int height, const uint8_t *in, uint8_t *out, bool ordered);
+
+#endif
@@ -6,6 +6,12 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <math.h>
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "../common/binout.c"
 #include "../common/binout.h"
 #include "../common/polyfill.h"
@@ -19,6 +25,8 @@
 // Quantization library
 #include "exoquant.h"
 #include "exoquant.c"
+#include "mcquant.h"
+#include "mcquant.c"
 
 // Compression library
 #include "../common/assetcomp.h"
@@ -31,6 +39,7 @@
 #define FMT_IHQ    (64 + 1)
 
 #define SWAP(a, b) ({ typeof(a) t = a; a = b; b = t; })
+#define MIN(a, b) ({ typeof(a) _a = a; typeof(b) _b = b; _a < _b ? _a : _b; })
 #define ROUND_UP(n, d) ({ \
 	typeof(n) _n = n; typeof(d) _d = d; \
 	(((_n) + (_d) - 1) / (_d) * (_d)); \
@@ -80,6 +89,17 @@ const char *mipmap_algo_name(int algo) {
     }
 }
 
+#define QUANT_ALGO_EXOQUANT    0
+#define QUANT_ALGO_MEDIANCUT   1
+
+const char *quant_algo_name(int algo) {
+    switch (algo) {
+    case QUANT_ALGO_EXOQUANT: return "EXOQUANT";
+    case QUANT_ALGO_MEDIANCUT: return "MEDIANCUT";
+    default: assert(0); return "";
+    }
+}
+
 #define DITHER_ALGO_NONE     0
 #define DITHER_ALGO_RANDOM   1
 #define DITHER_ALGO_ORDERED  2
@@ -112,6 +132,13 @@ typedef struct {
     int tileh;
     int mipmap_algo;
     int dither_algo;
+    int quant_algo;
+    bool tiled;
+    struct {
+        bool  enabled;      // If true, AUTO format uses error-budgeted selection
+        float min_psnr;     // Minimum PSNR (dB) accepted
+        int   max_err;      // Maximum error on a single channel accepted
+    } autofmt;
     texparms_t texparms;
     struct{
         const char   *infn;       // Input file for detail texture
@@ -136,6 +163,10 @@ void print_supported_mipmap(void) {
     fprintf(stderr, "Supported mipmap algorithms: NONE (disable), BOX\n");
 }
 
+void print_supported_quantizers(void) {
+    fprintf(stderr, "Supported quantizers: EXOQUANT (slower, high quality), MEDIANCUT (fast)\n");
+}
+
 void print_supported_dithers(void) {
     fprintf(stderr, "Supported dithering algorithms: NONE (disable), RANDOM, ORDERED. \nNote that dithering is only applied while quantizing an image.\n");
 }
@@ -149,8 +180,16 @@ void print_args( char * name )
     fprintf(stderr, "   -o/--output <dir>     Specify output directory (default: .)\n");
     fprintf(stderr, "   -f/--format <fmt>     Specify output format (default: AUTO)\n");
     fprintf(stderr, "   -D/--dither <dither>  Dithering algorithm (default: NONE)\n");
+    fprintf(stderr, "   --quantizer <algo>    Palette quantization algorithm for CI4/CI8 (default: EXOQUANT)\n");
+    fprintf(stderr, "   --tiled               Store the image pre-tiled in TMEM-sized blocks, each loaded with\n");
+    fprintf(stderr, "                         a single LOAD_BLOCK by rdpq_sprite_blit (not with --tiles or --atlas)\n");
+    fprintf(stderr, "\nError-budgeted format selection (with AUTO format):\n");
+    fprintf(stderr, "   --auto-psnr <dB>      Select the smallest format with PSNR of at least <dB>\n");
+    fprintf(stderr, "   --auto-maxerr <n>     Select the smallest format with a maximum error of <n> (0-255) per channel\n");
     fprintf(stderr, "   -c/--compress <level> Compress output files (default: %d)\n", DEFAULT_COMPRESSION);
     fprintf(stderr, "   -d/--debug            Dump computed images (eg: mipmaps) as PNG files in output directory\n");
+    fprintf(stderr, "   -j/--jobs <N>         Convert up to N files in parallel (default: 1)\n");
+    fprintf(stderr, "   --cache <dir>         Cache converted files in <dir>, and skip conversion of unchanged inputs\n");
     fprintf(stderr, "\nSampling flags:\n");
     fprintf(stderr, "   --texparms <x,s,r,m>          Sampling parameters:\n");
     fprintf(stderr, "                                 x=translation, s=scale, r=repetitions, m=mirror\n");
@@ -162,10 +201,15 @@ void print_args( char * name )
     fprintf(stderr, "                                         <fmt> is the output format (default: AUTO)\n");
     fprintf(stderr, "                                         <factor> is the blend factor in range 0..1 (default: 0.5)\n");
     fprintf(stderr, "   --detail-texparms <x,x,s,s,r,r,m,m>   Sampling parameters for the detail texture\n");
+    fprintf(stderr, "\nAtlas flags:\n");
+    fprintf(stderr, "   --atlas <name>        Pack all input images into <name>.sprite, with a table of named rects\n");
+    fprintf(stderr, "                         (additional sheets, if needed, are written as <name>.1.sprite, ...)\n");
+    fprintf(stderr, "   --atlas-size <w,h>    Maximum size of an atlas sheet (default: 512,512)\n");
     fprintf(stderr, "\n");
     print_supported_formats();
     print_supported_mipmap();
     print_supported_dithers();
+    print_supported_quantizers();
 }
 
 uint16_t conv_rgb5551(uint8_t r8, uint8_t g8, uint8_t b8, uint8_t a8) {
@@ -218,6 +262,13 @@ typedef struct {
 } palette_t;
 
 #define MAX_IMAGES 8
+#define SPRITE_EXT_VERSION 4    // Version of sprite_ext_t (sprite_internal.h)
+
+typedef struct {
+    char *name;             // Name of the sub-image (input filename without extension)
+    int x, y;               // Position within the atlas sheet
+    int width, height;      // Size of the sub-image
+} atlas_rect_t;
 
 typedef struct {
     const char *infn;       // Input file
@@ -234,6 +285,9 @@ typedef struct {
         bool         use_main_tex;  // If true, use the main texture as detail (fractal detail)
         bool         enabled;       // If true, detail texture is enabled
     } detail;
+    atlas_rect_t *atlas_rects;  // Named sub-rects (atlas mode), sorted by name
+    int num_atlas_rects;        // Number of named sub-rects
+    bool tiled;                 // If true, store the first image pre-tiled in TMEM-sized blocks
 } spritemaker_t;
 
 
@@ -641,10 +695,8 @@ bool spritemaker_expand_rgba(spritemaker_t *spr) {
     return true;
 }
 
-bool spritemaker_quantize(spritemaker_t *spr, uint8_t *colors, int num_colors, int dither) {
-    if (flag_verbose)
-        fprintf(stderr, "quantizing image(s) to %d colors%s\n", num_colors, colors ? " (using existing palette)" : "");
-
+// Quantize with exoquant. Fills ci_images with the remapped images.
+static bool quantize_exoquant(spritemaker_t *spr, uint8_t *colors, int num_colors, int dither, uint8_t **ci_images) {
     // Initialize the quantizer engine
     exq_data *exq = exq_init();
     exq->numBitsPerChannel = 5;   // force calculations using rgb555
@@ -654,10 +706,6 @@ bool spritemaker_quantize(spritemaker_t *spr, uint8_t *colors, int num_colors, i
     for (int i=0; i<MAX_IMAGES; i++) {
         if (spr->images[i].image == NULL)
             continue;
-        if (spr->images[i].ct != LCT_RGBA) {
-            fprintf(stderr, "ERROR: image %d is not RGBA\n", i);
-            goto error;
-        }
         exq_feed(exq, spr->images[i].image, spr->images[i].width * spr->images[i].height);
     }
 
@@ -667,14 +715,10 @@ bool spritemaker_quantize(spritemaker_t *spr, uint8_t *colors, int num_colors, i
 
         // Extract the generate palette
         exq_get_palette(exq, spr->palette.colors[0], num_colors);
-        spr->palette.num_colors = num_colors;
-        spr->palette.used_colors = num_colors;
     } else {
         // Force the input palette
         exq_set_palette(exq, colors, num_colors);
         memcpy(spr->palette.colors[0], colors, num_colors * 4);
-        spr->palette.num_colors = num_colors;
-        spr->palette.used_colors = num_colors;
     }
 
     // Remap the images to the new palette
@@ -682,32 +726,137 @@ bool spritemaker_quantize(spritemaker_t *spr, uint8_t *colors, int num_colors, i
         image_t *img = &spr->images[i];
         if (spr->images[i].image == NULL)
             continue;
-        uint8_t* ci_image = malloc(img->width * img->height);
         switch (dither) {
         case DITHER_ALGO_NONE:
-            exq_map_image(exq, img->width * img->height, img->image, ci_image);
+            exq_map_image(exq, img->width * img->height, img->image, ci_images[i]);
             break;
         case DITHER_ALGO_RANDOM:
-            exq_map_image_random(exq, img->width * img->height, img->image, ci_image);
+            exq_map_image_random(exq, img->width * img->height, img->image, ci_images[i]);
             break;
         case DITHER_ALGO_ORDERED:
-            exq_map_image_ordered(exq, img->width, img->height, img->image, ci_image);
+            exq_map_image_ordered(exq, img->width, img->height, img->image, ci_images[i]);
             break;
         default:
             fprintf(stderr, "ERROR: invalid dithering mode %d\n", dither);
-            goto error;
+            exq_free(exq);
+            return false;
         }
-        free(img->image);
-        img->image = ci_image;
-        img->ct = LCT_PALETTE;
     }
 
     exq_free(exq);
     return true;
+}
 
-error:
-    exq_free(exq);
-    return false;
+// Quantize with the median-cut quantizer. Fills ci_images with the remapped images.
+static bool quantize_mediancut(spritemaker_t *spr, uint8_t *colors, int num_colors, int dither, uint8_t **ci_images) {
+    mcq_data *mcq = mcq_init();
+
+    for (int i=0; i<MAX_IMAGES; i++) {
+        if (spr->images[i].image == NULL)
+            continue;
+        mcq_feed(mcq, spr->images[i].image, spr->images[i].width * spr->images[i].height);
+    }
+
+    if (!colors) {
+        mcq_quantize(mcq, num_colors);
+        mcq_get_palette(mcq, spr->palette.colors[0], num_colors);
+    } else {
+        mcq_set_palette(mcq, colors, num_colors);
+        memcpy(spr->palette.colors[0], colors, num_colors * 4);
+    }
+
+    for (int i=0; i<MAX_IMAGES; i++) {
+        image_t *img = &spr->images[i];
+        if (spr->images[i].image == NULL)
+            continue;
+        switch (dither) {
+        case DITHER_ALGO_NONE:
+            mcq_map_image(mcq, img->width * img->height, img->image, ci_images[i]);
+            break;
+        case DITHER_ALGO_RANDOM: case DITHER_ALGO_ORDERED:
+            mcq_map_image_dither(mcq, img->width, img->height, img->image, ci_images[i], dither == DITHER_ALGO_ORDERED);
+            break;
+        default:
+            fprintf(stderr, "ERROR: invalid dithering mode %d\n", dither);
+            mcq_free(mcq);
+            return false;
+        }
+    }
+
+    mcq_free(mcq);
+    return true;
+}
+
+// Calculate the PSNR (on RGB, over opaque pixels) of a quantized image, as it
+// will be displayed (that is, after the palette has been converted to RGBA5551).
+static double quantize_psnr(image_t *img, uint8_t *ci_image, palette_t *palette) {
+    double err = 0; int count = 0;
+    for (int i=0; i<img->width*img->height; i++) {
+        uint8_t *src = img->image + i*4;
+        uint8_t *pal = palette->colors[ci_image[i]];
+        if (src[3] == 0) continue;
+        for (int j=0; j<3; j++) {
+            int v5 = pal[j] >> 3;
+            int d = (int)src[j] - ((v5 << 3) | (v5 >> 2));
+            err += d*d;
+        }
+        count += 3;
+    }
+    double mse = count ? err / count : 0;
+    return mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+bool spritemaker_quantize(spritemaker_t *spr, uint8_t *colors, int num_colors, int dither, int quant) {
+    if (flag_verbose)
+        fprintf(stderr, "quantizing image(s) to %d colors%s [quantizer=%s]\n", num_colors, colors ? " (using existing palette)" : "", quant_algo_name(quant));
+
+    uint8_t *ci_images[MAX_IMAGES] = {0};
+    for (int i=0; i<MAX_IMAGES; i++) {
+        if (spr->images[i].image == NULL)
+            continue;
+        if (spr->images[i].ct != LCT_RGBA) {
+            fprintf(stderr, "ERROR: image %d is not RGBA\n", i);
+            for (int j=0; j<i; j++)
+                free(ci_images[j]);
+            return false;
+        }
+        ci_images[i] = malloc(spr->images[i].width * spr->images[i].height);
+    }
+
+    clock_t t0 = clock();
+    bool ok;
+    switch (quant) {
+    case QUANT_ALGO_MEDIANCUT: ok = quantize_mediancut(spr, colors, num_colors, dither, ci_images); break;
+    default:                   ok = quantize_exoquant(spr, colors, num_colors, dither, ci_images); break;
+    }
+    clock_t t1 = clock();
+
+    if (ok) {
+        spr->palette.num_colors = num_colors;
+        spr->palette.used_colors = num_colors;
+        if (flag_verbose) {
+            fprintf(stderr, "quantized in %.1f ms (PSNR:", (double)(t1 - t0) * 1000.0 / CLOCKS_PER_SEC);
+            for (int i=0; i<MAX_IMAGES; i++)
+                if (ci_images[i])
+                    fprintf(stderr, " %.2f", quantize_psnr(&spr->images[i], ci_images[i], &spr->palette));
+            fprintf(stderr, " dB)\n");
+        }
+    }
+
+    // Replace the images with the remapped ones
+    for (int i=0; i<MAX_IMAGES; i++) {
+        image_t *img = &spr->images[i];
+        if (!ci_images[i])
+            continue;
+        if (!ok) {
+            free(ci_images[i]);
+            continue;
+        }
+        free(img->image);
+        img->image = ci_images[i];
+        img->ct = LCT_PALETTE;
+    }
+    return ok;
 }
 
 static uint8_t ihq_calc_best_i4(float ifactor, uint8_t r0, uint8_t g0, uint8_t b0, uint8_t r, uint8_t g, uint8_t b, float *err) {
@@ -910,7 +1059,298 @@ bool spritemaker_convert_ihq(spritemaker_t *spr) {
     return true;
 }
 
+/** @brief Write the pixels of an image, converting them to the output format */
+void spritemaker_write_pixels(spritemaker_t *spr, FILE *out, image_t *image) {
+    switch ((int)image->fmt) {
+    case FMT_RGBA16: {
+        assert(image->ct == LCT_RGBA);
+        // Convert to 16-bit RGB5551 format.
+        uint8_t *img = image->image;
+        for (int i=0;i<image->width*image->height;i++) {
+            w16(out, conv_rgb5551(img[0], img[1], img[2], img[3]));
+            img += 4;
+        }
+        break;
+    }
+
+    case FMT_CI4: {
+        assert(image->ct == LCT_PALETTE);
+        assert(spr->palette.used_colors <= 16);
+        // Convert image to 4 bit.
+        uint8_t *img = image->image;
+        for (int j=0; j<image->height; j++) {
+            for (int i=0; i<image->width; i+=2) {
+                uint8_t ix0 = *img++;
+                uint8_t ix1 = (i+1 == image->width) ? 0 : *img++;
+                assert(ix0 < 16 && ix1 < 16);
+                w8(out, (uint8_t)((ix0 << 4) | ix1));
+            }
+        }
+        break;
+    }
+
+    case FMT_IA8: {
+        assert(image->ct == LCT_GREY_ALPHA);
+        uint8_t *img = image->image;
+        for (int i=0; i<image->width*image->height; i++) {
+            uint8_t I = *img++; uint8_t A = *img++;
+            w8(out, (uint8_t)((I & 0xF0) | (A >> 4)));
+        }
+        break;
+    }
+
+    case FMT_I4: {
+        assert(image->ct == LCT_GREY);
+        uint8_t *img = image->image;
+        for (int j=0; j<image->height; j++) {
+            for (int i=0; i<image->width; i+=2) {
+                uint8_t I0 = *img++;
+                uint8_t I1 = (i+1 == image->width) ? 0 : *img++;
+                w8(out, (uint8_t)((I0 & 0xF0) | (I1 >> 4)));
+            }
+        }
+        break;
+    }
+
+    case FMT_IA4: {
+        assert(image->ct == LCT_GREY_ALPHA);
+        // IA4 is 3 bit intensity and 1 bit alpha. Pack it
+        uint8_t *img = image->image;
+        for (int j=0; j<image->height; j++) {
+            for (int i=0; i<image->width; i+=2) {
+                uint8_t I0 = *img++;
+                uint8_t A0 = *img++;
+                uint8_t I1 = (i+1 == image->width) ? 0 : *img++;
+                uint8_t A1 = (i+1 == image->width) ? 0 : *img++;
+                A0 = A0 ? 1 : 0;
+                A1 = A1 ? 1 : 0;
+                w8(out, (uint8_t)((I0 & 0xE0) | (A0 << 4) | ((I1 & 0xE0) >> 4) | A1));
+            }
+        }
+        break;
+    }
+
+    case FMT_ZBUF: {
+        assert(image->ct == LCT_GREY);
+        uint8_t *img = image->image;
+        for (int j=0; j<image->height; j++) {
+            for (int i=0; i<image->width; i++) {
+                uint32_t Z0 = (img[0] << 8) | img[1]; img += 2;
+                Z0 <<= 2; // Convert into 0.15.3
+                uint16_t FZ0 = conv_float14(Z0) << 2;
+                w16(out, FZ0);
+            }
+        }
+        break;
+    }
+
+    default: {
+        // No further conversion needed. Used for: RGBA32, IA16, CI8, I8.
+        int numbytes = TEX_FORMAT_PIX2BYTES(image->fmt, image->width*image->height);
+        fwrite(image->image, 1, numbytes, out);
+        break;
+    }
+    }
+}
+
+/** @brief Number of bytes per pixel of an image in memory (before conversion) */
+static int image_bpp(image_t *image) {
+    switch (image->ct) {
+    case LCT_RGBA: return 4;
+    case LCT_GREY_ALPHA: return 2;
+    case LCT_GREY: return image->fmt == FMT_ZBUF ? 2 : 1;
+    default: return 1;
+    }
+}
+
+/** 
+ * @brief Maximum number of lines that can be loaded with LOAD_BLOCK, indexed by TMEM pitch / 8 - 11
+ * 
+ * This is the same table used by rdpq_tex.c (see there for how it was generated).
+ * Pitches below 11 words are unlimited.
+ */
+static const uint8_t block_max_lines_table[] = { 20, 42, 26, 14, 19, 32, 13, 28, 26, 8, 9, 4, 4, 5, 20, 13, 18, 3, 6, 3, 2, 16, 2, 2, 3, 14, 2, 13, 2, 1, 12, 4, 2, 2, 2, 2, 2, 2, 4, 10, 0, 1, 2, 9, 0, 1, 8, 0, 2, 0, 1, 0, 1, 8, 0, 0, 1, 0, 1, 0, 2, 0, 0, 1, 0, 6, 0, 0, 4, 0, 0, 6, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 0, 1, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+/** @brief Number of blocks needed along an axis of a pre-tiled image (see sprite_tiles_t) */
+static int tiled_count(int block_size, int image_size) {
+    if (block_size >= image_size) return 1;
+    return (image_size + block_size - 3) / (block_size - 2);
+}
+
+/** @brief First image pixel stored in a block along an axis of a pre-tiled image */
+static int tiled_origin(int block_size, int image_size, int idx) {
+    if (block_size >= image_size) return 0;
+    return idx ? idx * (block_size - 2) - 1 : 0;
+}
+
+/** @brief Maximum number of lines that LOAD_BLOCK can load with the given TMEM pitch (in bytes) */
+static int block_max_lines(int pitch) {
+    int words = pitch / 8;
+    return words >= 11 ? block_max_lines_table[words - 11] : 4096;
+}
+
+/**
+ * @brief Calculate the block layout of a pre-tiled image
+ * 
+ * Every block must be loadable with a single LOAD_BLOCK: it must fit TMEM and
+ * stay within the maximum number of lines allowed by the LOAD_BLOCK precision.
+ * Each block costs a load and a rectangle, so layouts are compared by number
+ * of blocks, including the ones added by the overlap.
+ * 
+ * When a few lines of the image fit TMEM, blocks span the full width, just
+ * like the strips used by the rdpq texloader. In this case, the layout must
+ * beat the texloader drawing the linear image with filtering: it must need
+ * less loads, or the same number of loads if some strips would need LOAD_TILE.
+ * The stride of the blocks can be padded further than the 8-byte alignment,
+ * when that allows to load more lines with LOAD_BLOCK.
+ * Otherwise, the image can only be drawn in columns, and we choose the layout
+ * with less blocks, and then the one using less memory.
+ * 
+ * @return true if the image should be pre-tiled, false if the linear layout is better
+ */
+bool tiled_layout(tex_format_t fmt, int width, int height, int *out_bw, int *out_bh, int *out_stride) {
+    int tmem_size = (fmt == FMT_RGBA32 || fmt == FMT_CI4 || fmt == FMT_CI8) ? 2048 : 4096;
+    int pitch_shift = fmt == FMT_RGBA32 ? 1 : 0;
+    int align = fmt == FMT_RGBA32 ? 16 : 8;
+
+    // If the whole image fits TMEM, always use a single block. It might still
+    // need to be loaded with LOAD_TILE if too tall, but it keeps the sprite
+    // usable with rdpq_sprite_upload.
+    int bytes = TEX_FORMAT_PIX2BYTES(fmt, width);
+    int pitch = ROUND_UP(bytes >> pitch_shift, 8);
+    *out_bw = width; *out_bh = height;
+    *out_stride = ROUND_UP(bytes, align);
+    if (pitch * height <= tmem_size)
+        return true;
+
+    int strip_lines = tmem_size / pitch;
+    if (strip_lines >= 3) {
+        // Count the strips drawn by the texloader (see ltd_texloader), and
+        // check whether they can all be loaded with LOAD_BLOCK.
+        int max_lines = (bytes & (align-1)) == 0 ? block_max_lines(pitch) : 0;
+        int strips = 0;
+        bool load_tile = false;
+        for (int t0 = 0; t0 < height; strips++) {
+            int tm = t0 > 0 ? t0 - 1 : 0;
+            int tn = MIN(tm + strip_lines, height);
+            if (tn - tm > max_lines || (tm & 1))
+                load_tile = true;
+            t0 = tn == height ? tn : tn - 1;
+        }
+
+        // Padding the stride a little more than required might allow to load
+        // more lines with LOAD_BLOCK. The padding is filled with the border pixels.
+        int best_blocks = 0;
+        for (int stride = *out_stride; ; stride += align) {
+            int bpitch = ROUND_UP(stride >> pitch_shift, 8);
+            int max_lines = tmem_size / bpitch;
+            if (max_lines < 3) break;
+            int bh = MIN(max_lines, block_max_lines(bpitch));
+            if (bh >= 3 && (!best_blocks || tiled_count(bh, height) < best_blocks)) {
+                best_blocks = tiled_count(bh, height);
+                *out_bw = TEX_FORMAT_BYTES2PIX(fmt, stride); *out_bh = bh; *out_stride = stride;
+            }
+        }
+        return best_blocks && (best_blocks < strips || (best_blocks == strips && load_tile));
+    }
+
+    int best_blocks = 0, best_bytes = 0;
+    for (int stride = align; ; stride += align) {
+        int bw = TEX_FORMAT_BYTES2PIX(fmt, stride);
+        bool last = bw >= width;
+        if (last) bw = width;
+
+        int pitch = ROUND_UP(TEX_FORMAT_PIX2BYTES(fmt, bw) >> pitch_shift, 8);
+        int max_lines = tmem_size / pitch;
+        if (max_lines < 3) break;
+        max_lines = MIN(max_lines, block_max_lines(pitch));
+
+        if (max_lines >= 3) {
+            int bh = MIN(max_lines, height);
+            int line_bytes = ROUND_UP(TEX_FORMAT_PIX2BYTES(fmt, bw), align);
+            int blocks = tiled_count(bw, width) * tiled_count(bh, height);
+            int bytes = blocks * line_bytes * bh;
+            if (!best_blocks || blocks < best_blocks || (blocks == best_blocks && bytes < best_bytes)) {
+                best_blocks = blocks; best_bytes = bytes;
+                *out_bw = bw; *out_bh = bh; *out_stride = line_bytes;
+            }
+        }
+        if (last) break;
+    }
+    assert(best_blocks > 0);
+    return true;
+}
+
+/** @brief Check whether the first image can be pre-tiled, and keep it linear if pre-tiling does not pay off */
+bool spritemaker_check_tiled(spritemaker_t *spr) {
+    image_t *image = &spr->images[0];
+    if (image->fmt == FMT_ZBUF) {
+        fprintf(stderr, "ERROR: pre-tiled layout is not supported for ZBUF format\n");
+        return false;
+    }
+
+    int bw, bh, stride;
+    if (!tiled_layout(image->fmt, image->width, image->height, &bw, &bh, &stride)) {
+        if (flag_verbose)
+            fprintf(stderr, "pre-tiled layout would not save TMEM loads: keeping the linear layout\n");
+        spr->tiled = false;
+        return true;
+    }
+
+    int nblocks = tiled_count(bw, image->width) * tiled_count(bh, image->height);
+    if (nblocks > 1 && (spr->images[1].image || spr->detail.enabled)) {
+        fprintf(stderr, "ERROR: pre-tiled layout with mipmaps or detail texture requires the image to fit TMEM\n");
+        return false;
+    }
+    return true;
+}
+
+/** @brief Write the first image pre-tiled in TMEM-sized blocks (see sprite_tiles_t) */
+void spritemaker_write_tiled(spritemaker_t *spr, FILE *out, image_t *image) {
+    int bw, bh, stride;
+    tiled_layout(image->fmt, image->width, image->height, &bw, &bh, &stride);
+    int nx = tiled_count(bw, image->width);
+    int ny = tiled_count(bh, image->height);
+    if (flag_verbose)
+        fprintf(stderr, "pre-tiled layout: %d blocks of %dx%d (stride: %d bytes)\n", nx*ny, bw, bh, stride);
+
+    w16(out, bw);
+    w16(out, bh);
+    w16(out, stride);
+    w16(out, nx*ny);
+
+    // Each block is written as an image whose width covers the whole stride,
+    // so that the padding is filled by repeating the border pixels.
+    int bpp = image_bpp(image);
+    image_t block = *image;
+    block.width = TEX_FORMAT_BYTES2PIX(image->fmt, stride);
+    block.height = bh;
+    block.image = malloc(block.width * block.height * bpp);
+
+    for (int by=0; by<ny; by++) {
+        int oy = tiled_origin(bh, image->height, by);
+        for (int bx=0; bx<nx; bx++) {
+            int ox = tiled_origin(bw, image->width, bx);
+            uint8_t *dst = block.image;
+            for (int y=0; y<block.height; y++) {
+                int sy = MIN(oy + y, image->height - 1);
+                for (int x=0; x<block.width; x++) {
+                    int sx = MIN(ox + x, image->width - 1);
+                    memcpy(dst, image->image + (sy * image->width + sx) * bpp, bpp);
+                    dst += bpp;
+                }
+            }
+            spritemaker_write_pixels(spr, out, &block);
+        }
+    }
+
+    free(block.image);
+}
+
 bool spritemaker_write(spritemaker_t *spr) {
+    if (spr->tiled && !spritemaker_check_tiled(spr))
+        return false;
+
     FILE *out;
     if (strcmp(spr->outfn, "(stdout)") == 0) {
         // We can't directly write to stdout because we need to seek.
@@ -935,11 +1375,12 @@ bool spritemaker_write(spritemaker_t *spr) {
     w16(out, spr->images[0].width);
     w16(out, spr->images[0].height);
     w8(out, 0); // deprecated field
-    w8(out, (uint8_t)(img0fmt | SPRITE_FLAGS_EXT));
+    w8(out, (uint8_t)(img0fmt | SPRITE_FLAGS_EXT | (spr->tiled ? SPRITE_FLAGS_TILED : 0)));
     w8(out, spr->hslices);
     w8(out, spr->vslices);
 
     uint32_t w_palpos = 0;
+    uint32_t w_atlaspos = 0;
     uint32_t w_lodpos[7] = {0};
 
     // Process the images (the first always exists)
@@ -954,96 +1395,10 @@ bool spritemaker_write(spritemaker_t *spr) {
             w32_at(out, w_lodpos[m-1], xpos);
         }
 
-        switch ((int)image->fmt) {
-        case FMT_RGBA16: {
-            assert(image->ct == LCT_RGBA);
-            // Convert to 16-bit RGB5551 format.
-            uint8_t *img = image->image;
-            for (int i=0;i<image->width*image->height;i++) {
-                w16(out, conv_rgb5551(img[0], img[1], img[2], img[3]));
-                img += 4;
-            }
-            break;
-        }
-
-        case FMT_CI4: {
-            assert(image->ct == LCT_PALETTE);
-            assert(spr->palette.used_colors <= 16);
-            // Convert image to 4 bit.
-            uint8_t *img = image->image;
-            for (int j=0; j<image->height; j++) {
-                for (int i=0; i<image->width; i+=2) {
-                    uint8_t ix0 = *img++;
-                    uint8_t ix1 = (i+1 == image->width) ? 0 : *img++;
-                    assert(ix0 < 16 && ix1 < 16);
-                    w8(out, (uint8_t)((ix0 << 4) | ix1));
-                }
-            }
-            break;
-        }
-
-        case FMT_IA8: {
-            assert(image->ct == LCT_GREY_ALPHA);
-            uint8_t *img = image->image;
-            for (int i=0; i<image->width*image->height; i++) {
-                uint8_t I = *img++; uint8_t A = *img++;
-                w8(out, (uint8_t)((I & 0xF0) | (A >> 4)));
-            }
-            break;
-        }
-
-        case FMT_I4: {
-            assert(image->ct == LCT_GREY);
-            uint8_t *img = image->image;
-            for (int j=0; j<image->height; j++) {
-                for (int i=0; i<image->width; i+=2) {
-                    uint8_t I0 = *img++;
-                    uint8_t I1 = (i+1 == image->width) ? 0 : *img++;
-                    w8(out, (uint8_t)((I0 & 0xF0) | (I1 >> 4)));
-                }
-            }
-            break;
-        }
-
-        case FMT_IA4: {
-            assert(image->ct == LCT_GREY_ALPHA);
-            // IA4 is 3 bit intensity and 1 bit alpha. Pack it
-            uint8_t *img = image->image;
-            for (int j=0; j<image->height; j++) {
-                for (int i=0; i<image->width; i+=2) {
-                    uint8_t I0 = *img++;
-                    uint8_t A0 = *img++;
-                    uint8_t I1 = (i+1 == image->width) ? 0 : *img++;
-                    uint8_t A1 = (i+1 == image->width) ? 0 : *img++;
-                    A0 = A0 ? 1 : 0;
-                    A1 = A1 ? 1 : 0;
-                    w8(out, (uint8_t)((I0 & 0xE0) | (A0 << 4) | ((I1 & 0xE0) >> 4) | A1));
-                }
-            }
-            break;
-        }
-
-        case FMT_ZBUF: {
-            assert(image->ct == LCT_GREY);
-            uint8_t *img = image->image;
-            for (int j=0; j<image->height; j++) {
-                for (int i=0; i<image->width; i++) {
-                    uint32_t Z0 = (img[0] << 8) | img[1]; img += 2;
-                    Z0 <<= 2; // Convert into 0.15.3
-                    uint16_t FZ0 = conv_float14(Z0) << 2;
-                    w16(out, FZ0);
-                }
-            }
-            break;
-        }
-
-        default: {
-            // No further conversion needed. Used for: RGBA32, IA16, CI8, I8.
-            int numbytes = TEX_FORMAT_PIX2BYTES(image->fmt, image->width*image->height);
-            fwrite(image->image, 1, numbytes, out);
-            break;
-        }
-        }
+        if (m == 0 && spr->tiled)
+            spritemaker_write_tiled(spr, out, image);
+        else
+            spritemaker_write_pixels(spr, out, image);
 
         // Padding to force alignment of every image
         walign(out, 8);
@@ -1051,8 +1406,8 @@ bool spritemaker_write(spritemaker_t *spr) {
         // Write extended sprite header after first image
         // See sprite_ext_t (sprite_internal.h)
         if (m == 0) { 
-            w16(out, 124);  // sizeof(sprite_ext_t)
-            w16(out, 4);    // version
+            w16(out, 128);  // sizeof(sprite_ext_t)
+            w16(out, SPRITE_EXT_VERSION);
             w_palpos = w32_placeholder(out); // placeholder for position of palette
             int numlods = 0;
             for (int i=1; i<8; i++) {
@@ -1096,6 +1451,7 @@ bool spritemaker_write(spritemaker_t *spr) {
             w8(out, 0); // padding
             w8(out, 0); // padding
             w8(out, 0); // padding
+            w_atlaspos = w32_placeholder(out); // placeholder for position of atlas table
 
             walign(out, 8);
         }
@@ -1118,6 +1474,29 @@ bool spritemaker_write(spritemaker_t *spr) {
         walign(out, 8);
     }
 
+    // Write the atlas table, if any. Entries are sorted by name so that the
+    // runtime can do a binary search.
+    if (spr->num_atlas_rects > 0) {
+        w32_at(out, w_atlaspos, ftell(out));
+        w32(out, spr->num_atlas_rects);
+        w32(out, 0); // padding
+        uint32_t *w_namepos = malloc(spr->num_atlas_rects * sizeof(uint32_t));
+        for (int i=0; i<spr->num_atlas_rects; i++) {
+            atlas_rect_t *r = &spr->atlas_rects[i];
+            w_namepos[i] = w32_placeholder(out);
+            w16(out, r->x);
+            w16(out, r->y);
+            w16(out, r->width);
+            w16(out, r->height);
+        }
+        for (int i=0; i<spr->num_atlas_rects; i++) {
+            w32_at(out, w_namepos[i], ftell(out));
+            fwrite(spr->atlas_rects[i].name, 1, strlen(spr->atlas_rects[i].name)+1, out);
+        }
+        free(w_namepos);
+        walign(out, 8);
+    }
+
     if (strcmp(spr->outfn, "(stdout)") == 0) {
         // Copy the temporary file to stdout
         char buf[4096]; size_t n;
@@ -1177,69 +1556,247 @@ void spritemaker_free(spritemaker_t *spr) {
     memset(spr, 0, sizeof(*spr));
 }
 
-int convert(const char *infn, const char *outfn, const parms_t *pm) {
-    if (flag_verbose)
-        fprintf(stderr, "Converting: %s -> %s [fmt=%s tiles=%d,%d mipmap=%s dither=%s]\n",
-            infn, outfn, tex_format_name(pm->outfmt), pm->tilew, pm->tileh, mipmap_algo_name(pm->mipmap_algo), dither_algo_name(pm->dither_algo));
+void spritemaker_init(spritemaker_t *spr, const char *infn, const char *outfn, const parms_t *pm) {
+    memset(spr, 0, sizeof(*spr));
+    spr->infn = infn;
+    spr->outfn = outfn;
+    spr->texparms = pm->texparms;
+    spr->tiled = pm->tiled;
+    if (!spr->texparms.defined) {
+        spr->texparms.s.translate = 0.0f;
+        spr->texparms.s.scale = 0;
+        spr->texparms.s.repeats = 1;
+        spr->texparms.s.mirror = 0;
+        spr->texparms.t = spr->texparms.s;
+    }
 
-    spritemaker_t spr = {0};
+    spr->detail.enabled = pm->detail.enabled;
+    spr->detail.use_main_tex = pm->detail.use_main_tex;
+    spr->detail.infn = pm->detail.infn;
+    spr->detail.blend_factor = pm->detail.blend_factor;
+    spr->detail.texparms = pm->detail.texparms;
+    if (!spr->detail.texparms.defined) {
+        spr->detail.texparms.s.translate = 0.0f;
+        spr->detail.texparms.s.scale = -1;
+        spr->detail.texparms.s.repeats = 2048;
+        spr->detail.texparms.s.mirror = 0;
+        spr->detail.texparms.t = spr->detail.texparms.s;
+    }
+}
 
-    spr.infn = infn;
-    spr.outfn = outfn;
-    spr.texparms = pm->texparms;
-    if (!spr.texparms.defined) {
-        spr.texparms.s.translate = 0.0f;
-        spr.texparms.s.scale = 0;
-        spr.texparms.s.repeats = 1;
-        spr.texparms.s.mirror = 0;
-        spr.texparms.t = spr.texparms.s;
+/************************************************************************
+ * Error-budgeted format selection
+ * 
+ * When --auto-psnr and/or --auto-maxerr are specified with the AUTO format,
+ * the input is converted to each candidate format (from the smallest to the
+ * largest), decoded back as the RDP would see it, and compared against the
+ * original. The first format within the error budget is selected.
+ ************************************************************************/
+
+// Candidate formats, sorted by increasing size
+static const int auto_candidates[] = {
+    FMT_I4, FMT_IA4, FMT_CI4,       // 4 bpp
+    FMT_IHQ,                        // 4 bpp + quarter-size RGBA16
+    FMT_I8, FMT_IA8, FMT_CI8,       // 8 bpp
+    FMT_IA16, FMT_RGBA16,           // 16 bpp
+    FMT_RGBA32,                     // 32 bpp (lossless)
+};
+
+#define EXPAND5(v)  ((((v)>>3) << 3) | ((v) >> 5))
+
+// Decode a quantized or IHQ sprite back to RGBA32
+static void auto_decode_sprite(spritemaker_t *spr, int width, int height, uint8_t *dec) {
+    image_t *img = &spr->images[0];
+    if (img->ct == LCT_PALETTE) {
+        for (int i=0; i<width*height; i++) {
+            uint8_t *c = spr->palette.colors[img->image[i]];
+            dec[i*4+0] = EXPAND5(c[0]);
+            dec[i*4+1] = EXPAND5(c[1]);
+            dec[i*4+2] = EXPAND5(c[2]);
+            dec[i*4+3] = c[3] ? 0xFF : 0;
+        }
+        return;
     }
 
-    spr.detail.enabled = pm->detail.enabled;
-    spr.detail.use_main_tex = pm->detail.use_main_tex;
-    spr.detail.infn = pm->detail.infn;
-    spr.detail.blend_factor = pm->detail.blend_factor;
-    spr.detail.texparms = pm->detail.texparms;
-    if (!spr.detail.texparms.defined) {
-        spr.detail.texparms.s.translate = 0.0f;
-        spr.detail.texparms.s.scale = -1;
-        spr.detail.texparms.s.repeats = 2048;
-        spr.detail.texparms.s.mirror = 0;
-        spr.detail.texparms.t = spr.detail.texparms.s;
+    // IHQ: bilinear upscale of the RGB plane, blended with the I4 plane
+    image_t *iimg = &spr->images[7];
+    float f = spr->detail.blend_factor;
+    for (int y=0; y<height; y++) {
+        float yy = (float)y * img->height / height;
+        int yy0 = (int)yy, yy1 = MIN(yy0+1, img->height-1);
+        float yyf = yy - yy0;
+        for (int x=0; x<width; x++) {
+            float xx = (float)x * img->width / width;
+            int xx0 = (int)xx, xx1 = MIN(xx0+1, img->width-1);
+            float xxf = xx - xx0;
+            for (int c=0; c<3; c++) {
+                float v = EXPAND5(img->image[(yy0*img->width + xx0)*4 + c]) * (1-xxf) * (1-yyf) +
+                          EXPAND5(img->image[(yy0*img->width + xx1)*4 + c]) * xxf * (1-yyf) +
+                          EXPAND5(img->image[(yy1*img->width + xx0)*4 + c]) * (1-xxf) * yyf +
+                          EXPAND5(img->image[(yy1*img->width + xx1)*4 + c]) * xxf * yyf;
+                int i = iimg->image[y*width + x];
+                dec[(y*width + x)*4 + c] = (uint8_t)MIN(v*(1-f) + (i | (i >> 4))*f, 255.0f);
+            }
+            dec[(y*width + x)*4 + 3] = 0xFF;
+        }
     }
+}
 
-    int mipmap_algo = pm->mipmap_algo;
+/**
+ * @brief Decode the image as it would look like once converted to the specified format
+ * 
+ * @return false if the format cannot be used for this image
+ */
+static bool auto_decode(int fmt, const image_t *src, bool opaque, const parms_t *pm, uint8_t *dec, int *tmem_usage) {
+    int w = src->width, h = src->height;
+    const uint8_t *s = src->image;
+
+    *tmem_usage = calc_tmem_usage(fmt, w, h);
+    switch (fmt) {
+    case FMT_CI4: case FMT_CI8: case FMT_IHQ: {
+        if (fmt == FMT_IHQ) {
+            // Check IHQ requirements upfront, to avoid error messages
+            if (!opaque || pm->detail.enabled || w % 2 || h % 2 || (w % 4 && h % 4) ||
+                calc_tmem_usage(FMT_RGBA16, w, h) > 8192)
+                return false;
+        }
+        spritemaker_t spr;
+        spritemaker_init(&spr, NULL, NULL, pm);
+        spr.detail.enabled = false;
+        spr.images[0] = *src;
+        spr.images[0].image = malloc(w * h * 4);
+        spr.images[0].fmt = fmt;
+        memcpy(spr.images[0].image, s, w * h * 4);
+        uint8_t *orig = spr.images[0].image;
+        bool ok = (fmt == FMT_IHQ) ? 
+            spritemaker_convert_ihq(&spr) :
+            spritemaker_quantize(&spr, NULL, fmt == FMT_CI8 ? 256 : 16, pm->dither_algo, pm->quant_algo);
+        // IHQ conversion replaces the main image with the RGB plane
+        if (fmt == FMT_IHQ && spr.images[0].image != orig) free(orig);
+        if (ok) {
+            auto_decode_sprite(&spr, w, h, dec);
+            spritemaker_fit_tmem(&spr, tmem_usage);
+        }
+        spritemaker_free(&spr);
+        return ok;
+    }
+    default:
+        break;
+    }
 
-    // Load the PNG, passing the desired output format (or FMT_NONE if autodetect).
-    if (!spritemaker_load_png(&spr, pm->outfmt))
-        goto error;
+    for (int i=0; i<w*h; i++, s+=4, dec+=4) {
+        // Grayscale formats use the red channel (like lodepng's conversion)
+        uint8_t I = s[0], A = s[3];
+        switch (fmt) {
+        case FMT_RGBA32: memcpy(dec, s, 4); continue;
+        case FMT_RGBA16: dec[0] = EXPAND5(s[0]); dec[1] = EXPAND5(s[1]); dec[2] = EXPAND5(s[2]); dec[3] = A ? 0xFF : 0; continue;
+        case FMT_IA16:   break;
+        case FMT_IA8:    I = (I >> 4) * 0x11; A = (A >> 4) * 0x11; break;
+        case FMT_IA4:    I = (I >> 5); I = (I << 5) | (I << 2) | (I >> 1); A = A ? 0xFF : 0; break;
+        // I formats have no alpha: the RDP returns the intensity as alpha
+        case FMT_I8:     A = opaque ? 0xFF : I; break;
+        case FMT_I4:     I = (I >> 4) * 0x11; A = opaque ? 0xFF : I; break;
+        default:         assert(0);
+        }
+        dec[0] = dec[1] = dec[2] = I;
+        dec[3] = A;
+    }
+    return true;
+}
 
-    if (spr.images[0].fmt == FMT_IHQ) {
-        if (!spritemaker_convert_ihq(&spr))
-            goto error;
-        // Compute mipmaps for IHQ
-        mipmap_algo = MIPMAP_ALGO_BOX;
-    } else if (spr.detail.enabled && !spr.detail.use_main_tex) {
-        // Load the detail PNG, passing the desired output format (or FMT_NONE if autodetect).
-        if (!spritemaker_load_detail_png(&spr, pm->detail.outfmt))
-            goto error;
+/**
+ * @brief Select the smallest format whose conversion error is within the budget.
+ * 
+ * @return The selected format, or FMT_NONE in case of error.
+ */
+tex_format_t spritemaker_select_format(const char *infn, const parms_t *pm) {
+    if (strcmp(infn, "(stdin)") == 0) {
+        fprintf(stderr, "ERROR: error-budgeted format selection is not supported on stdin\n");
+        return FMT_NONE;
     }
 
+    image_t src; palette_t pal;
+    if (!load_png_image(infn, FMT_RGBA32, &src, &pal))
+        return FMT_NONE;
+
+    int w = src.width, h = src.height;
+    bool opaque = true;
+    for (int i=0; i<w*h; i++)
+        if (src.image[i*4+3] != 0xFF) { opaque = false; break; }
+
+    uint8_t *dec = malloc(w * h * 4);
+    tex_format_t best = FMT_RGBA32;
+    double best_psnr = 99.0; int best_maxerr = 0, best_tmem = calc_tmem_usage(FMT_RGBA32, w, h);
+
+    // Quiet down the conversions done while testing candidates
+    bool verbose = flag_verbose;
+    for (int c=0; c<sizeof(auto_candidates)/sizeof(auto_candidates[0]); c++) {
+        int fmt = auto_candidates[c], tmem;
+        flag_verbose = false;
+        bool ok = auto_decode(fmt, &src, opaque, pm, dec, &tmem);
+        flag_verbose = verbose;
+        if (!ok) {
+            if (flag_verbose)
+                fprintf(stderr, "  %-7s not applicable\n", tex_format_name(fmt));
+            continue;
+        }
+
+        // Measure the error on alpha-premultiplied colors, so that the color
+        // of (semi-)transparent pixels is weighted by its visibility.
+        double err = 0; int maxerr = 0;
+        for (int i=0; i<w*h; i++) {
+            uint8_t *p0 = &src.image[i*4], *p1 = &dec[i*4];
+            for (int j=0; j<4; j++) {
+                int v0 = j < 3 ? (p0[j] * p0[3] + 127) / 255 : p0[3];
+                int v1 = j < 3 ? (p1[j] * p1[3] + 127) / 255 : p1[3];
+                int d = abs(v0 - v1);
+                err += d*d;
+                if (d > maxerr) maxerr = d;
+            }
+        }
+        double mse = err / (w * h * 4);
+        double psnr = mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+        bool pass = psnr >= pm->autofmt.min_psnr && maxerr <= pm->autofmt.max_err;
+
+        if (flag_verbose)
+            fprintf(stderr, "  %-7s PSNR %5.2f dB, max error %3d, TMEM %5d bytes%s\n",
+                tex_format_name(fmt), psnr, maxerr, tmem, pass ? " [OK]" : "");
+        if (pass) {
+            best = fmt; best_psnr = psnr; best_maxerr = maxerr; best_tmem = tmem;
+            break;
+        }
+    }
+
+    fprintf(stderr, "%s: selected format %s (PSNR %.2f dB, max error %d, TMEM %d bytes)\n",
+        infn, tex_format_name(best), best_psnr, best_maxerr, best_tmem);
+
+    free(dec);
+    free(src.image);
+    return best;
+}
+
+/**
+ * @brief Run the common conversion pipeline on a loaded sprite, write it and free it.
+ * 
+ * This computes mipmaps, quantizes to the target palette format if needed,
+ * and finally writes the sprite file (plus debug images if requested).
+ */
+int spritemaker_finish(spritemaker_t *spr, const parms_t *pm, int mipmap_algo) {
     // Calculate mipmap levels, if requested
     if (mipmap_algo != MIPMAP_ALGO_NONE) {
-        switch (spr.images[0].ct) {
+        switch (spr->images[0].ct) {
         case LCT_PALETTE: {
             // Mipmap generation of indexed image. In this case, we want to
             // preserve the original palette for all the mipmaps. To reuse
             // existing code, we expand first to RGBA and then quantize again
             // the original palette.
-            palette_t orig_palette = spr.palette;
-            int fmt_colors = spr.images[0].fmt == FMT_CI8 ? 256 : 16;
+            palette_t orig_palette = spr->palette;
+            int fmt_colors = spr->images[0].fmt == FMT_CI8 ? 256 : 16;
 
             // Expand to RGBA, calc lods, and quantize with the original palette
-            if (!spritemaker_expand_rgba(&spr)
-                || !spritemaker_calc_lods(&spr, mipmap_algo)
-                || !spritemaker_quantize(&spr, orig_palette.colors[0], fmt_colors, pm->dither_algo))
+            if (!spritemaker_expand_rgba(spr)
+                || !spritemaker_calc_lods(spr, mipmap_algo)
+                || !spritemaker_quantize(spr, orig_palette.colors[0], fmt_colors, pm->dither_algo, pm->quant_algo))
                 goto error;
 
             // Restore palette. Notice that spritemake_quantize has already done that
@@ -1247,31 +1804,31 @@ int convert(const char *infn, const char *outfn, const parms_t *pm) {
             // might be shipped with a 64 color palette that the user will use
             // at runtime). So we quantized all lods with the first 16 colors
             // (like the first image), but then we restore the other colors.
-            spr.palette = orig_palette;
+            spr->palette = orig_palette;
         }   break;
 
         default:
-            if (!spritemaker_calc_lods(&spr, mipmap_algo))
+            if (!spritemaker_calc_lods(spr, mipmap_algo))
                 goto error;
             break;
         }
     }
 
     // Run quantization if needed
-    if (spr.images[0].fmt == FMT_CI8 || spr.images[0].fmt == FMT_CI4) {
-        int expected_colors = spr.images[0].fmt == FMT_CI8 ? 256 : 16;
+    if (spr->images[0].fmt == FMT_CI8 || spr->images[0].fmt == FMT_CI4) {
+        int expected_colors = spr->images[0].fmt == FMT_CI8 ? 256 : 16;
 
-        switch (spr.images[0].ct) {
+        switch (spr->images[0].ct) {
         case LCT_RGBA:
-            if (!spritemaker_quantize(&spr, NULL, expected_colors, pm->dither_algo))
+            if (!spritemaker_quantize(spr, NULL, expected_colors, pm->dither_algo, pm->quant_algo))
                 goto error;
             break;
         case LCT_PALETTE:
             // When the source image is already palettized, we quantize only if
             // the requested number of colors is less than the actually used colors.
-            if (expected_colors < spr.palette.used_colors) {
-                if (!spritemaker_expand_rgba(&spr) || 
-                    !spritemaker_quantize(&spr, NULL, expected_colors, pm->dither_algo))
+            if (expected_colors < spr->palette.used_colors) {
+                if (!spritemaker_expand_rgba(spr) || 
+                    !spritemaker_quantize(spr, NULL, expected_colors, pm->dither_algo, pm->quant_algo))
                     goto error;
             }
             break;
@@ -1282,43 +1839,614 @@ int convert(const char *infn, const char *outfn, const parms_t *pm) {
 
     // Dump TMEM usage
     if (flag_verbose) {
-        int tmem_usage; spritemaker_fit_tmem(&spr, &tmem_usage);
+        int tmem_usage; spritemaker_fit_tmem(spr, &tmem_usage);
         fprintf(stderr, "TMEM required: %d bytes\n", tmem_usage);
     }
 
+    // Pre-tiled sprites made of multiple blocks cannot be accessed by tiles
+    // (see sprite_get_tile), so don't let the user ask for both.
+    if (pm->tiled && (pm->hslices || pm->vslices || pm->tilew || pm->tileh)) {
+        fprintf(stderr, "ERROR: --tiled cannot be used together with --tiles\n");
+        goto error;
+    }
+
     // Legacy support for old mksprite usage
-    if (pm->hslices) spr.hslices = pm->hslices;
-    if (pm->vslices) spr.vslices = pm->vslices;
+    if (pm->hslices) spr->hslices = pm->hslices;
+    if (pm->vslices) spr->vslices = pm->vslices;
     // Autodetection of optimal slice size. NOTE: we currently don't
     // use this in rdpq. rdpq_tex does its own from-scratch calculation,
     // but we could skip some runtime work by doing the same here.
-    if (pm->tilew) spr.hslices = spr.images[0].width / pm->tilew;
-    if (pm->tileh) spr.vslices = spr.images[0].height / pm->tileh;
-    if (!spr.hslices) {
-        spr.hslices = spr.images[0].width / 16;
-        if (!spr.hslices) spr.hslices = 1;
+    if (pm->tilew) spr->hslices = spr->images[0].width / pm->tilew;
+    if (pm->tileh) spr->vslices = spr->images[0].height / pm->tileh;
+    if (!spr->hslices) {
+        spr->hslices = spr->images[0].width / 16;
+        if (!spr->hslices) spr->hslices = 1;
     }
-    if (!spr.vslices) {
-        spr.vslices = spr.images[0].height / 16;
-        if (!spr.vslices) spr.vslices = 1;
+    if (!spr->vslices) {
+        spr->vslices = spr->images[0].height / 16;
+        if (!spr->vslices) spr->vslices = 1;
     }
 
     // Write the sprite
-    if (!spritemaker_write(&spr))
+    if (!spritemaker_write(spr))
         goto error;
 
     // Write debug files
     if (flag_debug)
-        spritemaker_write_pngs(&spr);
+        spritemaker_write_pngs(spr);
 
-    spritemaker_free(&spr);
+    spritemaker_free(spr);
     return 0;
 
+error:
+    spritemaker_free(spr);
+    return 1;
+}
+
+int convert(const char *infn, const char *outfn, const parms_t *pm) {
+    if (flag_verbose)
+        fprintf(stderr, "Converting: %s -> %s [fmt=%s tiles=%d,%d mipmap=%s dither=%s]\n",
+            infn, outfn, tex_format_name(pm->outfmt), pm->tilew, pm->tileh, mipmap_algo_name(pm->mipmap_algo), dither_algo_name(pm->dither_algo));
+
+    spritemaker_t spr;
+    spritemaker_init(&spr, infn, outfn, pm);
+
+    int mipmap_algo = pm->mipmap_algo;
+
+    // Select the format within the error budget, if requested
+    tex_format_t outfmt = pm->outfmt;
+    if (outfmt == FMT_NONE && pm->autofmt.enabled) {
+        outfmt = spritemaker_select_format(infn, pm);
+        if (outfmt == FMT_NONE)
+            goto error;
+    }
+
+    // Load the PNG, passing the desired output format (or FMT_NONE if autodetect).
+    if (!spritemaker_load_png(&spr, outfmt))
+        goto error;
+
+    if (spr.images[0].fmt == FMT_IHQ) {
+        if (!spritemaker_convert_ihq(&spr))
+            goto error;
+        // Compute mipmaps for IHQ
+        mipmap_algo = MIPMAP_ALGO_BOX;
+    } else if (spr.detail.enabled && !spr.detail.use_main_tex) {
+        // Load the detail PNG, passing the desired output format (or FMT_NONE if autodetect).
+        if (!spritemaker_load_detail_png(&spr, pm->detail.outfmt))
+            goto error;
+    }
+
+    return spritemaker_finish(&spr, pm, mipmap_algo);
+
 error:
     spritemaker_free(&spr);
     return 1;
 }
 
+void compress_output(const char *outfn, int compression) {
+    if (!compression)
+        return;
+    struct stat st_decomp = {0}, st_comp = {0};
+    stat(outfn, &st_decomp);
+    asset_compress(outfn, outfn, compression, 0);
+    stat(outfn, &st_comp);
+    if (flag_verbose)
+        fprintf(stderr, "compressed: %s (%d -> %d, ratio %.1f%%)\n", outfn,
+        (int)st_decomp.st_size, (int)st_comp.st_size, 100.0 * (float)st_comp.st_size / (float)(st_decomp.st_size == 0 ? 1 :st_decomp.st_size));
+}
+
+/************************************************************************
+ * Conversion cache
+ * 
+ * When a cache directory is specified (--cache), each converted file is
+ * also stored there, named after a hash of everything that affects the
+ * output: the input PNG(s), all the conversion parameters and the version
+ * of the converter. A later conversion with the same key just copies
+ * the cached file, skipping both conversion and compression.
+ *
+ * The key does not depend on when or where mksprite was built, so that
+ * builds stay reproducible. This means that CACHE_VERSION must be bumped
+ * whenever a change to mksprite alters its output for the same inputs.
+ ************************************************************************/
+
+#define CACHE_VERSION   1
+
+typedef struct {
+    uint64_t h;
+} cache_hash_t;
+
+static void cache_hash_init(cache_hash_t *hs) {
+    hs->h = 0xcbf29ce484222325ull;   // FNV-1a 64-bit offset basis
+}
+
+static void cache_hash_data(cache_hash_t *hs, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i=0; i<len; i++) {
+        hs->h ^= p[i];
+        hs->h *= 0x100000001b3ull;   // FNV-1a 64-bit prime
+    }
+}
+
+#define cache_hash_value(hs, v) ({ typeof(v) _v = (v); cache_hash_data(hs, &_v, sizeof(_v)); })
+
+static bool cache_hash_file(cache_hash_t *hs, const char *fn) {
+    FILE *f = fopen(fn, "rb");
+    if (!f) return false;
+    uint8_t buf[16384]; size_t n; uint64_t size = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        cache_hash_data(hs, buf, n);
+        size += n;
+    }
+    fclose(f);
+    cache_hash_value(hs, size);
+    return true;
+}
+
+static void cache_hash_texparms(cache_hash_t *hs, const texparms_t *tp) {
+    cache_hash_value(hs, tp->defined);
+    cache_hash_value(hs, tp->s.translate); cache_hash_value(hs, tp->s.scale);
+    cache_hash_value(hs, tp->s.repeats);   cache_hash_value(hs, tp->s.mirror);
+    cache_hash_value(hs, tp->t.translate); cache_hash_value(hs, tp->t.scale);
+    cache_hash_value(hs, tp->t.repeats);   cache_hash_value(hs, tp->t.mirror);
+}
+
+/**
+ * @brief Compute the cache key for a conversion.
+ * 
+ * Fields are hashed one by one (rather than hashing parms_t as a blob)
+ * to skip pointers and padding bytes.
+ */
+bool cache_key(const char *infn, const parms_t *pm, int compression, char *key /* [17] */) {
+    cache_hash_t hs; cache_hash_init(&hs);
+
+    cache_hash_value(&hs, CACHE_VERSION);
+    cache_hash_value(&hs, SPRITE_EXT_VERSION);
+    if (!cache_hash_file(&hs, infn))
+        return false;
+    cache_hash_value(&hs, pm->outfmt);
+    cache_hash_value(&hs, pm->hslices); cache_hash_value(&hs, pm->vslices);
+    cache_hash_value(&hs, pm->tilew);   cache_hash_value(&hs, pm->tileh);
+    cache_hash_value(&hs, pm->mipmap_algo);
+    cache_hash_value(&hs, pm->dither_algo);
+    cache_hash_value(&hs, pm->quant_algo);
+    cache_hash_value(&hs, pm->tiled);
+    cache_hash_value(&hs, pm->autofmt.enabled);
+    if (pm->autofmt.enabled) {
+        cache_hash_value(&hs, pm->autofmt.min_psnr);
+        cache_hash_value(&hs, pm->autofmt.max_err);
+    }
+    cache_hash_texparms(&hs, &pm->texparms);
+    cache_hash_value(&hs, pm->detail.enabled);
+    if (pm->detail.enabled) {
+        cache_hash_value(&hs, pm->detail.use_main_tex);
+        if (pm->detail.infn && !cache_hash_file(&hs, pm->detail.infn))
+            return false;
+        cache_hash_texparms(&hs, &pm->detail.texparms);
+        cache_hash_value(&hs, pm->detail.outfmt);
+        cache_hash_value(&hs, pm->detail.blend_factor);
+    }
+    cache_hash_value(&hs, compression);
+
+    sprintf(key, "%016llx", (unsigned long long)hs.h);
+    return true;
+}
+
+static bool copy_file(const char *src, const char *dst) {
+    FILE *in = fopen(src, "rb");
+    if (!in) return false;
+    FILE *out = fopen(dst, "wb");
+    if (!out) { fclose(in); return false; }
+    uint8_t buf[16384]; size_t n; bool ok = true;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        if (fwrite(buf, 1, n, out) != n) { ok = false; break; }
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    return ok;
+}
+
+// Fetch a file from the cache. Returns true on cache hit.
+bool cache_fetch(const char *cachedir, const char *key, const char *outfn) {
+    char *cachefn;
+    asprintf(&cachefn, "%s/%s.sprite", cachedir, key);
+    bool hit = copy_file(cachefn, outfn);
+    if (!hit) remove(outfn);
+    free(cachefn);
+    return hit;
+}
+
+// Store a file into the cache. The file is first copied with a temporary
+// name and then renamed, so that concurrent jobs never see partial files.
+void cache_store(const char *cachedir, const char *key, const char *outfn) {
+    char *cachefn, *tmpfn;
+    asprintf(&cachefn, "%s/%s.sprite", cachedir, key);
+    asprintf(&tmpfn, "%s/%s.%d.tmp", cachedir, key, (int)getpid());
+    if (!copy_file(outfn, tmpfn) || rename(tmpfn, cachefn) != 0) {
+        fprintf(stderr, "WARNING: cannot store %s into cache %s\n", outfn, cachedir);
+        remove(tmpfn);
+    }
+    free(cachefn);
+    free(tmpfn);
+}
+
+/************************************************************************
+ * Job pool
+ * 
+ * With -j N, each input file is converted in a forked child process, with
+ * up to N running at once. Each child gets a snapshot of the parameters as
+ * they were when the file was found on the command line.
+ ************************************************************************/
+
+int flag_jobs = 1;
+const char *cache_dir = NULL;
+static int jobs_running = 0;
+static bool jobs_failed = false;
+
+// Convert a single file, going through the cache if enabled
+int convert_file(const char *infn, const char *outfn, const parms_t *pm, int compression) {
+    // Debug dumps are a side effect of the conversion, so bypass the cache
+    char key[17];
+    bool use_cache = cache_dir && !flag_debug && cache_key(infn, pm, compression, key);
+
+    if (use_cache && cache_fetch(cache_dir, key, outfn)) {
+        if (flag_verbose)
+            fprintf(stderr, "cached: %s -> %s [%s]\n", infn, outfn, key);
+        return 0;
+    }
+
+    if (convert(infn, outfn, pm) != 0)
+        return 1;
+    compress_output(outfn, compression);
+
+    if (use_cache)
+        cache_store(cache_dir, key, outfn);
+    return 0;
+}
+
+#ifndef __MINGW32__
+static void job_wait_one(void) {
+    int status;
+    if (wait(&status) > 0) {
+        jobs_running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            jobs_failed = true;
+    }
+}
+#endif
+
+void convert_job(const char *infn, const char *outfn, const parms_t *pm, int compression) {
+    #ifndef __MINGW32__
+    if (flag_jobs > 1) {
+        while (jobs_running >= flag_jobs)
+            job_wait_one();
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0)
+            exit(convert_file(infn, outfn, pm, compression));
+        if (pid > 0) {
+            jobs_running++;
+            return;
+        }
+        // fork() failed: just convert in this process.
+    }
+    #endif
+    if (convert_file(infn, outfn, pm, compression) != 0)
+        jobs_failed = true;
+}
+
+bool jobs_wait_all(void) {
+    #ifndef __MINGW32__
+    while (jobs_running > 0)
+        job_wait_one();
+    #endif
+    return !jobs_failed;
+}
+
+/************************************************************************
+ * Atlas mode
+ * 
+ * In atlas mode, all the input images are packed into a single sprite
+ * (or a few, if they don't fit in the maximum sheet size), and a table
+ * mapping each input name to its rectangle is embedded in the sprite.
+ ************************************************************************/
+
+typedef struct {
+    const char *infn;       // Input file
+    char *name;             // Name of the sub-image (basename without extension)
+    image_t image;          // Loaded image
+    int sheet;              // Index of the sheet the image was packed into
+    int x, y;               // Position within the sheet
+} atlas_input_t;
+
+typedef struct {
+    int x, y;               // Left edge and height of this skyline segment
+    int width;              // Width of this skyline segment
+} skyline_node_t;
+
+typedef struct {
+    int width, height;      // Maximum size of the sheet
+    int used_w, used_h;     // Bounding box of the packed rectangles
+    int num_nodes;          // Number of nodes in the skyline
+    skyline_node_t *nodes;  // Skyline nodes, sorted by x
+} skyline_t;
+
+void skyline_init(skyline_t *sk, int width, int height) {
+    sk->width = width;
+    sk->height = height;
+    sk->used_w = sk->used_h = 0;
+    sk->nodes = realloc(sk->nodes, (width+1) * sizeof(skyline_node_t));
+    sk->nodes[0] = (skyline_node_t){ .x = 0, .y = 0, .width = width };
+    sk->num_nodes = 1;
+}
+
+// Check if a w*h rectangle fits with its left edge on the specified node.
+// Returns the y coordinate it would be placed at, or -1 if it does not fit.
+static int skyline_fit(skyline_t *sk, int idx, int w, int h) {
+    if (sk->nodes[idx].x + w > sk->width)
+        return -1;
+    int y = 0;
+    for (int i=idx; w > 0; i++) {
+        assert(i < sk->num_nodes);
+        if (sk->nodes[i].y > y) y = sk->nodes[i].y;
+        if (y + h > sk->height)
+            return -1;
+        w -= sk->nodes[i].width;
+    }
+    return y;
+}
+
+// Insert a w*h rectangle using the bottom-left heuristic.
+bool skyline_insert(skyline_t *sk, int w, int h, int *outx, int *outy) {
+    int best = -1, best_y = 0;
+    for (int i=0; i<sk->num_nodes; i++) {
+        int y = skyline_fit(sk, i, w, h);
+        if (y < 0) continue;
+        if (best < 0 || y < best_y || (y == best_y && sk->nodes[i].width < sk->nodes[best].width)) {
+            best = i;
+            best_y = y;
+        }
+    }
+    if (best < 0)
+        return false;
+
+    skyline_node_t node = { .x = sk->nodes[best].x, .y = best_y + h, .width = w };
+    memmove(&sk->nodes[best+1], &sk->nodes[best], (sk->num_nodes - best) * sizeof(skyline_node_t));
+    sk->nodes[best] = node;
+    sk->num_nodes++;
+
+    // Shrink or remove the nodes now covered by the new one
+    for (int i=best+1; i<sk->num_nodes; ) {
+        int shrink = node.x + node.width - sk->nodes[i].x;
+        if (shrink <= 0) break;
+        sk->nodes[i].x += shrink;
+        sk->nodes[i].width -= shrink;
+        if (sk->nodes[i].width > 0) break;
+        memmove(&sk->nodes[i], &sk->nodes[i+1], (sk->num_nodes - i - 1) * sizeof(skyline_node_t));
+        sk->num_nodes--;
+    }
+
+    // Merge adjacent nodes at the same height
+    for (int i=0; i<sk->num_nodes-1; ) {
+        if (sk->nodes[i].y == sk->nodes[i+1].y) {
+            sk->nodes[i].width += sk->nodes[i+1].width;
+            memmove(&sk->nodes[i+1], &sk->nodes[i+2], (sk->num_nodes - i - 2) * sizeof(skyline_node_t));
+            sk->num_nodes--;
+        } else {
+            i++;
+        }
+    }
+
+    if (node.x + w > sk->used_w) sk->used_w = node.x + w;
+    if (node.y > sk->used_h) sk->used_h = node.y;
+    *outx = node.x;
+    *outy = best_y;
+    return true;
+}
+
+static int atlas_input_cmp_size(const void *a, const void *b) {
+    const atlas_input_t *ia = a, *ib = b;
+    if (ia->image.height != ib->image.height)
+        return ib->image.height - ia->image.height;
+    return ib->image.width - ia->image.width;
+}
+
+static int atlas_input_cmp_name(const void *a, const void *b) {
+    const atlas_input_t *ia = a, *ib = b;
+    return strcmp(ia->name, ib->name);
+}
+
+/**
+ * @brief Pack the inputs into sheets of the specified maximum size.
+ * 
+ * Inputs must be already sorted by decreasing height. Widths are rounded up
+ * to a multiple of @p align pixels, so that every sub-image starts on a
+ * 8-byte boundary and can be loaded into TMEM without wasting space.
+ * 
+ * @return the number of sheets used, or -1 if an image is larger than the
+ *         sheet. The used size of each sheet is stored into sheet_size.
+ */
+int atlas_pack(atlas_input_t *inputs, int num_inputs, int width, int height, int align, int (*sheet_size)[2]) {
+    skyline_t sk = {0};
+    int num_sheets = 0;
+    int num_packed = 0;
+
+    for (int i=0; i<num_inputs; i++)
+        inputs[i].sheet = -1;
+
+    while (num_packed < num_inputs) {
+        skyline_init(&sk, width, height);
+        for (int i=0; i<num_inputs; i++) {
+            atlas_input_t *in = &inputs[i];
+            if (in->sheet >= 0) continue;
+            if (skyline_insert(&sk, ROUND_UP(in->image.width, align), in->image.height, &in->x, &in->y)) {
+                in->sheet = num_sheets;
+                num_packed++;
+            }
+        }
+        // Stop if the remaining images don't fit even an empty sheet
+        if (sk.used_w == 0) {
+            num_sheets = -1;
+            break;
+        }
+        sheet_size[num_sheets][0] = sk.used_w;
+        sheet_size[num_sheets][1] = sk.used_h;
+        num_sheets++;
+    }
+
+    free(sk.nodes);
+    return num_sheets;
+}
+
+int convert_atlas(const char **infns, int num_inputs, const char *outdir, const char *atlas_name,
+    int atlas_w, int atlas_h, const parms_t *pm, int compression)
+{
+    atlas_input_t *inputs = calloc(num_inputs, sizeof(atlas_input_t));
+    int (*sheet_size)[2] = calloc(num_inputs, sizeof(*sheet_size));
+    int ret = 1;
+
+    if (pm->mipmap_algo != MIPMAP_ALGO_NONE || pm->detail.enabled) {
+        fprintf(stderr, "ERROR: mipmaps and detail textures are not supported in atlas mode\n");
+        goto end;
+    }
+    if (pm->tiled) {
+        fprintf(stderr, "ERROR: pre-tiled layout (--tiled) is not supported in atlas mode\n");
+        goto end;
+    }
+
+    for (int i=0; i<num_inputs; i++) {
+        const char *basename = strrchr(infns[i], '/');
+        if (!basename) basename = infns[i]; else basename += 1;
+        inputs[i].infn = infns[i];
+        inputs[i].name = strdup(basename);
+        char *ext = strrchr(inputs[i].name, '.');
+        if (ext) *ext = '\0';
+    }
+
+    // Names are used as lookup keys, so they must be unique
+    qsort(inputs, num_inputs, sizeof(atlas_input_t), atlas_input_cmp_name);
+    for (int i=1; i<num_inputs; i++) {
+        if (!strcmp(inputs[i-1].name, inputs[i].name)) {
+            fprintf(stderr, "ERROR: duplicate atlas name \"%s\" (%s, %s)\n", inputs[i].name, inputs[i-1].infn, inputs[i].infn);
+            goto end;
+        }
+    }
+
+    // All the images share a single format. If not specified, use the
+    // autodetected one if all images agree, or fallback to RGBA16.
+    tex_format_t fmt = pm->outfmt;
+    if (fmt == FMT_NONE) {
+        for (int i=0; i<num_inputs; i++) {
+            image_t img; palette_t pal;
+            if (!load_png_image(inputs[i].infn, FMT_NONE, &img, &pal))
+                goto end;
+            free(img.image);
+            if (i == 0) fmt = img.fmt;
+            else if (fmt != img.fmt) {
+                fmt = FMT_RGBA16;
+                break;
+            }
+        }
+        if (flag_verbose)
+            fprintf(stderr, "atlas format: %s\n", tex_format_name(fmt));
+    }
+    if (fmt == FMT_ZBUF || fmt == FMT_IHQ) {
+        fprintf(stderr, "ERROR: format %s is not supported in atlas mode\n", tex_format_name(fmt));
+        goto end;
+    }
+
+    // Load all the images. Palettized images are expanded to RGBA, as the
+    // whole sheet will be quantized to a single palette.
+    int align = TEX_FORMAT_BYTES2PIX(fmt, 8);
+    atlas_w = atlas_w / align * align;
+    tex_format_t load_fmt = (fmt == FMT_CI8 || fmt == FMT_CI4) ? FMT_RGBA32 : fmt;
+    for (int i=0; i<num_inputs; i++) {
+        palette_t pal;
+        if (!load_png_image(inputs[i].infn, load_fmt, &inputs[i].image, &pal))
+            goto end;
+        if (ROUND_UP(inputs[i].image.width, align) > atlas_w || inputs[i].image.height > atlas_h) {
+            fprintf(stderr, "ERROR: %s (%dx%d) does not fit in the atlas size (%dx%d)\n",
+                inputs[i].infn, inputs[i].image.width, inputs[i].image.height, atlas_w, atlas_h);
+            goto end;
+        }
+    }
+
+    // Pack the images. If everything fits in one sheet, try also narrower
+    // sheets and keep the one with the smallest area, to avoid generating
+    // very wide and short sheets.
+    qsort(inputs, num_inputs, sizeof(atlas_input_t), atlas_input_cmp_size);
+    int best_w = atlas_w;
+    int num_sheets = atlas_pack(inputs, num_inputs, atlas_w, atlas_h, align, sheet_size);
+    if (num_sheets == 1) {
+        int best_area = sheet_size[0][0] * sheet_size[0][1];
+        for (int w = align; w < atlas_w; w *= 2) {
+            if (atlas_pack(inputs, num_inputs, w, atlas_h, align, sheet_size) == 1 &&
+                sheet_size[0][0] * sheet_size[0][1] < best_area) {
+                best_area = sheet_size[0][0] * sheet_size[0][1];
+                best_w = w;
+            }
+        }
+        atlas_pack(inputs, num_inputs, best_w, atlas_h, align, sheet_size);
+    }
+    qsort(inputs, num_inputs, sizeof(atlas_input_t), atlas_input_cmp_name);
+
+    // Compose and write each sheet
+    int bpp = inputs[0].image.ct == LCT_RGBA ? 4 : inputs[0].image.ct == LCT_GREY_ALPHA ? 2 : 1;
+    ret = 0;
+    for (int s=0; s<num_sheets && ret == 0; s++) {
+        char *outfn;
+        if (s == 0) asprintf(&outfn, "%s/%s.sprite", outdir, atlas_name);
+        else        asprintf(&outfn, "%s/%s.%d.sprite", outdir, atlas_name, s);
+
+        int sw = sheet_size[s][0], sh = sheet_size[s][1];
+        uint8_t *pixels = calloc(sw * sh, bpp);
+        atlas_rect_t *rects = calloc(num_inputs, sizeof(atlas_rect_t));
+        int num_rects = 0, used_pixels = 0;
+        for (int i=0; i<num_inputs; i++) {
+            atlas_input_t *in = &inputs[i];
+            if (in->sheet != s) continue;
+            for (int y=0; y<in->image.height; y++)
+                memcpy(pixels + ((in->y + y) * sw + in->x) * bpp,
+                    in->image.image + y * in->image.width * bpp, in->image.width * bpp);
+            rects[num_rects++] = (atlas_rect_t){
+                .name = in->name, .x = in->x, .y = in->y,
+                .width = in->image.width, .height = in->image.height,
+            };
+            used_pixels += in->image.width * in->image.height;
+        }
+
+        if (flag_verbose) {
+            fprintf(stderr, "Atlas sheet: %s [fmt=%s size=%dx%d images=%d usage=%.1f%%]\n",
+                outfn, tex_format_name(fmt), sw, sh, num_rects, 100.0f * used_pixels / (sw * sh));
+            for (int i=0; i<num_rects; i++)
+                fprintf(stderr, "  %s: %d,%d %dx%d\n", rects[i].name, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+        }
+
+        spritemaker_t spr;
+        spritemaker_init(&spr, atlas_name, outfn, pm);
+        spr.images[0] = (image_t){
+            .image = pixels, .width = sw, .height = sh,
+            .fmt = fmt, .ct = inputs[0].image.ct,
+        };
+        spr.atlas_rects = rects;
+        spr.num_atlas_rects = num_rects;
+        ret = spritemaker_finish(&spr, pm, MIPMAP_ALGO_NONE);
+        if (ret == 0)
+            compress_output(outfn, compression);
+        free(rects);
+        free(outfn);
+    }
+
+end:
+    for (int i=0; i<num_inputs; i++) {
+        free(inputs[i].name);
+        free(inputs[i].image.image);
+    }
+    free(inputs);
+    free(sheet_size);
+    return ret;
+}
+
 bool cli_parse_texparms(const char *opt, texparms_t *parms)
 {
     char extra;
@@ -1364,6 +2492,8 @@ int main(int argc, char *argv[])
     char *infn = NULL, *outdir = ".", *outfn = NULL;
     parms_t pm = {0}; int compression = -1;
     bool at_least_one_file = false;
+    char *atlas_name = NULL; int atlas_w = 512, atlas_h = 512;
+    const char **atlas_files = NULL; int num_atlas_files = 0;
 
     if (argc < 2) {
         print_args(argv[0]);
@@ -1479,6 +2609,52 @@ int main(int argc, char *argv[])
                 }
             } 
             
+            /* ---------------- AUTO FORMAT ERROR BUDGET console arguments ------------------- */
+            /* --auto-psnr <dB>      Minimum PSNR for error-budgeted AUTO format selection             */
+            /* --auto-maxerr <n>     Maximum channel error for error-budgeted AUTO format selection             */
+            else if (!strcmp(argv[i], "--auto-psnr") || !strcmp(argv[i], "--auto-maxerr")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                if (!pm.autofmt.enabled) {
+                    pm.autofmt.enabled = true;
+                    pm.autofmt.min_psnr = 0;
+                    pm.autofmt.max_err = 255;
+                }
+                char extra; bool ok;
+                if (!strcmp(argv[i-1], "--auto-psnr"))
+                    ok = sscanf(argv[i], "%f%c", &pm.autofmt.min_psnr, &extra) == 1 && pm.autofmt.min_psnr >= 0;
+                else
+                    ok = sscanf(argv[i], "%d%c", &pm.autofmt.max_err, &extra) == 1 && pm.autofmt.max_err >= 0 && pm.autofmt.max_err <= 255;
+                if (!ok) {
+                    fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
+                    return 1;
+                }
+            }
+
+            /* ---------------- QUANTIZER console argument ------------------- */
+            /* --quantizer <algo>    Palette quantization algorithm (default: EXOQUANT)             */
+            else if (!strcmp(argv[i], "--quantizer")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                if (!strcmp(argv[i], "EXOQUANT")) pm.quant_algo = QUANT_ALGO_EXOQUANT;
+                else if (!strcmp(argv[i], "MEDIANCUT")) pm.quant_algo = QUANT_ALGO_MEDIANCUT;
+                else {
+                    fprintf(stderr, "invalid quantizer: %s\n", argv[i]);
+                    print_supported_quantizers();
+                    return 1;
+                }
+            }
+
+            /* ---------------- TILED console argument ------------------- */
+            /* --tiled               Store the image pre-tiled in TMEM-sized blocks             */
+            else if (!strcmp(argv[i], "--tiled")) {
+                pm.tiled = true;
+            }
+
             /* ---------------- COMPRESS console argument ------------------- */
             /* -c/--compress         Compress output files (using mksasset)             */
             else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compress")) {
@@ -1570,6 +2746,60 @@ int main(int argc, char *argv[])
                 if (!cli_parse_texparms(argv[i], &pm.detail.texparms))
                     return 1;
             }
+
+            /* ---------------- JOBS console argument ------------------- */
+            /* -j/--jobs <N>         Convert up to N files in parallel             */
+            else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                char extra;
+                if (sscanf(argv[i], "%d%c", &flag_jobs, &extra) != 1 || flag_jobs < 1) {
+                    fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
+                    return 1;
+                }
+            }
+
+            /* ---------------- CACHE console argument ------------------- */
+            /* --cache <dir>         Reuse previous conversions stored in <dir>             */
+            else if (!strcmp(argv[i], "--cache")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                cache_dir = argv[i];
+                #ifndef __MINGW32__
+                mkdir(cache_dir, 0777);
+                #else
+                mkdir(cache_dir);
+                #endif
+            }
+
+            /* ---------------- ATLAS console argument ------------------- */
+            /* --atlas <name>         Pack all input images into a single sprite             */
+            else if (!strcmp(argv[i], "--atlas")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                atlas_name = argv[i];
+            }
+
+            /* ---------------- ATLAS SIZE console argument ------------------- */
+            /* --atlas-size <w,h>     Maximum size of an atlas sheet             */
+            else if (!strcmp(argv[i], "--atlas-size")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                char extra;
+                if (sscanf(argv[i], "%d,%d%c", &atlas_w, &atlas_h, &extra) != 2 ||
+                    atlas_w <= 0 || atlas_h <= 0 || atlas_w > 1024 || atlas_h > 1024) {
+                    fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
+                    return 1;
+                }
+            }
             
             else {
                 fprintf(stderr, "invalid flag: %s\n", argv[i]);
@@ -1580,6 +2810,13 @@ int main(int argc, char *argv[])
 
         at_least_one_file = true;
         infn = argv[i];
+        if (atlas_name) {
+            // In atlas mode, inputs are converted together at the end
+            atlas_files = realloc(atlas_files, (num_atlas_files+1) * sizeof(char*));
+            atlas_files[num_atlas_files++] = infn;
+            continue;
+        }
+
         char *basename = strrchr(infn, '/');
         if (!basename) basename = infn; else basename += 1;
         char* basename_noext = strdup(basename);
@@ -1588,23 +2825,27 @@ int main(int argc, char *argv[])
 
         asprintf(&outfn, "%s/%s.sprite", outdir, basename_noext);
 
-        if (convert(infn, outfn, &pm) != 0) {
-            error = true;
-        } else {
-            if (compression == -1)
-                compression = DEFAULT_COMPRESSION;
-            if (compression) {
-                struct stat st_decomp = {0}, st_comp = {0};
-                stat(outfn, &st_decomp);
-                asset_compress(outfn, outfn, compression, 0);
-                stat(outfn, &st_comp);
-                if (flag_verbose)
-                    fprintf(stderr, "compressed: %s (%d -> %d, ratio %.1f%%)\n", outfn,
-                    (int)st_decomp.st_size, (int)st_comp.st_size, 100.0 * (float)st_comp.st_size / (float)(st_decomp.st_size == 0 ? 1 :st_decomp.st_size));
-            }
-        }
+        if (compression == -1)
+            compression = DEFAULT_COMPRESSION;
+        convert_job(infn, outfn, &pm, compression);
 
         free(outfn);
+        free(basename_noext);
+    }
+
+    if (!jobs_wait_all())
+        error = true;
+
+    if (atlas_name) {
+        if (num_atlas_files == 0) {
+            fprintf(stderr, "atlas mode requires at least one input file\n");
+            return 1;
+        }
+        if (compression == -1)
+            compression = DEFAULT_COMPRESSION;
+        if (convert_atlas(atlas_files, num_atlas_files, outdir, atlas_name, atlas_w, atlas_h, &pm, compression) != 0)
+            error = true;
+        free(atlas_files);
     }
 
     if (!at_least_one_file) {
@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define STBDS_NO_SHORT_NAMES
+#define STB_DS_IMPLEMENTATION
+#include "common/stb_ds.h"
+
+#include "common/polyfill.h"
+
+bool flag_verbose = false;
+bool flag_inlines = true;
+bool flag_flat = false;
+
+void usage(const char *progname)
+{
+    fprintf(stderr, "%s - Symbolize profiles recorded by the libdragon sampling profiler\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Usage: %s [flags] <program.sym> [<profile.txt>]\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "The profile is the output of profile_flush(), and can be mixed with other\n");
+    fprintf(stderr, "log output. If no profile file is specified, it is read from stdin.\n");
+    fprintf(stderr, "By default, the output is a list of folded stacks (one per line, with\n");
+    fprintf(stderr, "the number of samples), which is the input format of flamegraph.pl.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Command-line flags:\n");
+    fprintf(stderr, "   -v/--verbose          Verbose output\n");
+    fprintf(stderr, "   -o/--output <file>    Output file (default: stdout)\n");
+    fprintf(stderr, "   -f/--flat             Output a flat profile (samples per function)\n");
+    fprintf(stderr, "   --no-inlines          Do not expand inlined functions\n");
+    fprintf(stderr, "\n");
+}
+
+/** @brief SYMT file loaded in memory (see symtable_header_t in backtrace.c) */
+struct {
+    uint8_t *data;
+    int size;
+    uint32_t addrtab_off, symtab_off, strtab_off;
+    int num_entries;
+} symt;
+
+uint32_t r32(uint32_t off) {
+    uint8_t *p = symt.data + off;
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+uint16_t r16(uint32_t off) {
+    uint8_t *p = symt.data + off;
+    return (p[0] << 8) | p[1];
+}
+
+#define ADDRENTRY_ADDR(e)       ((e) & ~3)
+#define ADDRENTRY_IS_FUNC(e)    ((e) &  1)
+#define ADDRENTRY_IS_INLINE(e)  ((e) &  2)
+
+bool symt_load(const char *fn)
+{
+    FILE *f = fopen(fn, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: cannot open file: %s\n", fn);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    symt.size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    symt.data = malloc(symt.size);
+    if (fread(symt.data, 1, symt.size, f) != symt.size) {
+        fprintf(stderr, "Error: cannot read file: %s\n", fn);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    if (symt.size < 32 || memcmp(symt.data, "SYMT", 4) != 0) {
+        fprintf(stderr, "Error: not a symbol table file: %s\n", fn);
+        return false;
+    }
+    if (r32(4) != 2) {
+        fprintf(stderr, "Error: unsupported symbol table version %d\n", r32(4));
+        return false;
+    }
+    symt.addrtab_off = r32(8);
+    symt.num_entries = r32(12);
+    symt.symtab_off = r32(16);
+    symt.strtab_off = r32(24);
+    if (symt.num_entries == 0 ||
+        symt.addrtab_off + symt.num_entries * 4 > symt.size ||
+        symt.symtab_off + symt.num_entries * 16 > symt.size ||
+        symt.strtab_off + r32(28) > symt.size) {
+        fprintf(stderr, "Error: corrupted symbol table: %s\n", fn);
+        return false;
+    }
+    return true;
+}
+
+uint32_t symt_addr(int idx) { return r32(symt.addrtab_off + idx * 4); }
+
+// Same search as symt_addrtab_search in backtrace.c
+int symt_search(uint32_t addr)
+{
+    int min = 0, max = symt.num_entries - 1;
+    while (min < max) {
+        int mid = (min + max) / 2;
+        if (addr <= ADDRENTRY_ADDR(symt_addr(mid)))
+            max = mid;
+        else
+            min = mid + 1;
+    }
+    if (min > 0 && ADDRENTRY_ADDR(symt_addr(min)) > addr)
+        --min;
+    return min;
+}
+
+char *symt_func(int idx)
+{
+    uint32_t e = symt.symtab_off + idx * 16;
+    uint32_t sidx = r32(e + 0);
+    uint16_t len = r16(e + 8);
+    return strndup((char*)symt.data + symt.strtab_off + sidx, len);
+}
+
+/**
+ * @brief Append the functions of a frame to a stack, from the outermost
+ *
+ * An address with an exact match in the symbol table (a call site) can
+ * expand into multiple inlined functions. Other addresses (like the sampled
+ * PC) are attributed to their containing function.
+ */
+void symbolize(uint32_t addr, char ***stack)
+{
+    int idx = symt_search(addr);
+    uint32_t e = symt_addr(idx);
+
+    if (ADDRENTRY_ADDR(e) == addr && flag_inlines) {
+        // Entries at the same address go from the innermost inline to the
+        // real function.
+        int first = idx;
+        while (ADDRENTRY_IS_INLINE(symt_addr(idx)) && idx + 1 < symt.num_entries)
+            idx++;
+        for (int i = idx; i >= first; i--)
+            stbds_arrput(*stack, symt_func(i));
+        return;
+    }
+
+    if (ADDRENTRY_ADDR(e) > addr) {
+        // Before the first symbol
+        char *s; asprintf(&s, "0x%08x", addr);
+        stbds_arrput(*stack, s);
+        return;
+    }
+    while (idx > 0 && !ADDRENTRY_IS_FUNC(e))
+        e = symt_addr(--idx);
+    // The last entry at this address is the real function
+    while (ADDRENTRY_IS_INLINE(symt_addr(idx)) && idx + 1 < symt.num_entries)
+        idx++;
+    stbds_arrput(*stack, symt_func(idx));
+}
+
+struct { char *key; int value; } *folded = NULL;
+struct { char *key; int value; } *flat = NULL;
+
+int sort_by_count(const void *a, const void *b)
+{
+    const typeof(*flat) *fa = a, *fb = b;
+    return fb->value - fa->value;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outfn = NULL;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+            flag_verbose = true;
+        } else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--flat")) {
+            flag_flat = true;
+        } else if (!strcmp(argv[i], "--no-inlines")) {
+            flag_inlines = false;
+        } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                return 1;
+            }
+            outfn = argv[i];
+        } else {
+            fprintf(stderr, "invalid flag: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (i == argc) {
+        fprintf(stderr, "missing symbol table filename\n");
+        return 1;
+    }
+    if (!symt_load(argv[i]))
+        return 1;
+
+    FILE *in = stdin;
+    if (i < argc-1) {
+        in = fopen(argv[i+1], "r");
+        if (!in) {
+            fprintf(stderr, "Error: cannot open file: %s\n", argv[i+1]);
+            return 1;
+        }
+    }
+    FILE *out = stdout;
+    if (outfn) {
+        out = fopen(outfn, "w");
+        if (!out) {
+            fprintf(stderr, "Error: cannot create file: %s\n", outfn);
+            return 1;
+        }
+    }
+
+    stbds_sh_new_strdup(folded);
+    stbds_shdefault(folded, 0);
+    stbds_sh_new_strdup(flat);
+    stbds_shdefault(flat, 0);
+
+    char *line = NULL; size_t line_size = 0;
+    bool in_profile = false;
+    int num_profiles = 0, total = 0, lost = 0;
+    while (getline(&line, &line_size, in) != -1) {
+        if (!strncmp(line, "PROF1 ", 6)) {
+            in_profile = true;
+            num_profiles++;
+            continue;
+        }
+        if (!in_profile)
+            continue;
+        if (!strncmp(line, "PROFEND ", 8)) {
+            int ns = 0, nl = 0;
+            sscanf(line + 8, "%d %d", &ns, &nl);
+            lost += nl;
+            in_profile = false;
+            continue;
+        }
+        if (line[0] != 'S')
+            continue;
+
+        char *p = line + 1;
+        int count = 1;
+        if (*p == '*')
+            count = strtol(p + 1, &p, 10);
+
+        // Frames are listed from the innermost: collect them, then
+        // symbolize from the outermost.
+        uint32_t addrs[64]; int n = 0;
+        while (n < 64) {
+            char *end;
+            uint32_t addr = strtoul(p, &end, 16);
+            if (end == p) break;
+            addrs[n++] = addr;
+            p = end;
+        }
+        if (n == 0)
+            continue;
+
+        char **stack = NULL;
+        for (int j = n-1; j >= 0; j--)
+            symbolize(addrs[j], &stack);
+
+        char *key = NULL;
+        for (int j = 0; j < stbds_arrlen(stack); j++) {
+            if (j) stbds_arrput(key, ';');
+            int len = strlen(stack[j]);
+            memcpy(stbds_arraddnptr(key, len), stack[j], len);
+        }
+        stbds_arrput(key, 0);
+
+        int cur = stbds_shget(folded, key);
+        stbds_shput(folded, key, cur + count);
+        char *self = stack[stbds_arrlen(stack)-1];
+        cur = stbds_shget(flat, self);
+        stbds_shput(flat, self, cur + count);
+        total += count;
+
+        for (int j = 0; j < stbds_arrlen(stack); j++)
+            free(stack[j]);
+        stbds_arrfree(stack);
+        stbds_arrfree(key);
+    }
+    free(line);
+
+    if (!num_profiles) {
+        fprintf(stderr, "Error: no profile found in the input\n");
+        return 1;
+    }
+    if (flag_verbose)
+        fprintf(stderr, "Read %d profiles, %d samples (%d lost)\n", num_profiles, total, lost);
+
+    if (flag_flat) {
+        qsort(flat, stbds_shlen(flat), sizeof(*flat), sort_by_count);
+        for (int j = 0; j < stbds_shlen(flat); j++)
+            fprintf(out, "%6.2f%% %8d  %s\n", 100.0f * flat[j].value / total, flat[j].value, flat[j].key);
+    } else {
+        for (int j = 0; j < stbds_shlen(folded); j++)
+            fprintf(out, "%s %d\n", folded[j].key, folded[j].value);
+    }
+
+    if (out != stdout) fclose(out);
+    if (in != stdin) fclose(in);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <sys/time.h>
 
 #define STBDS_NO_SHORT_NAMES
 #define STB_DS_IMPLEMENTATION
@@ -12,10 +13,14 @@
 #include "common/subprocess.h"
 #include "common/polyfill.h"
 #include "common/utils.h"
+#include "n64sym_elf.h"
 
 bool flag_verbose = false;
 int flag_max_sym_len = 64;
 bool flag_inlines = true;
+bool flag_binutils = false;
+bool flag_compare = false;
+int flag_jobs = 0;
 const char *n64_inst = NULL;
 
 // Printf if verbose
@@ -38,8 +43,14 @@ void usage(const char *progname)
     fprintf(stderr, "   -v/--verbose          Verbose output\n");
     fprintf(stderr, "   -m/--max-len <N>      Maximum symbol length (default: 64)\n");
     fprintf(stderr, "   --no-inlines          Do not export inlined symbols\n");
+    fprintf(stderr, "   -j/--jobs <N>         Number of threads used to parse debug info (default: all CPUs)\n");
+    fprintf(stderr, "   --binutils            Extract symbols with objdump and addr2line from the toolchain\n");
+    fprintf(stderr, "   --compare             Run both the builtin ELF reader and binutils, report their\n");
+    fprintf(stderr, "                         timings and check that the outputs are identical\n");
     fprintf(stderr, "\n");
-    fprintf(stderr, "This program requires a libdragon toolchain installed in $N64_INST.\n");
+    fprintf(stderr, "By default, symbols are extracted by parsing the ELF and DWARF debug information\n");
+    fprintf(stderr, "directly. The --binutils and --compare modes require a libdragon toolchain\n");
+    fprintf(stderr, "installed in $N64_INST.\n");
 }
 
 char *stringtable = NULL;
@@ -112,6 +123,27 @@ struct symtable_s {
     bool is_func, is_inline;
 } *symtable = NULL;
 
+void symbol_push(uint32_t addr, bool is_func, const char *func_name, const char *file, int line)
+{
+    // If the function of name is longer than 64 bytes, truncate it. This also
+    // avoid paradoxically long function names like in C++ that can even be
+    // several thousands of characters long.
+    int n = strlen(func_name);
+    char *func = strndup(func_name, MIN(n, flag_max_sym_len));
+    if (n > flag_max_sym_len) strcpy(&func[flag_max_sym_len-3], "...");
+
+    // Add the callsite to the list
+    stbds_arrput(symtable, ((struct symtable_s) {
+        .uuid = stbds_arrlen(symtable),
+        .addr = addr,
+        .func = func,
+        .file = strdup(file),
+        .line = line,
+        .is_func = is_func,
+        .is_inline = true,
+    }));
+}
+
 void symbol_add(const char *elf, uint32_t addr, bool is_func)
 {
     // We keep one addr2line process open for the last ELF file we processed.
@@ -174,12 +206,7 @@ void symbol_add(const char *elf, uint32_t addr, bool is_func)
         int n = getline(&line_buf, &line_buf_size, addr2line_r);
         assert(n != -1);
         if (strncmp(line_buf, "0x00000000", 10) == 0) break;
-
-        // If the function of name is longer than 64 bytes, truncate it. This also
-        // avoid paradoxically long function names like in C++ that can even be
-        // several thousands of characters long.
-        char *func = strndup(line_buf, MIN(n-1, flag_max_sym_len));
-        if (n-1 > flag_max_sym_len) strcpy(&func[flag_max_sym_len-3], "...");
+        char *func = strndup(line_buf, n-1);
 
         // Second line is the file name and line number
         int ret = getline(&line_buf, &line_buf_size, addr2line_r);
@@ -188,16 +215,9 @@ void symbol_add(const char *elf, uint32_t addr, bool is_func)
         char *file = strndup(line_buf, colon - line_buf);
         int line = atoi(colon + 1);
 
-        // Add the callsite to the list
-        stbds_arrput(symtable, ((struct symtable_s) {
-            .uuid = stbds_arrlen(symtable),
-            .addr = addr,
-            .func = func,
-            .file = file,
-            .line = line,
-            .is_func = is_func,
-            .is_inline = true,
-        }));
+        symbol_push(addr, is_func, func, file, line);
+        free(func);
+        free(file);
         at_least_one = true;
     }
     assert(at_least_one);
@@ -245,6 +265,41 @@ bool elf_find_callsites(const char *elf)
 #endif
 }
 
+struct native_ctx_s {
+    elfsym_t *elf;
+    uint32_t addr;
+    bool is_func;
+};
+
+void native_frame(void *arg, const char *func, const char *file, int line)
+{
+    struct native_ctx_s *ctx = arg;
+    symbol_push(ctx->addr, ctx->is_func, func, file, line);
+}
+
+void native_callsite(void *arg, uint32_t addr, bool is_func)
+{
+    struct native_ctx_s *ctx = arg;
+    ctx->addr = addr;
+    ctx->is_func = is_func;
+    elfsym_addr2line(ctx->elf, addr, flag_inlines, native_frame, ctx);
+    symtable[stbds_arrlen(symtable)-1].is_inline = false;
+}
+
+bool elf_find_callsites_native(const char *elf)
+{
+    // Parse the ELF file and its debug info in-process. The callsites and
+    // their symbols are the same that objdump and addr2line would report.
+    verbose("Parsing: %s\n", elf);
+    elfsym_t *e = elfsym_open(elf, flag_jobs);
+    if (!e)
+        return false;
+    struct native_ctx_s ctx = { .elf = e };
+    elfsym_find_callsites(e, native_callsite, &ctx);
+    elfsym_close(e);
+    return true;
+}
+
 void compute_function_offsets(void)
 {
     uint32_t func_addr = 0;
@@ -280,15 +335,31 @@ int symtable_sort_by_func(const void *a, const void *b)
     return sb_len - sa_len;
 }
 
-void process(const char *infn, const char *outfn)
+void symtable_reset(void)
+{
+    for (int i=0; i < stbds_arrlen(symtable); i++) {
+        free(symtable[i].func);
+        free(symtable[i].file);
+    }
+    stbds_arrfree(symtable);
+    stbds_arrfree(stringtable);
+    stbds_shfree(string_hash);
+}
+
+void process(const char *infn, const char *outfn, bool binutils)
 {
     verbose("Processing: %s -> %s\n", infn, outfn);
 
-    // First, find all functions and call sites. We do this by disassembling
-    // the ELF file and grepping it.
-    if (!elf_find_callsites(infn)) {
-        fprintf(stderr, "Error: objdump failed\n");
-        exit(1);
+    // First, find all functions and call sites, either by parsing the ELF
+    // file directly, or by disassembling it and grepping it.
+    if (binutils) {
+        if (!elf_find_callsites(infn)) {
+            fprintf(stderr, "Error: objdump failed\n");
+            exit(1);
+        }
+    } else {
+        if (!elf_find_callsites_native(infn))
+            exit(1);
     }
     verbose("Found %d callsites\n", stbds_arrlen(symtable));
 
@@ -367,6 +438,58 @@ void process(const char *infn, const char *outfn)
     fclose(out);
 }
 
+double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+uint8_t *read_file(const char *fn, int *size)
+{
+    FILE *f = fopen(fn, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*size);
+    *size = fread(data, 1, *size, f);
+    fclose(f);
+    return data;
+}
+
+// Build the symbol table with both extraction methods, and compare them
+bool compare(const char *infn, const char *outfn)
+{
+    char *binfn = NULL;
+    asprintf(&binfn, "%s.binutils", outfn);
+
+    double t0 = now();
+    process(infn, outfn, false);
+    double t1 = now();
+    symtable_reset();
+    process(infn, binfn, true);
+    double t2 = now();
+
+    int size1 = 0, size2 = 0;
+    uint8_t *data1 = read_file(outfn, &size1);
+    uint8_t *data2 = read_file(binfn, &size2);
+    bool same = data1 && data2 && size1 == size2 && memcmp(data1, data2, size1) == 0;
+    free(data1);
+    free(data2);
+
+    printf("builtin:  %8.3f s\n", t1 - t0);
+    printf("binutils: %8.3f s (%.1fx)\n", t2 - t1, (t2 - t1) / (t1 - t0));
+    if (same) {
+        printf("outputs are identical\n");
+        remove(binfn);
+    } else {
+        printf("outputs differ: %s %s\n", outfn, binfn);
+    }
+    free(binfn);
+    return same;
+}
+
 // Change filename extension
 char *change_ext(const char *fn, const char *ext)
 {
@@ -390,6 +513,16 @@ int main(int argc, char *argv[])
             flag_verbose = true;
         } else if (!strcmp(argv[i], "--no-inlines")) {
             flag_inlines = false;
+        } else if (!strcmp(argv[i], "--binutils")) {
+            flag_binutils = true;
+        } else if (!strcmp(argv[i], "--compare")) {
+            flag_compare = true;
+        } else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                return 1;
+            }
+            flag_jobs = atoi(argv[i]);
         } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
             if (++i == argc) {
                 fprintf(stderr, "missing argument for %s\n", argv[i-1]);
@@ -413,9 +546,9 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // Find n64 installation directory
+    // Find n64 installation directory (only needed to run binutils)
     n64_inst = n64_toolchain_dir();
-    if (!n64_inst) {
+    if (!n64_inst && (flag_binutils || flag_compare)) {
         // Do not mention N64_GCCPREFIX in the error message, since it is
         // a seldom used configuration.
         fprintf(stderr, "Error: N64_INST environment variable not set\n");
@@ -436,7 +569,9 @@ int main(int argc, char *argv[])
     }
     fclose(in);
 
-    process(infn, outfn);
+    if (flag_compare)
+        return compare(infn, outfn) ? 0 : 1;
+    process(infn, outfn, flag_binutils);
     return 0;
 }
 
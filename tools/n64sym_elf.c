@@ -0,0 +1,1862 @@
+/**
+ * @file n64sym_elf.c
+ * @brief Native ELF/DWARF symbol extraction for n64sym
+ *
+ * The lookup rules (which compilation unit, line row or function wins, how
+ * names are chosen, when the ELF symbol table is used as a fallback) follow
+ * those of the BFD library used by addr2line, including some of its quirks,
+ * so that the generated symbol table does not depend on which path was used.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define STBDS_NO_SHORT_NAMES
+#include "common/stb_ds.h"
+#include "common/mips_elf.h"
+#include "../src/utils.h"
+
+#include "n64sym_elf.h"
+
+#ifndef SHF_COMPRESSED
+#define SHF_COMPRESSED          0x800
+#endif
+
+// DWARF constants (subset)
+#define DW_TAG_entry_point              0x03
+#define DW_TAG_compile_unit             0x11
+#define DW_TAG_inlined_subroutine       0x1d
+#define DW_TAG_subprogram               0x2e
+
+#define DW_AT_stmt_list                 0x10
+#define DW_AT_low_pc                    0x11
+#define DW_AT_high_pc                   0x12
+#define DW_AT_language                  0x13
+#define DW_AT_name                      0x03
+#define DW_AT_comp_dir                  0x1b
+#define DW_AT_abstract_origin           0x31
+#define DW_AT_specification             0x47
+#define DW_AT_ranges                    0x55
+#define DW_AT_call_file                 0x58
+#define DW_AT_call_line                 0x59
+#define DW_AT_linkage_name              0x6e
+#define DW_AT_str_offsets_base          0x72
+#define DW_AT_addr_base                 0x73
+#define DW_AT_rnglists_base             0x74
+#define DW_AT_MIPS_linkage_name         0x2007
+
+#define DW_FORM_addr                    0x01
+#define DW_FORM_block2                  0x03
+#define DW_FORM_block4                  0x04
+#define DW_FORM_data2                   0x05
+#define DW_FORM_data4                   0x06
+#define DW_FORM_data8                   0x07
+#define DW_FORM_string                  0x08
+#define DW_FORM_block                   0x09
+#define DW_FORM_block1                  0x0a
+#define DW_FORM_data1                   0x0b
+#define DW_FORM_flag                    0x0c
+#define DW_FORM_sdata                   0x0d
+#define DW_FORM_strp                    0x0e
+#define DW_FORM_udata                   0x0f
+#define DW_FORM_ref_addr                0x10
+#define DW_FORM_ref1                    0x11
+#define DW_FORM_ref2                    0x12
+#define DW_FORM_ref4                    0x13
+#define DW_FORM_ref8                    0x14
+#define DW_FORM_ref_udata               0x15
+#define DW_FORM_indirect                0x16
+#define DW_FORM_sec_offset              0x17
+#define DW_FORM_exprloc                 0x18
+#define DW_FORM_flag_present            0x19
+#define DW_FORM_strx                    0x1a
+#define DW_FORM_addrx                   0x1b
+#define DW_FORM_ref_sup4                0x1c
+#define DW_FORM_strp_sup                0x1d
+#define DW_FORM_data16                  0x1e
+#define DW_FORM_line_strp               0x1f
+#define DW_FORM_ref_sig8                0x20
+#define DW_FORM_implicit_const          0x21
+#define DW_FORM_loclistx                0x22
+#define DW_FORM_rnglistx                0x23
+#define DW_FORM_ref_sup8                0x24
+#define DW_FORM_strx1                   0x25
+#define DW_FORM_strx2                   0x26
+#define DW_FORM_strx3                   0x27
+#define DW_FORM_strx4                   0x28
+#define DW_FORM_addrx1                  0x29
+#define DW_FORM_addrx2                  0x2a
+#define DW_FORM_addrx3                  0x2b
+#define DW_FORM_addrx4                  0x2c
+#define DW_FORM_GNU_addr_index          0x1f01
+#define DW_FORM_GNU_str_index           0x1f02
+#define DW_FORM_GNU_ref_alt             0x1f20
+#define DW_FORM_GNU_strp_alt            0x1f21
+
+#define DW_UT_type                      0x02
+#define DW_UT_skeleton                  0x04
+#define DW_UT_split_compile             0x05
+#define DW_UT_split_type                0x06
+
+#define DW_LNS_copy                     0x01
+#define DW_LNS_advance_pc               0x02
+#define DW_LNS_advance_line             0x03
+#define DW_LNS_set_file                 0x04
+#define DW_LNS_set_column               0x05
+#define DW_LNS_negate_stmt              0x06
+#define DW_LNS_set_basic_block          0x07
+#define DW_LNS_const_add_pc             0x08
+#define DW_LNS_fixed_advance_pc         0x09
+#define DW_LNE_end_sequence             0x01
+#define DW_LNE_set_address              0x02
+#define DW_LNE_define_file              0x03
+#define DW_LNE_set_discriminator        0x04
+#define DW_LNCT_path                    0x01
+#define DW_LNCT_directory_index         0x02
+
+#define DW_RLE_end_of_list              0x00
+#define DW_RLE_base_address             0x05
+#define DW_RLE_offset_pair              0x04
+#define DW_RLE_start_end                0x06
+#define DW_RLE_start_length             0x07
+
+/** @brief Bounds-checked reader of ELF/DWARF data */
+typedef struct {
+    const uint8_t *p, *end;
+    bool be;
+    bool err;
+} cur_t;
+
+static uint64_t rdn(cur_t *c, int n)
+{
+    if (c->end - c->p < n) { c->err = true; c->p = c->end; return 0; }
+    uint64_t v = 0;
+    if (c->be) for (int i=0; i<n; i++) v = (v << 8) | c->p[i];
+    else       for (int i=n-1; i>=0; i--) v = (v << 8) | c->p[i];
+    c->p += n;
+    return v;
+}
+
+static uint64_t rduleb(cur_t *c)
+{
+    uint64_t v = 0; int shift = 0;
+    while (c->p < c->end) {
+        uint8_t b = *c->p++;
+        if (shift < 64) v |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) return v;
+    }
+    c->err = true;
+    return v;
+}
+
+static int64_t rdsleb(cur_t *c)
+{
+    int64_t v = 0; int shift = 0; uint8_t b = 0;
+    while (c->p < c->end) {
+        b = *c->p++;
+        if (shift < 64) v |= (int64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) {
+            if (shift < 64 && (b & 0x40)) v |= -((int64_t)1 << shift);
+            return v;
+        }
+    }
+    c->err = true;
+    return v;
+}
+
+static const char *rdstr(cur_t *c)
+{
+    const uint8_t *s = c->p;
+    const uint8_t *z = memchr(s, 0, c->end - s);
+    if (!z) { c->err = true; c->p = c->end; return NULL; }
+    c->p = z + 1;
+    return (const char*)s;
+}
+
+static void skip(cur_t *c, uint64_t n)
+{
+    if (c->end - c->p < n) { c->err = true; c->p = c->end; return; }
+    c->p += n;
+}
+
+/** @brief A range of addresses [low, high) */
+typedef struct { uint64_t low, high; } range_t;
+
+typedef struct {
+    const char *name;
+    uint32_t type, flags, link;
+    uint64_t addr, size;
+    const uint8_t *data;            ///< Contents (NULL for NOBITS sections)
+} elf_section_t;
+
+typedef struct {
+    const char *name;
+    uint64_t value, size;
+    uint8_t type, bind, other;
+    uint32_t shndx;
+} elf_symbol_t;
+
+typedef struct {
+    const uint8_t *data;
+    uint64_t size;
+} dwarf_section_t;
+
+typedef struct {
+    uint32_t name, form;
+    int64_t implicit_const;
+} abbrev_attr_t;
+
+typedef struct {
+    uint64_t code;
+    uint32_t tag;
+    bool has_children;
+    int num_attrs;
+    abbrev_attr_t *attrs;
+} abbrev_t;
+
+/** @brief A function (or inlined function instance) found in the debug info */
+typedef struct {
+    uint32_t tag;
+    const char *name;
+    bool is_linkage;                ///< True if the name must not be replaced by the ELF symbol
+    int caller;                     ///< Index of the function this is inlined into (or -1)
+    const char *caller_file;
+    int caller_line;
+    range_t *ranges;                ///< Address ranges (the first one added goes first)
+} func_t;
+
+typedef struct {
+    uint64_t low, high;             ///< Bounds of the function (high is a running maximum)
+    int func;
+} func_lookup_t;
+
+typedef struct {
+    uint64_t addr;
+    const char *file;
+    int line;
+} line_row_t;
+
+/** @brief A line number sequence: rows sorted by address, ending with the end_sequence row */
+typedef struct {
+    uint64_t low;
+    int first, count;
+} line_seq_t;
+
+/** @brief A compilation unit */
+typedef struct {
+    uint64_t offset, end;           ///< Offsets of the unit in .debug_info
+    uint64_t die_offset;            ///< Offset of the first DIE
+    int version, addr_size, offset_size;
+    uint64_t abbrev_offset;
+    bool error;
+
+    abbrev_t *abbrevs;
+    int num_abbrevs;
+
+    uint32_t lang;
+    const char *comp_dir;
+    uint64_t base_address;
+    uint64_t str_offsets_base, addr_base;
+    bool has_stmt_list;
+    uint64_t stmt_list;
+    range_t *ranges;                ///< Ranges of the unit (from its DIE and its line sequences)
+
+    // Line table
+    bool dir_and_file_0;            ///< DWARF 5: directory and file indices start at 0
+    const char **dirs;
+    struct { const char *name; uint64_t dir; } *files;
+    char **filenames;               ///< Cache of full filenames, by file index
+    line_row_t *rows;
+    line_seq_t *seqs;
+
+    func_t *funcs;
+    func_lookup_t *lookup;
+} cu_t;
+
+struct elfsym_s {
+    uint8_t *data;
+    size_t size;
+    bool is64, be;
+
+    elf_section_t *sections;
+    int num_sections;
+    elf_symbol_t *symbols;
+    int num_symbols;
+
+    dwarf_section_t info, abbrev, line, str, line_str, str_offsets, addr, ranges, rnglists;
+
+    cu_t *cus;
+    int num_cus;
+
+    // Cache of the last function found in the ELF symbol table
+    struct {
+        int section;
+        elf_symbol_t *func;
+        const char *filename;
+        uint64_t code_off, code_size;
+    } fcache;
+};
+
+/** @brief Result of an address lookup */
+typedef struct {
+    const char *file;
+    const char *func;
+    int line;
+    cu_t *chain_cu;
+    func_t *chain;                  ///< Innermost inlined function containing the address
+} query_t;
+
+/***********************************************************************
+ * ELF
+ ***********************************************************************/
+
+static cur_t elf_cur(elfsym_t *elf, uint64_t off, uint64_t size)
+{
+    if (off > elf->size || size > elf->size - off)
+        return (cur_t){ .p = elf->data, .end = elf->data, .be = elf->be, .err = true };
+    return (cur_t){ .p = elf->data + off, .end = elf->data + off + size, .be = elf->be };
+}
+
+static bool elf_parse(elfsym_t *elf, const char *fn)
+{
+    if (elf->size < 52 || memcmp(elf->data, "\x7f" "ELF", 4) != 0) {
+        fprintf(stderr, "Error: not an ELF file: %s\n", fn);
+        return false;
+    }
+    elf->is64 = elf->data[EI_CLASS] == ELFCLASS64;
+    elf->be = elf->data[EI_DATA] == ELFDATA2MSB;
+
+    cur_t c = elf_cur(elf, 0, elf->size);
+    uint64_t shoff; int shentsize, shnum, shstrndx;
+    if (elf->is64) {
+        skip(&c, 0x28); shoff = rdn(&c, 8);
+        skip(&c, 0x3a - 0x30); shentsize = rdn(&c, 2); shnum = rdn(&c, 2); shstrndx = rdn(&c, 2);
+    } else {
+        skip(&c, 0x20); shoff = rdn(&c, 4);
+        skip(&c, 0x2e - 0x24); shentsize = rdn(&c, 2); shnum = rdn(&c, 2); shstrndx = rdn(&c, 2);
+    }
+    if (c.err || shoff == 0) {
+        fprintf(stderr, "Error: invalid ELF header: %s\n", fn);
+        return false;
+    }
+
+    // Read the section headers
+    cur_t sh0 = elf_cur(elf, shoff, shentsize);
+    skip(&sh0, elf->is64 ? 0x20 : 0x14);
+    uint64_t sh0_size = rdn(&sh0, elf->is64 ? 8 : 4);
+    uint32_t sh0_link = rdn(&sh0, 4);
+    if (shnum == 0) shnum = sh0_size;
+    if (shstrndx == SHN_XINDEX) shstrndx = sh0_link;
+
+    elf->sections = calloc(shnum, sizeof(elf_section_t));
+    elf->num_sections = shnum;
+    uint32_t *name_offs = calloc(shnum, sizeof(uint32_t));
+    for (int i=0; i<shnum; i++) {
+        elf_section_t *s = &elf->sections[i];
+        cur_t sh = elf_cur(elf, shoff + (uint64_t)i * shentsize, shentsize);
+        int w = elf->is64 ? 8 : 4;
+        name_offs[i] = rdn(&sh, 4);
+        s->type = rdn(&sh, 4);
+        s->flags = rdn(&sh, w);
+        s->addr = rdn(&sh, w);
+        uint64_t offset = rdn(&sh, w);
+        s->size = rdn(&sh, w);
+        s->link = rdn(&sh, 4);
+        if (sh.err) {
+            fprintf(stderr, "Error: invalid ELF section header: %s\n", fn);
+            free(name_offs);
+            return false;
+        }
+        if (s->type != SHT_NOBITS && s->size) {
+            if (offset > elf->size || s->size > elf->size - offset) {
+                fprintf(stderr, "Error: truncated ELF file: %s\n", fn);
+                free(name_offs);
+                return false;
+            }
+            s->data = elf->data + offset;
+        }
+    }
+    for (int i=0; i<shnum; i++) {
+        elf_section_t *strs = shstrndx < shnum ? &elf->sections[shstrndx] : NULL;
+        if (strs && strs->data && name_offs[i] < strs->size && memchr(strs->data + name_offs[i], 0, strs->size - name_offs[i]))
+            elf->sections[i].name = (const char*)strs->data + name_offs[i];
+        else
+            elf->sections[i].name = "";
+    }
+    free(name_offs);
+
+    // Read the symbol table
+    for (int i=0; i<shnum; i++) {
+        elf_section_t *s = &elf->sections[i];
+        if (s->type != SHT_SYMTAB || !s->data || s->link >= shnum)
+            continue;
+        elf_section_t *strs = &elf->sections[s->link];
+        int entsize = elf->is64 ? 24 : 16;
+        int n = s->size / entsize;
+        elf->symbols = calloc(n, sizeof(elf_symbol_t));
+        // Skip the null symbol at index 0
+        for (int j=1; j<n; j++) {
+            cur_t sc = { .p = s->data + j*entsize, .end = s->data + (j+1)*entsize, .be = elf->be };
+            elf_symbol_t *sym = &elf->symbols[elf->num_symbols++];
+            uint32_t name = rdn(&sc, 4);
+            uint8_t info, other; uint32_t shndx;
+            if (elf->is64) {
+                info = rdn(&sc, 1); other = rdn(&sc, 1); shndx = rdn(&sc, 2);
+                sym->value = rdn(&sc, 8); sym->size = rdn(&sc, 8);
+            } else {
+                sym->value = rdn(&sc, 4); sym->size = rdn(&sc, 4);
+                info = rdn(&sc, 1); other = rdn(&sc, 1); shndx = rdn(&sc, 2);
+            }
+            sym->type = ELF32_ST_TYPE(info);
+            sym->bind = ELF32_ST_BIND(info);
+            sym->other = other;
+            sym->shndx = shndx;
+            if (strs->data && name < strs->size && memchr(strs->data + name, 0, strs->size - name))
+                sym->name = (const char*)strs->data + name;
+            else
+                sym->name = "";
+        }
+        break;
+    }
+
+    // Find the DWARF sections
+    struct { const char *name; dwarf_section_t *sec; } dsecs[] = {
+        { ".debug_info", &elf->info }, { ".debug_abbrev", &elf->abbrev },
+        { ".debug_line", &elf->line }, { ".debug_str", &elf->str },
+        { ".debug_line_str", &elf->line_str }, { ".debug_str_offsets", &elf->str_offsets },
+        { ".debug_addr", &elf->addr }, { ".debug_ranges", &elf->ranges },
+        { ".debug_rnglists", &elf->rnglists },
+    };
+    for (int i=0; i<shnum; i++) {
+        elf_section_t *s = &elf->sections[i];
+        for (int j=0; j<sizeof(dsecs)/sizeof(dsecs[0]); j++) {
+            if (strcmp(s->name, dsecs[j].name) || dsecs[j].sec->data || !s->data)
+                continue;
+            if (s->flags & SHF_COMPRESSED) {
+                fprintf(stderr, "Error: compressed debug sections are not supported: %s\n", fn);
+                return false;
+            }
+            dsecs[j].sec->data = s->data;
+            dsecs[j].sec->size = s->size;
+        }
+    }
+    return true;
+}
+
+static bool is_function_symbol_candidate(elf_symbol_t *sym, int sec)
+{
+    // Same as BFD's _bfd_elf_maybe_function_sym
+    if (sym->type == STT_SECTION || sym->type == STT_FILE || sym->type == STT_OBJECT ||
+        sym->type == STT_TLS || sym->shndx != sec)
+        return false;
+    if (sym->size == 0 && sym->bind == STB_LOCAL && sym->type == STT_NOTYPE &&
+        ELF32_ST_VISIBILITY(sym->other) == STV_HIDDEN)
+        return false;
+    return true;
+}
+
+static bool better_fit(elfsym_t *elf, elf_symbol_t *sym, uint64_t code_off, uint64_t code_size, uint64_t offset)
+{
+    // Prefer the symbol closest to the address, then symbols that contain
+    // the address, then functions, then typed symbols, then smaller sizes.
+    if (code_off > offset)
+        return false;
+    if (code_off < elf->fcache.code_off)
+        return false;
+    if (code_off > elf->fcache.code_off)
+        return true;
+    if (elf->fcache.code_off + elf->fcache.code_size <= offset)
+        return code_size > elf->fcache.code_size;
+    if (code_off + code_size <= offset)
+        return false;
+    bool cur_func = elf->fcache.func->type == STT_FUNC || elf->fcache.func->type == STT_GNU_IFUNC;
+    bool new_func = sym->type == STT_FUNC || sym->type == STT_GNU_IFUNC;
+    if (cur_func != new_func)
+        return new_func;
+    if (elf->fcache.func->type == STT_NOTYPE && sym->type != STT_NOTYPE)
+        return true;
+    if (sym->type == STT_NOTYPE && elf->fcache.func->type != STT_NOTYPE)
+        return false;
+    return code_size < elf->fcache.code_size;
+}
+
+/**
+ * @brief Find the function containing an address using the ELF symbol table
+ *
+ * The result of the last search is cached and reused for addresses that fall
+ * within the same function, as BFD does (_bfd_elf_find_function).
+ */
+static elf_symbol_t *elf_find_function(elfsym_t *elf, int sec, uint64_t offset,
+    const char **filename_ptr, const char **func_ptr)
+{
+    if (!elf->symbols)
+        return NULL;
+
+    if (elf->fcache.section != sec || !elf->fcache.func ||
+        offset < elf->fcache.func->value ||
+        offset >= elf->fcache.func->value + elf->fcache.code_size) {
+        enum { NOTHING_SEEN, SYMBOL_SEEN, FILE_AFTER_SYMBOL_SEEN } state = NOTHING_SEEN;
+        elf_symbol_t *file = NULL;
+
+        elf->fcache.section = sec;
+        elf->fcache.func = NULL;
+        elf->fcache.filename = NULL;
+        elf->fcache.code_off = elf->fcache.code_size = 0;
+
+        for (int i=0; i<elf->num_symbols; i++) {
+            elf_symbol_t *sym = &elf->symbols[i];
+            if (sym->type == STT_FILE) {
+                file = sym;
+                if (state == SYMBOL_SEEN)
+                    state = FILE_AFTER_SYMBOL_SEEN;
+                continue;
+            }
+            if (state == NOTHING_SEEN)
+                state = SYMBOL_SEEN;
+            if (!is_function_symbol_candidate(sym, sec))
+                continue;
+
+            uint64_t code_off = sym->value;
+            uint64_t size = sym->size ? sym->size : 1;
+            if (better_fit(elf, sym, code_off, size, offset)) {
+                elf->fcache.func = sym;
+                elf->fcache.code_size = size;
+                elf->fcache.code_off = code_off;
+                elf->fcache.filename = NULL;
+                if (file && (sym->bind == STB_LOCAL || state != FILE_AFTER_SYMBOL_SEEN))
+                    elf->fcache.filename = file->name;
+            } else if (code_off > offset && code_off > elf->fcache.code_off &&
+                       code_off < elf->fcache.code_off + elf->fcache.code_size) {
+                // Shrink the cached function so that it does not cover this symbol
+                elf->fcache.code_size = code_off - elf->fcache.code_off;
+            }
+        }
+    }
+
+    if (!elf->fcache.func)
+        return NULL;
+    if (filename_ptr)
+        *filename_ptr = elf->fcache.filename;
+    *func_ptr = elf->fcache.func->name;
+    return elf->fcache.func;
+}
+
+static int elf_symbol_cmp(const void *a, const void *b)
+{
+    const elf_symbol_t *sa = *(const elf_symbol_t**)a, *sb = *(const elf_symbol_t**)b;
+    if (sa->value != sb->value)
+        return sa->value < sb->value ? -1 : 1;
+    return 0;
+}
+
+void elfsym_find_callsites(elfsym_t *elf, elfsym_callsite_cb cb, void *arg)
+{
+    // Symbols that objdump uses as labels in the disassembly
+    elf_symbol_t **syms = NULL;
+    for (int i=0; i<elf->num_symbols; i++) {
+        elf_symbol_t *sym = &elf->symbols[i];
+        if (!sym->name[0] || sym->type == STT_FILE || sym->type == STT_SECTION)
+            continue;
+        if (sym->shndx == SHN_UNDEF || sym->shndx == SHN_COMMON || sym->shndx >= elf->num_sections)
+            continue;
+        stbds_arrput(syms, sym);
+    }
+    qsort(syms, stbds_arrlen(syms), sizeof(elf_symbol_t*), elf_symbol_cmp);
+
+    for (int i=1; i<elf->num_sections; i++) {
+        elf_section_t *s = &elf->sections[i];
+        if (!(s->flags & SHF_EXECINSTR) || !s->data || s->size == 0)
+            continue;
+
+        // objdump splits the disassembly of a section at each distinct symbol
+        // address, and prints a label at the beginning of each chunk.
+        uint64_t *labels = NULL;
+        stbds_arrput(labels, s->addr);
+        for (int j=0; j<stbds_arrlen(syms); j++) {
+            elf_symbol_t *sym = syms[j];
+            if (sym->shndx != i || sym->value <= labels[stbds_arrlen(labels)-1])
+                continue;
+            if (sym->value >= s->addr + s->size)
+                break;
+            stbds_arrput(labels, sym->value);
+        }
+        stbds_arrput(labels, s->addr + s->size);
+
+        cur_t c = { .p = s->data, .end = s->data + s->size, .be = elf->be };
+        for (int j=0; j<stbds_arrlen(labels)-1; j++) {
+            cb(arg, labels[j], true);
+            for (uint64_t pc = labels[j]; pc + 4 <= labels[j+1]; pc += 4) {
+                c.p = s->data + (pc - s->addr);
+                uint32_t op = rdn(&c, 4);
+                bool jal = (op & 0xfc000000) == 0x0c000000;
+                bool jalr = (op & 0xfc1f07ff) == 0x00000009;
+                if (jal || jalr)
+                    cb(arg, pc, false);
+            }
+        }
+        stbds_arrfree(labels);
+    }
+    stbds_arrfree(syms);
+}
+
+/***********************************************************************
+ * DWARF
+ ***********************************************************************/
+
+typedef struct {
+    uint32_t form;
+    uint64_t val;
+    const char *str;
+} attr_t;
+
+static const char *dwarf_str(dwarf_section_t *sec, uint64_t off)
+{
+    if (!sec->data || off >= sec->size || !memchr(sec->data + off, 0, sec->size - off))
+        return NULL;
+    return (const char*)sec->data + off;
+}
+
+static uint64_t dwarf_addr_index(elfsym_t *elf, cu_t *cu, uint64_t idx)
+{
+    uint64_t off = cu->addr_base + idx * cu->addr_size;
+    if (!elf->addr.data || off + cu->addr_size > elf->addr.size)
+        return 0;
+    cur_t c = { .p = elf->addr.data + off, .end = elf->addr.data + elf->addr.size, .be = elf->be };
+    return rdn(&c, cu->addr_size);
+}
+
+static const char *dwarf_str_index(elfsym_t *elf, cu_t *cu, uint64_t idx)
+{
+    uint64_t off = cu->str_offsets_base + idx * cu->offset_size;
+    if (!elf->str_offsets.data || off + cu->offset_size > elf->str_offsets.size)
+        return NULL;
+    cur_t c = { .p = elf->str_offsets.data + off, .end = elf->str_offsets.data + elf->str_offsets.size, .be = elf->be };
+    return dwarf_str(&elf->str, rdn(&c, cu->offset_size));
+}
+
+static bool is_str_form(uint32_t form)
+{
+    switch (form) {
+    case DW_FORM_string: case DW_FORM_strp: case DW_FORM_strx: case DW_FORM_strx1:
+    case DW_FORM_strx2: case DW_FORM_strx3: case DW_FORM_strx4: case DW_FORM_line_strp:
+    case DW_FORM_GNU_strp_alt: case DW_FORM_GNU_str_index:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_int_form(uint32_t form)
+{
+    switch (form) {
+    case DW_FORM_addr: case DW_FORM_data2: case DW_FORM_data4: case DW_FORM_data8:
+    case DW_FORM_data1: case DW_FORM_flag: case DW_FORM_sdata: case DW_FORM_udata:
+    case DW_FORM_ref_addr: case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4:
+    case DW_FORM_ref8: case DW_FORM_ref_udata: case DW_FORM_sec_offset:
+    case DW_FORM_flag_present: case DW_FORM_ref_sig8: case DW_FORM_addrx:
+    case DW_FORM_implicit_const: case DW_FORM_addrx1: case DW_FORM_addrx2:
+    case DW_FORM_addrx3: case DW_FORM_addrx4: case DW_FORM_GNU_ref_alt:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** @brief True for languages whose plain function names are also linkage names */
+static bool mangle_style_none(uint32_t lang)
+{
+    switch (lang) {
+    case 0x0001: /* C89 */          case 0x0002: /* C */
+    case 0x0005: /* Cobol74 */      case 0x0006: /* Cobol85 */
+    case 0x0007: /* Fortran77 */    case 0x0009: /* Pascal83 */
+    case 0x000c: /* C99 */          case 0x000f: /* PLI */
+    case 0x0012: /* UPC */          case 0x001d: /* C11 */
+    case 0x8001: /* Mips_Assembler */
+    case 0x8004: /* HP_Basic91 */   case 0x8006: /* HP_IMS_Basic */
+    case 0x8007: /* HP_Assembler */ case 0x8765: /* Upc */
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** @brief Read an attribute value (addresses and strings are resolved) */
+static bool read_attr(elfsym_t *elf, cu_t *cu, cur_t *c, uint32_t form, int64_t implicit_const, attr_t *a)
+{
+    a->form = form;
+    a->val = 0;
+    a->str = NULL;
+    switch (form) {
+    case DW_FORM_addr:          a->val = rdn(c, cu->addr_size); break;
+    case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag:
+                                a->val = rdn(c, 1); break;
+    case DW_FORM_data2: case DW_FORM_ref2:
+                                a->val = rdn(c, 2); break;
+    case DW_FORM_data4: case DW_FORM_ref4: case DW_FORM_ref_sup4:
+                                a->val = rdn(c, 4); break;
+    case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case DW_FORM_ref_sup8:
+                                a->val = rdn(c, 8); break;
+    case DW_FORM_data16:        skip(c, 16); break;
+    case DW_FORM_sdata:         a->val = rdsleb(c); break;
+    case DW_FORM_udata: case DW_FORM_ref_udata: case DW_FORM_loclistx: case DW_FORM_rnglistx:
+                                a->val = rduleb(c); break;
+    case DW_FORM_flag_present:  a->val = 1; break;
+    case DW_FORM_implicit_const: a->val = implicit_const; break;
+    case DW_FORM_string:        a->str = rdstr(c); break;
+    case DW_FORM_strp:          a->val = rdn(c, cu->offset_size); a->str = dwarf_str(&elf->str, a->val); break;
+    case DW_FORM_line_strp:     a->val = rdn(c, cu->offset_size); a->str = dwarf_str(&elf->line_str, a->val); break;
+    case DW_FORM_strp_sup: case DW_FORM_GNU_strp_alt: case DW_FORM_GNU_ref_alt: case DW_FORM_sec_offset:
+                                a->val = rdn(c, cu->offset_size); break;
+    case DW_FORM_ref_addr:      a->val = rdn(c, cu->version == 2 ? cu->addr_size : cu->offset_size); break;
+    case DW_FORM_strx: case DW_FORM_GNU_str_index:
+                                a->val = rduleb(c); a->str = dwarf_str_index(elf, cu, a->val); break;
+    case DW_FORM_strx1:         a->val = rdn(c, 1); a->str = dwarf_str_index(elf, cu, a->val); break;
+    case DW_FORM_strx2:         a->val = rdn(c, 2); a->str = dwarf_str_index(elf, cu, a->val); break;
+    case DW_FORM_strx3:         a->val = rdn(c, 3); a->str = dwarf_str_index(elf, cu, a->val); break;
+    case DW_FORM_strx4:         a->val = rdn(c, 4); a->str = dwarf_str_index(elf, cu, a->val); break;
+    case DW_FORM_addrx: case DW_FORM_GNU_addr_index:
+                                a->val = dwarf_addr_index(elf, cu, rduleb(c)); break;
+    case DW_FORM_addrx1:        a->val = dwarf_addr_index(elf, cu, rdn(c, 1)); break;
+    case DW_FORM_addrx2:        a->val = dwarf_addr_index(elf, cu, rdn(c, 2)); break;
+    case DW_FORM_addrx3:        a->val = dwarf_addr_index(elf, cu, rdn(c, 3)); break;
+    case DW_FORM_addrx4:        a->val = dwarf_addr_index(elf, cu, rdn(c, 4)); break;
+    case DW_FORM_block1:        skip(c, rdn(c, 1)); break;
+    case DW_FORM_block2:        skip(c, rdn(c, 2)); break;
+    case DW_FORM_block4:        skip(c, rdn(c, 4)); break;
+    case DW_FORM_block: case DW_FORM_exprloc:
+                                skip(c, rduleb(c)); break;
+    case DW_FORM_indirect:
+        form = rduleb(c);
+        if (form == DW_FORM_implicit_const)
+            implicit_const = rdsleb(c);
+        return read_attr(elf, cu, c, form, implicit_const, a);
+    default:
+        return false;
+    }
+    return !c->err;
+}
+
+static int abbrev_cmp(const void *a, const void *b)
+{
+    const abbrev_t *aa = a, *ab = b;
+    return aa->code < ab->code ? -1 : aa->code > ab->code;
+}
+
+static bool parse_abbrevs(elfsym_t *elf, cu_t *cu)
+{
+    if (cu->abbrev_offset >= elf->abbrev.size)
+        return false;
+    cur_t c = { .p = elf->abbrev.data + cu->abbrev_offset, .end = elf->abbrev.data + elf->abbrev.size, .be = elf->be };
+    abbrev_t *abbrevs = NULL;
+    while (!c.err) {
+        uint64_t code = rduleb(&c);
+        if (code == 0)
+            break;
+        abbrev_t ab = { .code = code };
+        ab.tag = rduleb(&c);
+        ab.has_children = rdn(&c, 1) != 0;
+        abbrev_attr_t *attrs = NULL;
+        while (!c.err) {
+            abbrev_attr_t at = {0};
+            at.name = rduleb(&c);
+            at.form = rduleb(&c);
+            if (at.form == DW_FORM_implicit_const)
+                at.implicit_const = rdsleb(&c);
+            if (at.name == 0 && at.form == 0)
+                break;
+            stbds_arrput(attrs, at);
+        }
+        ab.num_attrs = stbds_arrlen(attrs);
+        ab.attrs = attrs;
+        stbds_arrput(abbrevs, ab);
+    }
+    cu->abbrevs = abbrevs;
+    cu->num_abbrevs = stbds_arrlen(abbrevs);
+    // Abbreviation codes are usually consecutive: sort them so that they
+    // can be looked up directly (or with a binary search otherwise).
+    qsort(cu->abbrevs, cu->num_abbrevs, sizeof(abbrev_t), abbrev_cmp);
+    return !c.err;
+}
+
+static abbrev_t *lookup_abbrev(cu_t *cu, uint64_t code)
+{
+    if (code >= 1 && code <= cu->num_abbrevs && cu->abbrevs[code-1].code == code)
+        return &cu->abbrevs[code-1];
+    abbrev_t key = { .code = code };
+    return bsearch(&key, cu->abbrevs, cu->num_abbrevs, sizeof(abbrev_t), abbrev_cmp);
+}
+
+static void arange_add(range_t **ranges, uint64_t low, uint64_t high)
+{
+    if (low == high)
+        return;
+    if (stbds_arrlen(*ranges) == 0) {
+        stbds_arrput(*ranges, ((range_t){ low, high }));
+        return;
+    }
+    // Extend an adjacent range if possible
+    for (int i=0; i<stbds_arrlen(*ranges); i++) {
+        range_t *r = &(*ranges)[i];
+        if (low == r->high) { r->high = high; return; }
+        if (high == r->low) { r->low = low; return; }
+    }
+    // New ranges are inserted right after the first one
+    stbds_arrins(*ranges, 1, ((range_t){ low, high }));
+}
+
+static bool ranges_contain(range_t *ranges, uint64_t addr)
+{
+    for (int i=0; i<stbds_arrlen(ranges); i++)
+        if (addr >= ranges[i].low && addr < ranges[i].high)
+            return true;
+    return false;
+}
+
+static bool read_rangelist(elfsym_t *elf, cu_t *cu, range_t **ranges, uint64_t offset)
+{
+    uint64_t base = cu->base_address;
+    uint64_t maxaddr = cu->addr_size == 8 ? ~0ull : (1ull << (cu->addr_size*8)) - 1;
+
+    if (cu->version <= 4) {
+        if (!elf->ranges.data || offset >= elf->ranges.size)
+            return false;
+        cur_t c = { .p = elf->ranges.data + offset, .end = elf->ranges.data + elf->ranges.size, .be = elf->be };
+        while (!c.err) {
+            uint64_t low = rdn(&c, cu->addr_size);
+            uint64_t high = rdn(&c, cu->addr_size);
+            if (c.err || (low == 0 && high == 0))
+                break;
+            if (low == maxaddr && high != maxaddr)
+                base = high;
+            else
+                arange_add(ranges, base + low, base + high);
+        }
+        return !c.err;
+    }
+
+    if (!elf->rnglists.data || offset >= elf->rnglists.size)
+        return false;
+    cur_t c = { .p = elf->rnglists.data + offset, .end = elf->rnglists.data + elf->rnglists.size, .be = elf->be };
+    while (!c.err) {
+        uint64_t low, high;
+        switch (rdn(&c, 1)) {
+        case DW_RLE_end_of_list:
+            return true;
+        case DW_RLE_base_address:
+            base = rdn(&c, cu->addr_size);
+            continue;
+        case DW_RLE_start_length:
+            low = rdn(&c, cu->addr_size);
+            high = low + rduleb(&c);
+            break;
+        case DW_RLE_offset_pair:
+            low = base + rduleb(&c);
+            high = base + rduleb(&c);
+            break;
+        case DW_RLE_start_end:
+            low = rdn(&c, cu->addr_size);
+            high = rdn(&c, cu->addr_size);
+            break;
+        default:
+            return false;
+        }
+        if (!c.err)
+            arange_add(ranges, low, high);
+    }
+    return false;
+}
+
+/** @brief Read the unit headers in .debug_info */
+static void parse_unit_headers(elfsym_t *elf)
+{
+    cur_t c = { .p = elf->info.data, .end = elf->info.data + elf->info.size, .be = elf->be };
+    while (c.p < c.end && !c.err) {
+        cu_t cu = { .offset = c.p - elf->info.data, .offset_size = 4 };
+        uint64_t len = rdn(&c, 4);
+        if (len == 0xffffffff) {
+            len = rdn(&c, 8);
+            cu.offset_size = 8;
+        }
+        if (c.err || len > c.end - c.p)
+            break;
+        cur_t h = { .p = c.p, .end = c.p + len, .be = elf->be };
+        c.p += len;
+        cu.end = c.p - elf->info.data;
+
+        cu.version = rdn(&h, 2);
+        if (cu.version < 2 || cu.version > 5)
+            continue;
+        if (cu.version >= 5) {
+            uint8_t unit_type = rdn(&h, 1);
+            cu.addr_size = rdn(&h, 1);
+            cu.abbrev_offset = rdn(&h, cu.offset_size);
+            if (unit_type == DW_UT_type || unit_type == DW_UT_split_type)
+                skip(&h, 8 + cu.offset_size);
+            else if (unit_type == DW_UT_skeleton || unit_type == DW_UT_split_compile)
+                skip(&h, 8);
+        } else {
+            cu.abbrev_offset = rdn(&h, cu.offset_size);
+            cu.addr_size = rdn(&h, 1);
+        }
+        if (h.err || (cu.addr_size != 2 && cu.addr_size != 4 && cu.addr_size != 8))
+            continue;
+        cu.die_offset = h.p - elf->info.data;
+        stbds_arrput(elf->cus, cu);
+    }
+    elf->num_cus = stbds_arrlen(elf->cus);
+}
+
+static cu_t *find_cu(elfsym_t *elf, uint64_t offset)
+{
+    int lo = 0, hi = elf->num_cus;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (offset < elf->cus[mid].offset) hi = mid;
+        else if (offset >= elf->cus[mid].end) lo = mid + 1;
+        else return &elf->cus[mid];
+    }
+    return NULL;
+}
+
+/** @brief First parsing step: abbreviations and attributes of the unit DIE */
+static void parse_unit_die(elfsym_t *elf, cu_t *cu)
+{
+    if (!parse_abbrevs(elf, cu)) {
+        cu->error = true;
+        return;
+    }
+
+    cur_t c = { .p = elf->info.data + cu->die_offset, .end = elf->info.data + cu->end, .be = elf->be };
+    abbrev_t *ab = lookup_abbrev(cu, rduleb(&c));
+    if (!ab) {
+        cu->error = true;
+        return;
+    }
+
+    // Indexed strings and addresses depend on the bases, which are attributes
+    // of this same DIE, so they are read first.
+    cur_t start = c;
+    for (int pass=0; pass<2; pass++) {
+        c = start;
+        uint64_t low_pc = 0, high_pc = 0;
+        bool high_pc_relative = false;
+        for (int i=0; i<ab->num_attrs; i++) {
+            attr_t a;
+            if (!read_attr(elf, cu, &c, ab->attrs[i].form, ab->attrs[i].implicit_const, &a)) {
+                cu->error = true;
+                return;
+            }
+            if (pass == 0) {
+                switch (ab->attrs[i].name) {
+                case DW_AT_str_offsets_base: cu->str_offsets_base = a.val; break;
+                case DW_AT_addr_base: cu->addr_base = a.val; break;
+                }
+                continue;
+            }
+            switch (ab->attrs[i].name) {
+            case DW_AT_stmt_list:
+                if (is_int_form(a.form)) {
+                    cu->has_stmt_list = true;
+                    cu->stmt_list = a.val;
+                }
+                break;
+            case DW_AT_comp_dir:
+                if (is_str_form(a.form)) {
+                    // IRIX cc prepends "<machine>.:" to the directory
+                    const char *dir = a.str;
+                    if (dir) {
+                        const char *cp = strchr(dir, ':');
+                        if (cp && cp != dir && cp[-1] == '.' && cp[1] == '/')
+                            dir = cp + 1;
+                    }
+                    cu->comp_dir = dir;
+                }
+                break;
+            case DW_AT_language:
+                if (is_int_form(a.form))
+                    cu->lang = a.val;
+                break;
+            case DW_AT_low_pc:
+                if (is_int_form(a.form)) {
+                    low_pc = a.val;
+                    if (ab->tag == DW_TAG_compile_unit)
+                        cu->base_address = low_pc;
+                }
+                break;
+            case DW_AT_high_pc:
+                if (is_int_form(a.form)) {
+                    high_pc = a.val;
+                    high_pc_relative = a.form != DW_FORM_addr;
+                }
+                break;
+            case DW_AT_ranges:
+                if (is_int_form(a.form) && !read_rangelist(elf, cu, &cu->ranges, a.val)) {
+                    cu->error = true;
+                    return;
+                }
+                break;
+            }
+        }
+        if (pass == 1 && high_pc != 0) {
+            if (high_pc_relative)
+                high_pc += low_pc;
+            arange_add(&cu->ranges, low_pc, high_pc);
+        }
+    }
+}
+
+static bool is_absolute_path(const char *fn)
+{
+#ifdef _WIN32
+    if (((fn[0] >= 'a' && fn[0] <= 'z') || (fn[0] >= 'A' && fn[0] <= 'Z')) && fn[1] == ':')
+        return true;
+    if (fn[0] == '\\')
+        return true;
+#endif
+    return fn[0] == '/';
+}
+
+/** @brief Compute the full path of a file of the line table (cached) */
+static const char *concat_filename(cu_t *cu, uint64_t file)
+{
+    static const char *unknown = "<unknown>";
+    uint64_t idx = file - !cu->dir_and_file_0;
+    if (idx >= stbds_arrlen(cu->files))
+        return unknown;
+    while (stbds_arrlen(cu->filenames) <= idx)
+        stbds_arrput(cu->filenames, NULL);
+    if (cu->filenames[idx])
+        return cu->filenames[idx];
+
+    const char *filename = cu->files[idx].name;
+    char *name;
+    if (!filename)
+        return unknown;
+    if (is_absolute_path(filename)) {
+        name = strdup(filename);
+    } else {
+        const char *dir_name = NULL, *subdir_name = NULL;
+        uint64_t dir = cu->files[idx].dir;
+        if (dir) {
+            if (cu->dir_and_file_0 && dir < stbds_arrlen(cu->dirs))
+                subdir_name = cu->dirs[dir];
+            else if (!cu->dir_and_file_0 && dir <= stbds_arrlen(cu->dirs))
+                subdir_name = cu->dirs[dir - 1];
+        }
+        if (!subdir_name || !is_absolute_path(subdir_name))
+            dir_name = cu->comp_dir;
+        if (!dir_name) {
+            dir_name = subdir_name;
+            subdir_name = NULL;
+        }
+        if (!dir_name)
+            name = strdup(filename);
+        else if (subdir_name)
+            asprintf(&name, "%s/%s/%s", dir_name, subdir_name, filename);
+        else
+            asprintf(&name, "%s/%s", dir_name, filename);
+    }
+    cu->filenames[idx] = name;
+    return name;
+}
+
+/** @brief Read the directory or file entries of a DWARF 5 line table header */
+static bool read_formatted_entries(elfsym_t *elf, cu_t *cu, cur_t *c, bool is_files)
+{
+    int nformats = rdn(c, 1);
+    uint64_t formats[nformats*2 + 1];
+    for (int i=0; i<nformats*2; i++)
+        formats[i] = rduleb(c);
+    uint64_t count = rduleb(c);
+    for (uint64_t n=0; n<count && !c->err; n++) {
+        const char *name = NULL;
+        uint64_t dir = 0;
+        for (int i=0; i<nformats; i++) {
+            attr_t a;
+            if (!read_attr(elf, cu, c, formats[i*2+1], 0, &a))
+                return false;
+            if (formats[i*2] == DW_LNCT_path && is_str_form(a.form))
+                name = a.str;
+            else if (formats[i*2] == DW_LNCT_directory_index && is_int_form(a.form))
+                dir = a.val;
+        }
+        if (is_files)
+            stbds_arrput(cu->files, ((typeof(*cu->files)){ name, dir }));
+        else
+            stbds_arrput(cu->dirs, name);
+    }
+    return !c->err;
+}
+
+/** @brief Append a row to the current line sequence, keeping it sorted */
+static void add_line_row(cu_t *cu, uint64_t addr, const char *file, int line, bool end_sequence, bool *new_seq)
+{
+    line_row_t row = { addr, file, line };
+    if (*new_seq) {
+        stbds_arrput(cu->seqs, ((line_seq_t){ .low = addr, .first = stbds_arrlen(cu->rows) }));
+        *new_seq = false;
+    }
+    line_seq_t *seq = &stbds_arrlast(cu->seqs);
+    line_row_t *last = seq->count ? &cu->rows[seq->first + seq->count - 1] : NULL;
+
+    if (last && !end_sequence && last->addr == addr) {
+        // Only the last row at the same address is kept
+        *last = row;
+    } else if (!last || end_sequence || addr > last->addr) {
+        stbds_arrput(cu->rows, row);
+        seq->count++;
+    } else {
+        // Out of order row: insert before the rows at the same or higher addresses
+        int pos = seq->first + seq->count - 1;
+        while (pos > seq->first && cu->rows[pos-1].addr >= addr)
+            pos--;
+        stbds_arrins(cu->rows, pos, row);
+        seq->count++;
+        if (addr < seq->low)
+            seq->low = addr;
+    }
+    if (end_sequence) {
+        arange_add(&cu->ranges, seq->low, addr);
+        *new_seq = true;
+    }
+}
+
+/** @brief Temporary entry used to sort the line sequences */
+typedef struct {
+    line_seq_t seq;
+    uint64_t end;
+    int idx;
+} seq_sort_t;
+
+static int seq_sort_cmp(const void *a, const void *b)
+{
+    const seq_sort_t *sa = a, *sb = b;
+    if (sa->seq.low != sb->seq.low)
+        return sa->seq.low < sb->seq.low ? -1 : 1;
+    // Equal starts: larger sequences go first
+    if (sa->end != sb->end)
+        return sa->end < sb->end ? 1 : -1;
+    return sa->idx - sb->idx;
+}
+
+/** @brief Decode the line number program of a compilation unit */
+static bool decode_line_info(elfsym_t *elf, cu_t *cu)
+{
+    if (!elf->line.data || cu->stmt_list >= elf->line.size)
+        return false;
+
+    cur_t c = { .p = elf->line.data + cu->stmt_list, .end = elf->line.data + elf->line.size, .be = elf->be };
+    int offset_size = 4;
+    uint64_t len = rdn(&c, 4);
+    if (len == 0xffffffff) {
+        len = rdn(&c, 8);
+        offset_size = 8;
+    }
+    if (c.err || len > c.end - c.p)
+        return false;
+    c.end = c.p + len;
+
+    int version = rdn(&c, 2);
+    if (version < 2 || version > 5)
+        return false;
+    if (version >= 5)
+        skip(&c, 2);    // address_size, segment_selector_size
+    uint64_t header_len = rdn(&c, offset_size);
+    if (c.err || header_len > c.end - c.p)
+        return false;
+    const uint8_t *program = c.p + header_len;
+
+    int min_insn_len = rdn(&c, 1);
+    int max_ops_per_insn = version >= 4 ? rdn(&c, 1) : 1;
+    if (max_ops_per_insn == 0)
+        return false;
+    skip(&c, 1);        // default_is_stmt
+    int line_base = (int8_t)rdn(&c, 1);
+    int line_range = rdn(&c, 1);
+    int opcode_base = rdn(&c, 1);
+    if (line_range == 0 || opcode_base == 0)
+        return false;
+    uint8_t std_opcode_lengths[256] = {0};
+    for (int i=1; i<opcode_base; i++)
+        std_opcode_lengths[i] = rdn(&c, 1);
+
+    if (version >= 5) {
+        // Strings in the line table header use the unit format
+        cu_t hcu = *cu;
+        hcu.offset_size = offset_size;
+        cu->dir_and_file_0 = true;
+        if (!read_formatted_entries(elf, &hcu, &c, false))
+            return false;
+        cu->dirs = hcu.dirs;
+        if (!read_formatted_entries(elf, &hcu, &c, true))
+            return false;
+        cu->files = hcu.files;
+    } else {
+        while (!c.err) {
+            const char *dir = rdstr(&c);
+            if (!dir || !dir[0])
+                break;
+            stbds_arrput(cu->dirs, dir);
+        }
+        while (!c.err) {
+            const char *name = rdstr(&c);
+            if (!name || !name[0])
+                break;
+            uint64_t dir = rduleb(&c);
+            rduleb(&c); rduleb(&c);     // mtime, size
+            stbds_arrput(cu->files, ((typeof(*cu->files)){ name, dir }));
+        }
+    }
+    if (c.err)
+        return false;
+
+    c.p = program;
+    bool new_seq = true;
+    while (c.p < c.end && !c.err) {
+        uint64_t address = 0, op_index = 0;
+        uint64_t file = 1;
+        const char *filename = concat_filename(cu, file);
+        int line = 1;
+        bool end_sequence = false;
+
+        #define ADVANCE(adv) ({ \
+            uint64_t _adv = (adv); \
+            if (max_ops_per_insn == 1) { \
+                address += _adv * min_insn_len; \
+            } else { \
+                address += ((op_index + _adv) / max_ops_per_insn) * min_insn_len; \
+                op_index = (op_index + _adv) % max_ops_per_insn; \
+            } \
+        })
+
+        while (!end_sequence && c.p < c.end && !c.err) {
+            uint8_t op = rdn(&c, 1);
+            if (op >= opcode_base) {
+                // Special opcode
+                int adj = op - opcode_base;
+                ADVANCE(adj / line_range);
+                line += line_base + adj % line_range;
+                add_line_row(cu, address, filename, line, false, &new_seq);
+                continue;
+            }
+            switch (op) {
+            case 0: {
+                uint64_t exlen = rduleb(&c);
+                const uint8_t *next = c.p + exlen;
+                if (exlen == 0 || exlen > c.end - c.p)
+                    return false;
+                switch (rdn(&c, 1)) {
+                case DW_LNE_end_sequence:
+                    end_sequence = true;
+                    add_line_row(cu, address, filename, line, true, &new_seq);
+                    break;
+                case DW_LNE_set_address:
+                    address = rdn(&c, exlen - 1);
+                    op_index = 0;
+                    break;
+                case DW_LNE_define_file: {
+                    const char *name = rdstr(&c);
+                    uint64_t dir = rduleb(&c);
+                    stbds_arrput(cu->files, ((typeof(*cu->files)){ name, dir }));
+                    break;
+                }
+                }
+                c.p = next;
+                break;
+            }
+            case DW_LNS_copy:
+                add_line_row(cu, address, filename, line, false, &new_seq);
+                break;
+            case DW_LNS_advance_pc:
+                ADVANCE(rduleb(&c));
+                break;
+            case DW_LNS_advance_line:
+                line += rdsleb(&c);
+                break;
+            case DW_LNS_set_file:
+                file = rduleb(&c);
+                filename = concat_filename(cu, file);
+                break;
+            case DW_LNS_const_add_pc:
+                ADVANCE((255 - opcode_base) / line_range);
+                break;
+            case DW_LNS_fixed_advance_pc:
+                address += rdn(&c, 2);
+                op_index = 0;
+                break;
+            default:
+                // Skip the operands of other standard opcodes
+                for (int i=0; i<std_opcode_lengths[op]; i++)
+                    rduleb(&c);
+                break;
+            }
+        }
+        #undef ADVANCE
+    }
+    if (c.err)
+        return false;
+
+    // A sequence that was not terminated is dropped
+    if (!new_seq)
+        stbds_arrsetlen(cu->seqs, stbds_arrlen(cu->seqs) - 1);
+
+    // Sort the sequences by start address (and then by size, larger first),
+    // and make them binary-searchable by trimming overlapping sequences and
+    // removing nested ones.
+    int nseqs = stbds_arrlen(cu->seqs);
+    seq_sort_t *tmp = malloc(nseqs * sizeof(seq_sort_t) + 1);
+    for (int i=0; i<nseqs; i++) {
+        tmp[i].seq = cu->seqs[i];
+        tmp[i].end = cu->rows[cu->seqs[i].first + cu->seqs[i].count - 1].addr;
+        tmp[i].idx = i;
+    }
+    qsort(tmp, nseqs, sizeof(seq_sort_t), seq_sort_cmp);
+    stbds_arrsetlen(cu->seqs, 0);
+    uint64_t last_high = 0;
+    for (int i=0; i<nseqs; i++) {
+        if (i > 0 && tmp[i].seq.low < last_high) {
+            if (tmp[i].end <= last_high)
+                continue;
+            tmp[i].seq.low = last_high;
+        }
+        last_high = tmp[i].end;
+        stbds_arrput(cu->seqs, tmp[i].seq);
+    }
+    free(tmp);
+    return true;
+}
+
+/** @brief Follow an abstract origin or specification to find the name of a function */
+static bool find_abstract_instance(elfsym_t *elf, cu_t *cu, attr_t *attr, int recur,
+    const char **pname, bool *is_linkage)
+{
+    if (recur == 100)
+        return false;
+
+    uint64_t off;
+    if (attr->form == DW_FORM_ref_addr) {
+        off = attr->val;
+        cu = find_cu(elf, off);
+        if (!cu || cu->error)
+            return false;
+    } else if (attr->form == DW_FORM_GNU_ref_alt) {
+        return false;
+    } else {
+        if (attr->val == 0 || attr->val >= cu->end - cu->offset)
+            return false;
+        off = cu->offset + attr->val;
+    }
+
+    cur_t c = { .p = elf->info.data + off, .end = elf->info.data + cu->end, .be = elf->be };
+    uint64_t code = rduleb(&c);
+    if (code == 0)
+        return !c.err;
+    abbrev_t *ab = lookup_abbrev(cu, code);
+    if (!ab)
+        return false;
+
+    for (int i=0; i<ab->num_attrs; i++) {
+        attr_t a;
+        if (!read_attr(elf, cu, &c, ab->attrs[i].form, ab->attrs[i].implicit_const, &a))
+            break;
+        switch (ab->attrs[i].name) {
+        case DW_AT_name:
+            // Prefer the linkage name over the plain name
+            if (!*pname && is_str_form(a.form)) {
+                *pname = a.str;
+                if (mangle_style_none(cu->lang))
+                    *is_linkage = true;
+            }
+            break;
+        case DW_AT_specification:
+            if (is_int_form(a.form) && !find_abstract_instance(elf, cu, &a, recur + 1, pname, is_linkage))
+                return false;
+            break;
+        case DW_AT_linkage_name:
+        case DW_AT_MIPS_linkage_name:
+            if (is_str_form(a.form)) {
+                *pname = a.str;
+                *is_linkage = true;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+static int func_lookup_cmp(const void *a, const void *b)
+{
+    const func_lookup_t *fa = a, *fb = b;
+    if (fa->low != fb->low)
+        return fa->low < fb->low ? -1 : 1;
+    if (fa->high != fb->high)
+        return fa->high < fb->high ? -1 : 1;
+    return fa->func - fb->func;
+}
+
+/** @brief Second parsing step: line table and functions of a unit */
+static void parse_unit_functions(elfsym_t *elf, cu_t *cu)
+{
+    if (cu->error)
+        return;
+    if (cu->has_stmt_list && !decode_line_info(elf, cu)) {
+        cu->error = true;
+        return;
+    }
+
+    cur_t c = { .p = elf->info.data + cu->die_offset, .end = elf->info.data + cu->end, .be = elf->be };
+    abbrev_t *ab = lookup_abbrev(cu, rduleb(&c));
+    for (int i=0; i<ab->num_attrs; i++) {
+        attr_t a;
+        read_attr(elf, cu, &c, ab->attrs[i].form, ab->attrs[i].implicit_const, &a);
+    }
+    if (!ab->has_children)
+        return;
+
+    // Innermost function at each nesting level of the DIE tree, used to
+    // link inlined functions to their caller.
+    int *nested = NULL;
+    int level = 0;
+    stbds_arrput(nested, -1);
+    while (level >= 0 && c.p < c.end && !c.err) {
+        uint64_t code = rduleb(&c);
+        if (code == 0) {
+            level--;
+            continue;
+        }
+        ab = lookup_abbrev(cu, code);
+        if (!ab) {
+            cu->error = true;
+            break;
+        }
+
+        func_t *func = NULL;
+        if (ab->tag == DW_TAG_subprogram || ab->tag == DW_TAG_inlined_subroutine || ab->tag == DW_TAG_entry_point) {
+            stbds_arrput(cu->funcs, ((func_t){ .tag = ab->tag, .caller = -1 }));
+            func = &stbds_arrlast(cu->funcs);
+            if (ab->tag == DW_TAG_inlined_subroutine) {
+                for (int i=level-1; i>=0; i--) {
+                    if (nested[i] >= 0) {
+                        func->caller = nested[i];
+                        break;
+                    }
+                }
+            }
+            nested[level] = stbds_arrlen(cu->funcs) - 1;
+        } else {
+            nested[level] = -1;
+        }
+
+        uint64_t low_pc = 0, high_pc = 0;
+        bool high_pc_relative = false;
+        for (int i=0; i<ab->num_attrs; i++) {
+            attr_t a;
+            if (!read_attr(elf, cu, &c, ab->attrs[i].form, ab->attrs[i].implicit_const, &a)) {
+                cu->error = true;
+                break;
+            }
+            if (!func)
+                continue;
+            switch (ab->attrs[i].name) {
+            case DW_AT_call_file:
+                if (is_int_form(a.form))
+                    func->caller_file = concat_filename(cu, a.val);
+                break;
+            case DW_AT_call_line:
+                if (is_int_form(a.form))
+                    func->caller_line = a.val;
+                break;
+            case DW_AT_abstract_origin:
+            case DW_AT_specification:
+                if (is_int_form(a.form) && !find_abstract_instance(elf, cu, &a, 0, &func->name, &func->is_linkage))
+                    cu->error = true;
+                break;
+            case DW_AT_name:
+                if (!func->name && is_str_form(a.form)) {
+                    func->name = a.str;
+                    if (mangle_style_none(cu->lang))
+                        func->is_linkage = true;
+                }
+                break;
+            case DW_AT_linkage_name:
+            case DW_AT_MIPS_linkage_name:
+                if (is_str_form(a.form)) {
+                    func->name = a.str;
+                    func->is_linkage = true;
+                }
+                break;
+            case DW_AT_low_pc:
+                if (is_int_form(a.form))
+                    low_pc = a.val;
+                break;
+            case DW_AT_high_pc:
+                if (is_int_form(a.form)) {
+                    high_pc = a.val;
+                    high_pc_relative = a.form != DW_FORM_addr;
+                }
+                break;
+            case DW_AT_ranges:
+                if (is_int_form(a.form) && !read_rangelist(elf, cu, &func->ranges, a.val))
+                    cu->error = true;
+                break;
+            }
+        }
+        if (cu->error)
+            break;
+
+        if (high_pc_relative)
+            high_pc += low_pc;
+        if (func && high_pc != 0)
+            arange_add(&func->ranges, low_pc, high_pc);
+
+        if (ab->has_children) {
+            level++;
+            if (level >= stbds_arrlen(nested))
+                stbds_arrput(nested, -1);
+        }
+    }
+    stbds_arrfree(nested);
+
+    // Build a lookup table of the functions sorted by address
+    for (int i=0; i<stbds_arrlen(cu->funcs); i++) {
+        range_t *r = cu->funcs[i].ranges;
+        if (!stbds_arrlen(r))
+            continue;
+        func_lookup_t fl = { r[0].low, r[0].high, i };
+        for (int j=1; j<stbds_arrlen(r); j++) {
+            fl.low = MIN(fl.low, r[j].low);
+            fl.high = MAX(fl.high, r[j].high);
+        }
+        stbds_arrput(cu->lookup, fl);
+    }
+    qsort(cu->lookup, stbds_arrlen(cu->lookup), sizeof(func_lookup_t), func_lookup_cmp);
+    for (int i=1; i<stbds_arrlen(cu->lookup); i++)
+        cu->lookup[i].high = MAX(cu->lookup[i].high, cu->lookup[i-1].high);
+}
+
+/** @brief Work shared by the parsing threads */
+typedef struct {
+    elfsym_t *elf;
+    void (*func)(elfsym_t *elf, cu_t *cu);
+    int next;
+} parse_job_t;
+
+static void *parse_thread(void *arg)
+{
+    parse_job_t *job = arg;
+    while (1) {
+        int idx = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (idx >= job->elf->num_cus)
+            break;
+        job->func(job->elf, &job->elf->cus[idx]);
+    }
+    return NULL;
+}
+
+static void parse_parallel(elfsym_t *elf, int num_threads, void (*func)(elfsym_t *elf, cu_t *cu))
+{
+    parse_job_t job = { elf, func, 0 };
+    pthread_t threads[num_threads];
+    int started = 0;
+    for (int i=1; i<num_threads; i++)
+        if (pthread_create(&threads[started], NULL, parse_thread, &job) == 0)
+            started++;
+    parse_thread(&job);
+    for (int i=0; i<started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/***********************************************************************
+ * Address lookup
+ ***********************************************************************/
+
+static func_t *lookup_function(cu_t *cu, uint64_t addr)
+{
+    int n = stbds_arrlen(cu->lookup);
+    // Find the first function whose running maximum end is above the address
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (addr >= cu->lookup[mid].high) lo = mid + 1;
+        else hi = mid;
+    }
+
+    // The best match is the smallest range containing the address. In case
+    // of ties, the function that comes later in the debug info wins.
+    func_t *best = NULL; int best_idx = -1;
+    uint64_t best_len = ~0ull;
+    for (int i=lo; i<n && cu->lookup[i].low <= addr; i++) {
+        func_t *f = &cu->funcs[cu->lookup[i].func];
+        for (int j=0; j<stbds_arrlen(f->ranges); j++) {
+            range_t *r = &f->ranges[j];
+            if (addr < r->low || addr >= r->high)
+                continue;
+            uint64_t len = r->high - r->low;
+            if (len < best_len || (len == best_len && cu->lookup[i].func > best_idx)) {
+                best = f;
+                best_idx = cu->lookup[i].func;
+                best_len = len;
+            }
+        }
+    }
+    return best;
+}
+
+static bool lookup_line(cu_t *cu, uint64_t addr, const char **file, int *line)
+{
+    int lo = 0, hi = stbds_arrlen(cu->seqs);
+    line_seq_t *seq = NULL;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        seq = &cu->seqs[mid];
+        uint64_t end = cu->rows[seq->first + seq->count - 1].addr;
+        if (addr < seq->low) hi = mid;
+        else if (addr >= end) lo = mid + 1;
+        else break;
+    }
+    if (!seq || addr < seq->low || addr >= cu->rows[seq->first + seq->count - 1].addr)
+        return false;
+
+    // Find the row with the highest address not above the searched one
+    line_row_t *rows = &cu->rows[seq->first];
+    lo = 0; hi = seq->count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (addr < rows[mid].addr) hi = mid;
+        else if (addr >= rows[mid+1].addr) lo = mid + 1;
+        else { lo = mid; break; }
+    }
+    if (lo >= seq->count - 1 || addr < rows[lo].addr || addr >= rows[lo+1].addr)
+        return false;
+    *file = rows[lo].file;
+    *line = rows[lo].line;
+    return true;
+}
+
+/**
+ * @brief Find the source position of an address (as BFD's DWARF2 reader)
+ *
+ * @return 0 if not found, 1 if found in the line tables, 2 if only the
+ *         function was found
+ */
+static int dwarf2_find_nearest_line(elfsym_t *elf, int sec, uint64_t addr, query_t *q)
+{
+    func_t *function = NULL;
+    int found = 0;
+
+    q->file = q->func = NULL;
+    q->line = 0;
+    q->chain = NULL;
+
+    for (int i=0; i<elf->num_cus; i++) {
+        cu_t *cu = &elf->cus[i];
+        if (cu->error)
+            continue;
+        if (stbds_arrlen(cu->ranges) && !ranges_contain(cu->ranges, addr))
+            continue;
+        function = lookup_function(cu, addr);
+        if (function && function->tag == DW_TAG_inlined_subroutine) {
+            q->chain = function;
+            q->chain_cu = cu;
+        }
+        if (lookup_line(cu, addr, &q->file, &q->line)) {
+            found = 1;
+            break;
+        }
+    }
+
+    if (function && function->is_linkage) {
+        q->func = function->name;
+        if (!found)
+            found = 2;
+    } else {
+        // Use the ELF symbol table for the function name (and the file name,
+        // if not found yet). A non-linkage name from the debug info is
+        // replaced with the symbol name if they start at the same address;
+        // either way, the symbol table is not searched again for it.
+        elf_symbol_t *fun = elf_find_function(elf, sec, addr, q->file ? NULL : &q->file, &q->func);
+        if (!found && fun)
+            found = 2;
+        if (function) {
+            if (!fun)
+                q->func = function->name;
+            else if (fun->value == function->ranges[0].low)
+                function->name = q->func;
+            function->is_linkage = true;
+        }
+    }
+    return found;
+}
+
+static char *demangle(const char *name)
+{
+    extern char *__cxa_demangle(const char *mangled, char *buf, size_t *len, int *status);
+
+    // Strip the symbol version suffix, if any
+    char *base = strdup(name);
+    char *at = strchr(base, '@');
+    if (at) *at = 0;
+    // Leading dots and dollars are kept out of demangling
+    const char *p = base;
+    while (*p == '.' || *p == '$') p++;
+
+    char *res = NULL;
+    if (p[0] == '_' && p[1] == 'Z') {
+        int status;
+        res = __cxa_demangle(p, NULL, NULL, &status);
+    } else if (!strncmp(p, "_GLOBAL_", 8) && strchr("._$", p[8]) && p[8] &&
+               (p[9] == 'I' || p[9] == 'D') && p[10] == '_') {
+        const char *kind = p[9] == 'I' ? "global constructors keyed to " : "global destructors keyed to ";
+        char *inner = NULL;
+        if (p[11] == '_' && p[12] == 'Z') {
+            int status;
+            inner = __cxa_demangle(p + 11, NULL, NULL, &status);
+        }
+        asprintf(&res, "%s%s", kind, inner ? inner : p + 11);
+        free(inner);
+    }
+
+    if (res && (p != base || at)) {
+        char *full;
+        asprintf(&full, "%.*s%s%s%s", (int)(p - base), base, res, at ? "@" : "", at ? at + 1 : "");
+        free(res);
+        res = full;
+    }
+    free(base);
+    return res;
+}
+
+void elfsym_addr2line(elfsym_t *elf, uint64_t addr, bool inlines, elfsym_frame_cb cb, void *arg)
+{
+    // Find the (allocated) section containing the address
+    int sec = -1;
+    for (int i=1; i<elf->num_sections; i++) {
+        elf_section_t *s = &elf->sections[i];
+        if ((s->flags & SHF_ALLOC) && addr >= s->addr && addr < s->addr + s->size) {
+            sec = i;
+            break;
+        }
+    }
+
+    query_t q = {0};
+    int found = 0;
+    if (sec >= 0) {
+        found = dwarf2_find_nearest_line(elf, sec, addr, &q);
+        if (found != 1) {
+            // On MIPS, BFD searches the DWARF info again through the generic
+            // ELF path when the line was not found.
+            found = dwarf2_find_nearest_line(elf, sec, addr, &q);
+        }
+    }
+    if (!found) {
+        cb(arg, "??", "??", 0);
+        return;
+    }
+
+    const char *func = q.func;
+    const char *file = q.file;
+    int line = q.line;
+    func_t *chain = q.chain;
+    while (1) {
+        char *dem = NULL;
+        if (!func || !func[0])
+            func = "??";
+        else if ((dem = demangle(func)))
+            func = dem;
+        cb(arg, func, file ? file : "??", line);
+        free(dem);
+
+        if (!inlines || !chain || chain->caller < 0)
+            break;
+        func_t *caller = &q.chain_cu->funcs[chain->caller];
+        func = caller->name;
+        file = chain->caller_file;
+        line = chain->caller_line;
+        chain = caller;
+    }
+}
+
+/***********************************************************************
+ * Loading
+ ***********************************************************************/
+
+elfsym_t *elfsym_open(const char *fn, int num_threads)
+{
+    FILE *f = fopen(fn, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: cannot open file: %s\n", fn);
+        return NULL;
+    }
+    elfsym_t *elf = calloc(1, sizeof(elfsym_t));
+    fseek(f, 0, SEEK_END);
+    elf->size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    elf->data = malloc(elf->size);
+    if (fread(elf->data, 1, elf->size, f) != elf->size) {
+        fprintf(stderr, "Error: cannot read file: %s\n", fn);
+        fclose(f);
+        elfsym_close(elf);
+        return NULL;
+    }
+    fclose(f);
+
+    if (!elf_parse(elf, fn)) {
+        elfsym_close(elf);
+        return NULL;
+    }
+    if (!elf->info.data || !elf->abbrev.data) {
+        // Without debug info, only the function names can be found (through
+        // the ELF symbol table), just like addr2line does.
+        fprintf(stderr, "Warning: no debug information found, only function names will be available: %s\n", fn);
+        return elf;
+    }
+
+    if (num_threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (num_threads <= 0)
+            num_threads = 4;
+    }
+
+    // Parse the units in parallel. Abstract origins can point to other units,
+    // so all abbreviations and unit attributes are parsed before functions.
+    parse_unit_headers(elf);
+    parse_parallel(elf, num_threads, parse_unit_die);
+    parse_parallel(elf, num_threads, parse_unit_functions);
+    return elf;
+}
+
+void elfsym_close(elfsym_t *elf)
+{
+    for (int i=0; i<elf->num_cus; i++) {
+        cu_t *cu = &elf->cus[i];
+        for (int j=0; j<cu->num_abbrevs; j++)
+            stbds_arrfree(cu->abbrevs[j].attrs);
+        stbds_arrfree(cu->abbrevs);
+        for (int j=0; j<stbds_arrlen(cu->funcs); j++)
+            stbds_arrfree(cu->funcs[j].ranges);
+        stbds_arrfree(cu->funcs);
+        stbds_arrfree(cu->lookup);
+        for (int j=0; j<stbds_arrlen(cu->filenames); j++)
+            free(cu->filenames[j]);
+        stbds_arrfree(cu->filenames);
+        stbds_arrfree(cu->dirs);
+        stbds_arrfree(cu->files);
+        stbds_arrfree(cu->rows);
+        stbds_arrfree(cu->seqs);
+        stbds_arrfree(cu->ranges);
+    }
+    stbds_arrfree(elf->cus);
+    free(elf->sections);
+    free(elf->symbols);
+    free(elf->data);
+    free(elf);
+}
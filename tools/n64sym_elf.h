@@ -0,0 +1,60 @@
+#ifndef N64SYM_ELF_H
+#define N64SYM_ELF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Symbol information extracted natively from an ELF file
+ *
+ * This module replaces the "objdump -d" + "addr2line" pipeline used by n64sym
+ * with an in-process reader of the ELF symbol table and of the DWARF debug
+ * information (.debug_info, .debug_line and their companion sections).
+ *
+ * Both the list of call sites and the symbolization of each address mimic
+ * the output of GNU binutils (objdump and addr2line --functions --inlines
+ * --demangle), so that the resulting symbol table is the same.
+ */
+typedef struct elfsym_s elfsym_t;
+
+/** @brief Callback for #elfsym_find_callsites */
+typedef void (*elfsym_callsite_cb)(void *arg, uint32_t addr, bool is_func);
+
+/** @brief Callback for #elfsym_addr2line, called once per (inlined) frame */
+typedef void (*elfsym_frame_cb)(void *arg, const char *func, const char *file, int line);
+
+/**
+ * @brief Load an ELF file and parse its debug information
+ *
+ * Compilation units are parsed in parallel using the specified number of
+ * threads. If the file has no debug information, only the function names
+ * from the ELF symbol table are available.
+ *
+ * @return The loaded file, or NULL in case of error (already reported on stderr)
+ */
+elfsym_t *elfsym_open(const char *fn, int num_threads);
+
+/** @brief Free a file loaded with #elfsym_open */
+void elfsym_close(elfsym_t *elf);
+
+/**
+ * @brief Enumerate function starts and call sites
+ *
+ * Addresses are reported in the same order as they appear in the disassembly
+ * produced by objdump: for each executable section, each symbol (and the
+ * section start itself) is reported as a function, followed by the JAL/JALR
+ * instructions it contains.
+ */
+void elfsym_find_callsites(elfsym_t *elf, elfsym_callsite_cb cb, void *arg);
+
+/**
+ * @brief Symbolize an address
+ *
+ * The callback is invoked once for the address, and then once for each
+ * function the address is inlined into (if inlines is true), in the same
+ * order and with the same strings printed by addr2line. Unknown values
+ * are reported as "??" and line 0.
+ */
+void elfsym_addr2line(elfsym_t *elf, uint64_t addr, bool inlines, elfsym_frame_cb cb, void *arg);
+
+#endif
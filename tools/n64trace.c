@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define STBDS_NO_SHORT_NAMES
+#define STB_DS_IMPLEMENTATION
+#include "common/stb_ds.h"
+
+#include "common/polyfill.h"
+
+bool flag_verbose = false;
+bool flag_ticks = false;
+
+void usage(const char *progname)
+{
+    fprintf(stderr, "%s - Decode event traces recorded by the libdragon trace module\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Usage: %s [flags] [<trace.txt>]\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "The trace is the output of trace_flush(), and can be mixed with other\n");
+    fprintf(stderr, "log output. If no trace file is specified, it is read from stdin.\n");
+    fprintf(stderr, "Each event is printed on a line, formatted with its format string, and\n");
+    fprintf(stderr, "prefixed by the time elapsed since the first event.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Command-line flags:\n");
+    fprintf(stderr, "   -v/--verbose          Verbose output\n");
+    fprintf(stderr, "   -o/--output <file>    Output file (default: stdout)\n");
+    fprintf(stderr, "   -t/--ticks            Print timestamps as CPU ticks instead of seconds\n");
+    fprintf(stderr, "\n");
+}
+
+/** @brief Format strings, indexed by id */
+char **fmts = NULL;
+
+/** @brief Decode the escapes of a format string written by trace_flush */
+char *unescape(const char *s)
+{
+    char *out = NULL;
+    for (; *s && *s != '\n'; s++) {
+        if (*s == '\\' && s[1]) {
+            s++;
+            switch (*s) {
+            case 'n': stbds_arrput(out, '\n'); break;
+            case 'r': stbds_arrput(out, '\r'); break;
+            case 't': stbds_arrput(out, '\t'); break;
+            default:  stbds_arrput(out, *s); break;
+            }
+        } else {
+            stbds_arrput(out, *s);
+        }
+    }
+    stbds_arrput(out, 0);
+    char *ret = strdup(out);
+    stbds_arrfree(out);
+    return ret;
+}
+
+/**
+ * @brief Format an event with its format string
+ *
+ * Arguments were recorded as 32-bit words: integer conversions use them as
+ * int32/uint32, floating point conversions as the bits of a float (see
+ * trace_float), and strings cannot be recovered, so their address is printed.
+ */
+void format_event(FILE *out, const char *fmt, uint32_t *args, int nargs)
+{
+    int argi = 0;
+    #define NEXT_ARG()  (argi < nargs ? args[argi++] : 0)
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            fputc(*fmt++, out);
+            continue;
+        }
+        if (fmt[1] == '%') {
+            fputc('%', out);
+            fmt += 2;
+            continue;
+        }
+
+        // Rebuild the conversion specification, without length modifiers
+        // (all arguments are 32-bit) and with '*' replaced by the values.
+        char spec[64]; int n = 0;
+        const char *start = fmt;
+        spec[n++] = *fmt++;
+        while (*fmt && strchr("-+ #0", *fmt) && n < 32)
+            spec[n++] = *fmt++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*fmt != '.') break;
+                spec[n++] = *fmt++;
+            }
+            if (*fmt == '*') {
+                n += snprintf(spec+n, sizeof(spec)-n, "%d", (int32_t)NEXT_ARG());
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9' && n < 48)
+                    spec[n++] = *fmt++;
+            }
+        }
+        while (*fmt && strchr("hlLqjzt", *fmt))
+            fmt++;
+        char conv = *fmt;
+        if (!conv) {
+            fputs(start, out);
+            break;
+        }
+        fmt++;
+        spec[n++] = conv;
+        spec[n] = 0;
+
+        uint32_t arg;
+        switch (conv) {
+        case 'd': case 'i': case 'c':
+            fprintf(out, spec, (int32_t)NEXT_ARG());
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            fprintf(out, spec, NEXT_ARG());
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            arg = NEXT_ARG();
+            float f; memcpy(&f, &arg, 4);
+            fprintf(out, spec, (double)f);
+        }   break;
+        case 'p':
+            fprintf(out, "0x%08x", NEXT_ARG());
+            break;
+        case 's': {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "<str@0x%08x>", NEXT_ARG());
+            spec[n-1] = 's';
+            fprintf(out, spec, buf);
+        }   break;
+        default:
+            // Unknown conversion: print it as is
+            fwrite(start, 1, fmt - start, out);
+            break;
+        }
+    }
+    #undef NEXT_ARG
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outfn = NULL;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+            flag_verbose = true;
+        } else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--ticks")) {
+            flag_ticks = true;
+        } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                return 1;
+            }
+            outfn = argv[i];
+        } else {
+            fprintf(stderr, "invalid flag: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if (i < argc) {
+        in = fopen(argv[i], "r");
+        if (!in) {
+            fprintf(stderr, "Error: cannot open file: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    FILE *out = stdout;
+    if (outfn) {
+        out = fopen(outfn, "w");
+        if (!out) {
+            fprintf(stderr, "Error: cannot create file: %s\n", outfn);
+            return 1;
+        }
+    }
+
+    char *line = NULL; size_t line_size = 0;
+    bool in_trace = false, first = true;
+    int num_chunks = 0, num_events = 0, num_lost = 0;
+    uint32_t ticks_per_second = 46875000, last_ticks = 0;
+    int64_t ticks = 0;
+    while (getline(&line, &line_size, in) != -1) {
+        if (!strncmp(line, "TRACE1 ", 7)) {
+            ticks_per_second = strtoul(line + 7, NULL, 10);
+            if (!ticks_per_second) ticks_per_second = 46875000;
+            in_trace = true;
+            num_chunks++;
+            continue;
+        }
+        if (!in_trace)
+            continue;
+        if (!strncmp(line, "TRACEEND ", 9)) {
+            int ne = 0, nl = 0;
+            sscanf(line + 9, "%d %d", &ne, &nl);
+            if (nl > 0) {
+                if (flag_verbose)
+                    fprintf(stderr, "Warning: %d events lost (buffer full)\n", nl);
+                fprintf(out, "... %d events lost ...\n", nl);
+            }
+            num_lost += nl;
+            in_trace = false;
+            continue;
+        }
+
+        char *p = line + 2;
+        if (line[0] == 'F' && line[1] == ' ') {
+            int id = strtol(p, &p, 16);
+            if (*p == ' ') p++;
+            if (id < 0 || id > 1<<20) continue;
+            while (stbds_arrlen(fmts) <= id)
+                stbds_arrput(fmts, NULL);
+            free(fmts[id]);
+            fmts[id] = unescape(p);
+            continue;
+        }
+        if (line[0] != 'E' || line[1] != ' ')
+            continue;
+
+        uint32_t t = strtoul(p, &p, 16);
+        int id = strtol(p, &p, 16);
+        uint32_t args[16]; int nargs = 0;
+        while (nargs < 16) {
+            char *end;
+            uint32_t arg = strtoul(p, &end, 16);
+            if (end == p) break;
+            args[nargs++] = arg;
+            p = end;
+        }
+
+        // The 32-bit counter overflows every ~90 seconds: accumulate the
+        // differences, which can be slightly negative for events recorded
+        // by interrupts.
+        if (first) {
+            first = false;
+            last_ticks = t;
+        }
+        ticks += (int32_t)(t - last_ticks);
+        last_ticks = t;
+
+        if (flag_ticks)
+            fprintf(out, "[%12lld] ", (long long)ticks);
+        else
+            fprintf(out, "[%12.6f] ", (double)ticks / ticks_per_second);
+        if (id >= 0 && id < stbds_arrlen(fmts) && fmts[id])
+            format_event(out, fmts[id], args, nargs);
+        else
+            fprintf(out, "<unknown event %x>", id);
+        fputc('\n', out);
+        num_events++;
+    }
+    free(line);
+
+    if (!num_chunks) {
+        fprintf(stderr, "Error: no trace found in the input\n");
+        return 1;
+    }
+    if (flag_verbose)
+        fprintf(stderr, "Read %d events in %d chunks (%d lost)\n", num_events, num_chunks, num_lost);
+
+    if (out != stdout) fclose(out);
+    if (in != stdin) fclose(in);
+    return 0;
+}
@@ -0,0 +1,8 @@
+/* Host replacement of dma.h for src/usb.c, implemented by usbloop.c */
+#ifndef __USBLOOP_DMA_H
+#define __USBLOOP_DMA_H
+
+void dma_read(void *ram_address, unsigned long pi_address, unsigned long len);
+void dma_write(const void *ram_address, unsigned long pi_address, unsigned long len);
+
+#endif
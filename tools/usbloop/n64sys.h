@@ -0,0 +1,18 @@
+/* Host replacement of n64sys.h for src/usb.c, implemented by usbloop.c */
+#ifndef __USBLOOP_N64SYS_H
+#define __USBLOOP_N64SYS_H
+
+#include <stdint.h>
+
+#define TICKS_PER_SECOND        46875000
+#define TICKS_READ()            usbloop_ticks()
+#define TICKS_FROM_MS(val)      (((val) * (TICKS_PER_SECOND / 1000)))
+#define TICKS_TO_US(val)        (((val) * 8 / (8 * TICKS_PER_SECOND / 1000000)))
+
+uint32_t usbloop_ticks(void);
+uint32_t io_read(uint32_t pi_address);
+void io_write(uint32_t pi_address, uint32_t data);
+void data_cache_hit_writeback(volatile const void *addr, unsigned long length);
+void data_cache_hit_writeback_invalidate(volatile void *addr, unsigned long length);
+
+#endif
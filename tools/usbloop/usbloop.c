@@ -0,0 +1,570 @@
+/*
+ * usbloop - Host loopback test of the USB debug library (src/usb.c)
+ *
+ * The library is compiled for the PC, and the PI accesses it does are served
+ * by a simulation of the registers and SDRAM of the 64Drive, EverDrive and
+ * SC64 flashcarts. Each packet sent through USB is decoded the way UNFLoader
+ * does, and checked against what the program meant to send. On the EverDrive
+ * and SC64, packets are then sent back to the N64, to test usb_poll and
+ * usb_read too.
+ *
+ * This checks the protocol framing, the alignment constraints of PI DMA, and
+ * that bulk transfers never overwrite data that is still being sent. The
+ * throughput it prints is measured with a simulated clock, and means nothing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../../src/usb.c"
+
+static int num_errors = 0;
+
+#define CHECK(cond, ...) ({ \
+    if (!(cond)) { \
+        fprintf(stderr, "ERROR: " __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        num_errors++; \
+    } \
+})
+
+/** @brief A USB packet */
+typedef struct {
+    int type;
+    int size;
+    uint8_t *data;
+} packet_t;
+
+/** @brief A FIFO of packets */
+typedef struct {
+    packet_t *packets;
+    int head, tail, cap;
+} packet_queue_t;
+
+/** @brief Simulated flashcart */
+static struct {
+    int type;                       ///< Flashcart being simulated (CART_*)
+    bool loopback;                  ///< Send the received packets back to the N64
+    uint8_t *sdram;                 ///< Debug area of the SDRAM
+    bool writable;                  ///< SDRAM writes are enabled
+    uint32_t ticks;                 ///< Simulated clock
+
+    bool tx_busy;                   ///< A USB transfer from SDRAM is in progress
+    int tx_polls;                   ///< Status reads before the transfer finishes
+    uint32_t tx_address;            ///< PI address of the data being sent
+    uint32_t tx_header;             ///< Header of the data being sent
+
+    uint32_t d64_p0r0, d64_p1r1;    ///< 64Drive USB parameter registers
+
+    uint8_t ed_fifo[512];           ///< EverDrive USB FIFO
+    uint8_t *ed_tx;                 ///< EverDrive bytes sent, not decoded yet
+    int ed_tx_len;
+    uint8_t *ed_rx;                 ///< EverDrive bytes to receive
+    int ed_rx_len, ed_rx_pos;
+
+    int sc64_unlock;                ///< SC64 unlock sequence position
+    uint32_t sc64_data[2];          ///< SC64 DATA registers
+    bool sc64_error;                ///< SC64 error flag of the last command
+
+    packet_queue_t rx;              ///< Packets sent back to the N64
+} cart;
+
+static packet_queue_t expected;     ///< Packets sent by the N64, in order
+static int next_received = 0;       ///< First packet not received yet by the PC
+static int next_echo = 0;           ///< First packet not received back yet by the N64
+
+static void queue_push(packet_queue_t *q, int type, const void *data, int size)
+{
+    if (q->tail == q->cap) {
+        q->cap = q->cap ? q->cap*2 : 64;
+        q->packets = realloc(q->packets, q->cap * sizeof(packet_t));
+    }
+    packet_t *pkt = &q->packets[q->tail++];
+    pkt->type = type;
+    pkt->size = size;
+    pkt->data = malloc(size + 1);
+    memcpy(pkt->data, data, size);
+}
+
+static void queue_free(packet_queue_t *q)
+{
+    for (int i = 0; i < q->tail; i++)
+        free(q->packets[i].data);
+    free(q->packets);
+    memset(q, 0, sizeof(*q));
+}
+
+/***********************************************************************
+ * PC side
+ ***********************************************************************/
+
+/** @brief Check a packet received by the PC, and send it back if required */
+static void host_receive(int type, int size, const uint8_t *data)
+{
+    if (next_received == expected.tail) {
+        CHECK(0, "unexpected packet (type %d, %d bytes)", type, size);
+        return;
+    }
+
+    packet_t *exp = &expected.packets[next_received++];
+    int exp_size = exp->size;
+    if (cart.type == CART_64DRIVE)
+        exp_size = ALIGN(exp_size, 4);
+
+    CHECK(type == exp->type && size == exp_size,
+        "packet %d: got type %d, %d bytes, expected type %d, %d bytes",
+        next_received-1, type, size, exp->type, exp_size);
+    if (size != exp_size)
+        return;
+    for (int i = 0; i < size; i++) {
+        uint8_t value = i < exp->size ? exp->data[i] : 0;
+        if (data[i] != value) {
+            CHECK(0, "packet %d: wrong data at offset %d (%02x instead of %02x)",
+                next_received-1, i, data[i], value);
+            break;
+        }
+    }
+
+    // Packets of size 0 cannot be polled
+    if (cart.loopback && size > 0)
+        queue_push(&cart.rx, type, data, size);
+}
+
+/***********************************************************************
+ * Simulated flashcart
+ ***********************************************************************/
+
+/** @brief Return the SDRAM memory at a PI address, or NULL if it is outside of the debug area */
+static uint8_t *sdram_ptr(uint32_t pi_address, uint32_t len)
+{
+    uint32_t base = 0x10000000 + DEBUG_ADDRESS;
+    if (pi_address < base || pi_address + len > base + DEBUG_ADDRESS_SIZE)
+        return NULL;
+    return cart.sdram + (pi_address - base);
+}
+
+static void tx_start(uint32_t pi_address, uint32_t header)
+{
+    int size = header & 0xFFFFFF;
+    CHECK(!cart.tx_busy, "USB transfer started while another one is in progress");
+    CHECK(sdram_ptr(pi_address, size), "USB transfer outside of the debug area: %08x", pi_address);
+    cart.tx_busy = true;
+    cart.tx_polls = 2 + size/65536;
+    cart.tx_address = pi_address;
+    cart.tx_header = header;
+}
+
+/** @brief Check the status of the USB transfer, which advances it */
+static bool tx_poll(void)
+{
+    if (cart.tx_busy && --cart.tx_polls <= 0) {
+        // The data is read at the end of the transfer, so that overwriting
+        // it while it is being sent is noticed.
+        int size = cart.tx_header & 0xFFFFFF;
+        uint8_t *data = sdram_ptr(cart.tx_address, size);
+        cart.tx_busy = false;
+        if (data)
+            host_receive(cart.tx_header >> 24, size, data);
+    }
+    return cart.tx_busy;
+}
+
+/** @brief Return true if the EverDrive has received bytes to be read */
+static bool ed_rx_pending(void)
+{
+    if (cart.ed_rx_pos == cart.ed_rx_len && cart.rx.head < cart.rx.tail) {
+        // Serialize the next packet as UNFLoader does
+        packet_t *pkt = &cart.rx.packets[cart.rx.head++];
+        int len = ALIGN(pkt->size, 2);
+        cart.ed_rx = realloc(cart.ed_rx, len + 12);
+        memcpy(cart.ed_rx, "DMA@", 4);
+        cart.ed_rx[4] = pkt->type;
+        cart.ed_rx[5] = pkt->size >> 16;
+        cart.ed_rx[6] = pkt->size >> 8;
+        cart.ed_rx[7] = pkt->size;
+        memset(cart.ed_rx + 8, 0, len);
+        memcpy(cart.ed_rx + 8, pkt->data, pkt->size);
+        memcpy(cart.ed_rx + 8 + len, "CMPH", 4);
+        cart.ed_rx_len = len + 12;
+        cart.ed_rx_pos = 0;
+    }
+    return cart.ed_rx_pos < cart.ed_rx_len;
+}
+
+/** @brief Decode the complete packets sent through the EverDrive FIFO */
+static void ed_decode(void)
+{
+    while (cart.ed_tx_len >= 8) {
+        if (memcmp(cart.ed_tx, "DMA@", 4) != 0) {
+            CHECK(0, "EverDrive: packet without DMA@ header");
+            cart.ed_tx_len = 0;
+            return;
+        }
+        int type = cart.ed_tx[4];
+        int size = (cart.ed_tx[5] << 16) | (cart.ed_tx[6] << 8) | cart.ed_tx[7];
+        int total = ALIGN(size + 12, 2);
+        if (cart.ed_tx_len < total)
+            return;
+        CHECK(memcmp(cart.ed_tx + 8 + size, "CMPH", 4) == 0, "EverDrive: packet without CMPH footer");
+        host_receive(type, size, cart.ed_tx + 8);
+        memmove(cart.ed_tx, cart.ed_tx + total, cart.ed_tx_len - total);
+        cart.ed_tx_len -= total;
+    }
+}
+
+static void ed_usbcfg(uint32_t value)
+{
+    int mode = value & 0xFE00;
+    int addr = value & 0x1FF;
+    int len = 512 - addr;
+
+    if (mode == ED_USBMODE_WR) {
+        cart.ed_tx = realloc(cart.ed_tx, cart.ed_tx_len + len);
+        memcpy(cart.ed_tx + cart.ed_tx_len, cart.ed_fifo + addr, len);
+        cart.ed_tx_len += len;
+        ed_decode();
+    } else if (mode == ED_USBMODE_RD) {
+        ed_rx_pending();
+        int avail = cart.ed_rx_len - cart.ed_rx_pos;
+        CHECK(avail >= len, "EverDrive: FIFO read of %d bytes, only %d received", len, avail);
+        if (avail > len)
+            avail = len;
+        memset(cart.ed_fifo + addr, 0, len);
+        memcpy(cart.ed_fifo + addr, cart.ed_rx + cart.ed_rx_pos, avail);
+        cart.ed_rx_pos += avail;
+    }
+}
+
+static void sc64_command(uint32_t cmd)
+{
+    uint32_t *data = cart.sc64_data;
+    cart.sc64_error = false;
+
+    switch (cmd) {
+    case SC64_CMD_CONFIG_SET:
+        if (data[0] == SC64_CFG_ROM_WRITE_ENABLE) {
+            bool prev = cart.writable;
+            cart.writable = data[1] != 0;
+            data[1] = prev;
+        }
+        break;
+    case SC64_CMD_USB_WRITE_STATUS:
+        data[0] = tx_poll() ? SC64_USB_WRITE_STATUS_BUSY : 0;
+        break;
+    case SC64_CMD_USB_WRITE:
+        if (cart.tx_busy) {
+            CHECK(0, "SC64: USB write started while busy");
+            cart.sc64_error = true;
+            break;
+        }
+        tx_start(data[0], data[1]);
+        break;
+    case SC64_CMD_USB_READ_STATUS:
+        if (cart.rx.head < cart.rx.tail) {
+            data[0] = cart.rx.packets[cart.rx.head].type;
+            data[1] = cart.rx.packets[cart.rx.head].size;
+        } else {
+            data[0] = data[1] = 0;
+        }
+        break;
+    case SC64_CMD_USB_READ: {
+        uint8_t *dst = sdram_ptr(data[0], data[1]);
+        if (cart.rx.head == cart.rx.tail || !dst) {
+            CHECK(0, "SC64: invalid USB read (%08x, %d bytes)", data[0], data[1]);
+            cart.sc64_error = true;
+            break;
+        }
+        packet_t *pkt = &cart.rx.packets[cart.rx.head++];
+        CHECK(data[1] == pkt->size, "SC64: USB read of %d bytes, %d received", data[1], pkt->size);
+        memcpy(dst, pkt->data, MIN(data[1], pkt->size));
+    }   break;
+    default:
+        CHECK(0, "SC64: unknown command %02x", cmd);
+        cart.sc64_error = true;
+        break;
+    }
+}
+
+/***********************************************************************
+ * N64 functions used by the library
+ ***********************************************************************/
+
+uint32_t usbloop_ticks(void)
+{
+    cart.ticks += 100;
+    return cart.ticks;
+}
+
+void data_cache_hit_writeback(volatile const void *addr, unsigned long length) {}
+void data_cache_hit_writeback_invalidate(volatile void *addr, unsigned long length) {}
+
+uint32_t io_read(uint32_t pi_address)
+{
+    switch (cart.type) {
+    case CART_64DRIVE:
+        switch (pi_address) {
+        case D64_REG_MAGIC:         return D64_MAGIC;
+        case D64_REG_STATUS:        return 0;
+        case D64_REG_USBCOMSTAT:    return tx_poll() ? D64_CUI_WRITE_BUSY : D64_CUI_WRITE_IDLE;
+        case D64_REG_USBP0R0:       return cart.d64_p0r0;
+        case D64_REG_USBP1R1:       return cart.d64_p1r1;
+        }
+        break;
+    case CART_EVERDRIVE:
+        switch (pi_address) {
+        case ED_REG_VERSION:        return ED3_VERSION;
+        case ED_REG_USBCFG:         return ED_USBSTAT_POWER | (ed_rx_pending() ? 0 : ED_USBSTAT_RXF);
+        }
+        break;
+    case CART_SC64:
+        switch (pi_address) {
+        case SC64_REG_SR_CMD:       return cart.sc64_error ? SC64_SR_CMD_ERROR : 0;
+        case SC64_REG_DATA_0:       return cart.sc64_data[0];
+        case SC64_REG_DATA_1:       return cart.sc64_data[1];
+        case SC64_REG_IDENTIFIER:   return cart.sc64_unlock == 2 ? SC64_V2_IDENTIFIER : 0;
+        }
+        break;
+    }
+    return 0;
+}
+
+void io_write(uint32_t pi_address, uint32_t data)
+{
+    switch (cart.type) {
+    case CART_64DRIVE:
+        switch (pi_address) {
+        case D64_REG_COMMAND:
+            if (data == D64_CI_ENABLE_ROMWR)  cart.writable = true;
+            if (data == D64_CI_DISABLE_ROMWR) cart.writable = false;
+            break;
+        case D64_REG_USBP0R0:   cart.d64_p0r0 = data; break;
+        case D64_REG_USBP1R1:   cart.d64_p1r1 = data; break;
+        case D64_REG_USBCOMSTAT:
+            if (data == D64_CUI_WRITE)
+                tx_start(D64_BASE + (cart.d64_p0r0 << 1), cart.d64_p1r1);
+            break;
+        }
+        break;
+    case CART_EVERDRIVE:
+        if (pi_address == ED_REG_USBCFG)
+            ed_usbcfg(data);
+        break;
+    case CART_SC64:
+        switch (pi_address) {
+        case SC64_REG_KEY:
+            if (data == SC64_KEY_RESET)
+                cart.sc64_unlock = 0;
+            else if (data == (cart.sc64_unlock == 0 ? SC64_KEY_UNLOCK_1 : SC64_KEY_UNLOCK_2))
+                cart.sc64_unlock++;
+            break;
+        case SC64_REG_DATA_0:   cart.sc64_data[0] = data; break;
+        case SC64_REG_DATA_1:   cart.sc64_data[1] = data; break;
+        case SC64_REG_SR_CMD:   sc64_command(data); break;
+        }
+        break;
+    }
+}
+
+void dma_read(void *ram_address, unsigned long pi_address, unsigned long len)
+{
+    pi_address = (pi_address | 0x10000000) & 0x1FFFFFFF;
+    if (cart.type == CART_EVERDRIVE && pi_address >= ED_REG_USBDAT && pi_address + len <= ED_REG_USBDAT + 512) {
+        memcpy(ram_address, cart.ed_fifo + (pi_address - ED_REG_USBDAT), len);
+        return;
+    }
+    uint8_t *src = sdram_ptr(pi_address, len);
+    CHECK(src, "PI DMA read outside of the debug area: %08lx", pi_address);
+    if (src)
+        memcpy(ram_address, src, len);
+}
+
+void dma_write(const void *ram_address, unsigned long pi_address, unsigned long len)
+{
+    pi_address = (pi_address | 0x10000000) & 0x1FFFFFFF;
+    CHECK(((uintptr_t)ram_address & 7) == 0 && (pi_address & 1) == 0 && (len & 1) == 0,
+        "misaligned PI DMA write: RAM %p, PI %08lx, %lu bytes", ram_address, pi_address, len);
+    if (cart.type == CART_EVERDRIVE && pi_address >= ED_REG_USBDAT && pi_address + len <= ED_REG_USBDAT + 512) {
+        memcpy(cart.ed_fifo + (pi_address - ED_REG_USBDAT), ram_address, len);
+        return;
+    }
+    uint8_t *dst = sdram_ptr(pi_address, len);
+    CHECK(dst, "PI DMA write outside of the debug area: %08lx", pi_address);
+    if (!dst)
+        return;
+    CHECK(cart.writable || cart.type == CART_EVERDRIVE, "SDRAM written while read-only");
+    if (cart.tx_busy) {
+        uint32_t tx_end = cart.tx_address + (cart.tx_header & 0xFFFFFF);
+        CHECK(pi_address >= tx_end || pi_address + len <= cart.tx_address,
+            "SDRAM overwritten while being sent (%08lx)", pi_address);
+    }
+    memcpy(dst, ram_address, len);
+}
+
+/***********************************************************************
+ * Tests
+ ***********************************************************************/
+
+#define PATTERN_SIZE    (USB_BULK_MAXSIZE + 4096)
+
+static uint8_t *pattern;
+static uint32_t rand_state = 1;
+
+static uint32_t rand_next(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+/** @brief Receive the packets sent back, and check them */
+static void check_echoes(void)
+{
+    static uint8_t buf[PATTERN_SIZE];
+
+    // Polling finishes the bulk transfer in progress
+    usb_bulk_flush();
+    CHECK(next_received == expected.tail, "%d packets sent, %d received",
+        expected.tail, next_received);
+    if (!cart.loopback)
+        return;
+
+    for (; next_echo < next_received; next_echo++) {
+        packet_t *exp = &expected.packets[next_echo];
+        if (exp->size == 0)
+            continue;
+
+        unsigned long header = usb_poll();
+        CHECK(USBHEADER_GETTYPE(header) == exp->type && USBHEADER_GETSIZE(header) == exp->size,
+            "echo %d: got type %lu, %lu bytes, expected type %d, %d bytes", next_echo,
+            USBHEADER_GETTYPE(header), USBHEADER_GETSIZE(header), exp->type, exp->size);
+
+        // Read in pieces of random size
+        int pos = 0;
+        while (pos < exp->size) {
+            int len = 1 + rand_next() % 3000;
+            if (len > exp->size - pos)
+                len = exp->size - pos;
+            usb_read(buf + pos, len);
+            pos += len;
+        }
+        CHECK(memcmp(buf, exp->data, exp->size) == 0, "echo %d: wrong data", next_echo);
+    }
+}
+
+static void send_write(int type, const uint8_t *data, int size)
+{
+    queue_push(&expected, type, data, size);
+    usb_write(type, data, size);
+}
+
+static void send_bulk(int type, const uint8_t *data, int size)
+{
+    queue_push(&expected, type, data, size);
+    usb_write_bulk(type, data, size);
+}
+
+/** @brief Send a stream in pieces of random size and alignment, of which only the first "written" bytes */
+static void send_stream(int type, int size, int written)
+{
+    uint8_t *data = calloc(size + 1, 1);
+    int pos = 0;
+
+    CHECK(usb_stream_begin(type, size), "usb_stream_begin failed");
+    while (pos < written) {
+        int len = 1 + rand_next() % 9000;
+        if (len > written - pos)
+            len = written - pos;
+        const uint8_t *src = pattern + rand_next() % (PATTERN_SIZE - len);
+        memcpy(data + pos, src, len);
+        usb_stream_write(src, len);
+        pos += len;
+    }
+    queue_push(&expected, type, data, size);
+    usb_stream_end();
+    free(data);
+}
+
+static void test_cart(int type, const char *name, bool loopback)
+{
+    static const int sizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 511, 512, 513, 1000, 4095, 4096, 65537 };
+    static const int offsets[] = { 0, 1, 2, 4, 7 };
+    uint8_t heartbeat[4] = { 0, USBPROTOCOL_VERSION, 0, HEARTBEAT_VERSION };
+    int errors = num_errors;
+
+    memset(&cart, 0, sizeof(cart));
+    cart.type = type;
+    cart.loopback = loopback;
+    cart.sdram = calloc(DEBUG_ADDRESS_SIZE, 1);
+    queue_free(&expected);
+    next_received = next_echo = 0;
+    usb_cart = CART_NONE;
+
+    // Initialization sends a heartbeat
+    queue_push(&expected, DATATYPE_HEARTBEAT, heartbeat, 4);
+    CHECK(usb_initialize() && usb_getcart() == type, "%s not detected", name);
+    check_echoes();
+
+    // Regular writes
+    send_write(DATATYPE_TEXT, (const uint8_t*)"usbloop", 7);
+    send_write(DATATYPE_RAWBINARY, pattern + 3, 1000);
+    check_echoes();
+
+    // Bulk writes, of all sizes and alignments, pipelined
+    for (int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+        for (int j = 0; j < sizeof(offsets)/sizeof(offsets[0]); j++)
+            send_bulk(DATATYPE_RAWBINARY, pattern + offsets[j] + i, sizes[i]);
+    check_echoes();
+
+    // Streams
+    for (int i = 0; i < 20; i++) {
+        int size = rand_next() % 300000;
+        send_stream(DATATYPE_RAWBINARY, size, size);
+    }
+    send_stream(DATATYPE_RAWBINARY, 10000, 5555);
+    check_echoes();
+
+    // Writes are refused while a stream is open
+    CHECK(usb_stream_begin(DATATYPE_TEXT, 4), "usb_stream_begin failed");
+    CHECK(!usb_stream_begin(DATATYPE_TEXT, 4), "usb_stream_begin accepted a second stream");
+    usb_write(DATATYPE_TEXT, "lost", 4);
+    usb_stream_write("kept", 4);
+    queue_push(&expected, DATATYPE_TEXT, "kept", 4);
+    usb_stream_end();
+    CHECK(!usb_stream_begin(DATATYPE_TEXT, USB_BULK_MAXSIZE+1), "usb_stream_begin accepted a packet too big");
+    check_echoes();
+
+    // Biggest bulk packet, and one that falls back to usb_write
+    send_bulk(DATATYPE_RAWBINARY, pattern + 8, USB_BULK_MAXSIZE);
+    send_bulk(DATATYPE_RAWBINARY, pattern + 16, 32);
+    send_bulk(DATATYPE_RAWBINARY, pattern + 5, USB_BULK_MAXSIZE + 1);
+    check_echoes();
+
+    unsigned long bytes, usecs;
+    float mbps = usb_bulk_getstats(&bytes, &usecs);
+    CHECK(!usb_timedout(), "%s: USB timed out", name);
+    printf("%-10s %4d packets, %9lu bulk bytes (%.2f MB/s simulated): %s\n", name,
+        expected.tail, bytes, mbps, num_errors == errors ? "OK" : "FAILED");
+
+    free(cart.sdram);
+    free(cart.ed_tx);
+    free(cart.ed_rx);
+    queue_free(&cart.rx);
+}
+
+int main(int argc, char *argv[])
+{
+    pattern = malloc(PATTERN_SIZE);
+    for (int i = 0; i < PATTERN_SIZE; i++)
+        pattern[i] = rand_next();
+
+    test_cart(CART_64DRIVE, "64Drive", false);
+    test_cart(CART_EVERDRIVE, "EverDrive", true);
+    test_cart(CART_SC64, "SC64", true);
+
+    queue_free(&expected);
+    free(pattern);
+    return num_errors ? 1 : 0;
+}